@@ -0,0 +1,190 @@
+#include <ClanLib/core.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "StatementStats.h"
+#include "BenchmarkReport.h"
+
+
+// what a run of each --bench-listview operation may allocate in a Debug build, with room for the difference
+// between runs. A page is at most 100 shows, so apart from the scans they don't grow with --bench-shows.
+// Lower a budget when an operation gets cheaper, so that it can't quietly go back
+static const BenchmarkBudget listview_budgets[] =
+{
+    { "build pages",        150000, 16 * 1024 * 1024 },
+    { "refresh",            8000,   1024 * 1024 },
+    { "paint",              2000,   256 * 1024 },
+    { "next page",          8000,   1024 * 1024 },
+    { "previous page",      8000,   1024 * 1024 },
+    { "search keystroke",   8000,   1024 * 1024 },
+    { "sort by ",           8000,   1024 * 1024 },
+    { "search results",     8000,   1024 * 1024 },
+    { "scan rows",          16,     4 * 1024 },
+    { "scan unpacked rows", 16,     4 * 1024 },
+};
+
+// what an operation may need over its baseline on top of the tolerance, so one that was close to nothing
+// doesn't fail over a few allocations
+static const unsigned int BASELINE_SLACK_ALLOCATIONS = 16;
+static const long BASELINE_SLACK_PEAK = 4096;
+
+BenchmarkReport::BenchmarkReport() : allocation_budget(0), peak_budget(0), baseline_tolerance(0)
+{
+}
+
+void BenchmarkReport::set_allocation_budget(unsigned int allocations)
+{
+    allocation_budget = allocations;
+}
+
+void BenchmarkReport::set_peak_budget(long bytes)
+{
+    peak_budget = bytes;
+}
+
+void BenchmarkReport::use_listview_budgets()
+{
+    budgets.assign(listview_budgets, listview_budgets + sizeof(listview_budgets) / sizeof(listview_budgets[0]));
+}
+
+void BenchmarkReport::set_baseline(const CL_String &text, int tolerance_percent)
+{
+    baseline.clear();
+    baseline_tolerance = tolerance_percent;
+
+    // the columns are found by name, the operation lines are those with as many fields as the header
+    std::vector<CL_String> lines = CL_StringHelp::split_text(text, "\n");
+    if(lines.empty())
+        throw CL_Exception("The benchmark baseline is empty");
+
+    std::vector<CL_String> header = CL_StringHelp::split_text(lines[0], "\t");
+    std::vector<CL_String>::size_type allocationsColumn = std::find(header.begin(), header.end(), "allocations_per_run") - header.begin();
+    std::vector<CL_String>::size_type peakColumn = std::find(header.begin(), header.end(), "max_peak_bytes") - header.begin();
+    if(header.empty() || header[0] != "operation" || allocationsColumn == header.size() || peakColumn == header.size())
+        throw CL_Exception("The benchmark baseline isn't a --bench-report file");
+
+    for(std::vector<CL_String>::size_type i = 1; i < lines.size(); i++)
+    {
+        std::vector<CL_String> fields = CL_StringHelp::split_text(lines[i], "\t");
+        if(fields.size() != header.size())
+            continue;
+
+        baseline[fields[0]] = std::make_pair(CL_StringHelp::text_to_uint(fields[allocationsColumn]), (long)CL_StringHelp::text_to_int(fields[peakColumn]));
+    }
+}
+
+const BenchmarkBudget *BenchmarkReport::find_budget(const CL_String &operation) const
+{
+    for(std::vector<BenchmarkBudget>::const_iterator it = budgets.begin(); it != budgets.end(); ++it)
+    {
+        CL_String name = it->operation;
+        if(operation == name || (name[name.length() - 1] == ' ' && operation.substr(0, name.length()) == name))
+            return &*it;
+    }
+    return 0;
+}
+
+void BenchmarkReport::add_value(const CL_String &name, int value)
+{
+    values.push_back(std::make_pair(name, value));
+}
+
+bool BenchmarkReport::record(const CL_String &operation, unsigned int duration, unsigned int allocations, long peak, unsigned int text_measurements)
+{
+    std::vector<BenchmarkOperation>::iterator it = operations.begin();
+    while(it != operations.end() && it->name != operation)
+        ++it;
+    if(it == operations.end())
+    {
+        operations.push_back(BenchmarkOperation());
+        it = operations.end() - 1;
+        it->name = operation;
+
+        const BenchmarkBudget *budget = find_budget(operation);
+        it->allocation_budget = allocation_budget > 0 ? allocation_budget : (budget ? budget->allocations : 0);
+        it->peak_budget = peak_budget > 0 ? peak_budget : (budget ? budget->peak : 0);
+    }
+
+    it->latency.record(duration);
+    it->allocations += allocations;
+    it->max_allocations = cl_max(it->max_allocations, allocations);
+    it->max_peak = cl_max(it->max_peak, peak);
+    it->text_measurements += text_measurements;
+
+    bool within = (it->allocation_budget == 0 || allocations <= it->allocation_budget) && (it->peak_budget == 0 || peak <= it->peak_budget);
+    if(within == false)
+        it->over_budget++;
+    return within;
+}
+
+std::vector<CL_String> BenchmarkReport::get_violations() const
+{
+    std::vector<CL_String> violations;
+    for(std::vector<BenchmarkOperation>::const_iterator it = operations.begin(); it != operations.end(); ++it)
+    {
+        if(it->over_budget > 0)
+        {
+            violations.push_back(cl_format("%1: %2 of %3 runs over ", it->name, it->over_budget, it->latency.get_count()) +
+                                 cl_format("the budget of %1 allocations and %2 bytes, ", it->allocation_budget, (int)it->peak_budget) +
+                                 cl_format("up to %1 allocations and %2 bytes", it->max_allocations, (int)it->max_peak));
+        }
+
+        std::map<CL_String, std::pair<unsigned int, long> >::const_iterator base = baseline.find(it->name);
+        if(base == baseline.end())
+            continue;
+
+        unsigned int allocations = (unsigned int)(it->allocations / cl_max(it->latency.get_count(), 1u));
+        unsigned int allocationLimit = base->second.first + base->second.first / 100 * baseline_tolerance + BASELINE_SLACK_ALLOCATIONS;
+        long peakLimit = base->second.second + base->second.second / 100 * baseline_tolerance + BASELINE_SLACK_PEAK;
+        if(allocations > allocationLimit || it->max_peak > peakLimit)
+        {
+            violations.push_back(cl_format("%1: %2 allocations per run and a peak of %3 bytes, ", it->name, allocations, (int)it->max_peak) +
+                                 cl_format("the baseline has %1 and %2 bytes", base->second.first, (int)base->second.second));
+        }
+    }
+    return violations;
+}
+
+bool BenchmarkReport::is_within_budget() const
+{
+    return get_violations().empty();
+}
+
+CL_String BenchmarkReport::to_text() const
+{
+    CL_String text = "operation\truns\tmean_us\tp50_us\tp90_us\tp99_us\tmax_us\tallocations_per_run\tmax_allocations\tmax_peak_bytes\ttext_measurements_per_run\n";
+    for(std::vector<BenchmarkOperation>::const_iterator it = operations.begin(); it != operations.end(); ++it)
+    {
+        const LatencyHistogram &latency = it->latency;
+        unsigned int runs = cl_max(latency.get_count(), 1u);
+        text += it->name + "\t" +
+            cl_format("%1\t%2\t%3\t", latency.get_count(), (unsigned int)(latency.get_mean() + 0.5), latency.get_percentile(0.5)) +
+            cl_format("%1\t%2\t%3\t", latency.get_percentile(0.9), latency.get_percentile(0.99), latency.get_max()) +
+            cl_format("%1\t%2\t%3\t", (unsigned int)(it->allocations / runs), it->max_allocations, (int)it->max_peak) +
+            cl_format("%1\n", (unsigned int)(it->text_measurements / runs));
+    }
+
+    if(values.empty() == false)
+    {
+        text += "\nvalue\tamount\n";
+        for(std::vector<std::pair<CL_String, int> >::const_iterator it = values.begin(); it != values.end(); ++it)
+            text += it->first + cl_format("\t%1\n", it->second);
+    }
+
+    std::vector<CL_String> violations = get_violations();
+    if(violations.empty() == false)
+    {
+        text += "\n";
+        for(std::vector<CL_String>::const_iterator it = violations.begin(); it != violations.end(); ++it)
+            text += *it + "\n";
+    }
+    return text;
+}
+
+void BenchmarkReport::write(CL_IODevice &file) const
+{
+    CL_String text = to_text();
+    if(file.send(text.data(), text.length(), true) != (int)text.length())
+        throw CL_Exception("Unable to write the benchmark report");
+}
@@ -0,0 +1,81 @@
+#ifndef BenchmarkReport_h__
+#define BenchmarkReport_h__
+
+
+
+// what every run of one benchmark operation cost
+struct BenchmarkOperation
+{
+    CL_String name;
+    LatencyHistogram latency;               // microseconds per run
+    unsigned long long allocations;         // operator new calls, all runs
+    unsigned int max_allocations;           // the most a single run made
+    long max_peak;                          // bytes, the most a single run had allocated on top of what it started with
+    unsigned long long text_measurements;   // text widths measured by the pages, all runs
+    unsigned int over_budget;               // runs that went over a budget
+    unsigned int allocation_budget;         // for a single run, 0 for none
+    long peak_budget;                       // bytes for a single run, 0 for none
+
+    BenchmarkOperation() : allocations(0), max_allocations(0), max_peak(0), text_measurements(0), over_budget(0),
+                           allocation_budget(0), peak_budget(0) {}
+};
+
+// the most a single run of an operation may allocate
+struct BenchmarkBudget
+{
+    const char *operation;      // the name, or the start of the names when it ends with a space, like "sort by "
+    unsigned int allocations;
+    long peak;                  // bytes
+};
+
+// collects the runs of a benchmark by operation and checks them against memory budgets, so a change
+// that makes the lists allocate more fails the benchmark instead of going unnoticed
+class BenchmarkReport
+{
+public:
+    BenchmarkReport();
+
+    // limits for a single run of any operation, 0 for none. They replace the budgets of the operations
+    void set_allocation_budget(unsigned int allocations);
+    void set_peak_budget(long bytes);
+
+    // the checked in budgets of the --bench-listview operations, see BenchmarkReport.cpp. Only builds that
+    // count allocations can be held to them
+    void use_listview_budgets();
+
+    // holds the operations to the allocations per run and the peak of an earlier to_text, an operation that
+    // needs more than tolerance_percent over them is a violation. Catches what stays under the budgets
+    void set_baseline(const CL_String &text, int tolerance_percent);
+
+    // false when the run was over a budget, the run is recorded either way
+    bool record(const CL_String &operation, unsigned int duration, unsigned int allocations, long peak, unsigned int text_measurements);
+
+    // in the order they were first recorded
+    const std::vector<BenchmarkOperation> &get_operations() const { return operations; }
+
+    // a number measured once rather than per run, like the size of a struct, listed after the operations
+    void add_value(const CL_String &name, int value);
+
+    // one line per operation that went over a budget or its baseline
+    std::vector<CL_String> get_violations() const;
+    bool is_within_budget() const;
+
+    // tab separated, one line per operation followed by the values and the budget violations
+    CL_String to_text() const;
+    void write(CL_IODevice &file) const;
+
+private:
+    std::vector<BenchmarkOperation> operations;
+    std::vector<std::pair<CL_String, int> > values;
+    std::vector<BenchmarkBudget> budgets;
+    std::map<CL_String, std::pair<unsigned int, long> > baseline;  // allocations per run and peak by operation
+    int baseline_tolerance;
+    unsigned int allocation_budget;
+    long peak_budget;
+
+    const BenchmarkBudget *find_budget(const CL_String &operation) const;
+};
+
+
+
+#endif // BenchmarkReport_h__
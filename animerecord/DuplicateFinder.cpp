@@ -0,0 +1,200 @@
+#include <ClanLib/core.h>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include "DuplicateFinder.h"
+
+
+// buckets bigger than this are mostly very short titles, only neighbours are compared in them
+static const int MAX_BUCKET_PAIRS = 32;
+
+// similarity isn't transitive, without a limit a chain of pairwise similar titles ends up in one huge cluster
+static const int MAX_CLUSTER_SIZE = 8;
+
+// murmur3 finalizer, turns the shingle hash into one independent looking hash per seed
+static unsigned int mix(unsigned int h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static unsigned int fnv1a(const char *data, int length, unsigned int hash = 2166136261u)
+{
+    for(int i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    return hash;
+}
+
+DuplicateFinder::DuplicateFinder(double threshold) : threshold(threshold), compared_pairs(0)
+{
+    unsigned int state = 1;
+    for(int i = 0; i < HASHES; i++)
+    {
+        state = state * 1103515245 + 12345;
+        seeds[i] = mix(state);
+    }
+}
+
+void DuplicateFinder::add(int id, const CL_String &key)
+{
+    if(key.empty())
+        return;
+
+    ids.push_back(id);
+    signatures.resize(signatures.size() + HASHES, 0xffffffff);
+    unsigned int *signature = &signatures[signatures.size() - HASHES];
+
+    // titles shorter than a trigram are a single shingle
+    int shingles = cl_max((int)key.length() - 2, 1);
+    int length = cl_min((int)key.length(), 3);
+    for(int s = 0; s < shingles; s++)
+    {
+        unsigned int shingle = fnv1a(key.data() + s, length);
+        for(int i = 0; i < HASHES; i++)
+        {
+            unsigned int h = mix(shingle ^ seeds[i]);
+            if(h < signature[i])
+                signature[i] = h;
+        }
+    }
+}
+
+int DuplicateFinder::find_root(int i)
+{
+    while(parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// the share of equal signature values estimates the Jaccard similarity of the trigram sets
+void DuplicateFinder::compare(int a, int b)
+{
+    // similar titles share several bands, the pair is only compared in the first
+    long long key = ((long long)cl_min(a, b) << 32) | (unsigned int)cl_max(a, b);
+    if(compared.insert(key).second == false)
+        return;
+
+    compared_pairs++;
+
+    const unsigned int *sa = &signatures[a * HASHES];
+    const unsigned int *sb = &signatures[b * HASHES];
+    int equal = 0;
+    for(int i = 0; i < HASHES; i++)
+    {
+        if(sa[i] == sb[i])
+            equal++;
+    }
+
+    double similarity = (double)equal / HASHES;
+    if(similarity >= threshold)
+    {
+        CandidatePair pair = { cl_min(a, b), cl_max(a, b), similarity };
+        candidates.push_back(pair);
+    }
+}
+
+std::vector<DuplicateCluster> DuplicateFinder::find()
+{
+    int count = ids.size();
+    candidates.clear();
+    compared.clear();
+    compared_pairs = 0;
+
+    for(int band = 0; band < BANDS; band++)
+    {
+        std::unordered_map<unsigned int, std::vector<int> > buckets;
+        for(int i = 0; i < count; i++)
+        {
+            const unsigned int *rows = &signatures[i * HASHES + band * ROWS];
+            unsigned int h = fnv1a((const char*)rows, ROWS * sizeof(unsigned int));
+            buckets[h].push_back(i);
+        }
+
+        for(std::unordered_map<unsigned int, std::vector<int> >::const_iterator it = buckets.begin(); it != buckets.end(); ++it)
+        {
+            const std::vector<int> &members = it->second;
+            int bucket_size = members.size();
+            for(int i = 0; i < bucket_size; i++)
+            {
+                for(int j = i + 1; j < bucket_size && j <= i + MAX_BUCKET_PAIRS; j++)
+                    compare(members[i], members[j]);
+            }
+        }
+    }
+
+    // most similar pairs are joined first so the size limit cuts off the weakest links
+    struct PairSortFun
+    {
+        bool operator()(const CandidatePair &p1, const CandidatePair &p2)
+        {
+            if(p1.similarity != p2.similarity)
+                return p1.similarity > p2.similarity;
+            if(p1.a != p2.a)
+                return p1.a < p2.a;
+            return p1.b < p2.b;
+        }
+    };
+
+    std::sort(candidates.begin(), candidates.end(), PairSortFun());
+
+    parent.resize(count);
+    size.assign(count, 1);
+    best.assign(count, 0.0);
+    for(int i = 0; i < count; i++)
+        parent[i] = i;
+
+    for(std::vector<CandidatePair>::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+    {
+        int ra = find_root(it->a), rb = find_root(it->b);
+        if(ra != rb)
+        {
+            if(size[ra] + size[rb] > MAX_CLUSTER_SIZE)
+                continue;
+            parent[ra] = rb;
+            size[rb] += size[ra];
+        }
+        best[it->a] = cl_max(best[it->a], it->similarity);
+        best[it->b] = cl_max(best[it->b], it->similarity);
+    }
+
+    std::map<int, DuplicateCluster> groups;
+    for(int i = 0; i < count; i++)
+    {
+        if(size[find_root(i)] < 2)
+            continue;
+
+        DuplicateCluster &cluster = groups[find_root(i)];
+        if(cluster.ids.empty())
+            cluster.similarity = 0.0;
+        cluster.ids.push_back(ids[i]);
+        cluster.similarity = cl_max(cluster.similarity, best[i]);
+    }
+
+    std::vector<DuplicateCluster> clusters;
+    for(std::map<int, DuplicateCluster>::iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+        std::sort(it->second.ids.begin(), it->second.ids.end());
+        clusters.push_back(it->second);
+    }
+
+    struct SortFun
+    {
+        bool operator()(const DuplicateCluster &c1, const DuplicateCluster &c2)
+        {
+            if(c1.similarity != c2.similarity)
+                return c1.similarity > c2.similarity;
+            return c1.ids.size() > c2.ids.size();
+        }
+    };
+
+    std::stable_sort(clusters.begin(), clusters.end(), SortFun());
+    return clusters;
+}
@@ -0,0 +1,57 @@
+#ifndef DuplicateFinder_h__
+#define DuplicateFinder_h__
+
+
+
+struct DuplicateCluster
+{
+    std::vector<int> ids;   // show IDs in ascending order
+    double similarity;      // highest estimated Jaccard similarity between two of the shows
+};
+
+// finds near duplicate titles in the whole library. Each title key gets a MinHash signature over its
+// character trigrams and the signatures are bucketed band by band (locality sensitive hashing), so only
+// titles that share a bucket are ever compared instead of every pair
+class DuplicateFinder
+{
+public:
+    // 16 bands of 4 rows put the LSH threshold at about (1/16)^(1/4) = 0.5
+    enum { BANDS = 16, ROWS = 4, HASHES = BANDS * ROWS };
+
+    DuplicateFinder(double threshold = 0.5);
+
+    // key is the normalized title, see make_title_key
+    void add(int id, const CL_String &key);
+
+    // returns the clusters ordered by similarity, most likely duplicates first
+    std::vector<DuplicateCluster> find();
+
+    // distinct pairs, a pair that shares several bands counts once
+    int get_compared_pairs() const { return compared_pairs; }
+
+private:
+    struct CandidatePair
+    {
+        int a, b;
+        double similarity;
+    };
+
+    double threshold;
+    unsigned int seeds[HASHES];
+
+    std::vector<int> ids;
+    std::vector<unsigned int> signatures;   // HASHES values per show
+    std::vector<CandidatePair> candidates;
+    std::unordered_set<long long> compared; // pairs already compared, see compare
+    std::vector<int> parent;
+    std::vector<int> size;
+    std::vector<double> best;
+    int compared_pairs;
+
+    void compare(int a, int b);
+    int find_root(int i);
+};
+
+
+
+#endif // DuplicateFinder_h__
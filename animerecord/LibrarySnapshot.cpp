@@ -0,0 +1,490 @@
+#include <ClanLib/core.h>
+#include <algorithm>
+#include <unordered_map>
+#include "ShowType.h"
+#include "ShowFilter.h"
+#include "LibrarySnapshot.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#endif
+
+
+static const char SNAPSHOT_MAGIC[8] = { 'A', 'R', 'S', 'N', 'A', 'P', 0, 0 };
+static const unsigned int SNAPSHOT_FORMAT_VERSION = 3;
+
+static unsigned int align8(unsigned int offset)
+{
+    return (offset + 7) & ~7u;
+}
+
+LibrarySnapshot::LibrarySnapshot()
+    : data(0), size(0), file_handle(0), mapping_handle(0), rows(0), genre_words(0),
+      ids(0), ratings(0), sort_key_offsets(0), title_offsets(0), title_key_offsets(0), comment_offsets(0),
+      genres(0), years(0), seasons(0), statuses(0), types(0), arena(0)
+{
+}
+
+LibrarySnapshot::~LibrarySnapshot()
+{
+    close();
+}
+
+bool LibrarySnapshot::open(const CL_String &filename, unsigned int library_version)
+{
+    close();
+
+    if(map(filename) == false)
+        return false;
+
+    if(validate(library_version) == false)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+bool LibrarySnapshot::map(const CL_String &filename)
+{
+    HANDLE file = CreateFileW(CL_StringHelp::utf8_to_ucs2(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    file_handle = file;
+
+    LARGE_INTEGER fileSize;
+    if(GetFileSizeEx(file, &fileSize) == FALSE || fileSize.QuadPart < (LONGLONG)sizeof(Header) || fileSize.HighPart != 0)
+    {
+        close();
+        return false;
+    }
+
+    mapping_handle = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+    if(mapping_handle == 0)
+    {
+        close();
+        return false;
+    }
+
+    data = (const char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    size = fileSize.LowPart;
+    if(data == 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void LibrarySnapshot::close()
+{
+    if(data)
+        UnmapViewOfFile(data);
+    if(mapping_handle)
+        CloseHandle(mapping_handle);
+    if(file_handle)
+        CloseHandle(file_handle);
+
+    data = 0;
+    size = 0;
+    file_handle = 0;
+    mapping_handle = 0;
+    rows = 0;
+}
+
+#else
+
+// the mapping stays valid after the descriptor is closed, so no handles are kept
+bool LibrarySnapshot::map(const CL_String &filename)
+{
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if(file < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(Header) || info.st_size > 0x7fffffff)
+    {
+        ::close(file);
+        return false;
+    }
+
+    void *view = mmap(0, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if(view == MAP_FAILED)
+        return false;
+
+    data = (const char *)view;
+    size = (unsigned int)info.st_size;
+    return true;
+}
+
+void LibrarySnapshot::close()
+{
+    if(data)
+        munmap((void *)data, size);
+
+    data = 0;
+    size = 0;
+    rows = 0;
+}
+
+#endif
+
+bool LibrarySnapshot::validate(unsigned int library_version)
+{
+    const Header *header = (const Header *)data;
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0 || header->format_version != SNAPSHOT_FORMAT_VERSION ||
+       header->library_version != library_version || header->file_size != size || header->rows > 0x400000 || header->genre_words > 64)
+        return false;
+
+    unsigned int count = header->rows;
+    unsigned int lengths[COLUMN_COUNT] =
+    {
+        count * 4, count * 4, (count + 1) * 4, (count + 1) * 4, (count + 1) * 4, (count + 1) * 4,
+        count * header->genre_words * 4, count * 2, count * 2, count, count, 0
+    };
+
+    // every column has to be aligned and inside the file, the arena runs to the end of it
+    for(int c = 0; c < COLUMN_COUNT; c++)
+    {
+        if(header->columns[c] % 8 != 0 || header->columns[c] < sizeof(Header) || header->columns[c] > size || size - header->columns[c] < lengths[c])
+            return false;
+    }
+
+    rows = count;
+    genre_words = header->genre_words;
+    ids = (const int *)(data + header->columns[COLUMN_ID]);
+    ratings = (const float *)(data + header->columns[COLUMN_RATING]);
+    sort_key_offsets = (const unsigned int *)(data + header->columns[COLUMN_SORT_KEY]);
+    title_offsets = (const unsigned int *)(data + header->columns[COLUMN_TITLE]);
+    title_key_offsets = (const unsigned int *)(data + header->columns[COLUMN_TITLE_KEY]);
+    comment_offsets = (const unsigned int *)(data + header->columns[COLUMN_COMMENT]);
+    genres = (const unsigned int *)(data + header->columns[COLUMN_GENRES]);
+    years = (const short *)(data + header->columns[COLUMN_YEAR]);
+    seasons = (const short *)(data + header->columns[COLUMN_SEASON]);
+    statuses = (const unsigned char *)(data + header->columns[COLUMN_STATUS]);
+    types = (const unsigned char *)(data + header->columns[COLUMN_TYPE]);
+    arena = data + header->columns[COLUMN_ARENA];
+
+    unsigned int arena_size = size - header->columns[COLUMN_ARENA];
+    return validate_offsets(sort_key_offsets, arena_size) && validate_offsets(title_offsets, arena_size) && validate_offsets(title_key_offsets, arena_size) &&
+           validate_offsets(comment_offsets, arena_size);
+}
+
+// a damaged offset would make the getters read outside the file
+bool LibrarySnapshot::validate_offsets(const unsigned int *offsets, unsigned int arena_size) const
+{
+    for(int row = 0; row < rows; row++)
+    {
+        if(offsets[row] > offsets[row+1])
+            return false;
+    }
+    return offsets[rows] <= arena_size;
+}
+
+int LibrarySnapshot::get_id(int row) const
+{
+    return ids[row];
+}
+
+CL_String LibrarySnapshot::get_sort_key(int row) const
+{
+    return CL_String(arena + sort_key_offsets[row], sort_key_offsets[row+1] - sort_key_offsets[row]);
+}
+
+CL_String LibrarySnapshot::get_title(int row) const
+{
+    return CL_String(arena + title_offsets[row], title_offsets[row+1] - title_offsets[row]);
+}
+
+CL_String LibrarySnapshot::get_comment(int row) const
+{
+    return CL_String(arena + comment_offsets[row], comment_offsets[row+1] - comment_offsets[row]);
+}
+
+float LibrarySnapshot::get_rating(int row) const
+{
+    return ratings[row];
+}
+
+int LibrarySnapshot::get_year(int row) const
+{
+    return years[row];
+}
+
+int LibrarySnapshot::get_season(int row) const
+{
+    return seasons[row];
+}
+
+SHOW_TYPE LibrarySnapshot::get_type(int row) const
+{
+    return (SHOW_TYPE)types[row];
+}
+
+int LibrarySnapshot::get_status(int row) const
+{
+    return statuses[row];
+}
+
+bool LibrarySnapshot::has_genre(int row, int genre) const
+{
+    if(genre < 0 || genre / 32 >= genre_words)
+        return false;
+    return (genres[row * genre_words + genre / 32] & (1u << (genre % 32))) != 0;
+}
+
+const char *LibrarySnapshot::get_text(const unsigned int *offsets, int row, unsigned int &length) const
+{
+    length = offsets[row+1] - offsets[row];
+    return arena + offsets[row];
+}
+
+const char *LibrarySnapshot::get_sort_key_data(int row, unsigned int &length) const
+{
+    return get_text(sort_key_offsets, row, length);
+}
+
+const char *LibrarySnapshot::get_title_data(int row, unsigned int &length) const
+{
+    return get_text(title_offsets, row, length);
+}
+
+const char *LibrarySnapshot::get_comment_data(int row, unsigned int &length) const
+{
+    return get_text(comment_offsets, row, length);
+}
+
+// same order as "order by sort_key, id", sort keys are plain ASCII so byte order is sqlite's order
+int LibrarySnapshot::compare_cursor(int row, const CL_String &key, int id) const
+{
+    unsigned int length = sort_key_offsets[row+1] - sort_key_offsets[row];
+    int result = memcmp(arena + sort_key_offsets[row], key.data(), cl_min((unsigned int)key.length(), length));
+    if(result == 0)
+        result = (int)length - (int)key.length();
+    if(result == 0)
+        result = ids[row] < id ? -1 : (ids[row] > id ? 1 : 0);
+    return result;
+}
+
+// cheapest columns first, the strings are only looked at for rows that pass the rest.
+// The comparisons follow the SQL Database::find_shows_after builds from the same filter
+bool LibrarySnapshot::matches(int row, const ShowFilter &filter) const
+{
+    // bit 0 is never looked at, like get_status_predicate
+    if(filter.status_mask > 0 && (statuses[row] == 0 || (filter.status_mask & (1 << statuses[row])) == 0))
+        return false;
+    if((filter.year_min > 0 && years[row] < filter.year_min) || (filter.year_max > 0 && years[row] > filter.year_max))
+        return false;
+    // the ratings were rounded to float when the snapshot was written, so the bounds are too
+    if((filter.rating_min >= 0 && ratings[row] < (float)filter.rating_min) || (filter.rating_max >= 0 && ratings[row] > (float)filter.rating_max))
+        return false;
+    if(filter.season > 0 && seasons[row] != filter.season)
+        return false;
+
+    for(std::vector<int>::const_iterator it = filter.genres.begin(); it != filter.genres.end(); ++it)
+    {
+        if(has_genre(row, *it) == false)
+            return false;
+    }
+
+    if(filter.type >= 0 && types[row] != filter.type)
+        return false;
+
+    // title keys are already case folded, a plain substring search does
+    if(filter.title_key.empty() == false)
+    {
+        const char *key = arena + title_key_offsets[row];
+        const char *keyEnd = arena + title_key_offsets[row+1];
+        if(std::search(key, keyEnd, filter.title_key.data(), filter.title_key.data() + filter.title_key.length()) == keyEnd)
+            return false;
+    }
+    return true;
+}
+
+std::vector<int> LibrarySnapshot::find_rows(const ShowFilter &filter, bool descending, const CL_String &afterKey, int afterId, int limit) const
+{
+    std::vector<int> found;
+
+    // first row that doesn't sort before the cursor
+    int first = 0, last = rows;
+    while(first < last)
+    {
+        int middle = first + (last - first) / 2;
+        if(compare_cursor(middle, afterKey, afterId) < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    if(descending)
+    {
+        for(int row = afterId == 0 ? rows - 1 : first - 1; row >= 0 && (int)found.size() < limit; row--)
+        {
+            if(matches(row, filter))
+                found.push_back(row);
+        }
+    }
+    else
+    {
+        if(afterId == 0)
+            first = 0;
+        else if(first < rows && compare_cursor(first, afterKey, afterId) == 0)
+            first++;
+
+        for(int row = first; row < rows && (int)found.size() < limit; row++)
+        {
+            if(matches(row, filter))
+                found.push_back(row);
+        }
+    }
+
+    return found;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+LibrarySnapshotWriter::LibrarySnapshotWriter(unsigned int library_version) : library_version(library_version), genre_words(1)
+{
+    sort_key_offsets.push_back(0);
+    title_offsets.push_back(0);
+    title_key_offsets.push_back(0);
+    comment_offsets.push_back(0);
+}
+
+void LibrarySnapshotWriter::add(const SnapshotRow &row)
+{
+    row_by_id[row.id] = (int)ids.size();
+
+    ids.push_back(row.id);
+    ratings.push_back(row.rating);
+    years.push_back((short)row.year);
+    seasons.push_back((short)row.season);
+    statuses.push_back((unsigned char)row.status);
+    types.push_back((unsigned char)row.type);
+    genres.resize(genres.size() + genre_words, 0);
+
+    sort_key_arena += row.sort_key;
+    sort_key_offsets.push_back(sort_key_arena.length());
+    title_arena += row.title;
+    title_offsets.push_back(title_arena.length());
+    title_key_arena += row.title_key;
+    title_key_offsets.push_back(title_key_arena.length());
+    comment_arena += row.comment;
+    comment_offsets.push_back(comment_arena.length());
+}
+
+void LibrarySnapshotWriter::add_genre(int id, int genre)
+{
+    std::unordered_map<int, int>::const_iterator found = row_by_id.find(id);
+    if(found == row_by_id.end() || genre < 0)
+        return;
+
+    if(genre / 32 >= genre_words)
+        grow_genres(genre / 32 + 1);
+
+    genres[found->second * genre_words + genre / 32] |= 1u << (genre % 32);
+}
+
+void LibrarySnapshotWriter::grow_genres(int words)
+{
+    std::vector<unsigned int> wider(ids.size() * words, 0);
+    for(std::vector<int>::size_type row = 0; row < ids.size(); row++)
+        std::copy(genres.begin() + row*genre_words, genres.begin() + (row+1)*genre_words, wider.begin() + row*words);
+
+    genres.swap(wider);
+    genre_words = words;
+}
+
+void LibrarySnapshotWriter::write(CL_IODevice &file, const void *data, unsigned int bytes)
+{
+    if(bytes > 0 && file.send(data, bytes, true) != (int)bytes)
+        throw CL_Exception("Unable to write the library snapshot");
+}
+
+// columns start at multiples of 8, whatever their element size
+void LibrarySnapshotWriter::write_padding(CL_IODevice &file, unsigned int column_length)
+{
+    static const char padding[8] = { 0 };
+    write(file, padding, align8(column_length) - column_length);
+}
+
+void LibrarySnapshotWriter::save(const CL_String &filename)
+{
+    typedef LibrarySnapshot::Header Header;
+
+    // the string columns share one arena in column order, each one's offsets are shifted past the ones before it
+    const CL_String *arenas[STRING_COLUMNS] = { &sort_key_arena, &title_arena, &title_key_arena, &comment_arena };
+    const std::vector<unsigned int> *offsets[STRING_COLUMNS] = { &sort_key_offsets, &title_offsets, &title_key_offsets, &comment_offsets };
+    std::vector<unsigned int> shifted[STRING_COLUMNS];
+    unsigned int arena_length = 0;
+    for(int i = 0; i < STRING_COLUMNS; i++)
+    {
+        shifted[i] = *offsets[i];
+        for(std::vector<unsigned int>::iterator it = shifted[i].begin(); it != shifted[i].end(); ++it)
+            *it += arena_length;
+        arena_length += arenas[i]->length();
+    }
+
+    unsigned int count = ids.size();
+    unsigned int lengths[LibrarySnapshot::COLUMN_COUNT] =
+    {
+        count * 4, count * 4, (count + 1) * 4, (count + 1) * 4, (count + 1) * 4, (count + 1) * 4,
+        count * genre_words * 4, count * 2, count * 2, count, count, arena_length
+    };
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.format_version = SNAPSHOT_FORMAT_VERSION;
+    header.library_version = library_version;
+    header.rows = count;
+    header.genre_words = genre_words;
+
+    unsigned int offset = align8(sizeof(Header));
+    for(int c = 0; c < LibrarySnapshot::COLUMN_COUNT; c++)
+    {
+        header.columns[c] = offset;
+        offset = align8(offset + lengths[c]);
+    }
+    header.file_size = offset;
+
+    CL_String temporary = filename + ".tmp";
+    {
+        CL_File file(temporary, CL_File::create_always, CL_File::access_write, CL_File::share_read, CL_File::flag_sequential_scan);
+        write(file, &header, sizeof(Header));
+        write_padding(file, sizeof(Header));
+
+        const void *columns[LibrarySnapshot::COLUMN_ARENA] =
+        {
+            ids.empty() ? 0 : &ids[0], ratings.empty() ? 0 : &ratings[0], &shifted[0][0], &shifted[1][0], &shifted[2][0], &shifted[3][0],
+            genres.empty() ? 0 : &genres[0], years.empty() ? 0 : &years[0], seasons.empty() ? 0 : &seasons[0], statuses.empty() ? 0 : &statuses[0],
+            types.empty() ? 0 : &types[0]
+        };
+        for(int c = 0; c < LibrarySnapshot::COLUMN_ARENA; c++)
+        {
+            write(file, columns[c], lengths[c]);
+            write_padding(file, lengths[c]);
+        }
+
+        for(int i = 0; i < STRING_COLUMNS; i++)
+            write(file, arenas[i]->data(), arenas[i]->length());
+        write_padding(file, lengths[LibrarySnapshot::COLUMN_ARENA]);
+        file.close();
+    }
+
+#ifdef _WIN32
+    if(MoveFileExW(CL_StringHelp::utf8_to_ucs2(temporary).c_str(), CL_StringHelp::utf8_to_ucs2(filename).c_str(), MOVEFILE_REPLACE_EXISTING) == FALSE)
+#else
+    if(rename(temporary.c_str(), filename.c_str()) != 0)
+#endif
+        throw CL_Exception("Unable to replace the library snapshot");
+}
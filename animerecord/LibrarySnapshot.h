@@ -0,0 +1,149 @@
+#ifndef LibrarySnapshot_h__
+#define LibrarySnapshot_h__
+
+
+
+// one show as the snapshot stores it
+struct SnapshotRow
+{
+    int id;
+    CL_String sort_key;
+    CL_String title;
+    CL_String title_key;
+    CL_String comment;
+    SHOW_TYPE type;
+    float rating;
+    int year;
+    int season;
+    int status;
+};
+
+// read only copy of the columns the library list needs, in a file that is memory mapped instead of read.
+// The file holds one array per column in (sort key, ID) order, the strings live in a single arena
+// addressed by offset arrays and the genres are one bitset per show indexed by genre ID.
+// library_version ties it to the database, a snapshot written for another version is never opened
+class LibrarySnapshot
+{
+public:
+    LibrarySnapshot();
+    ~LibrarySnapshot();
+
+    // false when the file is missing, damaged or doesn't match the library version
+    bool open(const CL_String &filename, unsigned int library_version);
+    void close();
+    bool is_open() const { return data != 0; }
+
+    int get_row_count() const { return rows; }
+    int get_id(int row) const;
+    CL_String get_sort_key(int row) const;
+    CL_String get_title(int row) const;
+    CL_String get_comment(int row) const;
+    float get_rating(int row) const;
+    int get_year(int row) const;
+    int get_season(int row) const;
+    SHOW_TYPE get_type(int row) const;
+    int get_status(int row) const;
+    bool has_genre(int row, int genre) const;
+
+    // the same strings without a copy, they point into the mapped file and aren't 0 terminated
+    const char *get_sort_key_data(int row, unsigned int &length) const;
+    const char *get_title_data(int row, unsigned int &length) const;
+    const char *get_comment_data(int row, unsigned int &length) const;
+
+    // rows after the (sort key, ID) cursor that match the filter, in sort order or the reverse of it.
+    // An ID of 0 starts at the first row. The genre names of the filter are ignored, its genre IDs have to be filled in
+    std::vector<int> find_rows(const ShowFilter &filter, bool descending, const CL_String &afterKey, int afterId, int limit) const;
+
+private:
+    enum Column
+    {
+        COLUMN_ID, COLUMN_RATING, COLUMN_SORT_KEY, COLUMN_TITLE, COLUMN_TITLE_KEY, COLUMN_COMMENT,
+        COLUMN_GENRES, COLUMN_YEAR, COLUMN_SEASON, COLUMN_STATUS, COLUMN_TYPE, COLUMN_ARENA, COLUMN_COUNT
+    };
+
+    struct Header
+    {
+        char magic[8];
+        unsigned int format_version;
+        unsigned int library_version;
+        unsigned int rows;
+        unsigned int genre_words;       // 32 bit words per show in COLUMN_GENRES
+        unsigned int file_size;
+        unsigned int columns[COLUMN_COUNT];
+    };
+
+    const char *data;
+    unsigned int size;
+    void *file_handle;
+    void *mapping_handle;
+
+    int rows;
+    int genre_words;
+    const int *ids;
+    const float *ratings;
+    const unsigned int *sort_key_offsets;  // rows+1 entries into the arena, string n ends where n+1 starts
+    const unsigned int *title_offsets;
+    const unsigned int *title_key_offsets;
+    const unsigned int *comment_offsets;
+    const unsigned int *genres;
+    const short *years;
+    const short *seasons;
+    const unsigned char *statuses;
+    const unsigned char *types;             // SHOW_TYPE
+    const char *arena;
+
+    bool map(const CL_String &filename);
+    bool validate(unsigned int library_version);
+    bool validate_offsets(const unsigned int *offsets, unsigned int arena_size) const;
+    int compare_cursor(int row, const CL_String &key, int id) const;
+    const char *get_text(const unsigned int *offsets, int row, unsigned int &length) const;
+    bool matches(int row, const ShowFilter &filter) const;
+
+    friend class LibrarySnapshotWriter;
+};
+
+// collects the columns in memory and writes them out in one go
+class LibrarySnapshotWriter
+{
+public:
+    LibrarySnapshotWriter(unsigned int library_version);
+
+    // rows have to come in sort key, ID order
+    void add(const SnapshotRow &row);
+    void add_genre(int id, int genre);
+
+    // writes to a temporary file first and moves it over filename, a reader never sees half a snapshot
+    void save(const CL_String &filename);
+
+private:
+    enum { STRING_COLUMNS = 4 };
+
+    unsigned int library_version;
+    int genre_words;
+
+    std::vector<int> ids;
+    std::vector<float> ratings;
+    std::vector<unsigned int> sort_key_offsets;
+    std::vector<unsigned int> title_offsets;
+    std::vector<unsigned int> title_key_offsets;
+    std::vector<unsigned int> comment_offsets;
+    std::vector<unsigned int> genres;
+    std::vector<short> years;
+    std::vector<short> seasons;
+    std::vector<unsigned char> statuses;
+    std::vector<unsigned char> types;
+    CL_String sort_key_arena;
+    CL_String title_arena;
+    CL_String title_key_arena;
+    CL_String comment_arena;
+    std::unordered_map<int, int> row_by_id;
+
+    void grow_genres(int words);
+
+    static void write(CL_IODevice &file, const void *data, unsigned int bytes);
+    static void write_padding(CL_IODevice &file, unsigned int column_length);
+};
+
+
+
+#endif // LibrarySnapshot_h__
@@ -0,0 +1,310 @@
+#include <ClanLib/core.h>
+#include "MALExportReader.h"
+
+
+MALExportEntry::MALExportEntry()
+{
+    clear();
+}
+
+void MALExportEntry::clear()
+{
+    series_animedb_id = 0;
+    series_title.clear();
+    series_type.clear();
+    series_episodes = 0;
+    my_watched_episodes = 0;
+    my_start_date.clear();
+    my_score = 0;
+    my_status.clear();
+    my_comments.clear();
+
+    has_library_fields = false;
+    library_type.clear();
+    library_year = 0;
+    library_season = 0;
+    library_rating = 0;
+    library_date_added = CL_DateTime();
+    library_date_updated = CL_DateTime();
+    library_genres.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+MALExportReader::MALExportReader(CL_IODevice &device) : device(device), pos(0), end_of_file(false)
+{
+}
+
+bool MALExportReader::read(MALExportEntry &entry)
+{
+    bool in_entry = false;
+    CL_String field;
+    CL_String text;
+
+    while(true)
+    {
+        CL_String value;
+        TokenType type = next_token(value);
+
+        if(type == TOKEN_EOF)
+        {
+            return false;
+        }
+        else if(type == TOKEN_START)
+        {
+            if(value == "anime")
+            {
+                in_entry = true;
+                entry.clear();
+            }
+            else if(in_entry)
+            {
+                field = value;
+                text.clear();
+            }
+        }
+        else if(type == TOKEN_TEXT)
+        {
+            if(field.empty() == false)
+                text += value;
+        }
+        else if(type == TOKEN_END)
+        {
+            if(value == "anime" && in_entry)
+                return true;
+
+            if(value == field)
+            {
+                set_field(entry, field, text);
+                field.clear();
+            }
+        }
+    }
+}
+
+void MALExportReader::set_field(MALExportEntry &entry, const CL_String &name, const CL_String &text) const
+{
+    if(name == "series_animedb_id")
+        entry.series_animedb_id = CL_StringHelp::text_to_int(text);
+    else if(name == "series_title")
+        entry.series_title = text;
+    else if(name == "series_type")
+        entry.series_type = text;
+    else if(name == "series_episodes")
+        entry.series_episodes = CL_StringHelp::text_to_int(text);
+    else if(name == "my_watched_episodes")
+        entry.my_watched_episodes = CL_StringHelp::text_to_int(text);
+    else if(name == "my_start_date")
+        entry.my_start_date = text;
+    else if(name == "my_score")
+        entry.my_score = CL_StringHelp::text_to_int(text);
+    else if(name == "my_status")
+        entry.my_status = text;
+    else if(name == "my_comments")
+        entry.my_comments = text;
+    else if(name == "animerecord_type")
+    {
+        entry.has_library_fields = true;
+        entry.library_type = text;
+    }
+    else if(name == "animerecord_year")
+        entry.library_year = CL_StringHelp::text_to_int(text);
+    else if(name == "animerecord_season")
+        entry.library_season = CL_StringHelp::text_to_int(text);
+    else if(name == "animerecord_rating")
+        entry.library_rating = CL_StringHelp::text_to_double(text);
+    else if(name == "animerecord_date_added")
+        entry.library_date_added = parse_timestamp(text);
+    else if(name == "animerecord_date_updated")
+        entry.library_date_updated = parse_timestamp(text);
+    else if(name == "animerecord_genre")
+        entry.library_genres.push_back(text);
+}
+
+// "YYYY-MM-DD HH:MM:SS" in UTC, the way sqlite's CURRENT_TIMESTAMP writes it
+CL_DateTime MALExportReader::parse_timestamp(const CL_String &text)
+{
+    if(text.length() != 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' || text[13] != ':' || text[16] != ':')
+        return CL_DateTime();
+
+    int year = CL_StringHelp::text_to_int(text.substr(0, 4));
+    int month = CL_StringHelp::text_to_int(text.substr(5, 2));
+    int day = CL_StringHelp::text_to_int(text.substr(8, 2));
+    if(year < 1 || month < 1 || month > 12 || day < 1 || day > 31)
+        return CL_DateTime();
+
+    return CL_DateTime(year, month, day, CL_StringHelp::text_to_int(text.substr(11, 2)), CL_StringHelp::text_to_int(text.substr(14, 2)),
+                       CL_StringHelp::text_to_int(text.substr(17, 2)), 0, CL_DateTime::utc_timezone);
+}
+
+// appends the next block of the file, dropping what has already been parsed
+bool MALExportReader::fill()
+{
+    if(end_of_file)
+        return false;
+
+    if(pos > 0)
+    {
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+
+    char block[64*1024];
+    int received = device.read(block, 64*1024, false);
+    if(received <= 0)
+    {
+        end_of_file = true;
+        return false;
+    }
+
+    buffer.append(block, received);
+    return true;
+}
+
+bool MALExportReader::find(const char *terminator, CL_String::size_type &found)
+{
+    CL_String::size_type scanned = 0;
+    while(true)
+    {
+        found = buffer.find(terminator, pos + scanned);
+        if(found != CL_String::npos)
+            return true;
+
+        // keep searching from where the last attempt stopped, allowing for a terminator split across blocks
+        CL_String::size_type length = strlen(terminator);
+        scanned = buffer.length() - pos > length ? buffer.length() - pos - length : 0;
+        if(fill() == false)
+            return false;
+    }
+}
+
+MALExportReader::TokenType MALExportReader::next_token(CL_String &value)
+{
+    while(true)
+    {
+        if(pos >= buffer.length() && fill() == false)
+            return TOKEN_EOF;
+
+        if(buffer[pos] != '<')
+        {
+            CL_String::size_type end;
+            if(find("<", end) == false)
+                end = buffer.length();
+
+            value = decode_entities(buffer.substr(pos, end - pos));
+            pos = end;
+            return TOKEN_TEXT;
+        }
+
+        // make sure the markup type can be told apart
+        while(buffer.length() - pos < 9 && fill())
+        {
+        }
+
+        CL_String::size_type end;
+        if(buffer.compare(pos, 4, "<!--") == 0)
+        {
+            if(find("-->", end) == false)
+                return TOKEN_EOF;
+            pos = end + 3;
+            continue;
+        }
+
+        if(buffer.compare(pos, 9, "<![CDATA[") == 0)
+        {
+            if(find("]]>", end) == false)
+                return TOKEN_EOF;
+            value = buffer.substr(pos + 9, end - pos - 9);
+            pos = end + 3;
+            return TOKEN_TEXT;
+        }
+
+        if(find(">", end) == false)
+            return TOKEN_EOF;
+
+        CL_String tag = buffer.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+
+        // processing instructions and doctype
+        if(tag.empty() || tag[0] == '?' || tag[0] == '!')
+            continue;
+
+        TokenType type = TOKEN_START;
+        if(tag[0] == '/')
+        {
+            type = TOKEN_END;
+            tag.erase(0, 1);
+        }
+        else if(tag[tag.length()-1] == '/')
+        {
+            type = TOKEN_EMPTY;
+            tag.erase(tag.length()-1);
+        }
+
+        // attributes are never used by the export
+        value = tag.substr(0, tag.find_first_of(" \t\r\n"));
+        return type;
+    }
+}
+
+CL_String MALExportReader::decode_entities(const CL_String &text)
+{
+    if(text.find('&') == CL_String::npos)
+        return text;
+
+    CL_String decoded;
+    CL_String::size_type i = 0;
+    while(i < text.length())
+    {
+        CL_String::size_type semicolon = text[i] == '&' ? text.find(';', i) : CL_String::npos;
+        if(semicolon == CL_String::npos)
+        {
+            decoded += text[i++];
+            continue;
+        }
+
+        CL_String name = text.substr(i+1, semicolon-i-1);
+        if(name == "amp") decoded += '&';
+        else if(name == "lt") decoded += '<';
+        else if(name == "gt") decoded += '>';
+        else if(name == "quot") decoded += '"';
+        else if(name == "apos") decoded += '\'';
+        else if(name.length() > 2 && name[0] == '#' && (name[1] == 'x' || name[1] == 'X'))
+            decoded += encode_utf8(CL_StringHelp::text_to_int(name.substr(2), 16));
+        else if(name.length() > 1 && name[0] == '#')
+            decoded += encode_utf8(CL_StringHelp::text_to_int(name.substr(1)));
+        else
+            decoded += text.substr(i, semicolon-i+1);
+
+        i = semicolon + 1;
+    }
+    return decoded;
+}
+
+CL_String MALExportReader::encode_utf8(unsigned int code)
+{
+    CL_String utf8;
+    if(code < 0x80)
+    {
+        utf8 += (char)code;
+    }
+    else if(code < 0x800)
+    {
+        utf8 += (char)(0xc0 | (code >> 6));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+    else if(code < 0x10000)
+    {
+        utf8 += (char)(0xe0 | (code >> 12));
+        utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+    else
+    {
+        utf8 += (char)(0xf0 | (code >> 18));
+        utf8 += (char)(0x80 | ((code >> 12) & 0x3f));
+        utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+    return utf8;
+}
@@ -0,0 +1,63 @@
+#ifndef MALExportReader_h__
+#define MALExportReader_h__
+
+
+
+// one <anime> element of a MyAnimeList list export
+struct MALExportEntry
+{
+    int series_animedb_id;
+    CL_String series_title;
+    CL_String series_type;      // TV, OVA, Movie, Special, ONA or Music
+    int series_episodes;
+    int my_watched_episodes;
+    CL_String my_start_date;    // 0000-00-00 when unknown
+    int my_score;
+    CL_String my_status;        // Watching, Completed, On-Hold, Dropped, Plan to Watch or the numeric code
+    CL_String my_comments;
+
+    // written by ShowExportWriter, absent from MyAnimeList exports
+    bool has_library_fields;
+    CL_String library_type;
+    int library_year;
+    int library_season;
+    double library_rating;
+    CL_DateTime library_date_added;     // null when missing or not a sqlite timestamp
+    CL_DateTime library_date_updated;
+    std::vector<CL_String> library_genres;
+
+    MALExportEntry();
+    void clear();
+};
+
+// pull parser for MyAnimeList list exports, reads the file in fixed size blocks
+// so memory use doesn't grow with the number of entries
+class MALExportReader
+{
+    enum TokenType { TOKEN_TEXT, TOKEN_START, TOKEN_END, TOKEN_EMPTY, TOKEN_EOF };
+
+    CL_IODevice device;
+    CL_String buffer;
+    CL_String::size_type pos;
+    bool end_of_file;
+
+public:
+    MALExportReader(CL_IODevice &device);
+
+    // returns false once there are no more entries
+    bool read(MALExportEntry &entry);
+
+private:
+    bool fill();
+    bool find(const char *terminator, CL_String::size_type &found);
+    TokenType next_token(CL_String &value);
+    void set_field(MALExportEntry &entry, const CL_String &name, const CL_String &text) const;
+
+    static CL_String decode_entities(const CL_String &text);
+    static CL_DateTime parse_timestamp(const CL_String &text);
+    static CL_String encode_utf8(unsigned int code);
+};
+
+
+
+#endif // MALExportReader_h__
@@ -0,0 +1,234 @@
+#include <ClanLib/core.h>
+#include <cstdlib>
+#include <new>
+#include "MemoryStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+
+// sqlite is linked in through ClanLib's sqlite module, sqlite3_status is all that is needed so it is
+// declared here instead of including sqlite3.h
+extern "C" int sqlite3_status(int op, int *current, int *highwater, int reset);
+static const int SQLITE_STATUS_MEMORY_USED = 0;
+
+// operator new can't use anything that allocates, so the counters are plain longs changed with the
+// platform's atomic operations instead of CL_InterlockedVariable
+struct TagCounters
+{
+    volatile long current;
+    volatile long peak;
+    volatile long allocations;
+};
+
+#ifdef ENABLE_MEMORY_STATS
+
+static TagCounters counters[MEMORY_TAG_COUNT];
+static THREAD_LOCAL int thread_tag = MEMORY_OTHER;
+
+static long atomic_add(volatile long *value, long amount)
+{
+#ifdef _WIN32
+    return InterlockedExchangeAdd(value, amount) + amount;
+#else
+    return __sync_add_and_fetch(value, amount);
+#endif
+}
+
+static long atomic_compare_exchange(volatile long *value, long expected, long replacement)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange(value, replacement, expected);
+#else
+    return __sync_val_compare_and_swap(value, expected, replacement);
+#endif
+}
+
+static void atomic_max(volatile long *value, long candidate)
+{
+    long seen = *value;
+    while(candidate > seen)
+    {
+        long previous = atomic_compare_exchange(value, seen, candidate);
+        if(previous == seen)
+            break;
+        seen = previous;
+    }
+}
+
+// 16 bytes keep the memory after it aligned for anything operator new has to support
+union AllocationHeader
+{
+    struct
+    {
+        size_t size;
+        int tag;
+    } info;
+    char padding[16];
+};
+
+static void *allocate(size_t size)
+{
+    AllocationHeader *header = (AllocationHeader *)malloc(sizeof(AllocationHeader) + size);
+    if(header == 0)
+        return 0;
+
+    int tag = thread_tag;
+    header->info.size = size;
+    header->info.tag = tag;
+
+    TagCounters &tagCounters = counters[tag];
+    atomic_max(&tagCounters.peak, atomic_add(&tagCounters.current, (long)size));
+    atomic_add(&tagCounters.allocations, 1);
+    return header + 1;
+}
+
+static void release(void *memory)
+{
+    if(memory == 0)
+        return;
+
+    AllocationHeader *header = (AllocationHeader *)memory - 1;
+    atomic_add(&counters[header->info.tag].current, -(long)header->info.size);
+    free(header);
+}
+
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+    void *memory = allocate(size);
+    if(memory == 0)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc)
+{
+    void *memory = allocate(size);
+    if(memory == 0)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) throw()
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) throw()
+{
+    return allocate(size);
+}
+
+void operator delete(void *memory) throw()
+{
+    release(memory);
+}
+
+void operator delete[](void *memory) throw()
+{
+    release(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) throw()
+{
+    release(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) throw()
+{
+    release(memory);
+}
+
+MEMORY_TAG MemoryStats::set_thread_tag(MEMORY_TAG tag)
+{
+    MEMORY_TAG previous = (MEMORY_TAG)thread_tag;
+    thread_tag = tag;
+    return previous;
+}
+
+#else
+
+// nothing counts the allocations, the tags read as 0
+static TagCounters counters[MEMORY_TAG_COUNT];
+
+MEMORY_TAG MemoryStats::set_thread_tag(MEMORY_TAG tag)
+{
+    return MEMORY_OTHER;
+}
+
+#endif // ENABLE_MEMORY_STATS
+
+//////////////////////////////////////////////////////////////////////////
+
+bool MemoryStats::is_enabled()
+{
+#ifdef ENABLE_MEMORY_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *MemoryStats::get_tag_name(MEMORY_TAG tag)
+{
+    switch(tag)
+    {
+    case MEMORY_SHOWS:
+        return "Shows";
+    case MEMORY_LIST_VIEW:
+        return "List view";
+    case MEMORY_XML:
+        return "XML";
+    default:
+        return "Other";
+    }
+}
+
+MemoryUsage MemoryStats::get_usage(MEMORY_TAG tag)
+{
+    MemoryUsage usage;
+    usage.current = counters[tag].current;
+    usage.peak = cl_max(counters[tag].peak, usage.current);
+    usage.allocations = (unsigned long)counters[tag].allocations;
+    return usage;
+}
+
+MemoryUsage MemoryStats::get_sqlite_usage()
+{
+    int current = 0, peak = 0;
+    sqlite3_status(SQLITE_STATUS_MEMORY_USED, &current, &peak, 0);
+
+    MemoryUsage usage;
+    usage.current = current;
+    usage.peak = cl_max(peak, current);
+    return usage;
+}
+
+void MemoryStats::reset_peaks()
+{
+    for(int i = 0; i < MEMORY_TAG_COUNT; i++)
+        counters[i].peak = counters[i].current;
+
+    int current, peak;
+    sqlite3_status(SQLITE_STATUS_MEMORY_USED, &current, &peak, 1);
+}
+
+void MemoryStats::write(CL_IODevice &file)
+{
+    CL_String text = "memory\tcurrent_bytes\tpeak_bytes\tallocations\n";
+    for(int i = 0; i < MEMORY_TAG_COUNT; i++)
+    {
+        MemoryUsage usage = get_usage((MEMORY_TAG)i);
+        text += cl_format("%1\t%2\t%3\t%4\n", get_tag_name((MEMORY_TAG)i), (int)usage.current, (int)usage.peak, (unsigned int)usage.allocations);
+    }
+
+    MemoryUsage sqlite = get_sqlite_usage();
+    text += cl_format("SQLite\t%1\t%2\t\n", (int)sqlite.current, (int)sqlite.peak);
+
+    if(file.send(text.data(), text.length(), true) != (int)text.length())
+        throw CL_Exception("Unable to write the memory statistics");
+}
@@ -0,0 +1,79 @@
+#ifndef MemoryStats_h__
+#define MemoryStats_h__
+
+
+
+// the counting operator new and delete cost every allocation in the process a header and a few atomic
+// operations, about 17 ns per new and delete pair, so they are only built when this is defined. The
+// Debug configuration defines it; without it only the sqlite counters are available
+//#define ENABLE_MEMORY_STATS
+
+// what heap memory is used for. Every operator new is charged to the tag of the MemoryScope open on
+// the calling thread, and given back to the same tag on delete however much later that happens
+enum MEMORY_TAG
+{
+    MEMORY_OTHER = 0,   // nothing more specific
+    MEMORY_SHOWS,       // show lists and search results the pages hold on to
+    MEMORY_LIST_VIEW,   // list view rows and their userdata
+    MEMORY_XML,         // MyAnimeList documents while they are parsed
+    MEMORY_TAG_COUNT
+};
+
+struct MemoryUsage
+{
+    long current;               // bytes
+    long peak;                  // bytes, since the start or the last reset_peaks
+    unsigned long allocations;  // operator new calls, since the start
+
+    MemoryUsage() : current(0), peak(0), allocations(0) {}
+};
+
+// the counters behind the replaced global operator new and delete. Each allocation carries a small
+// header with its size and tag, the counters are updated without a lock
+class MemoryStats
+{
+public:
+    // false when built without ENABLE_MEMORY_STATS, the tags then stay at 0
+    static bool is_enabled();
+
+    static const char *get_tag_name(MEMORY_TAG tag);
+    static MemoryUsage get_usage(MEMORY_TAG tag);
+
+    // sqlite keeps its page cache and statements outside operator new, these are its own counters
+    static MemoryUsage get_sqlite_usage();
+
+    // peaks start over from the current values, for measuring one operation
+    static void reset_peaks();
+
+    // tab separated, one line per tag and one for sqlite
+    static void write(CL_IODevice &file);
+
+    // for MemoryScope, returns the tag that was set before
+    static MEMORY_TAG set_thread_tag(MEMORY_TAG tag);
+};
+
+// charges the allocations of the calling thread to tag until it goes out of scope
+#ifdef ENABLE_MEMORY_STATS
+class MemoryScope
+{
+public:
+    MemoryScope(MEMORY_TAG tag) : previous(MemoryStats::set_thread_tag(tag)) {}
+    ~MemoryScope() { MemoryStats::set_thread_tag(previous); }
+
+private:
+    MEMORY_TAG previous;
+
+    MemoryScope(const MemoryScope &);
+    MemoryScope &operator =(const MemoryScope &);
+};
+#else
+class MemoryScope
+{
+public:
+    MemoryScope(MEMORY_TAG) {}
+};
+#endif
+
+
+
+#endif // MemoryStats_h__
@@ -0,0 +1,268 @@
+#include <ClanLib/core.h>
+#include <ClanLib/network.h>
+#include <zlib.h>
+#include "MockHTTPServer.h"
+
+
+HTTPFixtureStore::HTTPFixtureStore(const CL_String &directory) : directory(directory)
+{
+}
+
+CL_String HTTPFixtureStore::get_filename(const CL_String &path) const
+{
+    // readable prefix plus a FNV-1a hash of the full path, so "a b" and "a_b" don't collide
+    unsigned int hash = 2166136261u;
+    CL_String name;
+    for(CL_String::const_iterator it = path.begin(); it != path.end(); ++it)
+    {
+        hash = (hash ^ (unsigned char)*it) * 16777619u;
+
+        char ch = *it;
+        bool keep = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-' || ch == '.';
+        if(name.length() < 80)
+            name += keep ? ch : '_';
+    }
+
+    return CL_PathHelp::combine(directory, cl_format("%1-%2.xml", name, CL_StringHelp::uint_to_text(hash)));
+}
+
+bool HTTPFixtureStore::load(const CL_String &path, CL_DataBuffer &content) const
+{
+    try
+    {
+        CL_File file(get_filename(path), CL_File::open_existing, CL_File::access_read);
+        content = CL_DataBuffer(file.get_size());
+        file.read(content.get_data(), content.get_size());
+        return true;
+    }
+    catch(CL_Exception &)
+    {
+        return false;
+    }
+}
+
+void HTTPFixtureStore::save(const CL_String &path, const CL_DataBuffer &content) const
+{
+    CL_Directory::create(directory);
+    CL_File file(get_filename(path), CL_File::create_always, CL_File::access_write);
+    file.send(content.get_data(), content.get_size());
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+MockHTTPServerSettings::MockHTTPServerSettings()
+    : fixture_directory("fixtures"), port("8080"), latency(0), bandwidth(0), chunk_size(0),
+      compress(true), error_rate(0), error_status(503), seed(1)
+{
+}
+
+MockHTTPServer::MockHTTPServer(const MockHTTPServerSettings &settings)
+    : settings(settings), fixtures(settings.fixture_directory), stop_event(true, false), random_state(settings.seed)
+{
+}
+
+MockHTTPServer::~MockHTTPServer()
+{
+    stop();
+}
+
+void MockHTTPServer::start()
+{
+    listen = CL_TCPListen(CL_SocketName("127.0.0.1", settings.port));
+    stop_event.reset();
+    thread.start(this, &MockHTTPServer::worker_main);
+}
+
+void MockHTTPServer::stop()
+{
+    if(listen.is_null() == false)
+    {
+        stop_event.set();
+        thread.join();
+        listen.close();
+        listen = CL_TCPListen();
+    }
+}
+
+unsigned int MockHTTPServer::next_random()
+{
+    random_state = random_state * 1103515245 + 12345;
+    return (random_state >> 16) & 0x7fff;
+}
+
+void MockHTTPServer::worker_main()
+{
+    while(true)
+    {
+        CL_Event accept_event = listen.get_accept_event();
+        int wakeup = CL_Event::wait(stop_event, accept_event);
+        if(wakeup != 1)
+            break;
+
+        try
+        {
+            CL_TCPConnection connection = listen.accept();
+            handle_connection(connection);
+            connection.disconnect_graceful();
+        }
+        catch(CL_Exception &e)
+        {
+            cl_log_event("mockserver", "connection failed: %1", e.message);
+        }
+    }
+}
+
+static CL_String url_decode(const CL_String &url)
+{
+    CL_String decoded;
+    for(CL_String::size_type i = 0; i < url.length(); i++)
+    {
+        if(url[i] == '%' && i+2 < url.length())
+        {
+            decoded += (char)CL_StringHelp::text_to_int(url.substr(i+1, 2), 16);
+            i += 2;
+        }
+        else
+        {
+            decoded += url[i];
+        }
+    }
+    return decoded;
+}
+
+void MockHTTPServer::handle_connection(CL_TCPConnection &connection)
+{
+    CL_String request;
+    while(request.find("\r\n\r\n") == CL_String::npos && connection.get_read_event().wait(5000))
+    {
+        char buffer[4096];
+        int received = connection.read(buffer, 4096, false);
+        if(received == 0)
+            return;
+        request.append(buffer, received);
+    }
+
+    // example request line: GET /anime/1?format=xml HTTP/1.1
+    std::vector<CL_String> request_line = CL_StringHelp::split_text(request.substr(0, request.find("\r\n")), " ");
+    if(request_line.size() < 2)
+        return;
+
+    CL_String path = url_decode(request_line[1]);
+    bool accepts_gzip = settings.compress && CL_StringHelp::text_to_lower(request).find("accept-encoding: gzip") != CL_String::npos;
+
+    if(settings.latency > 0)
+        CL_System::sleep(settings.latency);
+
+    if(settings.error_rate > 0 && (int)(next_random() % 100) < settings.error_rate)
+    {
+        CL_String body = "Service temporarily unavailable";
+        send_response(connection, settings.error_status, "Injected Error", CL_DataBuffer(body.data(), body.length()), false);
+        return;
+    }
+
+    CL_DataBuffer content;
+    if(fixtures.load(path, content))
+    {
+        send_response(connection, 200, "OK", content, accepts_gzip);
+    }
+    else
+    {
+        // the search API answers unknown queries with a plain text body
+        if(path.find("/search.xml") != CL_String::npos)
+        {
+            CL_String body = "No results";
+            send_response(connection, 200, "OK", CL_DataBuffer(body.data(), body.length()), false);
+        }
+        else
+        {
+            CL_String body = "Not found";
+            send_response(connection, 404, "Not Found", CL_DataBuffer(body.data(), body.length()), false);
+        }
+    }
+}
+
+static CL_String to_hex(int value)
+{
+    static const char digits[] = "0123456789abcdef";
+    CL_String hex;
+    do
+    {
+        hex.insert(hex.begin(), digits[value & 15]);
+        value >>= 4;
+    } while(value > 0);
+    return hex;
+}
+
+void MockHTTPServer::send_response(CL_TCPConnection &connection, int status, const CL_String &reason, const CL_DataBuffer &body, bool accepts_gzip)
+{
+    CL_DataBuffer payload = accepts_gzip ? gzip(body) : body;
+
+    CL_String header = cl_format("HTTP/1.1 %1 %2\r\nConnection: close\r\nContent-Type: text/xml\r\n", status, reason);
+    if(accepts_gzip)
+        header += "Content-Encoding: gzip\r\n";
+    if(status == 429 || status == 503)
+        header += "Retry-After: 1\r\n";
+
+    if(settings.chunk_size > 0)
+    {
+        header += "Transfer-Encoding: chunked\r\n\r\n";
+        send_throttled(connection, header.data(), header.length());
+
+        for(int pos = 0; pos < payload.get_size(); pos += settings.chunk_size)
+        {
+            int length = cl_min(settings.chunk_size, payload.get_size() - pos);
+            CL_String chunk_header = to_hex(length) + "\r\n";
+            send_throttled(connection, chunk_header.data(), chunk_header.length());
+            send_throttled(connection, payload.get_data() + pos, length);
+            send_throttled(connection, "\r\n", 2);
+        }
+        send_throttled(connection, "0\r\n\r\n", 5);
+    }
+    else
+    {
+        header += cl_format("Content-Length: %1\r\n\r\n", payload.get_size());
+        send_throttled(connection, header.data(), header.length());
+        send_throttled(connection, payload.get_data(), payload.get_size());
+    }
+}
+
+void MockHTTPServer::send_throttled(CL_TCPConnection &connection, const char *data, int length)
+{
+    if(settings.bandwidth <= 0)
+    {
+        connection.send(data, length, true);
+        return;
+    }
+
+    // send in slices of ~10ms worth of bandwidth
+    int slice = cl_max(settings.bandwidth / 100, 1);
+    for(int pos = 0; pos < length; pos += slice)
+    {
+        int size = cl_min(slice, length - pos);
+        connection.send(data + pos, size, true);
+        CL_System::sleep(size * 1000 / settings.bandwidth);
+    }
+}
+
+CL_DataBuffer MockHTTPServer::gzip(const CL_DataBuffer &data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw CL_Exception("Unable to initialize zlib");
+
+    CL_DataBuffer output(deflateBound(&stream, data.get_size()) + 32);
+    stream.next_in = (Bytef*)data.get_data();
+    stream.avail_in = data.get_size();
+    stream.next_out = (Bytef*)output.get_data();
+    stream.avail_out = output.get_size();
+
+    int result = deflate(&stream, Z_FINISH);
+    output.set_size(stream.total_out);
+    deflateEnd(&stream);
+
+    if(result != Z_STREAM_END)
+        throw CL_Exception("Unable to compress the fixture");
+
+    return output;
+}
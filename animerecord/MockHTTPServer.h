@@ -0,0 +1,67 @@
+#ifndef MockHTTPServer_h__
+#define MockHTTPServer_h__
+
+
+
+// maps request paths to files in a fixture directory, shared by the recorder and the replay server
+class HTTPFixtureStore
+{
+    CL_String directory;
+
+public:
+    HTTPFixtureStore(const CL_String &directory);
+
+    CL_String get_filename(const CL_String &path) const;
+
+    bool load(const CL_String &path, CL_DataBuffer &content) const;
+    void save(const CL_String &path, const CL_DataBuffer &content) const;
+};
+
+struct MockHTTPServerSettings
+{
+    CL_String fixture_directory;
+    CL_String port;
+
+    int latency;        // ms before the first byte of every response
+    int bandwidth;      // bytes per second, 0 = unlimited
+    int chunk_size;     // send the body with chunked transfer encoding, 0 = use Content-Length
+    bool compress;      // gzip the body when the client accepts it
+    int error_rate;     // percentage of requests answered with error_status
+    int error_status;
+    unsigned int seed;
+
+    MockHTTPServerSettings();
+};
+
+// local stand-in for the MyAnimeList servers, replays recorded fixtures so the network path
+// can be exercised and measured without internet access
+class MockHTTPServer
+{
+    MockHTTPServerSettings settings;
+    HTTPFixtureStore fixtures;
+
+    CL_TCPListen listen;
+    CL_Thread thread;
+    CL_Event stop_event;
+    unsigned int random_state;
+
+public:
+    MockHTTPServer(const MockHTTPServerSettings &settings);
+    ~MockHTTPServer();
+
+    void start();
+    void stop();
+
+private:
+    void worker_main();
+    void handle_connection(CL_TCPConnection &connection);
+    void send_response(CL_TCPConnection &connection, int status, const CL_String &reason, const CL_DataBuffer &body, bool accepts_gzip);
+    void send_throttled(CL_TCPConnection &connection, const char *data, int length);
+    unsigned int next_random();
+
+    static CL_DataBuffer gzip(const CL_DataBuffer &data);
+};
+
+
+
+#endif // MockHTTPServer_h__
@@ -0,0 +1,260 @@
+#include <ClanLib/core.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include "Recommender.h"
+
+// the intrinsics are available to MSVC on x86 without /arch, gcc needs -msse
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define RECOMMENDER_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+
+// how much credit a genre gets for usually appearing together with the genres of the show
+static const float RELATED_GENRE_WEIGHT = 0.3f;
+
+struct HigherScore
+{
+    bool operator()(const Recommendation &a, const Recommendation &b) const
+    {
+        return a.score > b.score;
+    }
+};
+
+Recommender::Recommender() : stride(0)
+{
+}
+
+void Recommender::clear()
+{
+    stride = 0;
+    matrix.clear();
+    rating_weights.clear();
+    ids.clear();
+    row_columns.clear();
+    row_by_id.clear();
+    column_by_genre.clear();
+    cooccurrence.clear();
+}
+
+int Recommender::get_column(int genre)
+{
+    std::unordered_map<int, int>::const_iterator found = column_by_genre.find(genre);
+    if(found != column_by_genre.end())
+        return found->second;
+
+    int column = (int)column_by_genre.size();
+    if(column >= stride)
+        grow(column + 1);
+
+    column_by_genre[genre] = column;
+    return column;
+}
+
+// widens both matrices, the stride doubles so adding genres one by one stays cheap
+void Recommender::grow(int columns)
+{
+    int newStride = cl_max(stride, 4);
+    while(newStride < columns)
+        newStride *= 2;
+
+    std::vector<float> newMatrix(ids.size() * newStride, 0.0f);
+    for(std::vector<int>::size_type row = 0; row < ids.size(); row++)
+        std::copy(matrix.begin() + row*stride, matrix.begin() + (row+1)*stride, newMatrix.begin() + row*newStride);
+
+    std::vector<int> newCooccurrence(newStride * newStride, 0);
+    for(int a = 0; a < stride; a++)
+        std::copy(cooccurrence.begin() + a*stride, cooccurrence.begin() + (a+1)*stride, newCooccurrence.begin() + a*newStride);
+
+    matrix.swap(newMatrix);
+    cooccurrence.swap(newCooccurrence);
+    stride = newStride;
+}
+
+void Recommender::add_cooccurrence(const std::vector<int> &columns, int delta)
+{
+    for(std::vector<int>::const_iterator a = columns.begin(); a != columns.end(); ++a)
+    {
+        for(std::vector<int>::const_iterator b = columns.begin(); b != columns.end(); ++b)
+            cooccurrence[*a * stride + *b] += delta;
+    }
+}
+
+void Recommender::set_show(int id, const std::vector<int> &genres, double rating)
+{
+    // may widen the matrix, so the columns are resolved before the row is touched
+    std::vector<int> columns;
+    for(std::vector<int>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+    {
+        int column = get_column(*it);
+        if(std::find(columns.begin(), columns.end(), column) == columns.end())
+            columns.push_back(column);
+    }
+
+    int row;
+    std::unordered_map<int, int>::const_iterator found = row_by_id.find(id);
+    if(found != row_by_id.end())
+    {
+        row = found->second;
+        add_cooccurrence(row_columns[row], -1);
+    }
+    else
+    {
+        row = (int)ids.size();
+        ids.push_back(id);
+        matrix.resize(matrix.size() + stride, 0.0f);
+        rating_weights.push_back(0.0f);
+        row_columns.push_back(std::vector<int>());
+        row_by_id[id] = row;
+    }
+
+    float *values = matrix.empty() ? 0 : &matrix[row * stride];
+    std::fill(values, values + stride, 0.0f);
+    for(std::vector<int>::const_iterator it = columns.begin(); it != columns.end(); ++it)
+        values[*it] = 1.0f / std::sqrt((float)columns.size());
+
+    // an unrated show still counts, a 10/10 one counts double
+    rating_weights[row] = 0.5f + (float)cl_clamp(rating, 0.0, 10.0) / 20.0f;
+
+    row_columns[row] = columns;
+    add_cooccurrence(columns, 1);
+}
+
+void Recommender::remove_show(int id)
+{
+    std::unordered_map<int, int>::iterator found = row_by_id.find(id);
+    if(found == row_by_id.end())
+        return;
+
+    int row = found->second;
+    row_by_id.erase(found);
+    add_cooccurrence(row_columns[row], -1);
+
+    // the last row takes the place of the removed one
+    int last = (int)ids.size() - 1;
+    if(row != last)
+    {
+        std::copy(matrix.begin() + last*stride, matrix.begin() + (last+1)*stride, matrix.begin() + row*stride);
+        rating_weights[row] = rating_weights[last];
+        row_columns[row].swap(row_columns[last]);
+        ids[row] = ids[last];
+        row_by_id[ids[row]] = row;
+    }
+
+    matrix.resize(last * stride);
+    rating_weights.pop_back();
+    row_columns.pop_back();
+    ids.pop_back();
+}
+
+int Recommender::get_cooccurrence(int genreA, int genreB) const
+{
+    std::unordered_map<int, int>::const_iterator a = column_by_genre.find(genreA);
+    std::unordered_map<int, int>::const_iterator b = column_by_genre.find(genreB);
+    if(a == column_by_genre.end() || b == column_by_genre.end())
+        return 0;
+    return cooccurrence[a->second * stride + b->second];
+}
+
+std::vector<Recommendation> Recommender::find_similar(int id, int limit)
+{
+    std::vector<Recommendation> best;
+
+    std::unordered_map<int, int>::const_iterator found = row_by_id.find(id);
+    if(found == row_by_id.end() || row_columns[found->second].empty() || limit <= 0)
+        return best;
+
+    int row = found->second;
+    const std::vector<int> &own = row_columns[row];
+    int shows = (int)ids.size();
+    int columns = (int)column_by_genre.size();
+
+    // genres most of the library has say less about a show than rare ones
+    std::vector<float> idf(columns);
+    for(int c = 0; c < columns; c++)
+        idf[c] = std::log((float)(shows + 1) / (float)(cooccurrence[c*stride + c] + 1)) + 1.0f;
+
+    std::vector<float> query(stride, 0.0f);
+    for(int c = 0; c < columns; c++)
+    {
+        if(std::find(own.begin(), own.end(), c) != own.end())
+        {
+            query[c] = idf[c];
+            continue;
+        }
+
+        // average chance that a show with one of our genres also has this one
+        float related = 0.0f;
+        for(std::vector<int>::const_iterator g = own.begin(); g != own.end(); ++g)
+        {
+            int together = cooccurrence[*g * stride + c];
+            if(together > 0)
+                related += (float)together / (float)cooccurrence[*g * stride + *g];
+        }
+        query[c] = RELATED_GENRE_WEIGHT * related / own.size() * idf[c];
+    }
+
+    float norm = 0.0f;
+    for(int c = 0; c < stride; c++)
+        norm += query[c] * query[c];
+    norm = std::sqrt(norm);
+    for(int c = 0; c < stride; c++)
+        query[c] /= norm;
+
+    scores.resize(shows);
+    score_rows(&query[0], &matrix[0], stride, shows, &scores[0]);
+
+    // keep the best ones in a min heap, the weakest of them on top
+    HigherScore higher;
+    for(int i = 0; i < shows; i++)
+    {
+        float score = scores[i] * rating_weights[i];
+        if(i == row || score <= 0.0f)
+            continue;
+
+        if((int)best.size() == limit)
+        {
+            if(score <= best.front().score)
+                continue;
+            std::pop_heap(best.begin(), best.end(), higher);
+            best.pop_back();
+        }
+
+        Recommendation recommendation;
+        recommendation.id = ids[i];
+        recommendation.score = score;
+        best.push_back(recommendation);
+        std::push_heap(best.begin(), best.end(), higher);
+    }
+
+    std::sort_heap(best.begin(), best.end(), higher);
+    return best;
+}
+
+// dot product of the query with every row, four columns at a time
+void Recommender::score_rows(const float *query, const float *rows, int stride, int count, float *scores)
+{
+#ifdef RECOMMENDER_USE_SSE
+    for(int i = 0; i < count; i++)
+    {
+        const float *row = rows + i*stride;
+        __m128 sum = _mm_setzero_ps();
+        for(int c = 0; c < stride; c += 4)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(query + c), _mm_loadu_ps(row + c)));
+
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        _mm_store_ss(scores + i, sum);
+    }
+#else
+    for(int i = 0; i < count; i++)
+    {
+        const float *row = rows + i*stride;
+        float sum = 0.0f;
+        for(int c = 0; c < stride; c++)
+            sum += query[c] * row[c];
+        scores[i] = sum;
+    }
+#endif
+}
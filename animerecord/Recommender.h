@@ -0,0 +1,56 @@
+#ifndef Recommender_h__
+#define Recommender_h__
+
+
+
+struct Recommendation
+{
+    int id;
+    float score;    // 0..1, genre similarity scaled by the rating of the recommended show
+};
+
+// "more like this" over the whole library. Every show is one row of a packed float matrix holding its
+// genres as a unit vector, so scoring the library is a single pass of dot products. The query side is
+// weighted by how rare each genre is and spread to related genres through a genre co-occurrence matrix.
+// Both matrices are updated in place when a show is added, changed or removed
+class Recommender
+{
+public:
+    Recommender();
+
+    void clear();
+
+    // adds the show or replaces its previous genres and rating
+    void set_show(int id, const std::vector<int> &genres, double rating);
+    void remove_show(int id);
+
+    // the most similar shows, best first, the show itself excluded
+    std::vector<Recommendation> find_similar(int id, int limit);
+
+    int get_show_count() const { return (int)ids.size(); }
+
+    // number of shows having both genres, or just the one when they are the same
+    int get_cooccurrence(int genreA, int genreB) const;
+
+private:
+    int stride;                         // floats per matrix row, a multiple of 4
+    std::vector<float> matrix;          // stride floats per show
+    std::vector<float> rating_weights;  // per row
+    std::vector<int> ids;               // show ID per row
+    std::vector<std::vector<int> > row_columns;
+    std::unordered_map<int, int> row_by_id;
+
+    std::unordered_map<int, int> column_by_genre;
+    std::vector<int> cooccurrence;      // stride*stride counts
+    std::vector<float> scores;
+
+    int get_column(int genre);
+    void grow(int columns);
+    void add_cooccurrence(const std::vector<int> &columns, int delta);
+
+    static void score_rows(const float *query, const float *rows, int stride, int count, float *scores);
+};
+
+
+
+#endif // Recommender_h__
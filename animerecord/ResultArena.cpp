@@ -0,0 +1,72 @@
+#include <ClanLib/core.h>
+#include <cstring>
+#include <vector>
+#include "ResultArena.h"
+
+
+ResultArena::ResultArena() : current(0), offset(0), used_before(0)
+{
+}
+
+ResultArena::~ResultArena()
+{
+    for(std::vector<Block>::iterator it = blocks.begin(); it != blocks.end(); ++it)
+        delete[] it->data;
+}
+
+void *ResultArena::allocate(unsigned int size, unsigned int alignment)
+{
+    while(current < blocks.size())
+    {
+        unsigned int start = (offset + alignment - 1) & ~(alignment - 1);
+        if(start + size <= blocks[current].size)
+        {
+            offset = start + size;
+            return blocks[current].data + start;
+        }
+
+        // the rest of this block is wasted, the next one may be big enough
+        used_before += offset;
+        current++;
+        offset = 0;
+    }
+
+    // new blocks are never smaller than BLOCK_SIZE, a larger request gets a block of its own size
+    Block block;
+    block.size = cl_max(size + alignment, (unsigned int)BLOCK_SIZE);
+    block.data = new char[block.size];
+    blocks.push_back(block);
+    current = blocks.size() - 1;
+
+    unsigned int start = (unsigned int)((alignment - ((size_t)block.data & (alignment - 1))) & (alignment - 1));
+    offset = start + size;
+    return block.data + start;
+}
+
+const char *ResultArena::store(const char *text, unsigned int length)
+{
+    char *copy = (char *)allocate(length + 1, 1);
+    memcpy(copy, text, length);
+    copy[length] = 0;
+    return copy;
+}
+
+void ResultArena::clear()
+{
+    current = 0;
+    offset = 0;
+    used_before = 0;
+}
+
+unsigned int ResultArena::get_used() const
+{
+    return used_before + offset;
+}
+
+unsigned int ResultArena::get_reserved() const
+{
+    unsigned int reserved = 0;
+    for(std::vector<Block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+        reserved += it->size;
+    return reserved;
+}
@@ -0,0 +1,47 @@
+#ifndef ResultArena_h__
+#define ResultArena_h__
+
+
+
+// bump allocator for the rows of one query result. Strings and arrays are carved out of large blocks
+// and only freed together: clear() makes the blocks reusable and keeps them, so a list that is refilled
+// on every keystroke stops calling the heap once it has seen its largest result
+class ResultArena
+{
+public:
+    enum { BLOCK_SIZE = 64 * 1024 };
+
+    ResultArena();
+    ~ResultArena();
+
+    // never returns 0, the memory is uninitialized
+    void *allocate(unsigned int size, unsigned int alignment = sizeof(void *));
+
+    // copies length bytes and a terminating 0, returns the copy
+    const char *store(const char *text, unsigned int length);
+
+    void clear();
+
+    unsigned int get_used() const;
+    unsigned int get_reserved() const;
+    int get_block_count() const { return (int)blocks.size(); }
+
+private:
+    struct Block
+    {
+        char *data;
+        unsigned int size;
+    };
+
+    std::vector<Block> blocks;
+    std::vector<Block>::size_type current;  // the block allocations come from
+    unsigned int offset;                    // first free byte in it
+    unsigned int used_before;               // bytes handed out from the blocks before current
+
+    ResultArena(const ResultArena &);
+    ResultArena &operator =(const ResultArena &);
+};
+
+
+
+#endif // ResultArena_h__
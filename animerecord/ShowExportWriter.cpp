@@ -0,0 +1,242 @@
+#include <ClanLib/core.h>
+#include <sstream>
+#include "ShowExportWriter.h"
+
+
+ShowExportWriter::ShowExportWriter(CL_IODevice &device, Format format) : device(device), format(format), rows(0)
+{
+    buffer.reserve(BUFFER_SIZE + 4096);
+}
+
+ShowExportWriter::Format ShowExportWriter::get_format(const CL_String &filename)
+{
+    CL_String extension = CL_StringHelp::text_to_lower(CL_PathHelp::get_extension(filename));
+    if(extension == "json")
+        return FORMAT_JSON;
+    if(extension == "xml")
+        return FORMAT_XML;
+    return FORMAT_CSV;
+}
+
+void ShowExportWriter::begin()
+{
+    rows = 0;
+    if(format == FORMAT_CSV)
+        buffer += "id,title,type,year,episodes,season,rating,status,mal_id,date_added,date_updated,genres,comment\r\n";
+    else if(format == FORMAT_JSON)
+        buffer += "[";
+    else
+        buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<myanimelist>\n\t<myinfo>\n\t\t<user_export_type>1</user_export_type>\n\t</myinfo>\n";
+}
+
+void ShowExportWriter::write(const ExportRow &row)
+{
+    if(format == FORMAT_CSV)
+        write_csv(row);
+    else if(format == FORMAT_JSON)
+        write_json(row);
+    else
+        write_xml(row);
+
+    rows++;
+    if(buffer.length() >= BUFFER_SIZE)
+        flush();
+}
+
+void ShowExportWriter::end()
+{
+    if(format == FORMAT_JSON)
+        buffer += rows > 0 ? "\n]\n" : "]\n";
+    else if(format == FORMAT_XML)
+        buffer += "</myanimelist>\n";
+    flush();
+}
+
+// clear() keeps the capacity, the buffer is allocated once
+void ShowExportWriter::flush()
+{
+    if(buffer.empty())
+        return;
+
+    if(device.send(buffer.data(), buffer.length(), true) != (int)buffer.length())
+        throw CL_Exception("Unable to write the export file");
+    buffer.clear();
+}
+
+void ShowExportWriter::write_csv(const ExportRow &row)
+{
+    buffer += CL_StringHelp::int_to_text(row.id);
+    buffer += ',';
+    append_csv(row.title);
+    buffer += ',';
+    append_csv(row.type);
+    buffer += ',';
+    buffer += CL_StringHelp::int_to_text(row.year);
+    buffer += ',';
+    buffer += CL_StringHelp::int_to_text(row.episodes);
+    buffer += ',';
+    buffer += CL_StringHelp::int_to_text(row.season);
+    buffer += ',';
+    buffer += double_to_text(row.rating);
+    buffer += ',';
+    append_csv(row.status_name);
+    buffer += ',';
+    if(row.mal_id > 0)
+        buffer += CL_StringHelp::int_to_text(row.mal_id);
+    buffer += ',';
+    buffer += row.date_added;
+    buffer += ',';
+    buffer += row.date_updated;
+    buffer += ',';
+
+    CL_String genres;
+    for(std::vector<CL_String>::const_iterator it = row.genres.begin(); it != row.genres.end(); ++it)
+    {
+        if(it != row.genres.begin())
+            genres += ", ";
+        genres += *it;
+    }
+    append_csv(genres);
+    buffer += ',';
+    append_csv(row.comment);
+    buffer += "\r\n";
+}
+
+void ShowExportWriter::write_json(const ExportRow &row)
+{
+    buffer += rows > 0 ? ",\n{\"id\":" : "\n{\"id\":";
+    buffer += CL_StringHelp::int_to_text(row.id);
+    buffer += ",\"title\":";
+    append_json(row.title);
+    buffer += ",\"type\":";
+    append_json(row.type);
+    buffer += ",\"year\":";
+    buffer += CL_StringHelp::int_to_text(row.year);
+    buffer += ",\"episodes\":";
+    buffer += CL_StringHelp::int_to_text(row.episodes);
+    buffer += ",\"season\":";
+    buffer += CL_StringHelp::int_to_text(row.season);
+    buffer += ",\"rating\":";
+    buffer += double_to_text(row.rating);
+    buffer += ",\"status\":";
+    append_json(row.status_name);
+    buffer += ",\"mal_id\":";
+    buffer += row.mal_id > 0 ? CL_StringHelp::int_to_text(row.mal_id) : CL_String("null");
+    buffer += ",\"date_added\":";
+    append_json(row.date_added);
+    buffer += ",\"date_updated\":";
+    append_json(row.date_updated);
+    buffer += ",\"genres\":[";
+    for(std::vector<CL_String>::const_iterator it = row.genres.begin(); it != row.genres.end(); ++it)
+    {
+        if(it != row.genres.begin())
+            buffer += ',';
+        append_json(*it);
+    }
+    buffer += "],\"comment\":";
+    append_json(row.comment);
+    buffer += '}';
+}
+
+void ShowExportWriter::write_xml(const ExportRow &row)
+{
+    buffer += "\t<anime>\n";
+    append_xml_field("series_animedb_id", CL_StringHelp::int_to_text(row.mal_id));
+    append_xml_field("series_title", row.title);
+    append_xml_field("series_type", row.type == "Film" ? "Movie" : "TV");
+    append_xml_field("series_episodes", CL_StringHelp::int_to_text(row.episodes));
+    append_xml_field("my_watched_episodes", CL_StringHelp::int_to_text(row.episodes));
+    append_xml_field("my_score", CL_StringHelp::int_to_text((int)(row.rating + 0.5)));
+    append_xml_field("my_status", CL_StringHelp::int_to_text(row.status));
+    append_xml_field("my_comments", row.comment);
+
+    // everything below is ignored by MyAnimeList
+    append_xml_field("animerecord_type", row.type);
+    append_xml_field("animerecord_year", CL_StringHelp::int_to_text(row.year));
+    append_xml_field("animerecord_season", CL_StringHelp::int_to_text(row.season));
+    append_xml_field("animerecord_rating", double_to_text(row.rating));
+    append_xml_field("animerecord_date_added", row.date_added);
+    append_xml_field("animerecord_date_updated", row.date_updated);
+    for(std::vector<CL_String>::const_iterator it = row.genres.begin(); it != row.genres.end(); ++it)
+        append_xml_field("animerecord_genre", *it);
+    buffer += "\t</anime>\n";
+}
+
+// quoted only when needed, as spreadsheets expect
+void ShowExportWriter::append_csv(const CL_String &text)
+{
+    if(text.find_first_of(",\"\r\n") == CL_String::npos)
+    {
+        buffer += text;
+        return;
+    }
+
+    buffer += '"';
+    for(CL_String::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        if(*it == '"')
+            buffer += '"';
+        buffer += *it;
+    }
+    buffer += '"';
+}
+
+void ShowExportWriter::append_json(const CL_String &text)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    buffer += '"';
+    for(CL_String::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        unsigned char ch = *it;
+        if(ch == '"') buffer += "\\\"";
+        else if(ch == '\\') buffer += "\\\\";
+        else if(ch == '\n') buffer += "\\n";
+        else if(ch == '\r') buffer += "\\r";
+        else if(ch == '\t') buffer += "\\t";
+        else if(ch < 0x20)
+        {
+            buffer += "\\u00";
+            buffer += digits[ch >> 4];
+            buffer += digits[ch & 15];
+        }
+        else
+            buffer += *it;
+    }
+    buffer += '"';
+}
+
+// the other control characters aren't allowed in XML 1.0 at all and are dropped
+void ShowExportWriter::append_xml(const CL_String &text)
+{
+    for(CL_String::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        unsigned char ch = *it;
+        if(ch == '&') buffer += "&amp;";
+        else if(ch == '<') buffer += "&lt;";
+        else if(ch == '>') buffer += "&gt;";
+        else if(ch == '\r') buffer += "&#13;";
+        else if(ch >= 0x20 || ch == '\n' || ch == '\t')
+            buffer += *it;
+    }
+}
+
+void ShowExportWriter::append_xml_field(const char *name, const CL_String &value)
+{
+    buffer += "\t\t<";
+    buffer += name;
+    buffer += '>';
+    append_xml(value);
+    buffer += "</";
+    buffer += name;
+    buffer += ">\n";
+}
+
+// shortest text that reads back as the same rating, 7.5 rather than 7.500000
+CL_String ShowExportWriter::double_to_text(double value)
+{
+    std::ostringstream text;
+    text.precision(15);
+    text << value;
+    return text.str();
+}
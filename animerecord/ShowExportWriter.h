@@ -0,0 +1,75 @@
+#ifndef ShowExportWriter_h__
+#define ShowExportWriter_h__
+
+
+
+// one show as it is written to an export, filled from a database cursor row by row
+struct ExportRow
+{
+    int id;
+    CL_String title;
+    CL_String type;
+    int year;
+    int episodes;
+    int season;
+    double rating;
+    CL_String comment;
+    int status;             // VIEWING_STATUS code, the same numbers MyAnimeList uses
+    CL_String status_name;
+    int mal_id;             // 0 when the show didn't come from MyAnimeList
+    CL_String date_added;   // as sqlite stores them, "YYYY-MM-DD HH:MM:SS" in UTC
+    CL_String date_updated;
+    std::vector<CL_String> genres;
+};
+
+// shared between the exporting thread and the GUI
+struct ExportProgress
+{
+    CL_InterlockedVariable total;
+    CL_InterlockedVariable written;
+    CL_InterlockedVariable cancelled;
+};
+
+// streams rows to a device as CSV, JSON or XML through a fixed size buffer, so memory use doesn't grow
+// with the library. The XML is a MyAnimeList list export plus animerecord_ fields for what MyAnimeList
+// doesn't have, MALExportReader reads it back without loss. Nothing imports CSV or JSON, they are for
+// spreadsheets and scripts
+class ShowExportWriter
+{
+public:
+    enum Format { FORMAT_CSV, FORMAT_JSON, FORMAT_XML };
+
+    ShowExportWriter(CL_IODevice &device, Format format);
+
+    // picks the format from the file extension, CSV unless it is .json or .xml
+    static Format get_format(const CL_String &filename);
+
+    void begin();
+    void write(const ExportRow &row);
+    void end();
+
+private:
+    enum { BUFFER_SIZE = 64*1024 };
+
+    CL_IODevice device;
+    Format format;
+    CL_String buffer;
+    int rows;
+
+    void flush();
+
+    void write_csv(const ExportRow &row);
+    void write_json(const ExportRow &row);
+    void write_xml(const ExportRow &row);
+
+    void append_csv(const CL_String &text);
+    void append_json(const CL_String &text);
+    void append_xml(const CL_String &text);
+    void append_xml_field(const char *name, const CL_String &value);
+
+    static CL_String double_to_text(double value);
+};
+
+
+
+#endif // ShowExportWriter_h__
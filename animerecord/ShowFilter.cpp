@@ -0,0 +1,147 @@
+#include <ClanLib/core.h>
+#include "TitleKey.h"
+#include "ShowType.h"
+#include "ShowFilter.h"
+
+
+ShowFilter::ShowFilter() : status_mask(0), year_min(0), year_max(0), rating_min(-1), rating_max(-1), type(-1), season(0)
+{
+}
+
+// whitespace separated, double quotes keep whitespace inside a word and are dropped
+static std::vector<CL_String> split_words(const CL_String &text)
+{
+    std::vector<CL_String> words;
+    CL_String word;
+    bool quoted = false, started = false;
+    for(CL_String::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        if(*it == '"')
+        {
+            quoted = !quoted;
+            started = true;
+        }
+        else if(quoted == false && (*it == ' ' || *it == '\t' || *it == '\r' || *it == '\n'))
+        {
+            if(started)
+                words.push_back(word);
+            word.clear();
+            started = false;
+        }
+        else
+        {
+            word += *it;
+            started = true;
+        }
+    }
+    if(started)
+        words.push_back(word);
+    return words;
+}
+
+// digits with at most one decimal point, decimals only when allowed
+static bool parse_number(const CL_String &text, bool decimals, double &value)
+{
+    if(text.empty() || text.length() > 10)
+        return false;
+
+    bool point = false;
+    for(CL_String::const_iterator it = text.begin(); it != text.end(); ++it)
+    {
+        if(*it == '.' && decimals && point == false)
+            point = true;
+        else if(*it < '0' || *it > '9')
+            return false;
+    }
+    if(text == ".")
+        return false;
+
+    value = CL_StringHelp::text_to_double(text);
+    return true;
+}
+
+// "a-b", "a", "a-" or "-b", an open end is left at its old value
+static bool parse_range(const CL_String &text, bool decimals, double &low, double &high)
+{
+    CL_String::size_type dash = text.find('-');
+    if(dash == CL_String::npos)
+    {
+        double value;
+        if(parse_number(text, decimals, value) == false)
+            return false;
+        low = high = value;
+        return true;
+    }
+
+    CL_String first = text.substr(0, dash), second = text.substr(dash + 1);
+    if(first.empty() && second.empty())
+        return false;
+
+    double newLow = low, newHigh = high;
+    if(first.empty() == false && parse_number(first, decimals, newLow) == false)
+        return false;
+    if(second.empty() == false && parse_number(second, decimals, newHigh) == false)
+        return false;
+
+    low = newLow;
+    high = newHigh;
+    return true;
+}
+
+ShowFilter ShowFilter::parse(const CL_String &text)
+{
+    ShowFilter filter;
+    CL_String title;
+
+    std::vector<CL_String> words = split_words(text);
+    for(std::vector<CL_String>::const_iterator it = words.begin(); it != words.end(); ++it)
+    {
+        CL_String::size_type colon = it->find(':');
+        CL_String name = colon == CL_String::npos ? CL_String() : CL_StringHelp::text_to_lower(it->substr(0, colon));
+        CL_String value = colon == CL_String::npos ? CL_String() : it->substr(colon + 1);
+
+        bool criterion = false;
+        if(value.empty() == false)
+        {
+            if(name == "genre")
+            {
+                filter.genre_names.push_back(value);
+                criterion = true;
+            }
+            else if(name == "type")
+            {
+                SHOW_TYPE type;
+                criterion = parse_show_type(value, type);
+                if(criterion)
+                    filter.type = type;
+            }
+            else if(name == "year")
+            {
+                double low = filter.year_min, high = filter.year_max;
+                criterion = parse_range(value, false, low, high);
+                filter.year_min = (int)low;
+                filter.year_max = (int)high;
+            }
+            else if(name == "rating")
+            {
+                criterion = parse_range(value, true, filter.rating_min, filter.rating_max);
+            }
+            else if(name == "season")
+            {
+                double season;
+                criterion = parse_number(value, false, season) && season > 0;
+                if(criterion)
+                    filter.season = (int)season;
+            }
+        }
+
+        if(criterion == false)
+        {
+            title += *it;
+            title += ' ';
+        }
+    }
+
+    filter.title_key = make_title_key(title);
+    return filter;
+}
@@ -0,0 +1,33 @@
+#ifndef ShowFilter_h__
+#define ShowFilter_h__
+
+
+
+// what the library list is narrowed down to, every criterion that is set has to match.
+// The search box text is parsed into one, the status mask comes from the check boxes
+struct ShowFilter
+{
+    CL_String title_key;                // make_title_key of the plain words, matched anywhere in the title key
+    int status_mask;                    // bit n set for status n, 0 for every status
+    std::vector<CL_String> genre_names; // a show needs all of them
+    std::vector<int> genres;            // the IDs of genre_names, filled in by the database
+    int year_min, year_max;             // 0 leaves that end open
+    double rating_min, rating_max;      // negative leaves that end open
+    int type;                           // a SHOW_TYPE, -1 for every type
+    int season;                         // 0 for every season
+
+    ShowFilter();
+
+    // words of the form name:value are criteria, the rest is title text.
+    //   genre:Action      repeatable, quotes keep spaces: genre:"Slice of Life"
+    //   year:1990-1999    year:2005 or an open range like year:2000- and year:-1995
+    //   rating:8-10       the same forms as year, decimals allowed
+    //   type:Film         Anime, Film or TV, ignoring case
+    //   season:2
+    // a criterion with a value that doesn't parse is treated as title text
+    static ShowFilter parse(const CL_String &text);
+};
+
+
+
+#endif // ShowFilter_h__
@@ -0,0 +1,25 @@
+#include <ClanLib/core.h>
+#include "ShowType.h"
+
+
+static const char *type_names[TYPE_COUNT] = { "Anime", "Film", "TV" };
+
+const char *get_show_type_name(SHOW_TYPE type)
+{
+    if(type < 0 || type >= TYPE_COUNT)
+        return type_names[TYPE_ANIME];
+    return type_names[type];
+}
+
+bool parse_show_type(const CL_String &name, SHOW_TYPE &type)
+{
+    for(int i = 0; i < TYPE_COUNT; i++)
+    {
+        if(CL_StringHelp::compare(name, type_names[i], true) == 0)
+        {
+            type = (SHOW_TYPE)i;
+            return true;
+        }
+    }
+    return false;
+}
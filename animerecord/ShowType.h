@@ -0,0 +1,17 @@
+#ifndef ShowType_h__
+#define ShowType_h__
+
+
+
+// what kind of show it is, stored in show.type and the library snapshot as this number
+enum SHOW_TYPE { TYPE_ANIME = 0, TYPE_FILM, TYPE_TV, TYPE_COUNT };
+
+// "Anime", "Film" or "TV"
+const char *get_show_type_name(SHOW_TYPE type);
+
+// the name ignoring ASCII case, false leaves type alone
+bool parse_show_type(const CL_String &name, SHOW_TYPE &type);
+
+
+
+#endif // ShowType_h__
@@ -0,0 +1,232 @@
+#include <ClanLib/core.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "StatementStats.h"
+
+
+LatencyHistogram::LatencyHistogram() : count(0), total(0), max_value(0)
+{
+    std::fill(buckets, buckets + BUCKET_COUNT, 0u);
+}
+
+int LatencyHistogram::get_bucket(unsigned int value)
+{
+    if(value < SUB_BUCKETS)
+        return (int)value;
+
+    int exponent = SUB_BITS;
+    while(exponent < 31 && (value >> (exponent + 1)) != 0)
+        exponent++;
+
+    int sub = (int)((value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+    return SUB_BUCKETS * (exponent - SUB_BITS + 1) + sub;
+}
+
+unsigned int LatencyHistogram::get_bucket_limit(int bucket)
+{
+    if(bucket < SUB_BUCKETS)
+        return (unsigned int)bucket;
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    unsigned int low = (unsigned int)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return low + ((1u << shift) - 1);
+}
+
+void LatencyHistogram::record(unsigned int value)
+{
+    buckets[get_bucket(value)]++;
+    count++;
+    total += value;
+    max_value = cl_max(max_value, value);
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other)
+{
+    for(int i = 0; i < BUCKET_COUNT; i++)
+        buckets[i] += other.buckets[i];
+    count += other.count;
+    total += other.total;
+    max_value = cl_max(max_value, other.max_value);
+}
+
+unsigned int LatencyHistogram::get_percentile(double fraction) const
+{
+    if(count == 0)
+        return 0;
+
+    unsigned long long wanted = (unsigned long long)(fraction * count + 0.5);
+    wanted = cl_max(wanted, 1ull);
+
+    unsigned long long seen = 0;
+    for(int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if(seen >= wanted)
+            return cl_min(get_bucket_limit(i), max_value);
+    }
+    return max_value;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+StatementStats::StatementStats() : slow_threshold(0)
+{
+}
+
+void StatementStats::set_slow_threshold(unsigned int threshold)
+{
+    CL_MutexSection lock(&mutex);
+    slow_threshold = threshold;
+}
+
+unsigned int StatementStats::get_slow_threshold() const
+{
+    CL_MutexSection lock(&mutex);
+    return slow_threshold;
+}
+
+static bool is_word_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '?';
+}
+
+CL_String StatementStats::normalize(const CL_String &statement)
+{
+    CL_String key;
+    key.reserve(statement.length());
+
+    // text between numbers is copied in one piece
+    CL_String::size_type copied = 0;
+    bool quoted = false;
+    for(CL_String::size_type i = 0; i < statement.length(); i++)
+    {
+        char c = statement[i];
+        if(c == '\'')
+            quoted = !quoted;
+
+        // parameter numbers like ?1 and digits inside names stay
+        if(quoted || c < '0' || c > '9' || (i > 0 && is_word_char(statement[i - 1])))
+            continue;
+
+        key.append(statement, copied, i - copied);
+        while(i + 1 < statement.length() && ((statement[i + 1] >= '0' && statement[i + 1] <= '9') || statement[i + 1] == '.'))
+            i++;
+        copied = i + 1;
+
+        // a list of numbers folds into one ?
+        if(key.length() >= 2 && key[key.length() - 1] == ',' && key[key.length() - 2] == '?')
+            key.erase(key.length() - 1);
+        else
+            key += '?';
+    }
+    key.append(statement, copied, CL_String::npos);
+    return key;
+}
+
+bool StatementStats::record(const CL_String &statement, unsigned int duration, int rows, bool failed)
+{
+    CL_String key = normalize(statement);
+
+    CL_MutexSection lock(&mutex);
+    std::map<CL_String, StatementRecord>::iterator it = statements.find(key);
+    if(it == statements.end())
+    {
+        // generated statements that normalize can't fold still have a bound
+        if(statements.size() >= MAX_STATEMENTS)
+            key = "(other statements)";
+        it = statements.insert(std::make_pair(key, StatementRecord())).first;
+        it->second.statement = key;
+    }
+
+    StatementRecord &record = it->second;
+    record.calls++;
+    if(failed)
+        record.failures++;
+    if(rows > 0)
+        record.rows += rows;
+    record.latency.record(duration);
+
+    return slow_threshold > 0 && duration >= slow_threshold;
+}
+
+void StatementStats::add_slow(const SlowStatement &slow)
+{
+    CL_MutexSection lock(&mutex);
+    slow_statements.push_back(slow);
+    while(slow_statements.size() > MAX_SLOW_STATEMENTS)
+        slow_statements.pop_front();
+}
+
+static bool greater_total(const StatementRecord &a, const StatementRecord &b)
+{
+    return a.latency.get_total() > b.latency.get_total();
+}
+
+std::vector<StatementRecord> StatementStats::get_statements() const
+{
+    std::vector<StatementRecord> records;
+    {
+        CL_MutexSection lock(&mutex);
+        records.reserve(statements.size());
+        for(std::map<CL_String, StatementRecord>::const_iterator it = statements.begin(); it != statements.end(); ++it)
+            records.push_back(it->second);
+    }
+    std::sort(records.begin(), records.end(), greater_total);
+    return records;
+}
+
+std::vector<SlowStatement> StatementStats::get_slow_statements() const
+{
+    CL_MutexSection lock(&mutex);
+    return std::vector<SlowStatement>(slow_statements.begin(), slow_statements.end());
+}
+
+void StatementStats::reset()
+{
+    CL_MutexSection lock(&mutex);
+    statements.clear();
+    slow_statements.clear();
+}
+
+// one line per field, tabs and line breaks would break the columns
+static CL_String one_line(const CL_String &text)
+{
+    CL_String line = text;
+    for(CL_String::size_type i = 0; i < line.length(); i++)
+    {
+        if(line[i] == '\t' || line[i] == '\r' || line[i] == '\n')
+            line[i] = ' ';
+    }
+    return line;
+}
+
+static void write_text(CL_IODevice &file, const CL_String &text)
+{
+    if(file.send(text.data(), text.length(), true) != (int)text.length())
+        throw CL_Exception("Unable to write the statement statistics");
+}
+
+void StatementStats::write(CL_IODevice &file) const
+{
+    std::vector<StatementRecord> records = get_statements();
+    std::vector<SlowStatement> slow = get_slow_statements();
+
+    write_text(file, "statement\tcalls\tfailures\trows\ttotal_us\tmean_us\tp50_us\tp90_us\tp99_us\tmax_us\n");
+    for(std::vector<StatementRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
+    {
+        const LatencyHistogram &latency = it->latency;
+        write_text(file, one_line(it->statement) + "\t" +
+            cl_format("%1\t%2\t%3\t", it->calls, it->failures, CL_StringHelp::ull_to_text(it->rows)) +
+            cl_format("%1\t%2\t%3\t", CL_StringHelp::ull_to_text(latency.get_total()), (unsigned int)(latency.get_mean() + 0.5), latency.get_percentile(0.5)) +
+            cl_format("%1\t%2\t%3\n", latency.get_percentile(0.9), latency.get_percentile(0.99), latency.get_max()));
+    }
+
+    write_text(file, "\ntime\tduration_us\trows\tstatement\tparameters\tplan\n");
+    for(std::vector<SlowStatement>::const_iterator it = slow.begin(); it != slow.end(); ++it)
+    {
+        write_text(file, cl_format("%1\t%2\t%3\t", it->time, it->duration, it->rows) +
+            cl_format("%1\t%2\t%3\n", one_line(it->statement), one_line(it->parameters), one_line(it->plan)));
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef StatementStats_h__
+#define StatementStats_h__
+
+
+
+// latency distribution in microseconds with a bounded relative error, the same layout HdrHistogram uses:
+// values below 16 get a bucket each, above that every power of two is split into 16 buckets, so a
+// percentile is off by at most 1/16 of its value whatever the range
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(unsigned int value);
+    void add(const LatencyHistogram &other);
+
+    unsigned int get_count() const { return count; }
+    unsigned long long get_total() const { return total; }
+    unsigned int get_max() const { return max_value; }
+    double get_mean() const { return count > 0 ? (double)total / count : 0.0; }
+
+    // the value at or below which fraction (0-1) of the recorded values lie, rounded up to its bucket
+    unsigned int get_percentile(double fraction) const;
+
+private:
+    enum { SUB_BITS = 4, SUB_BUCKETS = 1 << SUB_BITS, BUCKET_COUNT = SUB_BUCKETS * (33 - SUB_BITS) };
+
+    unsigned int buckets[BUCKET_COUNT];
+    unsigned int count;
+    unsigned long long total;
+    unsigned int max_value;
+
+    static int get_bucket(unsigned int value);
+    static unsigned int get_bucket_limit(int bucket);
+};
+
+// everything run with the same statement text, literal numbers and in lists folded together
+struct StatementRecord
+{
+    CL_String statement;
+    unsigned int calls;
+    unsigned int failures;
+    unsigned long long rows;    // rows read, 0 for statements that don't return any
+    LatencyHistogram latency;   // microseconds from execute until the last row has been read
+
+    StatementRecord() : calls(0), failures(0), rows(0) {}
+};
+
+// one run that took longer than the slow threshold
+struct SlowStatement
+{
+    CL_String time;             // local time it finished
+    CL_String statement;        // the text as run
+    CL_String parameters;       // ?1=value, ?2=value ...
+    CL_String plan;             // the explain query plan steps separated by ;
+    unsigned int duration;      // microseconds
+    int rows;
+
+    SlowStatement() : duration(0), rows(0) {}
+};
+
+// call counts, rows and latency per statement plus a log of the slow runs. One instance is shared by
+// every Database connection in the process, so it locks
+class StatementStats
+{
+public:
+    enum { MAX_STATEMENTS = 1000, MAX_SLOW_STATEMENTS = 200 };
+
+    StatementStats();
+
+    // microseconds, 0 turns the slow log off
+    void set_slow_threshold(unsigned int threshold);
+    unsigned int get_slow_threshold() const;
+
+    // true when the run is over the slow threshold, the caller then fills in a SlowStatement for add_slow
+    bool record(const CL_String &statement, unsigned int duration, int rows, bool failed);
+    void add_slow(const SlowStatement &slow);
+
+    // largest total time first
+    std::vector<StatementRecord> get_statements() const;
+    // oldest first
+    std::vector<SlowStatement> get_slow_statements() const;
+
+    void reset();
+
+    // tab separated, a statement table followed by the slow log, for comparing runs offline
+    void write(CL_IODevice &file) const;
+
+    // the key a statement is counted under: numbers become ? and (?,?,?) becomes (?)
+    static CL_String normalize(const CL_String &statement);
+
+private:
+    mutable CL_Mutex mutex;
+    std::map<CL_String, StatementRecord> statements;
+    std::deque<SlowStatement> slow_statements;
+    unsigned int slow_threshold;
+};
+
+
+
+#endif // StatementStats_h__
@@ -0,0 +1,101 @@
+#include <ClanLib/core.h>
+#include <cmath>
+#include "SyntheticLibrary.h"
+
+
+static const char *syllables[] =
+{
+    "a", "ka", "sa", "ta", "na", "ha", "ma", "ya", "ra", "wa", "i", "ki", "shi", "chi", "ni", "mi", "ri",
+    "u", "ku", "su", "tsu", "nu", "fu", "mu", "yu", "ru", "e", "ke", "se", "te", "ne", "me", "re",
+    "o", "ko", "so", "to", "no", "ho", "mo", "yo", "ro", "ga", "za", "da", "ba", "gi", "ji", "bi",
+    "go", "zo", "do", "bo", "kyo", "sho", "ryu", "n"
+};
+
+static const int syllable_count = sizeof(syllables) / sizeof(syllables[0]);
+
+// spread of the title lengths around the median, log-normal sigma. 0.5 puts about 2% of them over
+// 2.7 times the median
+static const double title_spread = 0.5;
+
+
+SyntheticLibrary::SyntheticLibrary(unsigned int seed) : state(seed != 0 ? seed : 1)
+{
+}
+
+// xorshift32, plenty for made up data and the same on every platform
+int SyntheticLibrary::next_int(int limit)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return limit > 0 ? (int)(state % (unsigned int)limit) : 0;
+}
+
+double SyntheticLibrary::next_double()
+{
+    next_int(0);
+    return (state >> 8) / 16777216.0;
+}
+
+// Box-Muller, one of the two values is thrown away
+double SyntheticLibrary::next_gaussian()
+{
+    double u1 = 1.0 - next_double();
+    double u2 = next_double();
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+CL_String SyntheticLibrary::make_word()
+{
+    CL_String word;
+    int count = 1 + next_int(4);
+    for(int i = 0; i < count; i++)
+        word += syllables[next_int(syllable_count)];
+    return word;
+}
+
+// words until length characters, the last one cut where the length is reached
+CL_String SyntheticLibrary::make_words(int length, bool capitalize)
+{
+    CL_String text;
+    while((int)text.length() < length)
+    {
+        CL_String word = make_word();
+        if(capitalize)
+            word[0] = (char)toupper(word[0]);
+
+        if(text.empty() == false)
+            text += ' ';
+        text += word;
+    }
+
+    text = text.substr(0, cl_max(length, 1));
+    while(text.length() > 1 && text[text.length() - 1] == ' ')
+        text.erase(text.length() - 1);
+    return text;
+}
+
+CL_String SyntheticLibrary::make_title(int median, int max)
+{
+    int length = (int)(cl_max(median, 1) * exp(title_spread * next_gaussian()) + 0.5);
+    length = cl_clamp(length, 1, cl_max(max, 1));
+
+    // a quarter of the longer titles are "name: subtitle"
+    if(length >= 12 && next_int(4) == 0)
+    {
+        int name = 3 + next_int(length / 2 - 3);
+        CL_String title = make_words(name, true) + ": ";
+        return title + make_words(cl_max(length - (int)title.length(), 1), true);
+    }
+    return make_words(length, true);
+}
+
+CL_String SyntheticLibrary::make_comment()
+{
+    if(next_int(2) == 0)
+        return CL_String();
+
+    CL_String comment = make_words(5 + next_int(120), false);
+    comment[0] = (char)toupper(comment[0]);
+    return comment + ".";
+}
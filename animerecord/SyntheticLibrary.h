@@ -0,0 +1,36 @@
+#ifndef SyntheticLibrary_h__
+#define SyntheticLibrary_h__
+
+
+
+// made up titles and comments for filling a benchmark library. The same seed always gives the same
+// sequence, so runs against generated databases of the same settings can be compared
+class SyntheticLibrary
+{
+public:
+    SyntheticLibrary(unsigned int seed);
+
+    // romanized words separated by spaces, some with a ": subtitle". The length in characters is drawn
+    // from a log-normal distribution with the given median and cut at max, so like real titles most are
+    // short and a few are very long
+    CL_String make_title(int median, int max);
+
+    // empty for about half the shows, a few words to a couple of sentences for the rest
+    CL_String make_comment();
+
+    // 0 to limit - 1
+    int next_int(int limit);
+    // 0 to 1, 1 excluded
+    double next_double();
+
+private:
+    unsigned int state;
+
+    double next_gaussian();
+    CL_String make_word();
+    CL_String make_words(int length, bool capitalize);
+};
+
+
+
+#endif // SyntheticLibrary_h__
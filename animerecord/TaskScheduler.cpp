@@ -0,0 +1,304 @@
+#include <ClanLib/core.h>
+#include <deque>
+#include <exception>
+#include <vector>
+#include "Trace.h"
+#include "TaskScheduler.h"
+
+
+CancellationToken::CancellationToken() : flag(new CL_InterlockedVariable)
+{
+    flag->set(0);
+}
+
+void CancellationToken::cancel()
+{
+    flag->set(1);
+}
+
+bool CancellationToken::is_cancelled() const
+{
+    return flag->get() != 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+TaskScheduler::TaskScheduler(int threads)
+{
+    if(threads <= 0)
+        threads = cl_max(CL_System::get_num_cores(), 1);
+
+    next_worker.set(0);
+    stopping.set(0);
+    submitted.set(0);
+    executed.set(0);
+    stolen.set(0);
+    cancelled.set(0);
+    failures.set(0);
+    dispatched.set(0);
+
+    for(int i = 0; i < threads; i++)
+    {
+        CL_SharedPtr<Worker> worker(new Worker);
+        worker->sleeping.set(0);
+        workers.push_back(worker);
+    }
+
+    // every worker exists before the first one starts looking for work to steal
+    for(int i = 0; i < threads; i++)
+        workers[i]->thread.start(this, &TaskScheduler::worker_main, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    shutdown();
+}
+
+CancellationToken TaskScheduler::submit(const CL_SharedPtr<BackgroundTask> &task, TaskPriority priority)
+{
+    CancellationToken token;
+    submit(task, token, priority);
+    return token;
+}
+
+void TaskScheduler::submit(const CL_SharedPtr<BackgroundTask> &task, const CancellationToken &token, TaskPriority priority)
+{
+    if(workers.empty())
+        throw CL_Exception("The task scheduler has been shut down");
+
+    QueuedTask queued;
+    queued.task = task;
+    queued.token = token;
+
+    int target = (int)((unsigned int)next_worker.increment() % workers.size());
+    {
+        CL_MutexSection lock(&workers[target]->mutex);
+        workers[target]->queues[priority].push_back(queued);
+    }
+
+    submitted.increment();
+    wake(target);
+}
+
+// the target always gets a wakeup, if it's busy the first sleeping worker is woken as well so it can steal
+void TaskScheduler::wake(int target)
+{
+    workers[target]->wakeup.set();
+    if(workers[target]->sleeping.get() != 0)
+        return;
+
+    for(std::vector<CL_SharedPtr<Worker> >::size_type i = 0; i < workers.size(); i++)
+    {
+        if(workers[i]->sleeping.get() != 0)
+        {
+            workers[i]->wakeup.set();
+            return;
+        }
+    }
+}
+
+void TaskScheduler::post(const CL_Callback_v0 &callback)
+{
+    Completion completion;
+    completion.callback = callback;
+    push_completion(completion);
+}
+
+void TaskScheduler::shutdown()
+{
+    if(workers.empty())
+        return;
+
+    stopping.set(1);
+    for(std::vector<CL_SharedPtr<Worker> >::iterator it = workers.begin(); it != workers.end(); ++it)
+        (*it)->wakeup.set();
+
+    for(std::vector<CL_SharedPtr<Worker> >::iterator it = workers.begin(); it != workers.end(); ++it)
+    {
+        (*it)->thread.join();
+        for(int priority = 0; priority < PRIORITY_COUNT; priority++)
+        {
+            std::deque<QueuedTask> &queue = (*it)->queues[priority];
+            for(std::deque<QueuedTask>::iterator queued = queue.begin(); queued != queue.end(); ++queued)
+                queued->token.cancel();
+            cancelled.set(cancelled.get() + (int)queue.size());
+            queue.clear();
+        }
+    }
+    workers.clear();
+
+    CL_MutexSection lock(&completion_mutex);
+    completions.clear();
+}
+
+TaskSchedulerCounters TaskScheduler::get_counters() const
+{
+    TaskSchedulerCounters counters;
+    counters.submitted = submitted.get();
+    counters.executed = executed.get();
+    counters.stolen = stolen.get();
+    counters.cancelled = cancelled.get();
+    counters.failed = failures.get();
+    counters.dispatched = dispatched.get();
+    return counters;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TaskScheduler::worker_main(int index)
+{
+    Worker &self = *workers[index];
+    QueuedTask queued;
+
+    while(stopping.get() == 0)
+    {
+        if(take(index, queued))
+        {
+            execute(queued);
+            continue;
+        }
+
+        // announce the sleep first and look once more, a submit in between either shows up
+        // here or sees the flag and sets the event
+        self.sleeping.set(1);
+        if(take(index, queued))
+        {
+            self.sleeping.set(0);
+            execute(queued);
+            continue;
+        }
+
+        // the timeout is only a safety net, submit and shutdown both set the event
+        self.wakeup.wait(250);
+        self.sleeping.set(0);
+    }
+}
+
+// highest priority first: the front of the own queue, otherwise the back of another worker's
+bool TaskScheduler::take(int index, QueuedTask &queued)
+{
+    int count = (int)workers.size();
+    for(int priority = PRIORITY_COUNT - 1; priority >= 0; priority--)
+    {
+        {
+            Worker &self = *workers[index];
+            CL_MutexSection lock(&self.mutex);
+            if(self.queues[priority].empty() == false)
+            {
+                queued = self.queues[priority].front();
+                self.queues[priority].pop_front();
+                return true;
+            }
+        }
+
+        for(int i = 1; i < count; i++)
+        {
+            Worker &victim = *workers[(index + i) % count];
+            CL_MutexSection lock(&victim.mutex);
+            if(victim.queues[priority].empty() == false)
+            {
+                queued = victim.queues[priority].back();
+                victim.queues[priority].pop_back();
+                stolen.increment();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::execute(QueuedTask &queued)
+{
+    Completion completion;
+    completion.task = queued.task;
+    completion.token = queued.token;
+    queued.task = CL_SharedPtr<BackgroundTask>();
+
+    if(completion.token.is_cancelled())
+    {
+        cancelled.increment();
+        return;
+    }
+
+    try
+    {
+        TraceSpan span("tasks", "run");
+        completion.task->run(completion.token);
+    }
+    catch(CL_Exception &e)
+    {
+        completion.failed = true;
+        completion.error = e.message;
+        failures.increment();
+    }
+    catch(std::exception &e)
+    {
+        completion.failed = true;
+        completion.error = e.what();
+        failures.increment();
+    }
+    catch(...)
+    {
+        // nothing may escape a worker thread, that ends the process
+        completion.failed = true;
+        completion.error = "The task failed with an unknown exception";
+        failures.increment();
+    }
+    executed.increment();
+
+    if(completion.token.is_cancelled() == false)
+        push_completion(completion);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TaskScheduler::push_completion(const Completion &completion)
+{
+    {
+        CL_MutexSection lock(&completion_mutex);
+        completions.push_back(completion);
+    }
+    set_wakeup_event();
+}
+
+bool TaskScheduler::pop_completion(Completion &completion)
+{
+    CL_MutexSection lock(&completion_mutex);
+    if(completions.empty())
+        return false;
+
+    completion = completions.front();
+    completions.pop_front();
+    return true;
+}
+
+void TaskScheduler::dispatch_posted()
+{
+    process();
+}
+
+// one completion at a time, so a completion that opens a modal dialog can have the nested
+// message loop run the rest without running any of them twice
+void TaskScheduler::process()
+{
+    Completion completion;
+    while(pop_completion(completion))
+    {
+        TraceSpan span("tasks", "completion");
+        if(completion.callback.is_null() == false)
+        {
+            dispatched.increment();
+            completion.callback.invoke();
+        }
+        else if(completion.token.is_cancelled() == false)
+        {
+            dispatched.increment();
+            if(completion.failed)
+                completion.task->failed(completion.error);
+            else
+                completion.task->completed();
+        }
+
+        completion = Completion();
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef TaskScheduler_h__
+#define TaskScheduler_h__
+
+
+
+enum TaskPriority
+{
+    PRIORITY_LOW = 0,
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH,
+    PRIORITY_COUNT
+};
+
+// shared flag between whoever submitted a task and the task itself. Copies refer to the same flag,
+// so a page keeps one to cancel the work it started
+class CancellationToken
+{
+    CL_SharedPtr<CL_InterlockedVariable> flag;
+
+public:
+    CancellationToken();
+
+    void cancel();
+    bool is_cancelled() const;
+};
+
+// a unit of background work. run happens on a worker thread and must not touch widgets or the
+// GUI's Database, it keeps its input and result in members. completed or failed happen afterwards
+// on the GUI thread, neither is called once the token has been cancelled
+class BackgroundTask
+{
+public:
+    virtual ~BackgroundTask() {}
+
+    virtual void run(const CancellationToken &token) = 0;
+    virtual void completed() {}
+    virtual void failed(const CL_String &error) {}
+};
+
+// forwards completed and failed to callbacks, so a page can handle them in its own methods and
+// read the result out of the task
+class CallbackTask : public BackgroundTask
+{
+    CL_Callback_v0 completed_callback;
+    CL_Callback_v1<const CL_String &> failed_callback;
+
+public:
+    CL_Callback_v0 &func_completed() { return completed_callback; }
+    CL_Callback_v1<const CL_String &> &func_failed() { return failed_callback; }
+
+    void completed()
+    {
+        if(completed_callback.is_null() == false)
+            completed_callback.invoke();
+    }
+
+    void failed(const CL_String &error)
+    {
+        if(failed_callback.is_null() == false)
+            failed_callback.invoke(error);
+    }
+};
+
+struct TaskSchedulerCounters
+{
+    int submitted;  // submit() calls
+    int executed;   // tasks that ran, including the ones that threw
+    int stolen;     // tasks an idle worker took from another worker's queue
+    int cancelled;  // tasks dropped because their token was cancelled before they started
+    int failed;     // tasks whose run threw, whatever it threw
+    int dispatched; // completions and posted callbacks run on the GUI thread
+
+    TaskSchedulerCounters() : submitted(0), executed(0), stolen(0), cancelled(0), failed(0), dispatched(0) {}
+};
+
+// fixed pool of workers, each with its own queue per priority. Submissions are spread round robin,
+// a worker takes the oldest task of the highest priority from its own queue and when that is empty
+// steals the newest one from another worker. Results come back through a keep alive object, so
+// completions run inside CL_GUIManager::exec (and nested message loops like modal dialogs) on the
+// thread that created the scheduler
+class TaskScheduler : public CL_KeepAliveObject
+{
+public:
+    // 0 threads uses one per core
+    TaskScheduler(int threads = 0);
+    ~TaskScheduler();
+
+    CancellationToken submit(const CL_SharedPtr<BackgroundTask> &task, TaskPriority priority = PRIORITY_NORMAL);
+    void submit(const CL_SharedPtr<BackgroundTask> &task, const CancellationToken &token, TaskPriority priority = PRIORITY_NORMAL);
+
+    // runs callback on the GUI thread, callable from any thread
+    void post(const CL_Callback_v0 &callback);
+
+    // runs the waiting completions now, for callers that aren't inside a message loop
+    void dispatch_posted();
+
+    // cancels everything queued and joins the workers, completions that haven't run are dropped
+    void shutdown();
+
+    int get_thread_count() const { return (int)workers.size(); }
+    TaskSchedulerCounters get_counters() const;
+
+private:
+    struct QueuedTask
+    {
+        CL_SharedPtr<BackgroundTask> task;
+        CancellationToken token;
+    };
+
+    struct Worker
+    {
+        CL_Thread thread;
+        CL_Mutex mutex;
+        std::deque<QueuedTask> queues[PRIORITY_COUNT];
+        CL_Event wakeup;
+        CL_InterlockedVariable sleeping;
+    };
+
+    // something for the GUI thread, either a finished task or a posted callback
+    struct Completion
+    {
+        CL_SharedPtr<BackgroundTask> task;
+        CancellationToken token;
+        CL_String error;
+        bool failed;
+        CL_Callback_v0 callback;
+
+        Completion() : failed(false) {}
+    };
+
+    std::vector<CL_SharedPtr<Worker> > workers;
+    CL_InterlockedVariable next_worker;
+    CL_InterlockedVariable stopping;
+
+    CL_Mutex completion_mutex;
+    std::deque<Completion> completions;
+
+    CL_InterlockedVariable submitted, executed, stolen, cancelled, failures, dispatched;
+
+    void worker_main(int index);
+    bool take(int index, QueuedTask &queued);
+    void execute(QueuedTask &queued);
+    void wake(int target);
+    void push_completion(const Completion &completion);
+    bool pop_completion(Completion &completion);
+
+    void process();
+};
+
+
+
+#endif // TaskScheduler_h__
@@ -0,0 +1,360 @@
+#include <ClanLib/core.h>
+#include "TitleKey.h"
+
+
+// plain lower case spelling of U+00C0 - U+017F
+static const char *latin_folding[] =
+{
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",  // U+00C0
+    "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "ss",  // U+00D0
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",  // U+00E0
+    "d", "n", "o", "o", "o", "o", "o", "", "o", "u", "u", "u", "u", "y", "th", "y",  // U+00F0
+    "a", "a", "a", "a", "a", "a", "c", "c", "c", "c", "c", "c", "c", "c", "d", "d",  // U+0100
+    "d", "d", "e", "e", "e", "e", "e", "e", "e", "e", "e", "e", "g", "g", "g", "g",  // U+0110
+    "g", "g", "g", "g", "h", "h", "h", "h", "i", "i", "i", "i", "i", "i", "i", "i",  // U+0120
+    "i", "i", "ij", "ij", "j", "j", "k", "k", "k", "l", "l", "l", "l", "l", "l", "l",  // U+0130
+    "l", "l", "l", "n", "n", "n", "n", "n", "n", "n", "n", "n", "o", "o", "o", "o",  // U+0140
+    "o", "o", "oe", "oe", "r", "r", "r", "r", "r", "r", "s", "s", "s", "s", "s", "s",  // U+0150
+    "s", "s", "t", "t", "t", "t", "t", "t", "u", "u", "u", "u", "u", "u", "u", "u",  // U+0160
+    "u", "u", "u", "u", "w", "w", "y", "y", "y", "z", "z", "z", "z", "z", "z", "s",   // U+0170
+};
+
+// full-width katakana for the half-width forms U+FF66 - U+FF9D
+static const unsigned short halfwidth_katakana[] =
+{
+    0x30f2, 0x30a1, 0x30a3, 0x30a5, 0x30a7, 0x30a9, 0x30e3, 0x30e5, 0x30e7, 0x30c3, 0x30fc, 0x30a2,
+    0x30a4, 0x30a6, 0x30a8, 0x30aa, 0x30ab, 0x30ad, 0x30af, 0x30b1, 0x30b3, 0x30b5, 0x30b7, 0x30b9,
+    0x30bb, 0x30bd, 0x30bf, 0x30c1, 0x30c4, 0x30c6, 0x30c8, 0x30ca, 0x30cb, 0x30cc, 0x30cd, 0x30ce,
+    0x30cf, 0x30d2, 0x30d5, 0x30d8, 0x30db, 0x30de, 0x30df, 0x30e0, 0x30e1, 0x30e2, 0x30e4, 0x30e6,
+    0x30e8, 0x30e9, 0x30ea, 0x30eb, 0x30ec, 0x30ed, 0x30ef, 0x30f3,
+};
+
+// invalid sequences are read as latin-1, one byte at a time
+static unsigned int decode_utf8(const CL_String &text, CL_String::size_type &pos)
+{
+    unsigned char lead = text[pos++];
+    int length = 0;
+    unsigned int code = lead;
+    if(lead >= 0xf0 && lead < 0xf8) { length = 3; code = lead & 0x07; }
+    else if(lead >= 0xe0) { length = 2; code = lead & 0x0f; }
+    else if(lead >= 0xc0) { length = 1; code = lead & 0x1f; }
+
+    if(lead < 0xc0 || lead >= 0xf8 || pos + length > text.length())
+        return lead;
+
+    for(int i = 0; i < length; i++)
+    {
+        unsigned char ch = text[pos + i];
+        if((ch & 0xc0) != 0x80)
+            return lead;
+        code = (code << 6) | (ch & 0x3f);
+    }
+    pos += length;
+    return code;
+}
+
+static void encode_utf8(unsigned int code, CL_String &utf8)
+{
+    if(code < 0x80)
+    {
+        utf8 += (char)code;
+    }
+    else if(code < 0x800)
+    {
+        utf8 += (char)(0xc0 | (code >> 6));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+    else if(code < 0x10000)
+    {
+        utf8 += (char)(0xe0 | (code >> 12));
+        utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+    else
+    {
+        utf8 += (char)(0xf0 | (code >> 18));
+        utf8 += (char)(0x80 | ((code >> 12) & 0x3f));
+        utf8 += (char)(0x80 | ((code >> 6) & 0x3f));
+        utf8 += (char)(0x80 | (code & 0x3f));
+    }
+}
+
+// the combined form of a katakana and a (semi-)voiced sound mark, 0 if there is none
+static unsigned int compose_katakana(unsigned int base, unsigned int mark)
+{
+    bool voiced = mark == 0x3099;
+    if(voiced && base == 0x30a6)
+        return 0x30f4;
+    if(voiced && ((base >= 0x30ab && base <= 0x30c1 && (base & 1)) || base == 0x30c4 || base == 0x30c6 || base == 0x30c8))
+        return base + 1;
+    if(base >= 0x30cf && base <= 0x30db && (base - 0x30cf) % 3 == 0)
+        return base + (voiced ? 1 : 2);
+    return 0;
+}
+
+static bool is_removed(unsigned int code)
+{
+    if(code < 0x80)
+        return !((code >= 'a' && code <= 'z') || (code >= '0' && code <= '9'));
+
+    return (code >= 0x80 && code <= 0xbf) ||        // latin-1 controls, punctuation and symbols
+           code == 0xd7 || code == 0xf7 ||
+           (code >= 0x300 && code <= 0x36f) ||      // combining accents
+           (code >= 0x2000 && code <= 0x2bff) ||    // general punctuation, arrows, symbols, dingbats
+           (code >= 0x3000 && code <= 0x3003) ||    // ideographic space and punctuation
+           (code >= 0x3008 && code <= 0x301f) ||    // cjk brackets
+           code == 0x30fb ||                        // katakana middle dot
+           (code >= 0xfe30 && code <= 0xfe4f);      // cjk compatibility forms
+}
+
+CL_String make_title_key(const CL_String &title)
+{
+    std::vector<unsigned int> codes;
+    codes.reserve(title.length());
+
+    CL_String::size_type pos = 0;
+    while(pos < title.length())
+    {
+        unsigned int code = decode_utf8(title, pos);
+
+        // full-width ascii and half-width katakana
+        if(code >= 0xff01 && code <= 0xff5e)
+            code -= 0xfee0;
+        else if(code >= 0xff66 && code <= 0xff9d)
+            code = halfwidth_katakana[code - 0xff66];
+        else if(code == 0xff9e || code == 0xff9f)
+            code = code == 0xff9e ? 0x3099 : 0x309a;
+        else if(code == 0x309b || code == 0x309c)
+            code = code == 0x309b ? 0x3099 : 0x309a;
+
+        // case folding for latin, greek and cyrillic
+        if(code >= 'A' && code <= 'Z')
+            code += 'a' - 'A';
+        else if(code >= 0x391 && code <= 0x3a9 && code != 0x3a2)
+            code += 0x20;
+        else if(code >= 0x410 && code <= 0x42f)
+            code += 0x20;
+        else if(code >= 0x400 && code <= 0x40f)
+            code += 0x50;
+
+        // voiced sound marks join the preceding katakana, or hiragana which sits 0x60 below it
+        if((code == 0x3099 || code == 0x309a) && codes.empty() == false)
+        {
+            unsigned int base = codes.back();
+            bool hiragana = base >= 0x3041 && base <= 0x3096;
+            unsigned int composed = compose_katakana(hiragana ? base + 0x60 : base, code);
+            if(composed != 0)
+                codes.back() = hiragana ? composed - 0x60 : composed;
+            continue;
+        }
+
+        if(code >= 0xc0 && code <= 0x17f)
+        {
+            for(const char *ch = latin_folding[code - 0xc0]; *ch; ++ch)
+                codes.push_back(*ch);
+            continue;
+        }
+
+        if(is_removed(code) == false)
+            codes.push_back(code);
+    }
+
+    CL_String key;
+    key.reserve(codes.size());
+    for(std::vector<unsigned int>::const_iterator it = codes.begin(); it != codes.end(); ++it)
+        encode_utf8(*it, key);
+    return key;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// splits a precomposed voiced kana into its base and the secondary weight of the mark
+static unsigned int decompose_kana(unsigned int katakana, unsigned char &secondary)
+{
+    if(katakana == 0x30f4)
+    {
+        secondary = 2;
+        return 0x30a6;
+    }
+    if(compose_katakana(katakana - 1, 0x3099) == katakana)
+    {
+        secondary = 2;
+        return katakana - 1;
+    }
+    if(compose_katakana(katakana - 2, 0x309a) == katakana)
+    {
+        secondary = 3;
+        return katakana - 2;
+    }
+    return katakana;
+}
+
+static bool is_latin_upper(unsigned int code)
+{
+    if(code >= 0xc0 && code <= 0xde)
+        return code != 0xd7;
+    if((code >= 0x100 && code <= 0x137) || (code >= 0x14a && code <= 0x177))
+        return (code & 1) == 0;
+    if((code >= 0x139 && code <= 0x148) || (code >= 0x179 && code <= 0x17e))
+        return (code & 1) == 1;
+    return code == 0x178;
+}
+
+// primary weight of a folded character, 0 for ignorable characters. Every weight is at least 0x100
+// so the high byte of a weight is never the level separator
+static unsigned short get_primary_weight(unsigned int code)
+{
+    if(code >= '0' && code <= '9')
+        return 0x0100 + (code - '0');
+    if(code >= 'a' && code <= 'z')
+        return 0x0200 + (code - 'a');
+    if(code < 0x80 || is_removed(code))
+        return 0;
+    if(code >= 0x3b1 && code <= 0x3c9)
+        return 0x0300 + (code == 0x3c2 ? 0x3c3 : code) - 0x3b1;
+    if(code >= 0x430 && code <= 0x44f)
+        return 0x0400 + (code - 0x430) * 2;
+    if(code == 0x451)
+        return 0x0400 + (0x435 - 0x430) * 2 + 1;
+    if(code >= 0x450 && code <= 0x45f)
+        return 0x0440 + (code - 0x450);
+    if(code >= 0x30a1 && code <= 0x30fc)
+        return 0x0800 + (code - 0x30a1);
+    if(code < 0x2400)
+        return 0x1000 + code;
+    if(code < 0x3400)
+        return 0x33ff;
+    if(code <= 0xffff)
+        return code;
+    return 0xffff;
+}
+
+// packs the bytes 6 bits at a time into '0'...'o', which keeps the byte order of the keys
+static CL_String pack_key(const std::vector<unsigned char> &bytes)
+{
+    CL_String key;
+    key.reserve((bytes.size() * 4 + 2) / 3);
+
+    unsigned int bits = 0;
+    int count = 0;
+    for(std::vector<unsigned char>::const_iterator it = bytes.begin(); it != bytes.end(); ++it)
+    {
+        bits = (bits << 8) | *it;
+        count += 8;
+        while(count >= 6)
+        {
+            count -= 6;
+            key += (char)('0' + ((bits >> count) & 0x3f));
+        }
+    }
+    if(count > 0)
+        key += (char)('0' + ((bits << (6 - count)) & 0x3f));
+    return key;
+}
+
+CL_String make_sort_key(const CL_String &title)
+{
+    std::vector<unsigned short> primary;
+    std::vector<unsigned char> secondary;   // 1 = no accent
+    std::vector<unsigned char> tertiary;    // 1 = lower case, hiragana, normal width
+    primary.reserve(title.length());
+    secondary.reserve(title.length());
+    tertiary.reserve(title.length());
+
+    CL_String::size_type pos = 0;
+    while(pos < title.length())
+    {
+        unsigned int code = decode_utf8(title, pos);
+        unsigned char variant = 1;
+        unsigned char accent = 1;
+
+        if(code >= 0xff01 && code <= 0xff5e)
+        {
+            code -= 0xfee0;
+            variant += 4;
+        }
+        else if(code >= 0xff66 && code <= 0xff9d)
+        {
+            code = halfwidth_katakana[code - 0xff66];
+            variant += 4;
+        }
+        else if(code == 0xff9e || code == 0x309b)
+            code = 0x3099;
+        else if(code == 0xff9f || code == 0x309c)
+            code = 0x309a;
+
+        // marks change the accent of the character in front of them
+        if(code == 0x3099 || code == 0x309a || (code >= 0x300 && code <= 0x36f))
+        {
+            if(secondary.empty() == false)
+                secondary.back() = code == 0x3099 ? 2 : (code == 0x309a ? 3 : 4 + (code - 0x300));
+            continue;
+        }
+
+        if((code >= 'A' && code <= 'Z') || (code >= 0x391 && code <= 0x3a9) || (code >= 0x410 && code <= 0x42f))
+        {
+            code += 0x20;
+            variant += 1;
+        }
+        else if(code >= 0x400 && code <= 0x40f)
+        {
+            code += 0x50;
+            variant += 1;
+        }
+
+        if(code >= 0x3041 && code <= 0x3096)
+        {
+            code += 0x60;
+        }
+        else if(code >= 0x30a1 && code <= 0x30f6)
+        {
+            variant += 2;
+        }
+
+        if(code >= 0x30a1 && code <= 0x30f6)
+            code = decompose_kana(code, accent);
+
+        if(code >= 0xc0 && code <= 0x17f)
+        {
+            accent = code >= 0x100 ? 0x80 + ((code - 0x100) >> 1) : 0x40 + (code & 0x1f);
+            if(is_latin_upper(code))
+                variant += 1;
+
+            for(const char *ch = latin_folding[code - 0xc0]; *ch; ++ch)
+            {
+                primary.push_back(get_primary_weight(*ch));
+                secondary.push_back(accent);
+                tertiary.push_back(variant);
+            }
+            continue;
+        }
+
+        unsigned short weight = get_primary_weight(code);
+        if(weight == 0)
+            continue;
+
+        primary.push_back(weight);
+        secondary.push_back(accent);
+        tertiary.push_back(variant);
+    }
+
+    // trailing default weights are dropped, they are the lowest value so the order stays the same
+    while(secondary.empty() == false && secondary.back() == 1)
+        secondary.pop_back();
+    while(tertiary.empty() == false && tertiary.back() == 1)
+        tertiary.pop_back();
+
+    std::vector<unsigned char> bytes;
+    bytes.reserve(primary.size() * 4 + 2);
+    for(std::vector<unsigned short>::const_iterator it = primary.begin(); it != primary.end(); ++it)
+    {
+        bytes.push_back(*it >> 8);
+        bytes.push_back(*it & 0xff);
+    }
+    bytes.push_back(0);
+    bytes.insert(bytes.end(), secondary.begin(), secondary.end());
+    bytes.push_back(0);
+    bytes.insert(bytes.end(), tertiary.begin(), tertiary.end());
+
+    return pack_key(bytes);
+}
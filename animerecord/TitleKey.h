@@ -0,0 +1,20 @@
+#ifndef TitleKey_h__
+#define TitleKey_h__
+
+
+
+// normalized form of a show title used for duplicate detection: case folded, accents, full-width and
+// half-width forms folded to their plain form, punctuation, symbols and whitespace removed.
+// "Lucky☆Star", "LUCKY STAR" and "ｌｕｃｋｙ　ｓｔａｒ" all give "luckystar"
+CL_String make_title_key(const CL_String &title);
+
+// collation key for ordering titles, comparing two keys byte by byte gives the same order as comparing
+// the titles by letter, then accents and voiced marks, then case, kana type and width. Punctuation and
+// whitespace are ignored, digits sort before latin, greek, cyrillic, kana and then ideographs.
+// The key only uses the characters '0' to 'o' so it can be stored in a text column and used with
+// the default BINARY collation and its index
+CL_String make_sort_key(const CL_String &title);
+
+
+
+#endif // TitleKey_h__
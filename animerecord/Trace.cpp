@@ -0,0 +1,195 @@
+#include <ClanLib/core.h>
+#include <vector>
+#include "Trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+
+volatile bool Trace::enabled = false;
+Trace::Slot *Trace::slots = 0;
+unsigned int Trace::mask = 0;
+CL_InterlockedVariable Trace::next;
+
+volatile bool Trace::tracking = false;
+unsigned int Trace::tracked_thread = 0;
+Trace::Activity Trace::activities[MAX_ACTIVITY_DEPTH];
+CL_InterlockedVariable Trace::activity_depth;
+
+static unsigned int get_thread_id()
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return (unsigned int)(size_t)pthread_self();
+#endif
+}
+
+void Trace::enable(int capacity)
+{
+    // the buffer is never freed, a span that started before disable may still write to it
+    if(slots == 0)
+    {
+        unsigned int size = 1;
+        while(size < (unsigned int)cl_max(capacity, 1))
+            size *= 2;
+
+        slots = new Slot[size];
+        for(unsigned int i = 0; i < size; i++)
+            slots[i].sequence.set(0);
+        mask = size - 1;
+        next.set(0);
+    }
+    enabled = true;
+}
+
+void Trace::disable()
+{
+    enabled = false;
+}
+
+void Trace::record(const char *category, const char *name, unsigned long long start, unsigned long long end)
+{
+    if(slots == 0)
+        return;
+
+    // each writer owns the slot it got from next until it publishes the sequence
+    unsigned int position = (unsigned int)next.increment() - 1;
+    Slot &slot = slots[position & mask];
+    slot.sequence.set(0);
+    slot.event.category = category;
+    slot.event.name = name;
+    slot.event.start = start;
+    slot.event.duration = (unsigned int)(end - start);
+    slot.event.thread_id = get_thread_id();
+    slot.sequence.set((int)(position + 1));
+}
+
+void Trace::track_thread()
+{
+    tracked_thread = get_thread_id();
+    activity_depth.set(0);
+    tracking = true;
+}
+
+void Trace::stop_tracking()
+{
+    tracking = false;
+}
+
+bool Trace::push_activity(const char *category, const char *name)
+{
+    if(get_thread_id() != tracked_thread)
+        return false;
+
+    // the entry is complete before the depth makes it visible
+    int depth = activity_depth.get();
+    if(depth < MAX_ACTIVITY_DEPTH)
+    {
+        activities[depth].category = category;
+        activities[depth].name = name;
+        activities[depth].start = CL_System::get_microseconds();
+    }
+    activity_depth.set(depth + 1);
+    return true;
+}
+
+void Trace::pop_activity()
+{
+    activity_depth.set(activity_depth.get() - 1);
+}
+
+// the tracked thread may move on meanwhile, the answer is what it was doing a moment ago
+bool Trace::get_activity(const char *&category, const char *&name, unsigned long long &start)
+{
+    int depth = cl_min(activity_depth.get(), (int)MAX_ACTIVITY_DEPTH);
+    if(tracking == false || depth <= 0)
+        return false;
+
+    category = activities[depth - 1].category;
+    name = activities[depth - 1].name;
+    start = activities[depth - 1].start;
+    return true;
+}
+
+std::vector<TraceEvent> Trace::get_events()
+{
+    std::vector<TraceEvent> events;
+    if(slots == 0)
+        return events;
+
+    unsigned int end = (unsigned int)next.get();
+    unsigned int size = mask + 1;
+    unsigned int begin = end > size ? end - size : 0;
+    events.reserve(end - begin);
+
+    for(unsigned int position = begin; position != end; position++)
+    {
+        Slot &slot = slots[position & mask];
+        if((unsigned int)slot.sequence.get() != position + 1)
+            continue;
+
+        TraceEvent event = slot.event;
+        if((unsigned int)slot.sequence.get() == position + 1)
+            events.push_back(event);
+    }
+    return events;
+}
+
+unsigned int Trace::get_recorded_count()
+{
+    return slots == 0 ? 0 : (unsigned int)next.get();
+}
+
+static void append_json_string(CL_String &buffer, const char *text)
+{
+    buffer += '"';
+    for(; *text; text++)
+    {
+        if(*text == '"' || *text == '\\')
+            buffer += '\\';
+        if((unsigned char)*text >= 0x20)
+            buffer += *text;
+    }
+    buffer += '"';
+}
+
+static void write_buffer(CL_IODevice &file, const CL_String &buffer)
+{
+    if(file.send(buffer.data(), buffer.length(), true) != (int)buffer.length())
+        throw CL_Exception("Unable to write the trace");
+}
+
+void Trace::write_json(CL_IODevice &file)
+{
+    std::vector<TraceEvent> events = get_events();
+
+    unsigned long long origin = 0;
+    for(std::vector<TraceEvent>::const_iterator it = events.begin(); it != events.end(); ++it)
+    {
+        if(origin == 0 || it->start < origin)
+            origin = it->start;
+    }
+
+    CL_String buffer = "{\"traceEvents\":[\n";
+    for(std::vector<TraceEvent>::const_iterator it = events.begin(); it != events.end(); ++it)
+    {
+        buffer += "{\"name\":";
+        append_json_string(buffer, it->name);
+        buffer += ",\"cat\":";
+        append_json_string(buffer, it->category);
+        buffer += cl_format(",\"ph\":\"X\",\"ts\":%1,\"dur\":%2,\"pid\":1,\"tid\":%3}", CL_StringHelp::ull_to_text(it->start - origin), it->duration, it->thread_id);
+        buffer += it + 1 == events.end() ? "\n" : ",\n";
+
+        if(buffer.length() > 64 * 1024)
+        {
+            write_buffer(file, buffer);
+            buffer.clear();
+        }
+    }
+    buffer += "],\"displayTimeUnit\":\"ms\"}\n";
+    write_buffer(file, buffer);
+}
@@ -0,0 +1,111 @@
+#ifndef Trace_h__
+#define Trace_h__
+
+
+
+// a finished span as it sits in the ring buffer. Name and category are not copied, they have to be
+// string literals or live as long as the trace
+struct TraceEvent
+{
+    const char *category;
+    const char *name;
+    unsigned long long start;   // CL_System::get_microseconds
+    unsigned int duration;      // microseconds
+    unsigned int thread_id;
+};
+
+// process wide record of where the time went, written as Chrome trace events (chrome://tracing or
+// ui.perfetto.dev). Spans from any thread go into a fixed ring buffer without a lock, once it is full
+// the oldest events are overwritten. Off until enable is called, a span then only tests two flags
+class Trace
+{
+public:
+    // the capacity is rounded up to a power of two, enabling again keeps the existing buffer
+    static void enable(int capacity = 1 << 16);
+    static void disable();
+    static bool is_enabled() { return enabled; }
+
+    static void record(const char *category, const char *name, unsigned long long start, unsigned long long end);
+
+    // every event still in the buffer, oldest first. Events a thread is writing right now are skipped
+    static std::vector<TraceEvent> get_events();
+
+    // {"traceEvents":[...]} with complete ("X") events, times relative to the oldest one
+    static void write_json(CL_IODevice &file);
+
+    // spans recorded since the start, including the overwritten ones
+    static unsigned int get_recorded_count();
+
+    // keeps a stack of the spans open on the calling thread, whether tracing is on or not, so another
+    // thread can tell what it is busy with. One thread at a time
+    static void track_thread();
+    static void stop_tracking();
+    static bool is_tracking() { return tracking; }
+
+    // the innermost open span of the tracked thread and when it started, false when none is open
+    static bool get_activity(const char *&category, const char *&name, unsigned long long &start);
+
+    // for TraceSpan, push returns false on threads that aren't tracked
+    static bool push_activity(const char *category, const char *name);
+    static void pop_activity();
+
+private:
+    struct Slot
+    {
+        CL_InterlockedVariable sequence;   // 0 while the event is written, otherwise its position + 1
+        TraceEvent event;
+    };
+
+    static volatile bool enabled;
+    static Slot *slots;
+    static unsigned int mask;
+    static CL_InterlockedVariable next;
+
+    struct Activity
+    {
+        const char *category;
+        const char *name;
+        unsigned long long start;
+    };
+
+    // only the tracked thread writes, spans nested deeper than the array are counted but not kept
+    enum { MAX_ACTIVITY_DEPTH = 32 };
+    static volatile bool tracking;
+    static unsigned int tracked_thread;
+    static Activity activities[MAX_ACTIVITY_DEPTH];
+    static CL_InterlockedVariable activity_depth;
+};
+
+// times the enclosing scope: TraceSpan span("database", "find_show");
+class TraceSpan
+{
+public:
+    TraceSpan(const char *category, const char *name) : category(category), name(name), start(0), tracked(false)
+    {
+        if(Trace::is_enabled())
+            start = CL_System::get_microseconds();
+        if(Trace::is_tracking())
+            tracked = Trace::push_activity(category, name);
+    }
+
+    ~TraceSpan()
+    {
+        if(tracked)
+            Trace::pop_activity();
+        if(start != 0)
+            Trace::record(category, name, start, CL_System::get_microseconds());
+    }
+
+private:
+    const char *category;
+    const char *name;
+    unsigned long long start;
+    bool tracked;
+
+    TraceSpan(const TraceSpan &);
+    TraceSpan &operator =(const TraceSpan &);
+};
+
+
+
+#endif // Trace_h__
@@ -0,0 +1,112 @@
+#include <ClanLib/core.h>
+#include <deque>
+#include <vector>
+#include "Trace.h"
+#include "Watchdog.h"
+
+
+Watchdog::Watchdog(unsigned int threshold) : threshold(cl_max(threshold, 4u)), ping_pending(false), ping_time(0), stall_reported(false)
+{
+    stopping.set(0);
+    Trace::track_thread();
+    thread.start(this, &Watchdog::worker_main);
+}
+
+Watchdog::~Watchdog()
+{
+    stop();
+}
+
+void Watchdog::stop()
+{
+    if(stopping.get() != 0)
+        return;
+
+    stopping.set(1);
+    wakeup.set();
+    thread.join();
+    Trace::stop_tracking();
+}
+
+std::vector<StallEvent> Watchdog::get_stalls() const
+{
+    CL_MutexSection lock(&mutex);
+    return std::vector<StallEvent>(stalls.begin(), stalls.end());
+}
+
+// "category/name for n ms", names are string literals so reading them from here is safe
+CL_String Watchdog::get_activity()
+{
+    const char *category, *name;
+    unsigned long long start;
+    if(Trace::get_activity(category, name, start) == false)
+        return CL_String();
+
+    unsigned long long now = CL_System::get_microseconds();
+    unsigned int elapsed = now > start ? (unsigned int)((now - start) / 1000) : 0;
+    return cl_format("%1/%2 for %3 ms", category, name, elapsed);
+}
+
+void Watchdog::worker_main()
+{
+    unsigned int interval = cl_max(threshold / 4, 1u);
+
+    while(stopping.get() == 0)
+    {
+        wakeup.wait(interval);
+        if(stopping.get() != 0)
+            break;
+
+        unsigned int now = CL_System::get_time();
+        CL_MutexSection lock(&mutex);
+
+        if(ping_pending == false)
+        {
+            ping_pending = true;
+            ping_time = now;
+            stall_reported = false;
+            stall_activity.clear();
+            lock.unlock();
+            set_wakeup_event();
+            continue;
+        }
+
+        // remembered on every tick, a stall shorter than threshold + interval is over before it is reported
+        CL_String activity = get_activity();
+        if(activity.empty() == false || stall_activity.empty())
+            stall_activity = activity;
+
+        if(stall_reported == false && now - ping_time >= threshold)
+        {
+            stall_reported = true;
+            stall_time = CL_DateTime::get_current_local_time().to_short_datetime_string();
+            cl_log_event("stall", "the GUI thread hasn't run for %1 ms, it is in %2", now - ping_time,
+                         stall_activity.empty() ? CL_String("no traced operation") : stall_activity);
+        }
+    }
+}
+
+// on the GUI thread, the loop is running again
+void Watchdog::process()
+{
+    unsigned int now = CL_System::get_time();
+    CL_MutexSection lock(&mutex);
+    if(ping_pending == false)
+        return;
+
+    ping_pending = false;
+    unsigned int duration = now - ping_time;
+    if(duration < threshold)
+        return;
+
+    StallEvent stall;
+    stall.time = stall_reported ? stall_time : CL_DateTime::get_current_local_time().to_short_datetime_string();
+    stall.duration = duration;
+    stall.activity = stall_activity;
+    stalls.push_back(stall);
+    while(stalls.size() > MAX_STALLS)
+        stalls.pop_front();
+
+    cl_log_event("stall", "the GUI thread didn't run for %1 ms, it was in %2", duration,
+                 stall.activity.empty() ? CL_String("no traced operation") : stall.activity);
+}
@@ -0,0 +1,58 @@
+#ifndef Watchdog_h__
+#define Watchdog_h__
+
+
+
+// one time the GUI thread's message loop didn't run for longer than the threshold
+struct StallEvent
+{
+    CL_String time;         // local time it was noticed
+    unsigned int duration;  // ms until the loop ran again, to within threshold / 4
+    CL_String activity;     // the innermost span open on the GUI thread at the time, empty if there was none
+};
+
+// notices when the message loop of the thread that created it stops running. A thread of its own pings
+// a keep alive object every threshold / 4 ms, a ping that takes longer than threshold to be answered is a
+// stall. It is logged once when noticed and again with its length when the loop is back, both times with
+// the TraceSpan that was open on the GUI thread, so freezes in database, network or list code can be
+// told apart after the fact
+class Watchdog : public CL_KeepAliveObject
+{
+public:
+    enum { MAX_STALLS = 100 };
+
+    // ms
+    Watchdog(unsigned int threshold);
+    ~Watchdog();
+
+    void stop();
+
+    unsigned int get_threshold() const { return threshold; }
+
+    // the finished stalls, oldest first
+    std::vector<StallEvent> get_stalls() const;
+
+private:
+    unsigned int threshold;
+
+    CL_Thread thread;
+    CL_Event wakeup;
+    CL_InterlockedVariable stopping;
+
+    mutable CL_Mutex mutex;
+    bool ping_pending;
+    unsigned int ping_time;     // CL_System::get_time when the pending ping was sent
+    bool stall_reported;
+    CL_String stall_activity;   // what the GUI thread was doing while the ping was pending
+    CL_String stall_time;
+    std::deque<StallEvent> stalls;
+
+    void worker_main();
+    void process();
+
+    static CL_String get_activity();
+};
+
+
+
+#endif // Watchdog_h__
@@ -8,9 +8,33 @@
 #include <algorithm>
 #include <numeric>
 #include <map>
+#include <deque>
+#include <set>
+#include <unordered_set>
+#include <unordered_map>
 #include <iterator>
+#include <climits>
+#include <stdexcept>
+#include <zlib.h>
 
 #include "MessageDialog.h"
+#include "MockHTTPServer.h"
+#include "MALExportReader.h"
+#include "TitleKey.h"
+#include "DuplicateFinder.h"
+#include "Recommender.h"
+#include "ShowExportWriter.h"
+#include "ShowType.h"
+#include "ShowFilter.h"
+#include "LibrarySnapshot.h"
+#include "TaskScheduler.h"
+#include "ResultArena.h"
+#include "Trace.h"
+#include "StatementStats.h"
+#include "Watchdog.h"
+#include "MemoryStats.h"
+#include "SyntheticLibrary.h"
+#include "BenchmarkReport.h"
 
 //#define ENABLE_CONSOLE
 
@@ -80,68 +104,180 @@ T join(
     return t;
 }
 
+// FNV-1a, for using CL_String as a hash container key
+struct StringHash
+{
+    size_t operator()(const CL_String &str) const
+    {
+        unsigned int hash = 2166136261u;
+        for(CL_String::size_type i = 0; i < str.length(); i++)
+            hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+        return hash;
+    }
+};
+
+
+// a command that keeps its text and, while the slow statement log is on, its parameters, so Database can
+// count it under its statement and log what a slow run was given
+class SqlCommand
+{
+public:
+    SqlCommand() {}
+    SqlCommand(CL_DBConnection &db, const CL_StringRef &text, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+        : command(db.create_command(text, type)), text(text) {}
+
+    void set_input_parameter(int index, const CL_StringRef &value)
+    {
+        command.set_input_parameter_string(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, "'" + CL_String(value) + "'");
+    }
+
+    void set_input_parameter(int index, const char *value)
+    {
+        set_input_parameter(index, CL_StringRef(value));
+    }
+
+    void set_input_parameter(int index, bool value)
+    {
+        command.set_input_parameter_bool(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, value ? "true" : "false");
+    }
+
+    void set_input_parameter(int index, int value)
+    {
+        command.set_input_parameter_int(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, CL_StringHelp::int_to_text(value));
+    }
+
+    void set_input_parameter(int index, double value)
+    {
+        command.set_input_parameter_double(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, CL_StringHelp::double_to_text(value));
+    }
+
+    void set_input_parameter(int index, const CL_DateTime &value)
+    {
+        command.set_input_parameter_datetime(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, value.is_null() ? CL_String("null") : value.to_short_datetime_string());
+    }
+
+    void set_input_parameter(int index, const CL_DataBuffer &value)
+    {
+        command.set_input_parameter_binary(index, value);
+        if(keep_parameters)
+            set_parameter_text(index, cl_format("<%1 bytes>", value.get_size()));
+    }
+
+    int get_output_last_insert_rowid()
+    {
+        return command.get_output_last_insert_rowid();
+    }
+
+    CL_DBCommand &get_command() { return command; }
+    const CL_String &get_text() const { return text; }
+
+    // ?1=value, ?2=value ..., empty unless parameters are kept
+    CL_String get_parameters() const
+    {
+        CL_String list;
+        for(std::vector<CL_String>::size_type i = 0; i < parameters.size(); i++)
+        {
+            if(parameters[i].empty())
+                continue;
+            if(list.empty() == false)
+                list += ", ";
+            list += cl_format("?%1=%2", (int)i + 1, parameters[i]);
+        }
+        return list;
+    }
+
+    // copying the values costs an allocation each for every statement run, not just the slow ones, so
+    // it is only on while the slow statement log is, which is off unless asked for
+    static bool keep_parameters;
+
+private:
+    CL_DBCommand command;
+    CL_String text;
+    std::vector<CL_String> parameters;
+
+    void set_parameter_text(int index, const CL_String &value)
+    {
+        if(index < 1)
+            return;
+        if((int)parameters.size() < index)
+            parameters.resize(index);
+        parameters[index - 1] = value;
+    }
+};
+
+bool SqlCommand::keep_parameters = false;
 
 class DBArg
 {
 public:
-    DBArg(CL_DBConnection &db, const CL_StringRef &format, CL_DBCommand::Type type) : cmd(db.create_command(format, type)), i(1){}
+    DBArg(CL_DBConnection &db, const CL_StringRef &format, CL_DBCommand::Type type) : cmd(db, format, type), i(1){}
 
     DBArg &set_arg(const CL_StringRef &arg)
     {
-        cmd.set_input_parameter_string(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(const char *arg)
     {
-        cmd.set_input_parameter_string(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(bool arg)
     {
-        cmd.set_input_parameter_bool(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(int arg)
     {
-        cmd.set_input_parameter_int(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(double arg)
     {
-        cmd.set_input_parameter_double(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(const CL_DateTime &arg)
     {
-        cmd.set_input_parameter_datetime(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
     DBArg &set_arg(const CL_DataBuffer &arg)
     {
-        cmd.set_input_parameter_binary(i, arg);
+        cmd.set_input_parameter(i, arg);
         i++;
         return *this;
     }
 
-    CL_DBCommand get_result() const
+    SqlCommand get_result() const
     {
         return cmd;
     }
 
 private:
-    CL_DBCommand cmd;
+    SqlCommand cmd;
     int i;
 };
 
@@ -151,13 +287,25 @@ static DBArg begin_arg(CL_DBConnection &sql, const CL_StringRef &format, CL_DBCo
 }
 
 template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8>
-CL_DBCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+SqlCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
 { return begin_arg(sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).get_result(); }
 
 template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9>
-CL_DBCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+SqlCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
 { return begin_arg(sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).get_result(); }
 
+template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9, class Arg10>
+SqlCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, Arg10 arg10, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+{ return begin_arg(sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).set_arg(arg10).get_result(); }
+
+template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9, class Arg10, class Arg11>
+SqlCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, Arg10 arg10, Arg11 arg11, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+{ return begin_arg(sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).set_arg(arg10).set_arg(arg11).get_result(); }
+
+template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9, class Arg10, class Arg11, class Arg12>
+SqlCommand create_sql_command(CL_DBConnection &sql, const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, Arg10 arg10, Arg11 arg11, Arg12 arg12, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+{ return begin_arg(sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).set_arg(arg10).set_arg(arg11).set_arg(arg12).get_result(); }
+
 
 struct SearchQuery
 {
@@ -178,23 +326,177 @@ struct StatusItem
     CL_String name;
 };
 
+// one row of a statistics section
+struct StatsItem
+{
+    CL_String name;
+    int shows;
+    int episodes;
+};
+
+struct LibraryStats
+{
+    int shows;
+    int episodes;
+
+    std::vector<StatsItem> by_status;
+    std::vector<StatsItem> by_rating;
+    std::vector<StatsItem> by_year;
+    std::vector<StatsItem> top_genres;
+};
+
+// one show as it is edited, imported or saved. The fields the list, the filters and the orders read are packed
+// together first, status and type in a byte each, then the strings and genres and last the dates
 struct ShowItem : CL_ListViewItemUserData
 {
+    double rating;
     int id;
+    int year;
+    int season;
+    int episodes;
+    int mal_id;             // 0 when the show didn't come from MyAnimeList
+    unsigned char status;   // a VIEWING_STATUS
+    unsigned char type;     // a SHOW_TYPE
+
+    CL_String title;
+    CL_String sort_key;     // see make_sort_key
+    std::vector<GenreItem> genres;
+    CL_String comment;
 
     CL_DateTime date_added;
     CL_DateTime date_updated;
 
-    CL_String title;
-    CL_String type;
+    ShowItem() : mal_id(0), status(UNKNOWN), type(TYPE_ANIME) {}
+};
+
+// a show in a ShowList. The strings and genre IDs point into the list's arena, they stay valid until the list is cleared.
+// A filter or order over the list reads the first 32 bytes, what a page draws follows and the comment and dates come last
+struct ShowRow
+{
+    double rating;
+    int id;
     int year;
-    int episodes;
     int season;
-    std::vector<GenreItem> genres;
-    double rating;
-    CL_String comment;
+    int episodes;
+    int mal_id;
+    unsigned char status;   // a VIEWING_STATUS
+    unsigned char type;     // a SHOW_TYPE
 
-    int status;
+    const char *title;
+    const char *sort_key;
+    const int *genres;
+    int genre_count;
+    const char *comment;
+
+    CL_DateTime date_added;
+    CL_DateTime date_updated;
+
+    ShowRow() : rating(0), id(0), year(0), season(0), episodes(0), mal_id(0), status(UNKNOWN), type(TYPE_ANIME),
+                title(""), sort_key(""), genres(0), genre_count(0), comment("") {}
+};
+
+// the shows of one query. Refilling it reuses the row array and the arena blocks of the last result,
+// so paging through the library doesn't allocate once the largest page has been seen
+class ShowList
+{
+public:
+    typedef std::vector<ShowRow>::size_type size_type;
+
+    void clear()
+    {
+        rows.clear();
+        arena.clear();
+    }
+
+    size_type size() const { return rows.size(); }
+    bool empty() const { return rows.empty(); }
+    const ShowRow &operator[](size_type index) const { return rows[index]; }
+    ShowRow &operator[](size_type index) { return rows[index]; }
+    const ShowRow &back() const { return rows.back(); }
+
+    ShowRow &add()
+    {
+        rows.push_back(ShowRow());
+        return rows.back();
+    }
+
+    void add(const ShowItem &show)
+    {
+        set(add(), show);
+    }
+
+    // the strings the row pointed to stay in the arena until the list is cleared
+    void set(size_type index, const ShowItem &show)
+    {
+        set(rows[index], show);
+    }
+
+    const char *store(const CL_String &text)
+    {
+        return arena.store(text.data(), (unsigned int)text.length());
+    }
+
+    const char *store(const char *text, unsigned int length)
+    {
+        return arena.store(text, length);
+    }
+
+    int *allocate_genres(int count)
+    {
+        return (int *)arena.allocate(count * sizeof(int), sizeof(int));
+    }
+
+    const ResultArena &get_arena() const { return arena; }
+
+private:
+    ResultArena arena;
+    std::vector<ShowRow> rows;
+
+    void set(ShowRow &row, const ShowItem &show)
+    {
+        row.id = show.id;
+        row.date_added = show.date_added;
+        row.date_updated = show.date_updated;
+        row.title = store(show.title);
+        row.type = show.type;
+        row.comment = store(show.comment);
+        row.sort_key = store(show.sort_key);
+        row.year = show.year;
+        row.episodes = show.episodes;
+        row.season = show.season;
+        row.status = show.status;
+        row.mal_id = show.mal_id;
+        row.rating = show.rating;
+
+        int *genres = allocate_genres((int)show.genres.size());
+        for(std::vector<GenreItem>::size_type i = 0; i < show.genres.size(); i++)
+            genres[i] = show.genres[i].id;
+        row.genres = genres;
+        row.genre_count = (int)show.genres.size();
+    }
+};
+
+// columns the library list can be sorted by, each one has an index that starts with it
+enum SHOW_ORDER { ORDER_TITLE=0, ORDER_RATING, ORDER_YEAR, ORDER_EPISODES, ORDER_DATE_ADDED, ORDER_DATE_UPDATED, ORDER_COUNT };
+
+struct ShowOrder
+{
+    SHOW_ORDER column;
+    bool descending;
+
+    ShowOrder(SHOW_ORDER column = ORDER_TITLE, bool descending = false) : column(column), descending(descending) {}
+    bool operator==(const ShowOrder &other) const { return column == other.column && descending == other.descending; }
+};
+
+// where a page starts: the sort value and ID of the last show on the page before it, see Database::make_cursor.
+// An ID of 0 starts at the first show
+struct ShowCursor
+{
+    int id;
+    CL_String text;     // sort key or date, for the orders on text columns
+    double number;      // rating, year or episodes
+
+    ShowCursor() : id(0), number(0) {}
 };
 
 
@@ -209,7 +511,8 @@ public:
     HTTPHeader()
     {
         fields["Connection"] = "close";
-        fields["Accept"] = "text/plain, text/html";
+        fields["Accept"] = "text/plain, text/html, text/xml, application/xml";
+        fields["Accept-Encoding"] = "gzip, deflate";
         fields["User-Agent"] = "AnimeRecord/1.0";
     }
 
@@ -246,691 +549,4797 @@ public:
     }
 };
 
-class HTTPClient
+struct HTTPTransferStats
 {
+    int status;
+    int wire_bytes;     // everything read from the socket, headers included
+    int body_bytes;     // entity body as sent, before content decoding
+    int content_bytes;  // entity body after content decoding
+    unsigned int elapsed_ms;
+    int retry_after;    // seconds, from the Retry-After header of 429/503 responses
+    CL_String content_encoding;
+
+    HTTPTransferStats() : status(0), wire_bytes(0), body_bytes(0), content_bytes(0), elapsed_ms(0), retry_after(0) {}
+};
 
-    CL_String host;
-    CL_String port;
-    CL_String auth_string;
-    CL_TCPConnection connection;
+// growable output buffer, the decoders write straight into its spare capacity
+class HTTPContentBuffer
+{
+    CL_DataBuffer data;
+    int used;
 
-private:
-    CL_String header_to_string(const HTTPHeader &header) const
+public:
+    HTTPContentBuffer() : data(16*1024), used(0)
     {
-        struct JoinHTTPFields
-        {
-            CL_String operator()(const CL_String &acc, const std::pair<CL_String, CL_String> &field) const
-            {
-                return cl_format("%1%2: %3\r\n", acc, field.first, field.second);
-            }
-        };
-        return std::accumulate(header.begin(), header.end(), CL_String(), JoinHTTPFields()) + "\r\n";
+        data.set_size(0);
     }
 
-    CL_String encode_http_auth(const CL_String&user, const CL_String &pass) const
+    // make room for at least min_free bytes and return the write pointer
+    char *reserve(int min_free)
     {
-        if(user.empty() && pass.empty())
+        if(data.get_capacity() - used < min_free)
         {
-            return CL_String();
+            data.set_capacity(cl_max(data.get_capacity()*2, used+min_free));
         }
-
-        CL_String auth = CL_Base64Encoder::encode(cl_format("%1:%2", user, pass));
-        return cl_format("Basic %1", auth);
+        return data.get_data() + used;
     }
 
-    CL_String url_encode(const CL_String &url)
+    int get_free() const
     {
-        static std::map<char, CL_String> encode_map;
-
-        if(encode_map.empty())
-        {
-            encode_map[' '] = "%20";
-            encode_map['<'] = "%3C";
-            encode_map['>'] = "%3E"; 
-            encode_map['%'] = "%25"; 
-            encode_map['{'] = "%7B"; 
-            encode_map['}'] = "%7D"; 
-            encode_map['|'] = "%7C"; 
-            encode_map['\\'] = "%5C"; 
-            encode_map['^'] = "%5E"; 
-            encode_map['~'] = "%7E";
-            encode_map['['] = "%5B";
-            encode_map[']'] = "%5D";
-            encode_map['`'] = "%60";
-            encode_map['\''] = "%27";
-            encode_map[';'] = "%3B";
-            encode_map[':'] = "%3A"; 
-            encode_map['@'] = "%40"; 
-            encode_map['$'] = "%24";
-        }
-
-        struct EncodeUrl
-        {
-            std::map<char, CL_String> &encode_map;
-
-            EncodeUrl(std::map<char, CL_String> &encode_map) : encode_map(encode_map){}
-            
-            CL_String operator()(const CL_String &acc, char ch) const
-            {
-                std::map<char, CL_String>::const_iterator i = encode_map.find(ch);
-                if(i == encode_map.end())
-                {
-                    return acc+CL_String(1, ch);
-                }
-                else
-                {
-                    return acc+i->second;
-                }
-            }
-        };
-
-        return std::accumulate(url.begin(), url.end(), CL_String(), EncodeUrl(encode_map));
+        return data.get_capacity() - used;
     }
 
-public:
-    HTTPClient(const CL_String &host, const CL_String &port, const CL_String &username="", const CL_String &password="")
-        : host(host), port(port), auth_string(encode_http_auth(username, password)), connection(CL_SocketName(host, port))
+    void commit(int length)
     {
-        connection.set_nodelay(true);
+        used += length;
+        data.set_size(used);
     }
 
-    ~HTTPClient()
+    void append(const char *bytes, int length)
     {
-        close();
+        memcpy(reserve(length), bytes, length);
+        commit(length);
     }
 
-    void close()
+    int get_size() const
     {
-        connection.disconnect_graceful();
+        return used;
     }
 
-    CL_String get_header_string(const HTTPHeader &header) const
+    CL_DataBuffer get_data() const
     {
-        return header_to_string(header);
+        return data;
     }
+};
 
-    CL_String download_url(const CL_String &path, const HTTPHeader &header, const CL_String &refererer_url="", int timeout=15000)
-    {
-        CL_String request;
+// inflates a gzip or deflate encoded body incrementally as the bytes come in
+class HTTPContentDecoder
+{
+    enum Encoding { IDENTITY, GZIP, DEFLATE };
 
-        CL_String encoded_path = url_encode(path);
-        request = cl_format("GET %1 HTTP/1.1\r\n", encoded_path);
+    Encoding encoding;
+    z_stream stream;
+    bool stream_open;
+    bool stream_end;
+    bool has_input;
+    CL_String deflate_prefix;
 
-        HTTPHeader header_copy = header;
+    void open_stream(int window_bits)
+    {
+        memset(&stream, 0, sizeof(stream));
+        if(inflateInit2(&stream, window_bits) != Z_OK)
+            throw CL_Exception("Unable to initialize zlib");
+        stream_open = true;
+    }
 
-        if(auth_string.empty() == false)
+    void close_stream()
+    {
+        if(stream_open)
         {
-            header_copy["Authorization"] = auth_string;
+            inflateEnd(&stream);
+            stream_open = false;
         }
+    }
 
-        header_copy["Host"] = host;
+    int inflate_into(HTTPContentBuffer &output, const char *data, int length)
+    {
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = length;
 
-        if(refererer_url.empty() == false)
+        int result = Z_OK;
+        while(stream.avail_in > 0 && result != Z_STREAM_END)
         {
-            header_copy["Referer"] = refererer_url;
+            // compressed text usually expands 4-10x
+            char *out = output.reserve(cl_max(length*4, 16*1024));
+            int avail = output.get_free();
+            stream.next_out = (Bytef*)out;
+            stream.avail_out = avail;
+
+            result = inflate(&stream, Z_NO_FLUSH);
+            if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                return result;
+
+            output.commit(avail - stream.avail_out);
         }
 
-        request += header_to_string(header_copy);
+        if(result == Z_STREAM_END)
+            stream_end = true;
 
-        connection.send(request.data(), request.length(), true);      
+        return Z_OK;
+    }
+
+public:
+    HTTPContentDecoder(const CL_String &content_encoding)
+        : encoding(IDENTITY), stream_open(false), stream_end(false), has_input(false)
+    {
+        CL_String name = CL_StringHelp::text_to_lower(trimmed(content_encoding));
 
-        CL_String response;
-        while (connection.get_read_event().wait(timeout))
+        if(name == "gzip" || name == "x-gzip")
         {
-            char buffer[16*1024];
-            int received = connection.read(buffer, 16*1024, false);
-            if (received == 0)
-                break;
-            response.append(buffer, received);
+            encoding = GZIP;
+            open_stream(MAX_WBITS + 16);
         }
-        
-        CL_String response_header = response.substr(0, response.find("\r\n\r\n"));
-        CL_String content = response.substr(response_header.length() + 4);
-
-        if (response_header.find("Transfer-Encoding: chunked") != CL_String::npos)
+        else if(name == "deflate")
         {
-            CL_String::size_type start = 0;
-            while (true)
-            {
-                CL_String::size_type end = content.find("\r\n", start);
-                if (end == CL_String::npos)
-                    end = content.length();
+            // the stream is opened once the first two bytes tell whether the zlib wrapper is present
+            encoding = DEFLATE;
+        }
+        else if(name.empty() == false && name != "identity")
+        {
+            throw CL_Exception(cl_format("Unsupported content encoding: %1", content_encoding));
+        }
+    }
+
+    ~HTTPContentDecoder()
+    {
+        close_stream();
+    }
+
+    // false while a compressed body hasn't reached the end of its stream, an empty body is complete
+    bool is_complete() const
+    {
+        return encoding == IDENTITY || stream_end || has_input == false;
+    }
 
-                CL_String str_length = content.substr(start, end-start);
-                int length = CL_StringHelp::text_to_int(str_length, 16);
-                content = content.substr(0, start) + content.substr(end+2);
-                start += length;
+    void decode(HTTPContentBuffer &output, const char *data, int length)
+    {
+        if(length > 0)
+            has_input = true;
 
+        if(encoding == IDENTITY)
+        {
+            output.append(data, length);
+            return;
+        }
 
-                end = content.find("\r\n", start);
-                if (end == CL_String::npos)
-                    end = content.length();
-                content = content.substr(0, start) + content.substr(end+2);
+        if(stream_end || length == 0)
+            return;
 
-                if (length == 0)
-                    break;
-            }
+        if(stream_open == false)
+        {
+            deflate_prefix.append(data, length);
+            if(deflate_prefix.length() < 2)
+                return;
+
+            // some servers send "deflate" without the zlib wrapper, RFC 1950 headers are a multiple of 31
+            unsigned char cmf = deflate_prefix[0], flg = deflate_prefix[1];
+            bool zlib_wrapped = (cmf & 0x0f) == Z_DEFLATED && ((cmf << 8) | flg) % 31 == 0;
+            open_stream(zlib_wrapped ? MAX_WBITS : -MAX_WBITS);
+
+            CL_String prefix;
+            prefix.swap(deflate_prefix);
+            decode(output, prefix.data(), prefix.length());
+            return;
         }
 
-        return content;
+        int result = inflate_into(output, data, length);
+        if(result != Z_OK)
+            throw CL_Exception(cl_format("Unable to decompress the response (zlib error %1)", result));
     }
-
 };
 
-class MyAnimeListClient
+// splits an HTTP response into header and body, undoing the transfer and content encodings on the fly
+class HTTPResponseParser
 {
-public:
-    std::vector<CL_String> get_genres(int showid) const
-    {
-        // unofficial myanimelist API!
-        // this function is very slow, only use it when required
-        HTTPHeader header;
-        HTTPClient client("mal-api.com", "80");
+    enum State { HEADER, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER, DONE };
 
-        CL_String xmldoc = client.download_url(cl_format("/anime/%1?format=xml", showid), header);
+    State state;
+    CL_String line;
+    CL_String header_text;
+    HTTPHeaderFields fields;
+    int status;
+    int content_length;
+    int body_remaining;
+    int body_bytes;
+    std::auto_ptr<HTTPContentDecoder> decoder;
+    HTTPContentBuffer content;
 
-        CL_DataBuffer docdata(xmldoc.data(), xmldoc.length());
-        CL_IODevice_Memory docmem(docdata);
-        CL_DomDocument doc(docmem);
+    void parse_header()
+    {
+        std::vector<CL_String> lines = CL_StringHelp::split_text(header_text, "\r\n");
+        if(lines.empty())
+            throw CL_Exception("Empty HTTP response");
 
-        CL_XPathEvaluator xpath;
-        CL_XPathObject obj = xpath.evaluate("anime/genre", doc);
-        std::vector<CL_DomNode> nodes = obj.get_node_set();
+        // example status line: HTTP/1.1 200 OK
+        std::vector<CL_String> status_line = CL_StringHelp::split_text(lines[0], " ");
+        status = status_line.size() >= 2 ? CL_StringHelp::text_to_int(status_line[1]) : 0;
 
-        std::vector<CL_String> genres;
-        for(std::vector<CL_DomNode>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        for(std::vector<CL_String>::const_iterator it = lines.begin()+1; it != lines.end(); ++it)
         {
-            genres.push_back(it->to_element().get_text());
+            CL_String::size_type colon = it->find(':');
+            if(colon != CL_String::npos)
+            {
+                fields[CL_StringHelp::text_to_lower(trimmed(it->substr(0, colon)))] = trimmed(it->substr(colon+1));
+            }
         }
 
-        return genres;
+        decoder.reset(new HTTPContentDecoder(get_field("content-encoding")));
+
+        if(CL_StringHelp::text_to_lower(get_field("transfer-encoding")).find("chunked") != CL_String::npos)
+        {
+            state = CHUNK_SIZE;
+        }
+        else
+        {
+            CL_String length = get_field("content-length");
+            content_length = length.empty() ? -1 : CL_StringHelp::text_to_int(length);
+            body_remaining = content_length;
+            state = (content_length == 0) ? DONE : BODY;
+        }
     }
 
-    std::map<int,ShowItem> search(const CL_String &query) const
+    void decode_body(const char *data, int length)
     {
-        HTTPHeader header;
-        HTTPClient client("myanimelist.net", "80", "animerecord", "animerecord");
-
-        CL_String xmldoc = client.download_url(cl_format("/api/anime/search.xml?q=%1", query), header);
-
-
-        if(xmldoc == "Invalid credentials")
-            throw CL_Exception("Invalid username or password");
-
-        if(xmldoc == "No results")
-            xmldoc = "";
-
+        body_bytes += length;
+        decoder->decode(content, data, length);
+    }
 
-        CL_DataBuffer docdata(xmldoc.data(), xmldoc.length());
-        CL_IODevice_Memory docmem(docdata);
-        CL_DomDocument doc(docmem);
-       
-        CL_XPathEvaluator xpath;
-        CL_XPathObject obj = xpath.evaluate("anime/entry", doc);
-        std::vector<CL_DomNode> nodes = obj.get_node_set();
+    // consumes a CRLF terminated line, returns false while the line is incomplete
+    bool read_line(const char *&data, int &length)
+    {
+        while(length > 0)
+        {
+            char ch = *data++;
+            length--;
+            if(ch == '\n')
+                return true;
+            if(ch != '\r')
+                line += ch;
+        }
+        return false;
+    }
 
-        std::map<int,ShowItem> shows;
+public:
+    HTTPResponseParser() : state(HEADER), status(0), content_length(-1), body_remaining(-1), body_bytes(0) {}
 
-        for(std::vector<CL_DomNode>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+    // returns true once the whole response has been received
+    bool feed(const char *data, int length)
+    {
+        while(length > 0 && state != DONE)
         {
-            ShowItem show;
-            CL_DomNode child = it->get_first_child();
-            CL_String output;
-            int showid;
-            while(child.is_null() == false)
+            switch(state)
             {
-                if(child.get_node_name() == "id")
-                    showid = CL_StringHelp::text_to_int(child.to_element().get_text());
-
-                if(child.get_node_name() == "title")
-                    show.title = child.to_element().get_text();
+            case HEADER:
+                {
+                    // the header is small, so it is collected before the body is touched
+                    CL_String::size_type scan_from = header_text.length() > 3 ? header_text.length() - 3 : 0;
+                    header_text.append(data, length);
+                    CL_String::size_type end = header_text.find("\r\n\r\n", scan_from);
+                    if(end == CL_String::npos)
+                        return false;
+
+                    int consumed = length - (int)(header_text.length() - (end + 4));
+                    data += consumed;
+                    length -= consumed;
+                    header_text.resize(end);
+                    parse_header();
+                }
+                break;
 
-                if(child.get_node_name() == "score")
-                    show.rating = CL_StringHelp::text_to_double(child.to_element().get_text());
+            case BODY:
+                {
+                    int take = body_remaining < 0 ? length : cl_min(length, body_remaining);
+                    decode_body(data, take);
+                    data += take;
+                    length -= take;
+                    if(body_remaining >= 0)
+                    {
+                        body_remaining -= take;
+                        if(body_remaining == 0)
+                            state = DONE;
+                    }
+                }
+                break;
 
-                if(child.get_node_name() == "episodes")
-                    show.episodes = CL_StringHelp::text_to_int(child.to_element().get_text());
+            case CHUNK_SIZE:
+                if(read_line(data, length))
+                {
+                    // strip chunk extensions, example: 1a3f;name=value
+                    body_remaining = CL_StringHelp::text_to_int(trimmed(line.substr(0, line.find(';'))), 16);
+                    line.clear();
+                    state = body_remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+                }
+                break;
 
-                // example date: 2007-12-22
-                if(child.get_node_name() == "start_date")
+            case CHUNK_DATA:
                 {
-                    show.year = CL_StringHelp::text_to_int(child.to_element().get_text().substr(0,4));
+                    int take = cl_min(length, body_remaining);
+                    decode_body(data, take);
+                    data += take;
+                    length -= take;
+                    body_remaining -= take;
+                    if(body_remaining == 0)
+                        state = CHUNK_DATA_END;
                 }
+                break;
 
-                if(child.get_node_name() == "synopsis")
-                    show.comment = child.to_element().get_text();
+            case CHUNK_DATA_END:
+                if(read_line(data, length))
+                {
+                    line.clear();
+                    state = CHUNK_SIZE;
+                }
+                break;
 
+            case CHUNK_TRAILER:
+                if(read_line(data, length))
+                {
+                    bool empty = line.empty();
+                    line.clear();
+                    if(empty)
+                        state = DONE;
+                }
+                break;
 
-                child = child.get_next_sibling();
+            default:
+                break;
             }
+        }
 
-            show.id = -1;
-            show.type = "Anime";
-            show.status = PLANNING;
-            show.season = 1;
+        return state == DONE;
+    }
 
-            shows[showid] = show;
+    // the response is over, complete or because the server closed the connection. Throws unless the
+    // whole body arrived and a compressed one was decoded to the end of its stream
+    void finish()
+    {
+        if(state == HEADER)
+        {
+            if(header_text.empty())
+                throw CL_Exception("The server closed the connection without a response");
+            parse_header();
         }
 
-        return shows;
+        // without a length or chunks the body ends with the connection
+        if(state == BODY && content_length < 0)
+            state = DONE;
+
+        if(state != DONE)
+            throw CL_Exception(cl_format("The connection was closed after %1 bytes of the response body", body_bytes));
+        if(decoder->is_complete() == false)
+            throw CL_Exception("The compressed response ended before the end of its stream");
     }
-};
 
+    bool has_header() const
+    {
+        return state != HEADER;
+    }
 
-class Database
-{    
-    CL_SharedPtr<CL_DBConnection> sql;
-        
-    template<typename StrType>
-    StrType strip_sql_symbol(const StrType &s) const
+    int get_status() const
     {
-        return clean(s, StrType("%_"));
+        return status;
     }
 
+    CL_String get_field(const CL_String &name) const
+    {
+        HTTPHeaderFields::const_iterator i = fields.find(name);
+        return i != fields.end() ? i->second : CL_String();
+    }
 
-    /// \brief Create database command with 8 input arguments.
-    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8>
-    CL_DBCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
-    { return begin_arg(format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).get_result(); }
+    int get_body_bytes() const
+    {
+        return body_bytes;
+    }
 
-    /// \brief Create database command with 9 input arguments.
-    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9>
-    CL_DBCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
-    { return begin_arg(format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).get_result(); }
+    CL_DataBuffer get_content() const
+    {
+        return content.get_data();
+    }
+};
 
-    /// \brief Create database command with 10 input arguments.
-    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9, class Arg10>
-    CL_DBCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, Arg10 arg10, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
-    { return begin_arg(format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).set_arg(arg10).get_result(); }
+class HTTPClient
+{
 
+    CL_String host;
+    CL_String port;
+    CL_String auth_string;
+    CL_TCPConnection connection;
 
-public:
+    HTTPTransferStats last_stats;
 
-    Database()
+private:
+    CL_String header_to_string(const HTTPHeader &header) const
     {
-        CL_String databaseFile = "animerecord.s3db";
-        // test to see if the file exist or not by opening it
-        CL_File file(databaseFile, CL_File::open_existing, CL_File::access_read_write);
-        file.close();
-        sql = CL_SharedPtr<CL_DBConnection>(new CL_SqliteConnection(databaseFile));
+        struct JoinHTTPFields
+        {
+            CL_String operator()(const CL_String &acc, const std::pair<CL_String, CL_String> &field) const
+            {
+                return cl_format("%1%2: %3\r\n", acc, field.first, field.second);
+            }
+        };
+        return std::accumulate(header.begin(), header.end(), CL_String(), JoinHTTPFields()) + "\r\n";
     }
 
-    // return alphabetically sorted show genres
-    std::vector<GenreItem> get_all_genres()
+    CL_String encode_http_auth(const CL_String&user, const CL_String &pass) const
     {
-        CL_DBCommand cmd = sql->create_command("select id, name from genre order by name collate nocase");
-        CL_DBReader reader = sql->execute_reader(cmd);
-
-        std::vector<GenreItem> genres;
-        while(reader.retrieve_row())
+        if(user.empty() && pass.empty())
         {
-            GenreItem item;
-            item.id = reader.get_column_value("id");
-            item.name = reader.get_column_value("name");
-            genres.push_back(item);
+            return CL_String();
         }
 
-        return genres;
+        CL_String auth = CL_Base64Encoder::encode(cl_format("%1:%2", user, pass));
+        return cl_format("Basic %1", auth);
     }
 
-    std::vector<StatusItem> get_all_status()
+    CL_String url_encode(const CL_String &url)
     {
-        CL_DBCommand cmd = sql->create_command("select id, name from status order by id asc");
-        CL_DBReader reader = sql->execute_reader(cmd);
+        static std::map<char, CL_String> encode_map;
 
-        std::vector<StatusItem> statuses;
-        while(reader.retrieve_row())
+        if(encode_map.empty())
         {
-            StatusItem item;
-            item.id = reader.get_column_value("id");
-            item.name = reader.get_column_value("name");
-            statuses.push_back(item);
+            encode_map[' '] = "%20";
+            encode_map['<'] = "%3C";
+            encode_map['>'] = "%3E"; 
+            encode_map['%'] = "%25"; 
+            encode_map['{'] = "%7B"; 
+            encode_map['}'] = "%7D"; 
+            encode_map['|'] = "%7C"; 
+            encode_map['\\'] = "%5C"; 
+            encode_map['^'] = "%5E"; 
+            encode_map['~'] = "%7E";
+            encode_map['['] = "%5B";
+            encode_map[']'] = "%5D";
+            encode_map['`'] = "%60";
+            encode_map['\''] = "%27";
+            encode_map[';'] = "%3B";
+            encode_map[':'] = "%3A"; 
+            encode_map['@'] = "%40"; 
+            encode_map['$'] = "%24";
         }
 
-        return statuses;
+        struct EncodeUrl
+        {
+            std::map<char, CL_String> &encode_map;
+
+            EncodeUrl(std::map<char, CL_String> &encode_map) : encode_map(encode_map){}
+            
+            CL_String operator()(const CL_String &acc, char ch) const
+            {
+                std::map<char, CL_String>::const_iterator i = encode_map.find(ch);
+                if(i == encode_map.end())
+                {
+                    return acc+CL_String(1, ch);
+                }
+                else
+                {
+                    return acc+i->second;
+                }
+            }
+        };
+
+        return std::accumulate(url.begin(), url.end(), CL_String(), EncodeUrl(encode_map));
     }
 
-    // returns the GenreItems that were passed to this function with the ID set
-    std::vector<GenreItem> get_genres_by_name(const std::vector<CL_String> &genreStrs)
+public:
+    HTTPClient(const CL_String &host, const CL_String &port, const CL_String &username="", const CL_String &password="")
+        : host(host), port(port), auth_string(encode_http_auth(username, password)), connection(CL_SocketName(host, port))
     {
-        std::vector<GenreItem> genres;
-        for (std::vector<CL_String>::const_iterator it = genreStrs.begin(); it != genreStrs.end(); ++it)
-        {
-            CL_DBCommand cmd = sql->create_command("select id from genre "
-                                                   "where name = ?1 ", *it);
-            int id = sql->execute_scalar_int(cmd);
-
-            GenreItem item;
-            item.id = id;
-            item.name = *it;
-            genres.push_back(item);
-        }
+        connection.set_nodelay(true);
+    }
 
-        return genres;
+    ~HTTPClient()
+    {
+        close();
     }
 
-    // ensures all genreStrs are added to the database
-    void ensure_add_genres(const std::vector<CL_String> &genreStrs)
+    void close()
     {
-        for (std::vector<CL_String>::const_iterator it = genreStrs.begin(); it != genreStrs.end(); ++it)
-        {
-            CL_DBTransaction trans = sql->begin_transaction();
-            CL_DBCommand cmd = sql->create_command("insert into genre (name) "
-                                                   "select ?1 " 
-                                                   "where not exists (select * from genre where name = ?1 collate nocase)", *it);
-            sql->execute_non_query(cmd);
-            trans.commit();
-        }
+        connection.disconnect_graceful();
     }
 
-    // returns the inserted show id
-    int add_show(const CL_String &title, const CL_String &type, const std::vector<GenreItem> &genres, int year, int rating, const CL_String &comment, int episodes, int season, int status)
+    CL_String get_header_string(const HTTPHeader &header) const
     {
-        CL_String title_s = strip_sql_symbol(title);
-        CL_String type_s = strip_sql_symbol(type);
-        CL_String comment_s = strip_sql_symbol(comment);
+        return header_to_string(header);
+    }
 
-        if(title_s.empty())
-            throw CL_Exception("title is empty!");
+    // statistics of the last download
+    const HTTPTransferStats &get_last_stats() const
+    {
+        return last_stats;
+    }
 
-        CL_DBTransaction transaction = sql->begin_transaction();
+    // returns the decoded entity body, the response is decompressed while it is being received
+    CL_DataBuffer download(const CL_String &path, const HTTPHeader &header, const CL_String &refererer_url="", int timeout=15000)
+    {
+        TraceSpan span("http", "download");
+        unsigned int start_time = CL_System::get_time();
+        last_stats = HTTPTransferStats();
 
-        CL_DBCommand cmd = create_sql_command(*sql, "insert into show (title, type, year, rating, comment, episodes, season, status) values (?1,?2,?3,?4,?5,?6,?7,?8)",
-                                                title_s, type_s, year, rating, comment_s, episodes, season, status);
-        sql->execute_non_query(cmd);
+        CL_String request;
 
-        int showid = cmd.get_output_last_insert_rowid();
+        CL_String encoded_path = url_encode(path);
+        request = cl_format("GET %1 HTTP/1.1\r\n", encoded_path);
 
-        cmd = sql->create_command("insert into show_genre (show_id, genre_id) values (?1,?2)");
-        cmd.set_input_parameter(1, showid);
+        HTTPHeader header_copy = header;
 
-        for (std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+        if(auth_string.empty() == false)
         {
-            cmd.set_input_parameter(2, it->id);
-            sql->execute_non_query(cmd);
+            header_copy["Authorization"] = auth_string;
         }
 
-        transaction.commit();
-
-        return showid;
-    }
+        header_copy["Host"] = host;
 
-    void update_show(int showid, const CL_String &title, const CL_String &type, const std::vector<GenreItem> &genres, 
-                     int year, int rating, const CL_String &comment, int episodes, int season, int status)
-    {
-        CL_String title_s = strip_sql_symbol(title);
-        CL_String type_s = strip_sql_symbol(type);
-        CL_String comment_s = strip_sql_symbol(comment);
+        if(refererer_url.empty() == false)
+        {
+            header_copy["Referer"] = refererer_url;
+        }
 
-        if(title_s.empty())
-            throw CL_Exception("title is empty!");
+        request += header_to_string(header_copy);
+
+        connection.send(request.data(), request.length(), true);      
 
-        CL_DBTransaction transaction = sql->begin_transaction();
+        HTTPResponseParser response;
+        bool complete = false;
+        while (complete == false)
+        {
+            if(connection.get_read_event().wait(timeout) == false)
+                throw CL_Exception(cl_format("%1 didn't answer within %2 ms", host, timeout));
+
+            char buffer[16*1024];
+            int received = connection.read(buffer, 16*1024, false);
+            if (received == 0)
+                break;
+            last_stats.wire_bytes += received;
+            complete = response.feed(buffer, received);
+        }
 
-        CL_DBCommand cmd = create_sql_command(*sql, "update show set title=?2, type=?3, year=?4, rating=?5, comment=?6, episodes=?7, season=?8, status=?9 where id=?1",
-                                               showid, title_s, type_s, year, rating, comment_s, episodes, season, status);
-        sql->execute_non_query(cmd);
+        // a partial body is an error, not a shorter document
+        response.finish();
 
-        cmd = sql->create_command("delete from show_genre where show_id=?1", showid);
-        sql->execute_non_query(cmd);
+        CL_DataBuffer content = response.get_content();
 
-        cmd = sql->create_command("insert into show_genre (show_id, genre_id) values (?1,?2)");
-        cmd.set_input_parameter(1, showid);
+        last_stats.status = response.get_status();
+        last_stats.body_bytes = response.get_body_bytes();
+        last_stats.content_bytes = content.get_size();
+        last_stats.content_encoding = response.get_field("content-encoding");
+        last_stats.retry_after = CL_StringHelp::text_to_int(response.get_field("retry-after"));
+        last_stats.elapsed_ms = CL_System::get_time() - start_time;
 
-        for (std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
-        {
-            cmd.set_input_parameter(2, it->id);
-            sql->execute_non_query(cmd);
-        }
+        cl_log_event("http", "GET %1%2 status %3, %4 ms", host, path, last_stats.status, last_stats.elapsed_ms);
+        cl_log_event("http", "%1 bytes on the wire, body %2 -> %3 bytes (%4)", last_stats.wire_bytes, last_stats.body_bytes, last_stats.content_bytes,
+                     last_stats.content_encoding.empty() ? CL_String("identity") : last_stats.content_encoding);
 
-        transaction.commit();
+        return content;
     }
 
-    bool has_row(CL_DBCommand &cmd)
+    CL_String download_url(const CL_String &path, const HTTPHeader &header, const CL_String &refererer_url="", int timeout=15000)
     {
-        CL_DBReader reader = sql->execute_reader(cmd);
-        return reader.retrieve_row();
+        TraceSpan span("http", "download_url");
+        CL_DataBuffer content = download(path, header, refererer_url, timeout);
+        return CL_String(content.get_data(), content.get_size());
     }
 
-    bool show_exist(const CL_String &title, const CL_String &type, int year, int season)
+};
+
+struct HTTPRequest
+{
+    CL_String host;
+    CL_String port;
+    CL_String path;
+    CL_String username;
+    CL_String password;
+
+    HTTPRequest(const CL_String &host, const CL_String &port, const CL_String &path, const CL_String &username="", const CL_String &password="")
+        : host(host), port(port), path(path), username(username), password(password) {}
+
+    // requests with the same key return the same document
+    CL_String get_key() const
     {
-        CL_DBCommand cmd = sql->create_command("select id from show where title like ?1 and type=?2 and year=?3 and season=?4", title, type, year, season);
-        return has_row(cmd);        
+        return cl_format("%1:%2%3|%4", host, port, path, username);
     }
+};
 
-    bool show_exist(int showid)
+struct HTTPSchedulerCounters
+{
+    int requests;   // fetch() calls
+    int coalesced;  // calls that joined an identical request already in flight
+    int queued;     // downloads that had to wait for their host's rate limit
+    int retried;    // downloads repeated after a transient failure
+    int failed;     // requests that gave up after the last retry
+    unsigned long long wire_bytes;      // read from the sockets by every completed attempt, headers included
+    unsigned long long content_bytes;   // decoded bodies of the successful downloads
+
+    HTTPSchedulerCounters() : requests(0), coalesced(0), queued(0), retried(0), failed(0), wire_bytes(0), content_bytes(0) {}
+};
+
+// sits in front of HTTPClient: merges identical in-flight requests, paces each host with a 
+// token bucket and retries transient failures with jittered exponential backoff
+class HTTPRequestScheduler
+{
+    struct TokenBucket
     {
-        CL_DBCommand cmd = sql->create_command("select id from show where id=?1", showid);
-        return has_row(cmd);        
+        double tokens;
+        double rate;    // tokens per second
+        double burst;
+        unsigned int last_refill;
+    };
+
+    // the shared result of one download, every coalesced caller waits on the same object
+    struct PendingRequest
+    {
+        CL_Event done;
+        CL_DataBuffer content;
+        CL_String error;
+        bool failed;
+
+        PendingRequest() : done(true, false), failed(false) {}
+    };
+
+    CL_Mutex mutex;
+    std::map<CL_String, CL_SharedPtr<PendingRequest> > in_flight;
+    std::map<CL_String, TokenBucket> buckets;
+    HTTPSchedulerCounters counters;
+
+    double default_rate;
+    double default_burst;
+    int max_retries;
+    unsigned int base_delay;
+    unsigned int max_delay;
+    unsigned int random_state;
+    bool blocking;  // false fails a request instead of sleeping for a token or a retry
+
+    // small LCG so that a given seed always produces the same backoff sequence
+    unsigned int next_random()
+    {
+        random_state = random_state * 1103515245 + 12345;
+        return (random_state >> 16) & 0x7fff;
     }
 
-    // find out if the current show matches another show in the database or not
-    bool show_similar_to(int showid, const CL_String &title, const CL_String &type, int year, int season)
+    TokenBucket &get_bucket(const CL_String &host)
     {
-        CL_DBCommand cmd = sql->create_command("select id from show where id<>?1 and title=?2 and type=?3 and year=?4 and season=?5", 
-                                                showid, title, type, year, season);
-        return has_row(cmd);        
+        std::map<CL_String, TokenBucket>::iterator it = buckets.find(host);
+        if(it == buckets.end())
+        {
+            TokenBucket bucket;
+            bucket.rate = default_rate;
+            bucket.burst = default_burst;
+            bucket.tokens = default_burst;
+            bucket.last_refill = CL_System::get_time();
+            it = buckets.insert(std::make_pair(host, bucket)).first;
+        }
+        return it->second;
     }
 
-    std::vector<GenreItem> find_show_genres(int id)
+    // blocks until the host's bucket has a token, returns true if the caller had to wait. Throws
+    // instead of waiting when the scheduler doesn't block
+    bool acquire_token(const CL_String &host)
     {
-        CL_DBCommand genreCmd = sql->create_command("select show_genre.genre_id, genre.name "
-                                                    "from show, show_genre, genre "
-                                                    "where show.id = show_genre.show_id and show_genre.genre_id = genre.id and show.id = ?1", id);
+        bool waited = false;
+        while(true)
+        {
+            unsigned int wait_time;
+            {
+                CL_MutexSection lock(&mutex);
+                TokenBucket &bucket = get_bucket(host);
 
-        CL_DBReader genreReader = sql->execute_reader(genreCmd);
+                unsigned int now = CL_System::get_time();
+                bucket.tokens = cl_min(bucket.burst, bucket.tokens + (now - bucket.last_refill) * bucket.rate / 1000.0);
+                bucket.last_refill = now;
 
-        std::vector<GenreItem> genres;
+                if(bucket.tokens >= 1.0)
+                {
+                    bucket.tokens -= 1.0;
+                    return waited;
+                }
 
-        while(genreReader.retrieve_row())
-        {
-            GenreItem gi;
-            gi.id = genreReader.get_column_value("genre_id");
-            gi.name = genreReader.get_column_value("name");
-            genres.push_back(gi);
-        }
+                wait_time = (unsigned int)((1.0 - bucket.tokens) * 1000.0 / bucket.rate) + 1;
+                if(blocking == false)
+                    throw CL_Exception(cl_format("%1 is rate limited, the request would have waited %2 ms", host, wait_time));
+            }
 
-        return genres;
+            waited = true;
+            CL_System::sleep(wait_time);
+        }
     }
 
-    ShowItem read_show(CL_DBReader &reader)
+    static bool is_transient_status(int status)
     {
-        ShowItem show;
-
-        show.id = reader.get_column_value("id");
-        show.date_added = reader.get_column_value("date_added");
-        show.date_updated = reader.get_column_value("date_updated");
-        show.title = reader.get_column_value("title");
-        show.type = reader.get_column_value("type");
-        show.year = reader.get_column_value("year");
-        show.episodes = reader.get_column_value("episodes");
-        show.season = reader.get_column_value("season");
-        show.rating = reader.get_column_value("rating");
-        show.comment = reader.get_column_value("comment");
-        show.status = reader.get_column_value("status");
+        return status == 429 || status == 502 || status == 503 || status == 504;
+    }
 
-        return show;
+    // "equal jitter": half of the exponential backoff plus a random share of the other half,
+    // so that coalesced clients of several app instances don't retry in lockstep
+    unsigned int get_backoff_delay(int attempt, int retry_after)
+    {
+        unsigned int limit = cl_min(max_delay, base_delay << cl_min(attempt, 16));
+        unsigned int delay;
+        {
+            CL_MutexSection lock(&mutex);
+            delay = limit / 2 + (next_random() % (limit / 2 + 1));
+        }
+        return cl_max(delay, cl_min(max_delay, (unsigned int)retry_after * 1000));
     }
 
-    ShowItem find_show(int id)
+    void perform(const HTTPRequest &request, PendingRequest &pending)
     {
-        ShowItem show;
+        for(int attempt = 0; ; attempt++)
+        {
+            int retry_after = 0;
+            try
+            {
+                if(acquire_token(request.host))
+                {
+                    CL_MutexSection lock(&mutex);
+                    counters.queued++;
+                }
 
-        CL_DBCommand cmd = sql->create_command("select id, date_added, date_updated, title, type, year, episodes, season, rating, comment, status " 
-                                               "from show where id = ?1", id);
-        CL_DBReader reader = sql->execute_reader(cmd);
+                HTTPHeader header;
+                HTTPClient client(request.host, request.port, request.username, request.password);
+                pending.content = client.download(request.path, header);
 
-        if(reader.retrieve_row())
-        {
-            show = read_show(reader);
-            reader.close();
+                const HTTPTransferStats &stats = client.get_last_stats();
+                {
+                    CL_MutexSection lock(&mutex);
+                    counters.wire_bytes += stats.wire_bytes;
+                    if(is_transient_status(stats.status) == false)
+                        counters.content_bytes += stats.content_bytes;
+                }
+                if(is_transient_status(stats.status) == false)
+                    return;
 
-            show.genres = find_show_genres(show.id);     
+                pending.error = cl_format("%1 answered with HTTP status %2", request.host, stats.status);
+                retry_after = stats.retry_after;
+            }
+            catch(CL_Exception &e)
+            {
+                // connection failures are as transient as a 503
+                pending.error = e.message;
+            }
+
+            {
+                CL_MutexSection lock(&mutex);
+                if(attempt >= max_retries || blocking == false)
+                {
+                    counters.failed++;
+                    pending.failed = true;
+                    return;
+                }
+                counters.retried++;
+            }
+            CL_System::sleep(get_backoff_delay(attempt, retry_after));
         }
+    }
 
-        return show;
+public:
+    HTTPRequestScheduler(double requests_per_second = 2.0, double burst = 4.0, int max_retries = 4, unsigned int seed = 0x5eed)
+        : default_rate(requests_per_second), default_burst(burst), max_retries(max_retries), 
+          base_delay(500), max_delay(16000), random_state(seed), blocking(true)
+    {
     }
 
-    // TODO full text search
-    std::vector<ShowItem> find_shows(const CL_String &title, int statusmask, 
-                                     int start, int limit)
+    void set_host_rate(const CL_String &host, double requests_per_second, double burst)
     {
-        std::vector<ShowItem> shows;
+        CL_MutexSection lock(&mutex);
+        TokenBucket &bucket = get_bucket(host);
+        bucket.rate = requests_per_second;
+        bucket.burst = burst;
+        bucket.tokens = cl_min(bucket.tokens, burst);
+    }
 
-        CL_DBCommand cmd;
+    void set_backoff(unsigned int base_delay_ms, unsigned int max_delay_ms)
+    {
+        CL_MutexSection lock(&mutex);
+        base_delay = base_delay_ms;
+        max_delay = max_delay_ms;
+    }
 
-        std::vector<CL_String> where_preds;
+    // a caller on the GUI thread can't sleep for the rate limit or seconds of backoff, without blocking
+    // such a request fails right away and the caller carries on without it
+    void set_blocking(bool enable)
+    {
+        CL_MutexSection lock(&mutex);
+        blocking = enable;
+    }
 
-        CL_String status_line;
+    HTTPSchedulerCounters get_counters()
+    {
+        CL_MutexSection lock(&mutex);
+        return counters;
+    }
+
+    // returns the decoded body of a successful download, throws when every attempt failed
+    CL_DataBuffer fetch(const HTTPRequest &request)
+    {
+        TraceSpan span("http", "fetch");
+        CL_String key = request.get_key();
+        CL_SharedPtr<PendingRequest> pending;
+        bool owner = false;
 
-        if(statusmask > 0)
         {
-            status_line = " status in (";
+            CL_MutexSection lock(&mutex);
+            counters.requests++;
 
-            int i = 1;
-            std::vector<CL_String> statuses;
-            while(statusmask > 0)
+            std::map<CL_String, CL_SharedPtr<PendingRequest> >::iterator it = in_flight.find(key);
+            if(it != in_flight.end())
             {
-                int s = (statusmask >> i) & 1;
-
-                if(s)
-                {
-                    statuses.push_back(CL_StringHelp::int_to_text(i));
-                }
-                statusmask &= ~(1 << i);
-                i++;
+                counters.coalesced++;
+                pending = it->second;
+            }
+            else
+            {
+                pending = CL_SharedPtr<PendingRequest>(new PendingRequest);
+                in_flight[key] = pending;
+                owner = true;
             }
-            status_line += join(statuses.begin(), statuses.end(), CL_String(",")) + ") ";
-            where_preds.push_back(status_line);
         }
 
-        if(start == -1 && limit == -1)
-        {
-            cmd = sql->create_command(CL_String("select id, date_added, date_updated, title, type, year, episodes, season, rating, comment, status from show ") +
-                                      (status_line.empty() ? CL_String() : CL_String(" where ") + status_line) +
-                                      CL_String("order by title COLLATE NOCASE ") );
-        }
-        else
+        if(owner)
         {
-            cmd = sql->create_command(CL_String("select id, date_added, date_updated, title, type, year, episodes, season, rating, comment, status from show  ") +
-                                      CL_String("where title like ?1 ") + (status_line.empty() ? CL_String() : CL_String(" and ") + status_line) +
-                                      CL_String("order by title COLLATE NOCASE " 
-                                                "limit ?2, ?3 "),
-                                                title.empty() ? "%" : title, start, limit);
-        }
-
-    
-        CL_DBReader reader = sql->execute_reader(cmd);
+            perform(request, *pending);
 
-        while(reader.retrieve_row())
-        {
-            shows.push_back(read_show(reader));           
+            {
+                CL_MutexSection lock(&mutex);
+                in_flight.erase(key);
+            }
+            pending->done.set();
         }
-        reader.close();
-
-        for (std::vector<ShowItem>::iterator it = shows.begin(); it != shows.end(); ++it)
+        else
         {
-            it->genres = find_show_genres(it->id);
+            pending->done.wait();
         }
 
-        return shows;
-    }
+        if(pending->failed)
+            throw CL_Exception(pending->error);
 
-    std::vector<ShowItem> find_all_shows()
-    {
-        return find_shows("", ALL_VIEWING_STATUS_MASK, -1, -1);
+        return pending->content;
     }
 };
 
+// where the MyAnimeList requests go, overridable from the command line
+struct MyAnimeListConfig
+{
+    CL_String search_host;
+    CL_String search_port;
+    CL_String api_host;     // unofficial API used for genres
+    CL_String api_port;
+    CL_String record_directory;  // when set, every downloaded document is saved as a fixture and serves as offline cache
+    double requests_per_second;
+
+    MyAnimeListConfig() : search_host("myanimelist.net"), search_port("80"), api_host("mal-api.com"), api_port("80"), requests_per_second(2.0) {}
+};
 
-class Page
+struct MyAnimeListDetails
 {
+    std::vector<CL_String> genres;
+    int year;   // 0 when unknown
 
-    int id;
+    MyAnimeListDetails() : year(0) {}
+};
 
-public:
-    Page(int id) : id(id)
-    {
+class MyAnimeListClient
+{
+    CL_SharedPtr<HTTPRequestScheduler> scheduler;
+    MyAnimeListConfig config;
 
+    static bool content_equals(const CL_DataBuffer &content, const char *text)
+    {
+        int length = strlen(text);
+        return content.get_size() == length && memcmp(content.get_data(), text, length) == 0;
     }
-    virtual ~Page(){}
 
-    int get_id() const
+    CL_DataBuffer fetch(const HTTPRequest &request) const
     {
-        return id;
+        CL_DataBuffer content;
+        if(scheduler)
+        {
+            content = scheduler->fetch(request);
+        }
+        else
+        {
+            HTTPHeader header;
+            HTTPClient client(request.host, request.port, request.username, request.password);
+            content = client.download(request.path, header);
+        }
+
+        if(config.record_directory.empty() == false)
+            HTTPFixtureStore(config.record_directory).save(request.path, content);
+
+        return content;
     }
-    virtual void fill_page(const void *data)
+
+    static MyAnimeListDetails parse_details(CL_DataBuffer docdata)
     {
+        TraceSpan span("xml", "parse_details");
+        MemoryScope memory(MEMORY_XML);
+        // the decoded body is parsed in place, without copying it into a string first
+        CL_IODevice_Memory docmem(docdata);
+        CL_DomDocument doc(docmem);
 
-    }
-};
+        CL_XPathEvaluator xpath;
+        CL_XPathObject obj = xpath.evaluate("anime/genre", doc);
+        std::vector<CL_DomNode> nodes = obj.get_node_set();
 
+        MyAnimeListDetails details;
+        for(std::vector<CL_DomNode>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        {
+            details.genres.push_back(it->to_element().get_text());
+        }
 
-class TabManager
-{
-    CL_Tab *tab;
+        // example date: 2007-12-22
+        nodes = xpath.evaluate("anime/start_date", doc).get_node_set();
+        if(nodes.empty() == false)
+            details.year = CL_StringHelp::text_to_int(nodes.front().to_element().get_text().substr(0,4));
 
-    // pages
-    std::auto_ptr<Page> addPage;
-    std::auto_ptr<Page> viewPage;
-    std::auto_ptr<Page> searchPage;
+        return details;
+    }
 
 public:
-    TabManager(CL_GUIComponent *parent, const CL_SharedPtr<Database> &database);
-    ~TabManager(){}
-
-    CL_Tab *get_tab() const;
+    MyAnimeListClient(const CL_SharedPtr<HTTPRequestScheduler> &scheduler = CL_SharedPtr<HTTPRequestScheduler>(), 
+                      const MyAnimeListConfig &config = MyAnimeListConfig()) 
+        : scheduler(scheduler), config(config)
+    {
+    }
 
-    void load_show_item(const ShowItem &si)
+    // where the documents are requested, and saved as fixtures
+    static CL_String get_search_path(const CL_String &query)
     {
-        addPage->fill_page(&si);
+        return cl_format("/api/anime/search.xml?q=%1", query);
+    }
+    static CL_String get_details_path(int showid)
+    {
+        return cl_format("/anime/%1?format=xml", showid);
     }
 
-    void display_show_item(const ShowItem &si)
+    std::vector<CL_String> get_genres(int showid) const
     {
-        load_show_item(si);
-        get_tab()->show_page(addPage->get_id());
+        return get_details(showid).genres;
     }
-};
 
-template<typename T1, typename T2>
-class UserItemPair : public std::pair<T1,T2>, public CL_ListViewItemUserData
-{
-public:
-    UserItemPair &operator =(const std::pair<T1,T2> &rhs)
+    MyAnimeListDetails get_details(int showid) const
     {
-        std::pair<T1,T2>::operator =(rhs);
-        return *this;
+        TraceSpan span("mal", "get_details");
+        // unofficial myanimelist API!
+        // this function is very slow, only use it when required
+        return parse_details(fetch(HTTPRequest(config.api_host, config.api_port, get_details_path(showid))));
     }
-};
 
-typedef UserItemPair<int,ShowItem> ShowItemPair;
+    // looks the show up in the fixture directory only, never touches the network
+    bool get_cached_details(int showid, MyAnimeListDetails &details) const
+    {
+        CL_DataBuffer docdata;
+        if(config.record_directory.empty() || HTTPFixtureStore(config.record_directory).load(get_details_path(showid), docdata) == false)
+            return false;
 
-class SearchPage : public Page
-{
-    CL_TabPage *page;
-    TabManager *tabMan;
-    CL_SharedPtr<Database> database;
+        details = parse_details(docdata);
+        return true;
+    }
 
-    CL_ListView *result;
-    CL_LineEdit *search;
-    CL_PushButton *previous, *next, *edit;
-    CL_LineEdit *pagenumber;
+    std::map<int,ShowItem> search(const CL_String &query) const
+    {
+        TraceSpan span("mal", "search");
+        CL_DataBuffer docdata = fetch(HTTPRequest(config.search_host, config.search_port, get_search_path(query), "animerecord", "animerecord"));
 
-    int currentPage;
 
-    enum { LIMIT = 100 };
+        if(content_equals(docdata, "Invalid credentials"))
+            throw CL_Exception("Invalid username or password");
 
-    void on_search_enter_pressed()
-    {
-        MyAnimeListClient client;
-        std::map<int, ShowItem> shows = client.search(search->get_text());
+        if(content_equals(docdata, "No results"))
+            docdata.set_size(0);
 
-        CL_ListViewItem docItem = result->get_document_item();
 
-        while(docItem.get_child_count() != LIMIT)
+        MemoryScope memory(MEMORY_XML);
+        CL_IODevice_Memory docmem(docdata);
+        CL_DomDocument doc(docmem);
+       
+        CL_XPathEvaluator xpath;
+        CL_XPathObject obj = xpath.evaluate("anime/entry", doc);
+        std::vector<CL_DomNode> nodes = obj.get_node_set();
+
+        std::map<int,ShowItem> shows;
+
+        for(std::vector<CL_DomNode>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+        {
+            ShowItem show;
+            CL_DomNode child = it->get_first_child();
+            CL_String output;
+            int showid;
+            while(child.is_null() == false)
+            {
+                if(child.get_node_name() == "id")
+                    showid = CL_StringHelp::text_to_int(child.to_element().get_text());
+
+                if(child.get_node_name() == "title")
+                    show.title = child.to_element().get_text();
+
+                if(child.get_node_name() == "score")
+                    show.rating = CL_StringHelp::text_to_double(child.to_element().get_text());
+
+                if(child.get_node_name() == "episodes")
+                    show.episodes = CL_StringHelp::text_to_int(child.to_element().get_text());
+
+                // example date: 2007-12-22
+                if(child.get_node_name() == "start_date")
+                {
+                    show.year = CL_StringHelp::text_to_int(child.to_element().get_text().substr(0,4));
+                }
+
+                if(child.get_node_name() == "synopsis")
+                    show.comment = child.to_element().get_text();
+
+
+                child = child.get_next_sibling();
+            }
+
+            show.id = -1;
+            show.mal_id = showid;
+            show.type = TYPE_ANIME;
+            show.status = PLANNING;
+            show.season = 1;
+
+            // the results outlive the document
+            MemoryScope resultMemory(MEMORY_SHOWS);
+            shows[showid] = show;
+        }
+
+        return shows;
+    }
+};
+
+
+class Database
+{    
+    CL_SharedPtr<CL_DBConnection> sql;
+
+    // MyAnimeList IDs already in the library, loaded on first use
+    std::unordered_set<int> owned_mal_ids;
+    bool owned_mal_ids_loaded;
+
+    // genre dictionary, keyed by the lower case name since genre names are unique regardless of case.
+    // count(*) and max(id) of the genre table tell when another process has changed it
+    std::unordered_map<CL_String, GenreItem, StringHash> genre_by_name;
+    std::vector<GenreItem> genre_list; // sorted by name
+    int genre_count;
+    int genre_max_id;
+    int genre_generation;
+
+    CL_Signal_v1<const ShowItem &> show_saved;
+    CL_Signal_v1<int> show_removed;
+    CL_Signal_v1<const std::vector<int> &> shows_changed;
+    CL_Signal_v0 edits_lost;
+
+    // other processes may use the file at the same time: a locked database is waited for up to
+    // BUSY_TIMEOUT ms, and their commits are noticed through data_version and the show_change log
+    enum { BUSY_TIMEOUT = 5000, BUSY_RETRIES = 3 };
+    int data_version;
+    bool has_data_version;
+    int last_change;    // highest show_change.change already reported
+
+    // memory mapped copy of the list columns, opened on first use. Any write makes it stale until
+    // save_snapshot rewrites it, meanwhile the list is read from sqlite
+    LibrarySnapshot snapshot;
+    CL_String snapshot_file;
+    bool snapshot_checked;
+    bool snapshot_stale;
+    unsigned int snapshot_version;  // the library_version the open snapshot was written for
+
+    // write-behind: with a delay set, show edits share one open transaction that is committed once the
+    // oldest of them is write_delay ms old, so a burst of edits pays for one sync. Reads on this connection
+    // see the queued rows, other connections only after flush
+    unsigned int write_delay;   // 0 commits every edit on its own
+    CL_DBTransaction group;     // the open group transaction, null when nothing is queued
+    int group_writes;
+    unsigned int group_start;
+
+    // one edit: its own transaction, or a savepoint in the group transaction so a failed edit
+    // is undone without losing the queued ones
+    class WriteScope
+    {
+        Database &database;
+        CL_DBTransaction transaction;
+        bool grouped;
+        bool done;
+
+    public:
+        WriteScope(Database &database) : database(database), grouped(database.write_delay > 0), done(false)
+        {
+            if(grouped)
+            {
+                if(database.group.is_null())
+                {
+                    database.group = database.start_transaction(CL_DBTransaction::immediate);
+                    database.group_start = CL_System::get_time();
+                }
+                database.execute("savepoint edit");
+            }
+            else
+            {
+                transaction = database.start_transaction(CL_DBTransaction::immediate);
+            }
+        }
+
+        ~WriteScope()
+        {
+            if(grouped && done == false)
+            {
+                try
+                {
+                    database.execute("rollback to edit");
+                    database.execute("release edit");
+                }
+                catch(CL_Exception &)
+                {
+                }
+            }
+        }
+
+        void commit()
+        {
+            if(grouped)
+            {
+                database.execute("release edit");
+                database.group_writes++;
+            }
+            else
+            {
+                transaction.commit();
+            }
+            done = true;
+        }
+    };
+
+    // the reader of a timed statement. The statement counts as finished when retrieve_row runs out of
+    // rows, on close or when the last copy goes away, whichever comes first, so a caller that stops
+    // early is charged for its own work between the rows as well
+    class StatementReader
+    {
+        struct State
+        {
+            Database *database;
+            SqlCommand command;
+            CL_DBReader reader;
+            unsigned long long start;
+            int rows;
+            bool failed;
+            bool finished;
+
+            ~State()
+            {
+                finish();
+            }
+
+            void finish()
+            {
+                if(finished)
+                    return;
+                finished = true;
+                database->finish_statement(command, start, rows, failed);
+            }
+        };
+
+        CL_SharedPtr<State> state;
+
+    public:
+        StatementReader() {}
+
+        StatementReader(Database *database, const SqlCommand &command, const CL_DBReader &reader, unsigned long long start)
+            : state(new State)
+        {
+            state->database = database;
+            state->command = command;
+            state->reader = reader;
+            state->start = start;
+            state->rows = 0;
+            state->failed = false;
+            state->finished = false;
+        }
+
+        bool retrieve_row()
+        {
+            try
+            {
+                if(state->reader.retrieve_row())
+                {
+                    state->rows++;
+                    return true;
+                }
+            }
+            catch(CL_Exception &)
+            {
+                state->failed = true;
+                state->finish();
+                throw;
+            }
+            state->finish();
+            return false;
+        }
+
+        void close()
+        {
+            state->reader.close();
+            state->finish();
+        }
+
+        int get_name_index(const CL_StringRef &name) const { return state->reader.get_name_index(name); }
+        CL_DBValue get_column_value(int index) const { return state->reader.get_column_value(index); }
+        CL_DBValue get_column_value(const CL_StringRef &name) const { return state->reader.get_column_value(name); }
+        int get_column_int(int index) const { return state->reader.get_column_int(index); }
+    };
+
+    // every statement of every connection is counted here
+    static StatementStats statement_stats;
+
+    StatementReader execute_reader(SqlCommand &cmd)
+    {
+        unsigned long long start = CL_System::get_microseconds();
+        try
+        {
+            return StatementReader(this, cmd, sql->execute_reader(cmd.get_command()), start);
+        }
+        catch(CL_Exception &)
+        {
+            finish_statement(cmd, start, 0, true);
+            throw;
+        }
+    }
+
+    int execute_scalar_int(SqlCommand &cmd)
+    {
+        unsigned long long start = CL_System::get_microseconds();
+        int value;
+        try
+        {
+            value = sql->execute_scalar_int(cmd.get_command());
+        }
+        catch(CL_Exception &)
+        {
+            finish_statement(cmd, start, 0, true);
+            throw;
+        }
+        finish_statement(cmd, start, 1, false);
+        return value;
+    }
+
+    void execute_non_query(SqlCommand &cmd)
+    {
+        unsigned long long start = CL_System::get_microseconds();
+        try
+        {
+            sql->execute_non_query(cmd.get_command());
+        }
+        catch(CL_Exception &)
+        {
+            finish_statement(cmd, start, 0, true);
+            throw;
+        }
+        finish_statement(cmd, start, 0, false);
+    }
+
+    // called from StatementReader's destructor too, so nothing may escape
+    void finish_statement(const SqlCommand &cmd, unsigned long long start, int rows, bool failed)
+    {
+        unsigned long long end = CL_System::get_microseconds();
+        unsigned int duration = (unsigned int)cl_min(end - start, 0xffffffffull);
+        try
+        {
+            if(statement_stats.record(cmd.get_text(), duration, rows, failed) == false)
+                return;
+
+            SlowStatement slow;
+            slow.time = CL_DateTime::get_current_local_time().to_short_datetime_string();
+            slow.statement = cmd.get_text();
+            slow.parameters = cmd.get_parameters();
+            slow.plan = explain_query_plan(cmd.get_text());
+            slow.duration = duration;
+            slow.rows = rows;
+            statement_stats.add_slow(slow);
+
+            cl_log_event("slow query", "%1 ms, %2 rows: %3 [%4] plan: %5", duration / 1000, rows, slow.statement, slow.parameters, slow.plan);
+        }
+        catch(CL_Exception &)
+        {
+        }
+    }
+
+    // the steps of explain query plan separated by ;, run on the raw connection so it isn't counted itself.
+    // Parameters stay unbound, sqlite picks the plan without looking at their values
+    CL_String explain_query_plan(const CL_String &statement)
+    {
+        CL_String start = CL_StringHelp::text_to_lower(trimmed(statement).substr(0, 7));
+        if(start.substr(0, 6) != "select" && start.substr(0, 6) != "insert" && start.substr(0, 6) != "update" &&
+           start.substr(0, 6) != "delete" && start.substr(0, 4) != "with" && start.substr(0, 7) != "replace")
+            return CL_String();
+
+        CL_DBCommand cmd = sql->create_command("explain query plan " + statement);
+        CL_DBReader reader = sql->execute_reader(cmd);
+        int detail = reader.get_name_index("detail");
+
+        CL_String plan;
+        while(reader.retrieve_row())
+        {
+            if(plan.empty() == false)
+                plan += "; ";
+            plan += (CL_String)reader.get_column_value(detail);
+        }
+        reader.close();
+        return plan;
+    }
+        
+    template<typename StrType>
+    StrType strip_sql_symbol(const StrType &s) const
+    {
+        return clean(s, StrType("%_"));
+    }
+
+
+    /// \brief Create database command without input arguments.
+    SqlCommand create_command(const CL_StringRef &format, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return SqlCommand(*sql, format, type); }
+
+    /// \brief Create database command with 1 input argument.
+    template <class Arg1>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).get_result(); }
+
+    /// \brief Create database command with 2 input arguments.
+    template <class Arg1, class Arg2>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).get_result(); }
+
+    /// \brief Create database command with 3 input arguments.
+    template <class Arg1, class Arg2, class Arg3>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).get_result(); }
+
+    /// \brief Create database command with 4 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).get_result(); }
+
+    /// \brief Create database command with 5 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).get_result(); }
+
+    /// \brief Create database command with 6 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).get_result(); }
+
+    /// \brief Create database command with 7 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).get_result(); }
+
+    /// \brief Create database command with 8 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).get_result(); }
+
+    /// \brief Create database command with 9 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).get_result(); }
+
+    /// \brief Create database command with 10 input arguments.
+    template <class Arg1, class Arg2, class Arg3, class Arg4, class Arg5, class Arg6, class Arg7, class Arg8, class Arg9, class Arg10>
+    SqlCommand create_command(const CL_StringRef &format, Arg1 arg1, Arg2 arg2, Arg3 arg3, Arg4 arg4, Arg5 arg5, Arg6 arg6, Arg7 arg7, Arg8 arg8, Arg9 arg9, Arg10 arg10, CL_DBCommand::Type type = CL_DBCommand::sql_statement)
+    { return begin_arg(*sql, format, type).set_arg(arg1).set_arg(arg2).set_arg(arg3).set_arg(arg4).set_arg(arg5).set_arg(arg6).set_arg(arg7).set_arg(arg8).set_arg(arg9).set_arg(arg10).get_result(); }
+
+
+public:
+
+    // the snapshot file is rewritten on exit, so a second library needs one of its own
+    Database(const CL_String &databaseFile = "animerecord.s3db", const CL_String &snapshotFile = "animerecord.snapshot")
+    {
+        // test to see if the file exist or not by opening it
+        CL_File file(databaseFile, CL_File::open_existing, CL_File::access_read_write);
+        file.close();
+        sql = CL_SharedPtr<CL_DBConnection>(new CL_SqliteConnection(databaseFile));
+        owned_mal_ids_loaded = false;
+        genre_count = 0;
+        genre_max_id = 0;
+        genre_generation = 0;
+        snapshot_file = snapshotFile;
+        snapshot_checked = false;
+        snapshot_stale = false;
+        snapshot_version = 0;
+        write_delay = 0;
+        group_writes = 0;
+        group_start = 0;
+        has_data_version = true;
+
+        // sqlite before 3.7.15 has no busy_timeout pragma and fails on a locked database right away
+        try
+        {
+            SqlCommand cmd = create_command(cl_format("pragma busy_timeout = %1", (int)BUSY_TIMEOUT));
+            execute_scalar_int(cmd);
+        }
+        catch(CL_Exception &)
+        {
+        }
+
+        upgrade_schema();
+
+        last_change = get_last_change();
+        data_version = read_data_version();
+    }
+
+    ~Database()
+    {
+        try
+        {
+            flush();
+        }
+        catch(CL_Exception &e)
+        {
+            // a failed commit was already rolled back, a lock that didn't go away leaves the edits queued
+            if(group.is_null())
+                cl_log_event("database", "%1", e.message);
+            else
+                cl_log_event("database", "%1 queued edits were lost: %2", group_writes, e.message);
+        }
+    }
+
+    // ms an edit may wait for its commit, 0 commits each one right away
+    void set_write_delay(unsigned int delay)
+    {
+        flush();
+        write_delay = delay;
+    }
+
+    unsigned int get_write_delay() const { return write_delay; }
+
+    // shared by every connection in the process
+    static StatementStats &get_statement_stats() { return statement_stats; }
+
+    // runs of at least threshold ms go to the slow statement log with their parameters and query plan, 0 turns it off
+    static void set_slow_query_threshold(unsigned int threshold)
+    {
+        statement_stats.set_slow_threshold(threshold * 1000);
+        SqlCommand::keep_parameters = threshold > 0;
+    }
+    int get_queued_writes() const { return group_writes; }
+
+    // durability barrier, returns once every queued edit is on disk. While another process holds the lock
+    // the commit is tried again, and if it still can't get it the edits stay queued for the next flush. Any
+    // other failure rolls them back: the caches are dropped and sig_edits_lost tells the pages to reload
+    void flush()
+    {
+        TraceSpan span("database", "flush");
+        if(group.is_null())
+            return;
+
+        for(int attempt = 1; ; attempt++)
+        {
+            try
+            {
+                group.commit();
+                break;
+            }
+            catch(CL_Exception &e)
+            {
+                if(e.message.find("locked") == CL_String::npos)
+                {
+                    int lost = group_writes;
+                    discard_group();
+                    throw CL_Exception(cl_format("%1 queued edits were lost: %2", lost, e.message));
+                }
+                if(attempt == BUSY_RETRIES)
+                    throw;
+                cl_log_event("database", "still locked after %1 ms, commit attempt %2 of %3", (int)BUSY_TIMEOUT, attempt + 1, (int)BUSY_RETRIES);
+            }
+        }
+
+        cl_log_event("database", "%1 edits committed after %2 ms", group_writes, CL_System::get_time() - group_start);
+        group = CL_DBTransaction();
+        group_writes = 0;
+    }
+
+    // commits the queued edits once the oldest has waited write_delay ms, called from a GUI timer
+    void flush_if_due()
+    {
+        if(group.is_null() == false && CL_System::get_time() - group_start >= write_delay)
+            flush();
+    }
+
+    // reports the shows other processes have added, changed or deleted since the last call through
+    // sig_shows_changed. Nothing is read but the pragma until something changed, so a timer can poll it
+    int check_external_changes()
+    {
+        TraceSpan span("database", "check_external_changes");
+        int version = read_data_version();
+        if(version == data_version)
+            return 0;
+        data_version = version;
+
+        // the snapshot was only matched against library_version when it was opened, and not every write
+        // shows up in the change log
+        if(snapshot.is_open() && get_library_version() != snapshot_version)
+        {
+            cl_log_event("snapshot", "the library was changed by another process, the list is read from the database");
+            library_changed();
+        }
+
+        std::vector<int> changed;
+        SqlCommand cmd = create_command("select show_id, change from show_change where change > ?1 order by change", last_change);
+        StatementReader reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+        {
+            changed.push_back(reader.get_column_value("show_id"));
+            last_change = reader.get_column_value("change");
+        }
+        reader.close();
+
+        if(changed.empty())
+            return 0;
+
+        // whatever was cached about the library may be out of date
+        library_changed();
+        owned_mal_ids.clear();
+        owned_mal_ids_loaded = false;
+
+        cl_log_event("database", "%1 shows changed by another process", changed.size());
+        shows_changed.invoke(changed);
+        return changed.size();
+    }
+
+private:
+    // the queued edits are gone, everything cached since the group began may hold them
+    void discard_group()
+    {
+        try
+        {
+            group.rollback();
+        }
+        catch(CL_Exception &)
+        {
+        }
+        group = CL_DBTransaction();
+        group_writes = 0;
+
+        library_changed();
+        owned_mal_ids.clear();
+        owned_mal_ids_loaded = false;
+        genre_count = -1;   // genres added in the group, refresh_genres reloads them
+        edits_lost.invoke();
+    }
+
+    void execute(const CL_StringRef &statement)
+    {
+        SqlCommand cmd = create_command(statement);
+        execute_non_query(cmd);
+    }
+
+    // sqlite doesn't nest transactions, so a transaction of its own ends the group first
+    CL_DBTransaction begin_transaction(CL_DBTransaction::Type type = CL_DBTransaction::deferred)
+    {
+        flush();
+        return start_transaction(type);
+    }
+
+    // writers start with an immediate transaction, a deferred one that reads first can't wait for another
+    // process's write lock and fails right away. The busy timeout can still run out while other processes
+    // keep writing, and since nothing has happened yet the begin is simply tried again
+    CL_DBTransaction start_transaction(CL_DBTransaction::Type type)
+    {
+        TraceSpan span("database", "begin_transaction");
+        for(int attempt = 1; ; attempt++)
+        {
+            try
+            {
+                return sql->begin_transaction(type);
+            }
+            catch(CL_Exception &e)
+            {
+                if(attempt == BUSY_RETRIES || e.message.find("locked") == CL_String::npos)
+                    throw;
+                cl_log_event("database", "still locked after %1 ms, attempt %2 of %3", (int)BUSY_TIMEOUT, attempt + 1, (int)BUSY_RETRIES);
+            }
+        }
+    }
+
+    int get_last_change()
+    {
+        SqlCommand cmd = create_command("select ifnull(max(change), 0) from show_change");
+        return execute_scalar_int(cmd);
+    }
+
+    // pragma data_version needs sqlite 3.8.8, older versions return no row and the last change is
+    // compared instead, which also moves with this connection's own edits
+    int read_data_version()
+    {
+        if(has_data_version)
+        {
+            try
+            {
+                SqlCommand cmd = create_command("pragma data_version");
+                return execute_scalar_int(cmd);
+            }
+            catch(CL_Exception &)
+            {
+                has_data_version = false;
+            }
+        }
+        return get_last_change();
+    }
+
+    bool has_column(const CL_String &table, const CL_String &column)
+    {
+        SqlCommand cmd = create_command(cl_format("pragma table_info(%1)", table));
+        StatementReader reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+        {
+            if(CL_String(reader.get_column_value("name")) == column)
+                return true;
+        }
+        return false;
+    }
+
+    // brings database files created by older versions up to date, user_version counts the steps applied
+    void upgrade_schema()
+    {
+        TraceSpan span("database", "upgrade_schema");
+        SqlCommand cmd = create_command("pragma user_version");
+        int version = execute_scalar_int(cmd);
+
+        if(version < 1)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            if(has_column("show", "mal_id") == false)
+                execute("alter table show add column mal_id INTEGER");
+            execute("create unique index if not exists show_mal_id_index on show(mal_id)");
+            execute("pragma user_version = 1");
+            transaction.commit();
+        }
+
+        if(version < 2)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            if(has_column("show", "title_key") == false)
+                execute("alter table show add column title_key NVARCHAR(1000)");
+            fill_title_keys();
+            create_title_key_index();
+            execute("pragma user_version = 2");
+            transaction.commit();
+        }
+
+        if(version < 3)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            if(has_column("show", "sort_key") == false)
+                execute("alter table show add column sort_key TEXT");
+            fill_sort_keys();
+            execute("create index if not exists show_sort_key_index on show(sort_key, id)");
+            execute("pragma user_version = 3");
+            transaction.commit();
+        }
+
+        if(version < 4)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_stats_tables();
+            recompute_stats();
+            execute("pragma user_version = 4");
+            transaction.commit();
+        }
+
+        if(version < 5)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_library_version();
+            execute("pragma user_version = 5");
+            transaction.commit();
+        }
+
+        if(version < 6)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_filter_index();
+            execute("pragma user_version = 6");
+            transaction.commit();
+        }
+
+        if(version < 7)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_order_indexes();
+            execute("pragma user_version = 7");
+            transaction.commit();
+        }
+
+        if(version < 8)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_change_log();
+            execute("pragma user_version = 8");
+            transaction.commit();
+        }
+
+        if(version < 9)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            rebuild_show_table();
+            execute("pragma user_version = 9");
+            transaction.commit();
+        }
+
+        if(version < 10)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_genre_mask_triggers();
+            execute("pragma user_version = 10");
+            transaction.commit();
+        }
+
+        if(version < 11)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            create_change_log();
+            execute("pragma user_version = 11");
+            transaction.commit();
+        }
+
+        if(version < 12)
+        {
+            CL_DBTransaction transaction = sql->begin_transaction();
+            execute("create index if not exists show_genre_genre_index on show_genre(genre_id, show_id)");
+            execute("pragma user_version = 12");
+            transaction.commit();
+        }
+    }
+
+    // bit n of genre_mask is set when the show has genre n, for the genre IDs below 63 so the mask stays
+    // a positive 64 bit integer. The filters test the mask instead of joining show_genre for every row
+    static CL_String get_genre_mask_expression()
+    {
+        return "(select ifnull(sum(1 << genre_id), 0) from "
+               "(select distinct genre_id from show_genre where show_genre.show_id = show.id and genre_id < 63))";
+    }
+
+    // ClanLib only binds 32 bit integers, the mask goes in as text and sqlite casts it back
+    static CL_String make_genre_mask(const std::vector<GenreItem> &genres)
+    {
+        long long mask = 0;
+        for (std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+        {
+            if(it->id >= 0 && it->id < 63)
+                mask |= 1LL << it->id;
+        }
+        return CL_StringHelp::ll_to_text(mask);
+    }
+
+    // keeps genre_mask right when show_genre is changed by anything else, another copy of the program or
+    // a sqlite tool. sqlite only has row triggers, so they skip the show when the bit is already right:
+    // add_show and add_shows write the mask with the show and their genre rows don't touch it again
+    void create_genre_mask_triggers()
+    {
+        execute("drop trigger if exists ON_TBL_SHOW_GENRE_MASK_INSERT");
+        execute("create trigger ON_TBL_SHOW_GENRE_MASK_INSERT after insert on show_genre for each row when new.genre_id >= 0 and new.genre_id < 63 begin "
+                "update show set genre_mask = genre_mask | (1 << new.genre_id) "
+                "where id = new.show_id and genre_mask & (1 << new.genre_id) = 0; "
+                "end");
+
+        // a show can have a genre twice, the bit stays until the last row goes
+        execute("drop trigger if exists ON_TBL_SHOW_GENRE_MASK_DELETE");
+        execute("create trigger ON_TBL_SHOW_GENRE_MASK_DELETE after delete on show_genre for each row when old.genre_id >= 0 and old.genre_id < 63 begin "
+                "update show set genre_mask = genre_mask & ~(1 << old.genre_id) "
+                "where id = old.show_id and genre_mask & (1 << old.genre_id) <> 0 "
+                "and not exists (select 1 from show_genre where show_id = old.show_id and genre_id = old.genre_id); "
+                "end");
+
+        // masks that went wrong before the triggers existed
+        execute("update show set genre_mask = " + get_genre_mask_expression() + " where genre_mask <> " + get_genre_mask_expression());
+    }
+
+    // an index for listing in column order: the column and the ID, then every column a filter compares,
+    // so the rows that don't match are skipped without touching the table
+    static CL_String get_order_index_columns(const CL_String &column)
+    {
+        const char *filterColumns[] = { "status", "year", "rating", "type", "season", "genre_mask", "title_key" };
+
+        CL_String columns = column + ", id";
+        for(int i = 0; i < 7; i++)
+        {
+            if(column != filterColumns[i])
+                columns += CL_String(", ") + filterColumns[i];
+        }
+        return columns;
+    }
+
+    // show_filter_index serves the list in title order
+    void create_filter_index()
+    {
+        if(has_column("show", "genre_mask") == false)
+            execute("alter table show add column genre_mask INTEGER DEFAULT 0 NOT NULL");
+        execute("update show set genre_mask = " + get_genre_mask_expression());
+
+        execute("drop index if exists show_sort_key_index");
+        execute("create index if not exists show_filter_index on show(" + get_order_index_columns("sort_key") + ")");
+    }
+
+    // one index per order other than title, scanned forwards or backwards for either direction
+    void create_order_indexes()
+    {
+        for(int order = ORDER_RATING; order < ORDER_COUNT; order++)
+        {
+            execute(cl_format("create index if not exists %1 on show(%2)", get_order_index((SHOW_ORDER)order), get_order_index_columns(get_order_column((SHOW_ORDER)order))));
+        }
+    }
+
+    // a counter the triggers bump on every change to show or show_genre, whoever makes it.
+    // The library snapshot records the value it was written for
+    void create_library_version()
+    {
+        execute("create table if not exists library_version ([version] INTEGER NOT NULL)");
+        execute("insert into library_version (version) select 0 where not exists (select 1 from library_version)");
+
+        const char *triggers[][2] =
+        {
+            { "ON_TBL_SHOW_VERSION_INSERT", "after insert on show" },
+            { "ON_TBL_SHOW_VERSION_UPDATE", "after update on show" },
+            { "ON_TBL_SHOW_VERSION_DELETE", "after delete on show" },
+            { "ON_TBL_SHOW_GENRE_VERSION_INSERT", "after insert on show_genre" },
+            { "ON_TBL_SHOW_GENRE_VERSION_DELETE", "after delete on show_genre" },
+        };
+        for(int i = 0; i < 5; i++)
+        {
+            execute(cl_format("drop trigger if exists %1", triggers[i][0]));
+            execute(cl_format("create trigger %1 %2 for each row begin update library_version set version = version + 1; end", triggers[i][0], triggers[i][1]));
+        }
+    }
+
+    // show.type becomes a SHOW_TYPE number, sqlite can't change the type of a column so the rows are copied
+    // into a new table. It also stores the small columns the list, the filters and the orders read in front
+    // of the strings, a long comment spills into overflow pages and the columns before it are read without them.
+    // Dropping the old table drops its indexes and triggers, they are created again on the new one
+    void rebuild_show_table()
+    {
+        SqlCommand cmd = create_command("select ifnull((select seq from sqlite_sequence where name = 'show'), 0)");
+        int sequence = execute_scalar_int(cmd);
+
+        execute("create table show_new ([id] INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, [type] INTEGER DEFAULT 0 NOT NULL, "
+                "[status] INTEGER DEFAULT 0 NOT NULL, [year] INTEGER DEFAULT 1900 NOT NULL, [season] INTEGER DEFAULT 1 NOT NULL, "
+                "[episodes] INTEGER DEFAULT 0 NOT NULL, [rating] REAL DEFAULT 5 NOT NULL, [mal_id] INTEGER, [genre_mask] INTEGER DEFAULT 0 NOT NULL, "
+                "[date_added] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL, [date_updated] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL, "
+                "[sort_key] TEXT, [title_key] NVARCHAR(1000), [title] NVARCHAR(1000) NOT NULL, [comment] NVARCHAR(5000) NOT NULL)");
+        execute(cl_format("insert into show_new (id, type, status, year, season, episodes, rating, mal_id, genre_mask, date_added, date_updated, sort_key, title_key, title, comment) "
+                          "select id, case lower(type) when 'film' then %1 when 'tv' then %2 else %3 end, status, year, season, episodes, rating, mal_id, genre_mask, "
+                          "date_added, date_updated, sort_key, title_key, title, comment from show order by id", (int)TYPE_FILM, (int)TYPE_TV, (int)TYPE_ANIME));
+        execute("drop table show");
+        execute("alter table show_new rename to show");
+
+        // IDs of deleted shows stay retired
+        execute("delete from sqlite_sequence where name = 'show'");
+        cmd = create_command("insert into sqlite_sequence (name, seq) values ('show', max(?1, (select ifnull(max(id), 0) from show)))", sequence);
+        execute_non_query(cmd);
+
+        execute("create unique index if not exists show_mal_id_index on show(mal_id)");
+        create_title_key_index();
+        execute("create index if not exists show_filter_index on show(" + get_order_index_columns("sort_key") + ")");
+        create_order_indexes();
+        create_stats_tables();
+        create_library_version();
+        create_change_log();
+
+        // snapshots of the old table hold the type as text
+        execute("update library_version set version = version + 1");
+    }
+
+    // the latest change number of every show that was added, changed or deleted, so another process can
+    // tell which rows to reload. One row per show, so it never grows past the library. A genre added to or
+    // taken from a show counts as a change of the show
+    void create_change_log()
+    {
+        execute("create table if not exists show_change ([show_id] INTEGER PRIMARY KEY NOT NULL, [change] INTEGER NOT NULL)");
+        execute("create index if not exists show_change_index on show_change(change)");
+
+        const char *triggers[][3] =
+        {
+            { "ON_TBL_SHOW_CHANGE_INSERT", "after insert on show", "new.id" },
+            { "ON_TBL_SHOW_CHANGE_UPDATE", "after update on show", "new.id" },
+            { "ON_TBL_SHOW_CHANGE_DELETE", "after delete on show", "old.id" },
+            { "ON_TBL_SHOW_GENRE_CHANGE_INSERT", "after insert on show_genre", "new.show_id" },
+            { "ON_TBL_SHOW_GENRE_CHANGE_DELETE", "after delete on show_genre", "old.show_id" },
+        };
+        for(int i = 0; i < 5; i++)
+        {
+            execute(cl_format("drop trigger if exists %1", triggers[i][0]));
+            execute(cl_format("create trigger %1 %2 for each row begin "
+                              "insert or replace into show_change (show_id, change) values (%3, (select ifnull(max(change), 0) + 1 from show_change)); "
+                              "end", triggers[i][0], triggers[i][1], triggers[i][2]));
+        }
+    }
+
+    // summary tables for the statistics page, the triggers on show and show_genre keep them up to date
+    // so the page never has to scan the library
+    void create_stats_tables()
+    {
+        execute("create table if not exists stats_status ([status] INTEGER PRIMARY KEY NOT NULL, [shows] INTEGER DEFAULT 0 NOT NULL, [episodes] INTEGER DEFAULT 0 NOT NULL)");
+        execute("create table if not exists stats_rating ([rating] INTEGER PRIMARY KEY NOT NULL, [shows] INTEGER DEFAULT 0 NOT NULL)");
+        execute("create table if not exists stats_year ([year] INTEGER PRIMARY KEY NOT NULL, [shows] INTEGER DEFAULT 0 NOT NULL, [episodes] INTEGER DEFAULT 0 NOT NULL)");
+        execute("create table if not exists stats_genre ([genre_id] INTEGER PRIMARY KEY NOT NULL, [shows] INTEGER DEFAULT 0 NOT NULL)");
+
+        // sqlite has no upsert, every bucket is created with "insert or ignore" before it's counted
+        execute("drop trigger if exists ON_TBL_SHOW_INSERT");
+        execute("create trigger ON_TBL_SHOW_INSERT after insert on show for each row begin "
+                "insert or ignore into stats_status (status) values (new.status); "
+                "update stats_status set shows = shows + 1, episodes = episodes + new.episodes where status = new.status; "
+                "insert or ignore into stats_rating (rating) values (cast(new.rating as integer)); "
+                "update stats_rating set shows = shows + 1 where rating = cast(new.rating as integer); "
+                "insert or ignore into stats_year (year) values (new.year); "
+                "update stats_year set shows = shows + 1, episodes = episodes + new.episodes where year = new.year; "
+                "end");
+
+        execute("drop trigger if exists ON_TBL_SHOW_DELETE_ITEM");
+        execute("create trigger ON_TBL_SHOW_DELETE_ITEM after delete on show for each row begin "
+                "delete from show_genre where show_id = old.id; "
+                "update stats_status set shows = shows - 1, episodes = episodes - old.episodes where status = old.status; "
+                "update stats_rating set shows = shows - 1 where rating = cast(old.rating as integer); "
+                "update stats_year set shows = shows - 1, episodes = episodes - old.episodes where year = old.year; "
+                "end");
+
+        // the date_updated update doesn't fire this trigger again since recursive triggers are off,
+        // the where clauses skip the buckets of columns that didn't change
+        execute("drop trigger if exists ON_TBL_SHOW_UPDATE");
+        execute("create trigger ON_TBL_SHOW_UPDATE after update on show for each row begin "
+                "update show set date_updated = datetime('now') where id = new.id; "
+                "update stats_status set shows = shows - 1, episodes = episodes - old.episodes "
+                "where status = old.status and (old.status <> new.status or old.episodes <> new.episodes); "
+                "insert or ignore into stats_status (status) values (new.status); "
+                "update stats_status set shows = shows + 1, episodes = episodes + new.episodes "
+                "where status = new.status and (old.status <> new.status or old.episodes <> new.episodes); "
+                "update stats_rating set shows = shows - 1 "
+                "where rating = cast(old.rating as integer) and cast(old.rating as integer) <> cast(new.rating as integer); "
+                "insert or ignore into stats_rating (rating) values (cast(new.rating as integer)); "
+                "update stats_rating set shows = shows + 1 "
+                "where rating = cast(new.rating as integer) and cast(old.rating as integer) <> cast(new.rating as integer); "
+                "update stats_year set shows = shows - 1, episodes = episodes - old.episodes "
+                "where year = old.year and (old.year <> new.year or old.episodes <> new.episodes); "
+                "insert or ignore into stats_year (year) values (new.year); "
+                "update stats_year set shows = shows + 1, episodes = episodes + new.episodes "
+                "where year = new.year and (old.year <> new.year or old.episodes <> new.episodes); "
+                "end");
+
+        execute("drop trigger if exists ON_TBL_SHOW_GENRE_INSERT");
+        execute("create trigger ON_TBL_SHOW_GENRE_INSERT after insert on show_genre for each row begin "
+                "insert or ignore into stats_genre (genre_id) values (new.genre_id); "
+                "update stats_genre set shows = shows + 1 where genre_id = new.genre_id; "
+                "end");
+
+        execute("drop trigger if exists ON_TBL_SHOW_GENRE_DELETE");
+        execute("create trigger ON_TBL_SHOW_GENRE_DELETE after delete on show_genre for each row begin "
+                "update stats_genre set shows = shows - 1 where genre_id = old.genre_id; "
+                "end");
+    }
+
+    void recompute_stats()
+    {
+        execute("delete from stats_status");
+        execute("delete from stats_rating");
+        execute("delete from stats_year");
+        execute("delete from stats_genre");
+        execute("insert into stats_status (status, shows, episodes) select status, count(*), sum(episodes) from show group by status");
+        execute("insert into stats_rating (rating, shows) select cast(rating as integer), count(*) from show group by cast(rating as integer)");
+        execute("insert into stats_year (year, shows, episodes) select year, count(*), sum(episodes) from show group by year");
+        execute("insert into stats_genre (genre_id, shows) select genre_id, count(*) from show_genre group by genre_id");
+    }
+
+    std::vector<std::pair<int, CL_String> > get_titles()
+    {
+        std::vector<std::pair<int, CL_String> > titles;
+
+        SqlCommand cmd = create_command("select id, title from show");
+        StatementReader reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+        {
+            titles.push_back(std::make_pair((int)reader.get_column_value("id"), (CL_String)reader.get_column_value("title")));
+        }
+        reader.close();
+
+        return titles;
+    }
+
+    void fill_title_keys()
+    {
+        std::vector<std::pair<int, CL_String> > titles = get_titles();
+
+        SqlCommand updateCmd = create_command("update show set title_key=?2 where id=?1");
+        for (std::vector<std::pair<int, CL_String> >::const_iterator it = titles.begin(); it != titles.end(); ++it)
+        {
+            updateCmd.set_input_parameter(1, it->first);
+            updateCmd.set_input_parameter(2, make_title_key(it->second));
+            execute_non_query(updateCmd);
+        }
+    }
+
+    void fill_sort_keys()
+    {
+        std::vector<std::pair<int, CL_String> > titles = get_titles();
+
+        SqlCommand updateCmd = create_command("update show set sort_key=?2 where id=?1");
+        for (std::vector<std::pair<int, CL_String> >::const_iterator it = titles.begin(); it != titles.end(); ++it)
+        {
+            updateCmd.set_input_parameter(1, it->first);
+            updateCmd.set_input_parameter(2, make_sort_key(it->second));
+            execute_non_query(updateCmd);
+        }
+    }
+
+    // shows that only differed in case or punctuation could already be in the database, in which case
+    // the index can't be unique but still serves the duplicate checks
+    void create_title_key_index()
+    {
+        SqlCommand cmd = create_command("select count(*) from (select 1 from show group by title_key, type, year, season having count(*) > 1)");
+        int duplicates = execute_scalar_int(cmd);
+
+        if(duplicates == 0)
+        {
+            execute("create unique index if not exists show_title_key_index on show(title_key, type, year, season)");
+        }
+        else
+        {
+            cl_log_event("database", "%1 shows share a title key with another show, the title key index won't be unique", duplicates);
+            execute("create index if not exists show_title_key_index on show(title_key, type, year, season)");
+        }
+    }
+
+    void load_owned_mal_ids()
+    {
+        if(owned_mal_ids_loaded)
+            return;
+
+        SqlCommand cmd = create_command("select mal_id from show where mal_id is not null");
+        StatementReader reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+        {
+            owned_mal_ids.insert(reader.get_column_value("mal_id"));
+        }
+        owned_mal_ids_loaded = true;
+    }
+
+    void set_owned_mal_id(int malid)
+    {
+        if(malid > 0 && owned_mal_ids_loaded)
+            owned_mal_ids.insert(malid);
+    }
+
+    unsigned int get_library_version()
+    {
+        SqlCommand cmd = create_command("select version from library_version");
+        return execute_scalar_int(cmd);
+    }
+
+    bool use_snapshot()
+    {
+        if(snapshot_checked == false)
+        {
+            snapshot_checked = true;
+            unsigned int start_time = CL_System::get_time();
+            snapshot_version = get_library_version();
+            snapshot_stale = snapshot.open(snapshot_file, snapshot_version) == false;
+            if(snapshot_stale)
+                cl_log_event("snapshot", "%1 is missing or out of date, the list is read from the database", snapshot_file);
+            else
+                cl_log_event("snapshot", "%1 shows mapped from %2 in %3 ms", snapshot.get_row_count(), snapshot_file, CL_System::get_time() - start_time);
+        }
+        return snapshot.is_open();
+    }
+
+    void library_changed()
+    {
+        snapshot.close();
+        snapshot_checked = true;
+        snapshot_stale = true;
+    }
+
+    void find_snapshot_shows(const ShowFilter &filter, bool descending, const ShowCursor &after, int limit, ShowList &shows)
+    {
+        MemoryScope memory(MEMORY_SHOWS);
+        std::vector<int> rows = snapshot.find_rows(filter, descending, after.text, after.id, limit);
+
+        unsigned int length;
+        const char *text;
+        for(std::vector<int>::const_iterator it = rows.begin(); it != rows.end(); ++it)
+        {
+            ShowRow &show = shows.add();
+            show.id = snapshot.get_id(*it);
+            text = snapshot.get_sort_key_data(*it, length);
+            show.sort_key = shows.store(text, length);
+            text = snapshot.get_title_data(*it, length);
+            show.title = shows.store(text, length);
+            show.type = snapshot.get_type(*it);
+            text = snapshot.get_comment_data(*it, length);
+            show.comment = shows.store(text, length);
+            show.rating = snapshot.get_rating(*it);
+            show.year = snapshot.get_year(*it);
+            show.season = snapshot.get_season(*it);
+            show.status = (VIEWING_STATUS)snapshot.get_status(*it);
+        }
+    }
+
+    void notify_show_saved(int showid, double rating, const std::vector<GenreItem> &genres)
+    {
+        ShowItem show;
+        show.id = showid;
+        show.rating = rating;
+        show.genres = genres;
+        show_saved.invoke(show);
+    }
+
+    static CL_String get_genre_key(const CL_String &name)
+    {
+        return CL_StringHelp::text_to_lower(name);
+    }
+
+    static void sort_genres(std::vector<GenreItem> &genres)
+    {
+        struct SortFun
+        {
+            bool operator()(const GenreItem &item1, const GenreItem &item2)
+            {
+                return get_genre_key(item1.name) < get_genre_key(item2.name);
+            }
+        };
+
+        std::sort(genres.begin(), genres.end(), SortFun());
+    }
+
+    // reloads the genre dictionary if the genre table changed since the last check
+    void refresh_genres()
+    {
+        TraceSpan span("database", "refresh_genres");
+        SqlCommand cmd = create_command("select count(*) as total, ifnull(max(id),0) as max_id from genre");
+        StatementReader reader = execute_reader(cmd);
+        reader.retrieve_row();
+        int count = reader.get_column_value("total");
+        int max_id = reader.get_column_value("max_id");
+        reader.close();
+
+        if(genre_generation > 0 && count == genre_count && max_id == genre_max_id)
+            return;
+
+        genre_by_name.clear();
+        genre_list.clear();
+
+        SqlCommand genreCmd = create_command("select id, name from genre");
+        StatementReader genreReader = execute_reader(genreCmd);
+        while(genreReader.retrieve_row())
+        {
+            GenreItem item;
+            item.id = genreReader.get_column_value("id");
+            item.name = genreReader.get_column_value("name");
+            genre_by_name[get_genre_key(item.name)] = item;
+            genre_list.push_back(item);
+        }
+        genreReader.close();
+
+        sort_genres(genre_list);
+
+        genre_count = count;
+        genre_max_id = max_id;
+        genre_generation++;
+    }
+
+public:
+
+    // return alphabetically sorted show genres
+    std::vector<GenreItem> get_all_genres()
+    {
+        refresh_genres();
+        return genre_list;
+    }
+
+    // changes whenever the genre list does, so callers can tell when to rebuild what they made from it
+    int get_genre_generation()
+    {
+        refresh_genres();
+        return genre_generation;
+    }
+
+    std::vector<StatusItem> get_all_status()
+    {
+        SqlCommand cmd = create_command("select id, name from status order by id asc");
+        StatementReader reader = execute_reader(cmd);
+
+        std::vector<StatusItem> statuses;
+        while(reader.retrieve_row())
+        {
+            StatusItem item;
+            item.id = reader.get_column_value("id");
+            item.name = reader.get_column_value("name");
+            statuses.push_back(item);
+        }
+
+        return statuses;
+    }
+
+    // returns the GenreItems that were passed to this function with the ID set
+    std::vector<GenreItem> get_genres_by_name(const std::vector<CL_String> &genreStrs)
+    {
+        refresh_genres();
+
+        std::vector<GenreItem> genres;
+        for (std::vector<CL_String>::const_iterator it = genreStrs.begin(); it != genreStrs.end(); ++it)
+        {
+            std::unordered_map<CL_String, GenreItem, StringHash>::const_iterator genre = genre_by_name.find(get_genre_key(*it));
+            if(genre == genre_by_name.end())
+                throw CL_Exception(cl_format("Unknown genre %1", *it));
+
+            genres.push_back(genre->second);
+        }
+
+        return genres;
+    }
+
+    // returns the genres in genreStrs that aren't in the database yet
+    std::vector<CL_String> get_missing_genres(const std::vector<CL_String> &genreStrs)
+    {
+        refresh_genres();
+
+        std::set<CL_String> seen;
+        std::vector<CL_String> missing;
+        for (std::vector<CL_String>::const_iterator it = genreStrs.begin(); it != genreStrs.end(); ++it)
+        {
+            CL_String key = get_genre_key(*it);
+            if(genre_by_name.find(key) == genre_by_name.end() && seen.insert(key).second)
+                missing.push_back(*it);
+        }
+
+        return missing;
+    }
+
+    // ensures all genreStrs are added to the database, using a single transaction for the whole list
+    void ensure_add_genres(const std::vector<CL_String> &genreStrs)
+    {
+        if(get_missing_genres(genreStrs).empty())
+            return;
+
+        // take the write lock before checking again so no other process can add the same genre in between
+        CL_DBTransaction transaction = begin_transaction(CL_DBTransaction::immediate);
+
+        std::vector<CL_String> missing = get_missing_genres(genreStrs);
+        if(missing.empty())
+            return;
+
+        SqlCommand cmd = create_command("insert into genre (name) values (?1)");
+
+        std::vector<GenreItem> added;
+        for (std::vector<CL_String>::const_iterator it = missing.begin(); it != missing.end(); ++it)
+        {
+            cmd.set_input_parameter(1, *it);
+            execute_non_query(cmd);
+
+            GenreItem item;
+            item.id = cmd.get_output_last_insert_rowid();
+            item.name = *it;
+            added.push_back(item);
+        }
+
+        transaction.commit();
+
+        // the dictionary is only touched once the rows are really there
+        for (std::vector<GenreItem>::const_iterator it = added.begin(); it != added.end(); ++it)
+        {
+            genre_by_name[get_genre_key(it->name)] = *it;
+            genre_list.push_back(*it);
+            genre_max_id = cl_max(genre_max_id, it->id);
+        }
+        sort_genres(genre_list);
+
+        genre_count += added.size();
+        genre_generation++;
+    }
+
+    // returns the inserted show id
+    int add_show(const CL_String &title, SHOW_TYPE type, const std::vector<GenreItem> &genres, int year, int rating, const CL_String &comment, int episodes, int season, int status, int malid = 0)
+    {
+        TraceSpan span("database", "add_show");
+        CL_String title_s = strip_sql_symbol(title);
+        CL_String comment_s = strip_sql_symbol(comment);
+
+        if(title_s.empty())
+            throw CL_Exception("title is empty!");
+
+        WriteScope transaction(*this);
+
+        SqlCommand cmd = create_sql_command(*sql, "insert into show (title, type, year, rating, comment, episodes, season, status, mal_id, title_key, sort_key, genre_mask) "
+                                                    "values (?1,?2,?3,?4,?5,?6,?7,?8,nullif(?9,0),?10,?11,cast(?12 as integer))",
+                                                title_s, (int)type, year, rating, comment_s, episodes, season, status, malid, make_title_key(title_s), make_sort_key(title_s),
+                                                make_genre_mask(genres));
+        execute_non_query(cmd);
+
+        int showid = cmd.get_output_last_insert_rowid();
+
+        cmd = create_command("insert into show_genre (show_id, genre_id) values (?1,?2)");
+        cmd.set_input_parameter(1, showid);
+
+        for (std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+        {
+            cmd.set_input_parameter(2, it->id);
+            execute_non_query(cmd);
+        }
+
+        transaction.commit();
+        set_owned_mal_id(malid);
+        library_changed();
+        notify_show_saved(showid, rating, genres);
+
+        return showid;
+    }
+
+    void update_show(int showid, const CL_String &title, SHOW_TYPE type, const std::vector<GenreItem> &genres, 
+                     int year, int rating, const CL_String &comment, int episodes, int season, int status, int malid = 0)
+    {
+        TraceSpan span("database", "update_show");
+        CL_String title_s = strip_sql_symbol(title);
+        CL_String comment_s = strip_sql_symbol(comment);
+
+        if(title_s.empty())
+            throw CL_Exception("title is empty!");
+
+        WriteScope transaction(*this);
+
+        // the ID the show had, a new one takes its place in the owned set
+        int oldMalId = 0;
+        if(malid > 0)
+        {
+            SqlCommand malCmd = create_command("select ifnull(mal_id, 0) from show where id=?1", showid);
+            oldMalId = execute_scalar_int(malCmd);
+        }
+
+        // the old genres go first, the delete trigger would otherwise clear the bits of the new mask
+        SqlCommand cmd = create_command("delete from show_genre where show_id=?1", showid);
+        execute_non_query(cmd);
+
+        // a show keeps its MyAnimeList ID unless a new one is given
+        cmd = create_sql_command(*sql, "update show set title=?2, type=?3, year=?4, rating=?5, comment=?6, episodes=?7, season=?8, status=?9, "
+                                                    "mal_id=ifnull(nullif(?10,0), mal_id), title_key=?11, sort_key=?12, genre_mask=cast(?13 as integer) where id=?1",
+                                               showid, title_s, (int)type, year, rating, comment_s, episodes, season, status, malid, make_title_key(title_s), make_sort_key(title_s));
+        cmd.set_input_parameter(13, make_genre_mask(genres));
+        execute_non_query(cmd);
+
+        cmd = create_command("insert into show_genre (show_id, genre_id) values (?1,?2)");
+        cmd.set_input_parameter(1, showid);
+
+        for (std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+        {
+            cmd.set_input_parameter(2, it->id);
+            execute_non_query(cmd);
+        }
+
+        transaction.commit();
+        if(oldMalId > 0 && oldMalId != malid)
+            owned_mal_ids.erase(oldMalId);
+        set_owned_mal_id(malid);
+        library_changed();
+        notify_show_saved(showid, rating, genres);
+    }
+
+    // inserts a batch of new shows in a single transaction, the genres must have their ID set. Shows
+    // with dates keep them, an import of our own export shouldn't make every show new
+    void add_shows(const std::vector<ShowItem> &shows)
+    {
+        TraceSpan span("database", "add_shows");
+        WriteScope transaction(*this);
+
+        SqlCommand showCmd = create_command("insert into show (title, type, year, rating, comment, episodes, season, status, mal_id, title_key, sort_key, genre_mask, date_added, date_updated) "
+                                                   "values (?1,?2,?3,?4,?5,?6,?7,?8,nullif(?9,0),?10,?11,cast(?12 as integer),"
+                                                   "ifnull(nullif(?13,''),CURRENT_TIMESTAMP),ifnull(nullif(?14,''),CURRENT_TIMESTAMP))");
+        SqlCommand genreCmd = create_command("insert into show_genre (show_id, genre_id) values (?1,?2)");
+
+        std::vector<int> showIds(shows.size(), -1);
+        for (std::vector<ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
+        {
+            CL_String title_s = strip_sql_symbol(it->title);
+            if(title_s.empty())
+                continue;
+
+            showCmd.set_input_parameter(1, title_s);
+            showCmd.set_input_parameter(2, (int)it->type);
+            showCmd.set_input_parameter(3, it->year);
+            showCmd.set_input_parameter(4, it->rating);
+            showCmd.set_input_parameter(5, strip_sql_symbol(it->comment));
+            showCmd.set_input_parameter(6, it->episodes);
+            showCmd.set_input_parameter(7, it->season);
+            showCmd.set_input_parameter(8, it->status);
+            showCmd.set_input_parameter(9, it->mal_id);
+            showCmd.set_input_parameter(10, make_title_key(title_s));
+            showCmd.set_input_parameter(11, make_sort_key(title_s));
+            showCmd.set_input_parameter(12, make_genre_mask(it->genres));
+            showCmd.set_input_parameter(13, it->date_added.is_null() ? CL_String() : it->date_added.to_utc().to_short_datetime_string());
+            showCmd.set_input_parameter(14, it->date_updated.is_null() ? CL_String() : it->date_updated.to_utc().to_short_datetime_string());
+            execute_non_query(showCmd);
+
+            showIds[it - shows.begin()] = showCmd.get_output_last_insert_rowid();
+            genreCmd.set_input_parameter(1, showIds[it - shows.begin()]);
+            for (std::vector<GenreItem>::const_iterator genre = it->genres.begin(); genre != it->genres.end(); ++genre)
+            {
+                genreCmd.set_input_parameter(2, genre->id);
+                execute_non_query(genreCmd);
+            }
+        }
+
+        transaction.commit();
+        library_changed();
+
+        for (std::vector<ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
+        {
+            set_owned_mal_id(it->mal_id);
+            if(showIds[it - shows.begin()] != -1)
+                notify_show_saved(showIds[it - shows.begin()], it->rating, it->genres);
+        }
+    }
+
+    // duplicate detection key, matches what show_exist compares
+    static CL_String make_show_key(const CL_String &title, SHOW_TYPE type, int year, int season)
+    {
+        return cl_format("%1|%2|%3|%4", make_title_key(title), (int)type, year, season);
+    }
+
+    // recomputes the summary tables from scratch
+    void rebuild_stats()
+    {
+        CL_DBTransaction transaction = begin_transaction(CL_DBTransaction::immediate);
+        recompute_stats();
+        transaction.commit();
+    }
+
+    // compares the summary tables with a full recompute, returns the number of rows that differ per table
+    std::map<CL_String, int> check_stats()
+    {
+        TraceSpan span("database", "check_stats");
+        const char *checks[][2] =
+        {
+            { "stats_status", "select status, shows, episodes from stats_status where shows <> 0", },
+            { "stats_status", "select status, count(*), sum(episodes) from show group by status" },
+            { "stats_rating", "select rating, shows from stats_rating where shows <> 0" },
+            { "stats_rating", "select cast(rating as integer), count(*) from show group by cast(rating as integer)" },
+            { "stats_year", "select year, shows, episodes from stats_year where shows <> 0" },
+            { "stats_year", "select year, count(*), sum(episodes) from show group by year" },
+            { "stats_genre", "select genre_id, shows from stats_genre where shows <> 0" },
+            { "stats_genre", "select genre_id, count(*) from show_genre group by genre_id" },
+        };
+
+        std::map<CL_String, int> differences;
+        for(int i = 0; i < 8; i += 2)
+        {
+            CL_String stored = checks[i][1];
+            CL_String recomputed = checks[i+1][1];
+            SqlCommand cmd = create_command("select (select count(*) from (" + stored + " except " + recomputed + ")) + "
+                                                   "(select count(*) from (" + recomputed + " except " + stored + "))");
+            differences[checks[i][0]] = execute_scalar_int(cmd);
+        }
+        return differences;
+    }
+
+    LibraryStats get_stats()
+    {
+        TraceSpan span("database", "get_stats");
+        LibraryStats stats;
+        stats.shows = 0;
+        stats.episodes = 0;
+
+        SqlCommand cmd = create_command("select ifnull(status.name, 'Unknown') as name, stats_status.shows as shows, stats_status.episodes as episodes "
+                                               "from stats_status left join status on status.id = stats_status.status "
+                                               "where stats_status.shows > 0 order by stats_status.status");
+        stats.by_status = read_stats(cmd);
+        for(std::vector<StatsItem>::const_iterator it = stats.by_status.begin(); it != stats.by_status.end(); ++it)
+        {
+            stats.shows += it->shows;
+            stats.episodes += it->episodes;
+        }
+
+        cmd = create_command("select rating || '/10' as name, shows, 0 as episodes from stats_rating where shows > 0 order by rating desc");
+        stats.by_rating = read_stats(cmd);
+
+        cmd = create_command("select case year when 0 then 'Unknown' else cast(year as text) end as name, shows, episodes "
+                                  "from stats_year where shows > 0 order by year desc");
+        stats.by_year = read_stats(cmd);
+
+        cmd = create_command("select genre.name as name, stats_genre.shows as shows, 0 as episodes "
+                                  "from stats_genre, genre where genre.id = stats_genre.genre_id and stats_genre.shows > 0 "
+                                  "order by stats_genre.shows desc limit 20");
+        stats.top_genres = read_stats(cmd);
+
+        return stats;
+    }
+
+    // ID and title key of every show, for the duplicate finder
+    std::vector<std::pair<int, CL_String> > get_title_keys()
+    {
+        SqlCommand cmd = create_command("select id, title_key from show");
+        StatementReader reader = execute_reader(cmd);
+
+        std::vector<std::pair<int, CL_String> > keys;
+        while(reader.retrieve_row())
+        {
+            keys.push_back(std::make_pair((int)reader.get_column_value("id"), (CL_String)reader.get_column_value("title_key")));
+        }
+
+        return keys;
+    }
+
+    // folds the genres and the MyAnimeList ID of the merged shows into keepId, then deletes them
+    void merge_shows(int keepId, const std::vector<int> &mergeIds)
+    {
+        TraceSpan span("database", "merge_shows");
+        WriteScope transaction(*this);
+
+        SqlCommand genreCmd = create_command("insert into show_genre (show_id, genre_id) "
+                                                    "select ?1, genre_id from show_genre "
+                                                    "where show_id = ?2 and genre_id not in (select genre_id from show_genre where show_id = ?1)");
+        SqlCommand malIdCmd = create_command("select ifnull(mal_id,0) from show where id=?1");
+        SqlCommand deleteCmd = create_command("delete from show where id=?1");
+        SqlCommand malUpdateCmd = create_command("update show set mal_id=?2 where id=?1 and mal_id is null");
+
+        for (std::vector<int>::const_iterator it = mergeIds.begin(); it != mergeIds.end(); ++it)
+        {
+            if(*it == keepId)
+                continue;
+
+            genreCmd.set_input_parameter(1, keepId);
+            genreCmd.set_input_parameter(2, *it);
+            execute_non_query(genreCmd);
+
+            malIdCmd.set_input_parameter(1, *it);
+            int malid = execute_scalar_int(malIdCmd);
+
+            // the show_genre rows go with the ON_TBL_SHOW_DELETE_ITEM trigger
+            deleteCmd.set_input_parameter(1, *it);
+            execute_non_query(deleteCmd);
+
+            if(malid > 0)
+            {
+                malUpdateCmd.set_input_parameter(1, keepId);
+                malUpdateCmd.set_input_parameter(2, malid);
+                execute_non_query(malUpdateCmd);
+            }
+        }
+
+        transaction.commit();
+        library_changed();
+
+        // a merged show can take its MyAnimeList ID with it
+        owned_mal_ids.clear();
+        owned_mal_ids_loaded = false;
+
+        for (std::vector<int>::const_iterator it = mergeIds.begin(); it != mergeIds.end(); ++it)
+        {
+            if(*it != keepId)
+                show_removed.invoke(*it);
+        }
+        show_saved.invoke(find_show(keepId));
+    }
+
+    // empties the library before a benchmark fills it, the genres stay. Nothing is signalled, it is
+    // meant for a database no page shows yet
+    void remove_all_shows()
+    {
+        TraceSpan span("database", "remove_all_shows");
+        WriteScope transaction(*this);
+
+        // the triggers take the show_genre rows and the summary tables along
+        execute("delete from show");
+
+        transaction.commit();
+        library_changed();
+        owned_mal_ids.clear();
+        owned_mal_ids_loaded = false;
+    }
+
+    // raised after a show has been added or changed, only the ID, rating and genre IDs are guaranteed to be set
+    CL_Signal_v1<const ShowItem &> &sig_show_saved() { return show_saved; }
+    CL_Signal_v1<int> &sig_show_removed() { return show_removed; }
+
+    // raised by check_external_changes with the IDs of the shows another process changed or deleted
+    CL_Signal_v1<const std::vector<int> &> &sig_shows_changed() { return shows_changed; }
+
+    // raised when flush had to roll back the queued edits, the lists may show shows that are gone
+    CL_Signal_v0 &sig_edits_lost() { return edits_lost; }
+
+    // ID, rating and genre IDs of every show, for the recommender
+    std::vector<ShowItem> get_show_genres()
+    {
+        TraceSpan span("database", "get_show_genres");
+        SqlCommand cmd = create_command("select show.id as id, show.rating as rating, ifnull(show_genre.genre_id, 0) as genre_id "
+                                               "from show left join show_genre on show_genre.show_id = show.id order by show.id");
+        StatementReader reader = execute_reader(cmd);
+
+        std::vector<ShowItem> shows;
+        while(reader.retrieve_row())
+        {
+            int id = reader.get_column_value("id");
+            if(shows.empty() || shows.back().id != id)
+            {
+                shows.push_back(ShowItem());
+                shows.back().id = id;
+                shows.back().rating = reader.get_column_value("rating");
+            }
+
+            GenreItem genre;
+            genre.id = reader.get_column_value("genre_id");
+            if(genre.id != 0)
+                shows.back().genres.push_back(genre);
+        }
+
+        return shows;
+    }
+
+    // constant time check whether a MyAnimeList show is already in the library
+    bool is_mal_id_owned(int malid)
+    {
+        load_owned_mal_ids();
+        return owned_mal_ids.find(malid) != owned_mal_ids.end();
+    }
+
+    // returns a show with id -1 when the MyAnimeList ID isn't in the library
+    ShowItem find_show_by_mal_id(int malid)
+    {
+        ShowItem show;
+        show.id = -1;
+
+        if(is_mal_id_owned(malid) == false)
+            return show;
+
+        SqlCommand cmd = create_command("select id from show where mal_id = ?1", malid);
+        StatementReader reader = execute_reader(cmd);
+        if(reader.retrieve_row())
+        {
+            int showid = reader.get_column_value("id");
+            reader.close();
+            show = find_show(showid);
+        }
+
+        return show;
+    }
+
+    bool has_row(SqlCommand &cmd)
+    {
+        StatementReader reader = execute_reader(cmd);
+        return reader.retrieve_row();
+    }
+
+    bool show_exist(const CL_String &title, SHOW_TYPE type, int year, int season)
+    {
+        SqlCommand cmd = create_command("select id from show where title_key=?1 and type=?2 and year=?3 and season=?4", make_title_key(title), (int)type, year, season);
+        return has_row(cmd);        
+    }
+
+    bool show_exist(int showid)
+    {
+        SqlCommand cmd = create_command("select id from show where id=?1", showid);
+        return has_row(cmd);        
+    }
+
+    // find out if the current show matches another show in the database or not
+    bool show_similar_to(int showid, const CL_String &title, SHOW_TYPE type, int year, int season)
+    {
+        SqlCommand cmd = create_command("select id from show where title_key=?2 and type=?3 and year=?4 and season=?5 and id<>?1", 
+                                                showid, make_title_key(title), (int)type, year, season);
+        return has_row(cmd);        
+    }
+
+    std::vector<GenreItem> find_show_genres(int id)
+    {
+        SqlCommand genreCmd = create_command("select show_genre.genre_id, genre.name "
+                                                    "from show, show_genre, genre "
+                                                    "where show.id = show_genre.show_id and show_genre.genre_id = genre.id and show.id = ?1", id);
+
+        StatementReader genreReader = execute_reader(genreCmd);
+
+        std::vector<GenreItem> genres;
+
+        while(genreReader.retrieve_row())
+        {
+            GenreItem gi;
+            gi.id = genreReader.get_column_value("genre_id");
+            gi.name = genreReader.get_column_value("name");
+            genres.push_back(gi);
+        }
+
+        return genres;
+    }
+
+    ShowItem read_show(StatementReader &reader)
+    {
+        ShowItem show;
+
+        show.id = reader.get_column_value("id");
+        show.date_added = reader.get_column_value("date_added");
+        show.date_updated = reader.get_column_value("date_updated");
+        show.title = reader.get_column_value("title");
+        show.type = (SHOW_TYPE)(int)reader.get_column_value("type");
+        show.year = reader.get_column_value("year");
+        show.episodes = reader.get_column_value("episodes");
+        show.season = reader.get_column_value("season");
+        show.rating = reader.get_column_value("rating");
+        show.comment = reader.get_column_value("comment");
+        show.status = (VIEWING_STATUS)(int)reader.get_column_value("status");
+        show.mal_id = reader.get_column_value("mal_id");
+        show.sort_key = reader.get_column_value("sort_key");
+
+        return show;
+    }
+
+    ShowItem find_show(int id)
+    {
+        TraceSpan span("database", "find_show");
+        ShowItem show;
+
+        SqlCommand cmd = create_command(get_show_columns() + "from show where id = ?1", id);
+        StatementReader reader = execute_reader(cmd);
+
+        if(reader.retrieve_row())
+        {
+            show = read_show(reader);
+            reader.close();
+
+            show.genres = find_show_genres(show.id);     
+        }
+
+        return show;
+    }
+
+private:
+    // sort_key is aliased to its ifnull, so an order by has to name show.sort_key to walk the index
+    static CL_String get_show_columns()
+    {
+        return "select id, date_added, date_updated, title, type, year, episodes, season, rating, comment, status, "
+               "ifnull(mal_id,0) as mal_id, ifnull(sort_key,'') as sort_key ";
+    }
+
+    static CL_String get_status_predicate(int statusmask)
+    {
+        CL_String status_line;
+
+        if(statusmask > 0)
+        {
+            status_line = " status in (";
+
+            int i = 1;
+            std::vector<CL_String> statuses;
+            while(statusmask > 0)
+            {
+                int s = (statusmask >> i) & 1;
+
+                if(s)
+                {
+                    statuses.push_back(CL_StringHelp::int_to_text(i));
+                }
+                statusmask &= ~(1 << i);
+                i++;
+            }
+            status_line += join(statuses.begin(), statuses.end(), CL_String(",")) + ") ";
+        }
+
+        return status_line;
+    }
+
+    // value for one ?n of a filter statement
+    struct FilterParameter
+    {
+        bool is_text;
+        bool is_integer;
+        CL_String text;
+        double number;
+    };
+
+    // returns the ?n the value is bound to, the filter parameters come after the three fixed ones
+    static CL_String add_filter_parameter(std::vector<FilterParameter> &parameters, const CL_String &value)
+    {
+        FilterParameter parameter = { true, false, value, 0 };
+        parameters.push_back(parameter);
+        return cl_format("?%1", parameters.size() + 3);
+    }
+
+    static CL_String add_filter_parameter(std::vector<FilterParameter> &parameters, int value)
+    {
+        FilterParameter parameter = { false, true, CL_String(), (double)value };
+        parameters.push_back(parameter);
+        return cl_format("?%1", parameters.size() + 3);
+    }
+
+    static CL_String add_filter_parameter(std::vector<FilterParameter> &parameters, double value)
+    {
+        FilterParameter parameter = { false, false, CL_String(), value };
+        parameters.push_back(parameter);
+        return cl_format("?%1", parameters.size() + 3);
+    }
+
+    // fills in the genre IDs, false when one of the names isn't a genre and nothing can match
+    bool resolve_filter_genres(ShowFilter &filter)
+    {
+        refresh_genres();
+
+        filter.genres.clear();
+        for (std::vector<CL_String>::const_iterator it = filter.genre_names.begin(); it != filter.genre_names.end(); ++it)
+        {
+            std::unordered_map<CL_String, GenreItem, StringHash>::const_iterator genre = genre_by_name.find(get_genre_key(*it));
+            if(genre == genre_by_name.end())
+                return false;
+            filter.genres.push_back(genre->second.id);
+        }
+        return true;
+    }
+
+    std::vector<StatsItem> read_stats(SqlCommand &cmd)
+    {
+        std::vector<StatsItem> items;
+
+        StatementReader reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+        {
+            StatsItem item;
+            item.name = reader.get_column_value("name");
+            item.shows = reader.get_column_value("shows");
+            item.episodes = reader.get_column_value("episodes");
+            items.push_back(item);
+        }
+
+        return items;
+    }
+
+    std::vector<ShowItem> read_shows(SqlCommand &cmd)
+    {
+        std::vector<ShowItem> shows;
+
+        StatementReader reader = execute_reader(cmd);
+
+        while(reader.retrieve_row())
+        {
+            shows.push_back(read_show(reader));           
+        }
+        reader.close();
+
+        for (std::vector<ShowItem>::iterator it = shows.begin(); it != shows.end(); ++it)
+        {
+            it->genres = find_show_genres(it->id);
+        }
+
+        return shows;
+    }
+
+    // the columns are looked up once instead of by name for every value
+    void read_show_rows(SqlCommand &cmd, ShowList &shows)
+    {
+        StatementReader reader = execute_reader(cmd);
+
+        int id = reader.get_name_index("id"), dateAdded = reader.get_name_index("date_added"), dateUpdated = reader.get_name_index("date_updated"),
+            title = reader.get_name_index("title"), type = reader.get_name_index("type"), year = reader.get_name_index("year"),
+            episodes = reader.get_name_index("episodes"), season = reader.get_name_index("season"), rating = reader.get_name_index("rating"),
+            comment = reader.get_name_index("comment"), status = reader.get_name_index("status"), malId = reader.get_name_index("mal_id"),
+            sortKey = reader.get_name_index("sort_key");
+
+        while(reader.retrieve_row())
+        {
+            ShowRow &show = shows.add();
+            show.id = reader.get_column_value(id);
+            show.date_added = reader.get_column_value(dateAdded);
+            show.date_updated = reader.get_column_value(dateUpdated);
+            show.title = shows.store(reader.get_column_value(title));
+            show.type = (SHOW_TYPE)(int)reader.get_column_value(type);
+            show.year = reader.get_column_value(year);
+            show.episodes = reader.get_column_value(episodes);
+            show.season = reader.get_column_value(season);
+            show.rating = reader.get_column_value(rating);
+            show.comment = shows.store(reader.get_column_value(comment));
+            show.status = (VIEWING_STATUS)(int)reader.get_column_value(status);
+            show.mal_id = reader.get_column_value(malId);
+            show.sort_key = shows.store(reader.get_column_value(sortKey));
+        }
+        reader.close();
+
+        read_row_genres(shows);
+    }
+
+    // the genre IDs of every row in one statement, read_shows asks once per show
+    void read_row_genres(ShowList &shows)
+    {
+        if(shows.empty())
+            return;
+
+        CL_String ids;
+        ids.reserve(shows.size() * 8);
+        for(ShowList::size_type i = 0; i < shows.size(); i++)
+        {
+            if(i > 0)
+                ids += ',';
+            ids += CL_StringHelp::int_to_text(shows[i].id);
+        }
+
+        SqlCommand cmd = create_command("select show_id, genre_id from show_genre where show_id in (" + ids + ") order by show_id, genre_id");
+        StatementReader reader = execute_reader(cmd);
+
+        std::vector<std::pair<int,int> > pairs;
+        while(reader.retrieve_row())
+            pairs.push_back(std::make_pair(reader.get_column_int(0), reader.get_column_int(1)));
+        reader.close();
+
+        for(ShowList::size_type i = 0; i < shows.size(); i++)
+        {
+            std::vector<std::pair<int,int> >::const_iterator first = std::lower_bound(pairs.begin(), pairs.end(), std::make_pair(shows[i].id, INT_MIN));
+            std::vector<std::pair<int,int> >::const_iterator last = first;
+            while(last != pairs.end() && last->first == shows[i].id)
+                ++last;
+
+            int *genres = shows.allocate_genres((int)(last - first));
+            for(std::vector<std::pair<int,int> >::const_iterator it = first; it != last; ++it)
+                genres[it - first] = it->second;
+            shows[i].genres = genres;
+            shows[i].genre_count = (int)(last - first);
+        }
+    }
+
+public:
+    // TODO full text search
+    std::vector<ShowItem> find_shows(const CL_String &title, int statusmask, 
+                                     int start, int limit)
+    {
+        SqlCommand cmd;
+
+        CL_String status_line = get_status_predicate(statusmask);
+
+        if(start == -1 && limit == -1)
+        {
+            cmd = create_command(get_show_columns() + "from show " +
+                                      (status_line.empty() ? CL_String() : CL_String(" where ") + status_line) +
+                                      CL_String("order by show.sort_key, show.id ") );
+        }
+        else
+        {
+            cmd = create_command(get_show_columns() + "from show " +
+                                      CL_String("where title like ?1 ") + (status_line.empty() ? CL_String() : CL_String(" and ") + status_line) +
+                                      CL_String("order by show.sort_key, show.id " 
+                                                "limit ?2, ?3 "),
+                                                title.empty() ? "%" : title, start, limit);
+        }
+
+        return read_shows(cmd);
+    }
+
+    static const char *get_order_column(SHOW_ORDER order)
+    {
+        static const char *columns[ORDER_COUNT] = { "sort_key", "rating", "year", "episodes", "date_added", "date_updated" };
+        return columns[order];
+    }
+
+    static CL_String get_order_index(SHOW_ORDER order)
+    {
+        if(order == ORDER_TITLE)
+            return "show_filter_index";
+        return cl_format("show_%1_index", get_order_column(order));
+    }
+
+    static bool is_text_order(SHOW_ORDER order)
+    {
+        return order == ORDER_TITLE || order == ORDER_DATE_ADDED || order == ORDER_DATE_UPDATED;
+    }
+
+    // the cursor for the page after show. Dates are compared as sqlite stores them, "YYYY-MM-DD HH:MM:SS"
+    static ShowCursor make_cursor(const ShowOrder &order, const ShowRow &show)
+    {
+        ShowCursor cursor;
+        cursor.id = show.id;
+        switch(order.column)
+        {
+        case ORDER_TITLE:        cursor.text = show.sort_key; break;
+        case ORDER_RATING:       cursor.number = show.rating; break;
+        case ORDER_YEAR:         cursor.number = show.year; break;
+        case ORDER_EPISODES:     cursor.number = show.episodes; break;
+        case ORDER_DATE_ADDED:   cursor.text = show.date_added.to_short_datetime_string(); break;
+        case ORDER_DATE_UPDATED: cursor.text = show.date_updated.to_short_datetime_string(); break;
+        default: break;
+        }
+        return cursor;
+    }
+
+    // binds what add_filter_parameter numbered, from ?4 on
+    static void set_filter_parameters(SqlCommand &cmd, const std::vector<FilterParameter> &parameters)
+    {
+        for(std::vector<FilterParameter>::size_type i = 0; i < parameters.size(); i++)
+        {
+            if(parameters[i].is_text)
+                cmd.set_input_parameter(i + 4, parameters[i].text);
+            else if(parameters[i].is_integer)
+                cmd.set_input_parameter(i + 4, (int)parameters[i].number);
+            else
+                cmd.set_input_parameter(i + 4, parameters[i].number);
+        }
+    }
+
+    // how find_shows_after reads a filter, see there
+    enum { SELECTIVE_SHOWS = 2000, SCAN_LIMIT = 10000 };
+
+    // the year range, the rating range or the genre that lets in the fewest shows, counted in the stats
+    // tables the triggers keep. Returns the count and sets index to the index of that range, or genre to the
+    // genre. A rating range is counted in whole points, which can only come out high
+    int find_filter_access(const ShowFilter &filter, CL_String &index, int &genre)
+    {
+        int fewest = INT_MAX;
+        genre = -1;
+        if(filter.year_min > 0 || filter.year_max > 0)
+        {
+            SqlCommand cmd = create_command("select ifnull(sum(shows), 0) from stats_year where year between ?1 and ?2",
+                                            filter.year_min, filter.year_max > 0 ? filter.year_max : INT_MAX);
+            fewest = execute_scalar_int(cmd);
+            index = "show_year_index";
+        }
+        if(filter.rating_min >= 0 || filter.rating_max >= 0)
+        {
+            SqlCommand cmd = create_command("select ifnull(sum(shows), 0) from stats_rating where rating between ?1 and ?2",
+                                            filter.rating_min >= 0 ? (int)filter.rating_min : 0, filter.rating_max >= 0 ? (int)filter.rating_max : INT_MAX);
+            int shows = execute_scalar_int(cmd);
+            if(shows < fewest)
+            {
+                fewest = shows;
+                index = "show_rating_index";
+            }
+        }
+        for(std::vector<int>::const_iterator it = filter.genres.begin(); it != filter.genres.end(); ++it)
+        {
+            SqlCommand cmd = create_command("select ifnull((select shows from stats_genre where genre_id = ?1), 0)", *it);
+            int shows = execute_scalar_int(cmd);
+            if(shows < fewest)
+            {
+                fewest = shows;
+                genre = *it;
+            }
+        }
+        return fewest;
+    }
+
+    // keyset pagination, returns up to limit shows that match the filter and come after the cursor in the
+    // given order, ties are broken by ID. Unlike an offset this costs the same on every page, the statement
+    // walks the index of the order column forwards or backwards and stops after limit rows.
+    // Every filter is one statement with the same shape, the criteria that are set add a term with a bound parameter.
+    // A filter that lets few shows through would walk the whole index for a page, so a year range, rating range
+    // or genre that the stats count at SELECTIVE_SHOWS or fewer reads its own index instead, and otherwise the
+    // walk stops after SCAN_LIMIT entries. Returns true when it stopped before the page was full, resume is then
+    // the last entry it looked at and the next page starts after it.
+    // Title order is served from the snapshot when it is current, those shows only have the columns it stores
+    // and find_show has the rest. shows is cleared first, its arena holds the strings and genres of the result
+    bool find_shows_after(const ShowFilter &filter, const ShowOrder &order, const ShowCursor &after, int limit, ShowList &shows, ShowCursor &resume)
+    {
+        TraceSpan span("database", "find_shows_after");
+        MemoryScope memory(MEMORY_SHOWS);
+        shows.clear();
+        resume = ShowCursor();
+
+        ShowFilter resolved = filter;
+        if(resolve_filter_genres(resolved) == false)
+            return false;
+
+        if(order.column == ORDER_TITLE && use_snapshot())
+        {
+            find_snapshot_shows(resolved, order.descending, after, limit, shows);
+            return false;
+        }
+
+        // ?1 to ?3 are the cursor and the limit, the filter parameters follow
+        std::vector<FilterParameter> parameters;
+        std::vector<CL_String> terms;
+
+        CL_String column = get_order_column(order.column);
+        const char *direction = order.descending ? "<" : ">";
+        CL_String cursorTerm = cl_format("show.%1 %2= ?1 and (show.%1 %2 ?1 or show.id %2 ?2)", column, direction);
+        if(after.id > 0)
+        {
+            // the first term lets sqlite start the index scan at the cursor. It seeks on the column only, shows
+            // with the same value before the cursor are stepped over. Qualified like the order by, so the title
+            // cursor compares the column and not the ifnull alias
+            terms.push_back(cursorTerm);
+        }
+
+        CL_String status_line = get_status_predicate(resolved.status_mask);
+        if(status_line.empty() == false)
+            terms.push_back(status_line);
+        if(resolved.year_min > 0)
+            terms.push_back("year >= " + add_filter_parameter(parameters, resolved.year_min));
+        if(resolved.year_max > 0)
+            terms.push_back("year <= " + add_filter_parameter(parameters, resolved.year_max));
+        if(resolved.rating_min >= 0)
+            terms.push_back("rating >= " + add_filter_parameter(parameters, resolved.rating_min));
+        if(resolved.rating_max >= 0)
+            terms.push_back("rating <= " + add_filter_parameter(parameters, resolved.rating_max));
+        if(resolved.season > 0)
+            terms.push_back("season = " + add_filter_parameter(parameters, resolved.season));
+        if(resolved.type >= 0)
+            terms.push_back("type = " + add_filter_parameter(parameters, resolved.type));
+
+        // genres that don't fit in the mask need show_genre
+        std::vector<GenreItem> maskGenres;
+        for(std::vector<int>::const_iterator it = resolved.genres.begin(); it != resolved.genres.end(); ++it)
+        {
+            if(*it >= 0 && *it < 63)
+            {
+                maskGenres.push_back(GenreItem());
+                maskGenres.back().id = *it;
+            }
+            else
+                terms.push_back("exists (select 1 from show_genre where show_genre.show_id = show.id and show_genre.genre_id = " + add_filter_parameter(parameters, *it) + ")");
+        }
+        if(maskGenres.empty() == false)
+        {
+            CL_String mask = add_filter_parameter(parameters, make_genre_mask(maskGenres));
+            terms.push_back("genre_mask & cast(" + mask + " as integer) = cast(" + mask + " as integer)");
+        }
+
+        // title keys have no % or _ left, they can go in a pattern as they are
+        if(resolved.title_key.empty() == false)
+            terms.push_back("title_key like " + add_filter_parameter(parameters, "%" + resolved.title_key + "%"));
+
+        CL_String index = get_order_index(order.column);
+        CL_String access = "indexed by " + index;
+        CL_String descending = order.descending ? " desc" : "";
+        CL_String orderBy = "order by show." + column + descending + ", show.id" + descending;
+
+        int genre = -1;
+        CL_String rangeIndex;
+        bool filtered = terms.size() > (after.id > 0 ? 1u : 0u);
+        bool selective = filtered && find_filter_access(resolved, rangeIndex, genre) <= SELECTIVE_SHOWS;
+        if(selective && genre >= 0)
+        {
+            // the IDs from show_genre_genre_index are looked up by rowid, not indexed keeps sqlite off the order index
+            access = "not indexed";
+            terms.push_back("show.id in (select show_id from show_genre where genre_id = " + add_filter_parameter(parameters, genre) + ")");
+        }
+        else if(selective)
+            access = "indexed by " + rangeIndex;
+
+        // the last of the next SCAN_LIMIT entries of the order index bounds the scan. They are counted from
+        // where the scan starts, the cursor or a range on the order column
+        bool bounded = false;
+        if(filtered && selective == false)
+        {
+            std::vector<FilterParameter> scanParameters;
+            std::vector<CL_String> scanTerms;
+            if(after.id > 0)
+                scanTerms.push_back(cursorTerm);
+            if(order.column == ORDER_YEAR && resolved.year_min > 0)
+                scanTerms.push_back("year >= " + add_filter_parameter(scanParameters, resolved.year_min));
+            if(order.column == ORDER_YEAR && resolved.year_max > 0)
+                scanTerms.push_back("year <= " + add_filter_parameter(scanParameters, resolved.year_max));
+            if(order.column == ORDER_RATING && resolved.rating_min >= 0)
+                scanTerms.push_back("rating >= " + add_filter_parameter(scanParameters, resolved.rating_min));
+            if(order.column == ORDER_RATING && resolved.rating_max >= 0)
+                scanTerms.push_back("rating <= " + add_filter_parameter(scanParameters, resolved.rating_max));
+
+            // dates are read as the text they are stored as, which is what a cursor holds
+            CL_String value = is_text_order(order.column) ? "cast(show." + column + " as text)" : "show." + column;
+            SqlCommand cmd = create_command("select " + value + ", show.id from show indexed by " + index + " " +
+                                            (scanTerms.empty() ? CL_String() : "where " + join(scanTerms.begin(), scanTerms.end(), CL_String(" and ")) + " ") +
+                                            orderBy + " limit 1 offset ?3");
+            if(is_text_order(order.column))
+                cmd.set_input_parameter(1, after.text);
+            else
+                cmd.set_input_parameter(1, after.number);
+            cmd.set_input_parameter(2, after.id);
+            cmd.set_input_parameter(3, SCAN_LIMIT - 1);
+            set_filter_parameters(cmd, scanParameters);
+
+            StatementReader reader = execute_reader(cmd);
+            if(reader.retrieve_row())
+            {
+                if(is_text_order(order.column))
+                    resume.text = reader.get_column_value(0);
+                else
+                    resume.number = reader.get_column_value(0);
+                resume.id = reader.get_column_int(1);
+                bounded = true;
+            }
+            reader.close();
+
+            if(bounded)
+            {
+                const char *through = order.descending ? ">" : "<";
+                CL_String bound = is_text_order(order.column) ? add_filter_parameter(parameters, resume.text) : add_filter_parameter(parameters, resume.number);
+                CL_String boundId = add_filter_parameter(parameters, resume.id);
+                terms.push_back(cl_format("show.%1 %2= %3 and (show.%1 %2 %3 or show.id %2= %4)", column, through, bound, boundId));
+            }
+        }
+
+        // sqlite plans without seeing the bound values, left alone it takes the year or rating index for a range
+        // on those columns however wide it is and then sorts every match. Naming the index keeps each page
+        // either a read of the few shows one criterion lets in or a scan of the order index that stops after
+        // limit rows. The order column is qualified since get_show_columns has an alias named sort_key
+        SqlCommand cmd = create_command(get_show_columns() + "from show " + access + " " +
+                                               (terms.empty() ? CL_String() : "where " + join(terms.begin(), terms.end(), CL_String(" and ")) + " ") +
+                                               orderBy + " limit ?3");
+        if(is_text_order(order.column))
+            cmd.set_input_parameter(1, after.text);
+        else
+            cmd.set_input_parameter(1, after.number);
+        cmd.set_input_parameter(2, after.id);
+        cmd.set_input_parameter(3, limit);
+        set_filter_parameters(cmd, parameters);
+
+        read_show_rows(cmd, shows);
+        return bounded && (int)shows.size() < limit;
+    }
+
+    // rewrites the snapshot if it is missing or out of date, so the next start doesn't need sqlite for the list
+    void save_snapshot()
+    {
+        TraceSpan span("database", "save_snapshot");
+        use_snapshot();
+        if(snapshot_stale == false)
+            return;
+
+        snapshot.close();
+        unsigned int start_time = CL_System::get_time();
+
+        // one read transaction, so the version matches the rows even if another process writes meanwhile
+        CL_DBTransaction transaction = begin_transaction();
+        LibrarySnapshotWriter writer(get_library_version());
+
+        SqlCommand cmd = create_command("select id, sort_key, title, ifnull(title_key,'') as title_key, comment, type, rating, year, season, status "
+                                               "from show order by sort_key, id");
+        StatementReader reader = execute_reader(cmd);
+        SnapshotRow row;
+        int count = 0;
+        while(reader.retrieve_row())
+        {
+            row.id = reader.get_column_value("id");
+            row.sort_key = reader.get_column_value("sort_key");
+            row.title = reader.get_column_value("title");
+            row.title_key = reader.get_column_value("title_key");
+            row.comment = reader.get_column_value("comment");
+            row.type = (SHOW_TYPE)(int)reader.get_column_value("type");
+            row.rating = (float)(double)reader.get_column_value("rating");
+            row.year = reader.get_column_value("year");
+            row.season = reader.get_column_value("season");
+            row.status = reader.get_column_value("status");
+            writer.add(row);
+            count++;
+        }
+        reader.close();
+
+        cmd = create_command("select show_id, genre_id from show_genre");
+        reader = execute_reader(cmd);
+        while(reader.retrieve_row())
+            writer.add_genre((int)reader.get_column_value("show_id"), (int)reader.get_column_value("genre_id"));
+        reader.close();
+
+        transaction.commit();
+        writer.save(snapshot_file);
+
+        snapshot_checked = false;
+        snapshot_stale = false;
+        cl_log_event("snapshot", "%1 shows written to %2 in %3 ms", count, snapshot_file, CL_System::get_time() - start_time);
+    }
+
+    std::vector<ShowItem> find_all_shows()
+    {
+        return find_shows("", ALL_VIEWING_STATUS_MASK, -1, -1);
+    }
+
+    // streams the whole library one row at a time. The genres come from a second cursor over show_genre
+    // walked in step with the shows, both scans follow the ID order of their table or index so nothing
+    // has to be sorted and there is no query per show
+    void export_shows(ShowExportWriter &writer, ExportProgress &progress)
+    {
+        TraceSpan span("database", "export_shows");
+        SqlCommand cmd = create_command("select count(*) from show");
+        progress.total.set(execute_scalar_int(cmd));
+        progress.written.set(0);
+
+        std::map<int, CL_String> genre_names;
+        std::vector<GenreItem> genres = get_all_genres();
+        for(std::vector<GenreItem>::const_iterator it = genres.begin(); it != genres.end(); ++it)
+            genre_names[it->id] = it->name;
+
+        cmd = create_command("select show.id as id, title, type, year, episodes, season, rating, comment, show.status as status, "
+                                  "ifnull(status.name, '') as status_name, ifnull(mal_id, 0) as mal_id, date_added, date_updated "
+                                  "from show left join status on status.id = show.status order by show.id");
+        StatementReader reader = execute_reader(cmd);
+
+        SqlCommand genreCmd = create_command("select show_id, genre_id from show_genre order by show_id");
+        StatementReader genreReader = execute_reader(genreCmd);
+        bool hasGenre = genreReader.retrieve_row();
+
+        writer.begin();
+
+        ExportRow row;
+        int written = 0;
+        while(reader.retrieve_row())
+        {
+            if(progress.cancelled.get() != 0)
+                throw CL_Exception("The export was cancelled");
+
+            row.id = reader.get_column_value("id");
+            row.title = reader.get_column_value("title");
+            row.type = get_show_type_name((SHOW_TYPE)(int)reader.get_column_value("type"));
+            row.year = reader.get_column_value("year");
+            row.episodes = reader.get_column_value("episodes");
+            row.season = reader.get_column_value("season");
+            row.rating = reader.get_column_value("rating");
+            row.comment = reader.get_column_value("comment");
+            row.status = reader.get_column_value("status");
+            row.status_name = reader.get_column_value("status_name");
+            row.mal_id = reader.get_column_value("mal_id");
+            row.date_added = reader.get_column_value("date_added");
+            row.date_updated = reader.get_column_value("date_updated");
+
+            // show_genre rows of deleted shows are skipped on the way
+            row.genres.clear();
+            while(hasGenre && (int)genreReader.get_column_value("show_id") < row.id)
+                hasGenre = genreReader.retrieve_row();
+            while(hasGenre && (int)genreReader.get_column_value("show_id") == row.id)
+            {
+                row.genres.push_back(genre_names[(int)genreReader.get_column_value("genre_id")]);
+                hasGenre = genreReader.retrieve_row();
+            }
+
+            writer.write(row);
+
+            if(++written % 1000 == 0)
+                progress.written.set(written);
+        }
+
+        writer.end();
+        progress.written.set(written);
+    }
+};
+
+StatementStats Database::statement_stats;
+
+
+struct MALImportResult
+{
+    int imported;
+    int duplicates;
+    int without_genres;  // entries whose genres were neither cached nor fetched
+    unsigned int elapsed_ms;
+
+    MALImportResult() : imported(0), duplicates(0), without_genres(0), elapsed_ms(0) {}
+};
+
+// imports a MyAnimeList list export, the file is streamed and the shows are written in large batches
+class MALListImporter
+{
+    CL_SharedPtr<Database> database;
+    MyAnimeListClient client;
+
+    std::set<CL_String> show_keys; // shows imported by this run, the database only sees them when the batch is written
+    std::vector<ShowItem> batch;
+
+    enum { BATCH_SIZE = 2000 };
+
+    static VIEWING_STATUS map_status(const CL_String &status)
+    {
+        // newer exports write the numeric status code
+        if(status == "Watching" || status == "1") return WATCHING;
+        if(status == "Completed" || status == "2") return COMPLETED;
+        if(status == "On-Hold" || status == "3") return ONHOLD;
+        if(status == "Dropped" || status == "4") return DROPPED;
+        if(status == "Plan to Watch" || status == "6") return PLANNING;
+        return UNKNOWN;
+    }
+
+    static SHOW_TYPE map_type(const CL_String &type)
+    {
+        return type == "Movie" ? TYPE_FILM : TYPE_ANIME;
+    }
+
+    // resolves genre names to IDs, adding the genres the database doesn't know yet
+    std::vector<GenreItem> resolve_genres(const std::vector<CL_String> &names)
+    {
+        database->ensure_add_genres(names);
+        return database->get_genres_by_name(names);
+    }
+
+    void flush()
+    {
+        if(batch.empty() == false)
+        {
+            database->add_shows(batch);
+            batch.clear();
+        }
+    }
+
+public:
+    MALListImporter(const CL_SharedPtr<Database> &database, const MyAnimeListClient &client) : database(database), client(client)
+    {
+    }
+
+    MALImportResult import(CL_IODevice &file, bool fetch_missing_genres)
+    {
+        TraceSpan span("import", "import");
+        MALImportResult result;
+        unsigned int start_time = CL_System::get_time();
+
+        std::unordered_set<int> seen_mal_ids;
+
+        MALExportReader reader(file);
+        MALExportEntry entry;
+        while(reader.read(entry))
+        {
+            ShowItem show;
+            show.id = -1;
+            show.title = trimmed(entry.series_title);
+            show.type = map_type(entry.series_type);
+            show.episodes = entry.series_episodes > 0 ? entry.series_episodes : entry.my_watched_episodes;
+            show.season = 1;
+            show.rating = entry.my_score > 0 ? entry.my_score : 5;
+            show.comment = entry.my_comments;
+            show.status = map_status(entry.my_status);
+            show.mal_id = entry.series_animedb_id;
+
+            // our own exports carry the fields MyAnimeList doesn't have
+            if(entry.has_library_fields)
+            {
+                SHOW_TYPE type = (SHOW_TYPE)show.type;
+                parse_show_type(entry.library_type, type);
+                show.type = type;
+                show.season = entry.library_season;
+                show.rating = entry.library_rating;
+                show.episodes = entry.series_episodes;
+                show.date_added = entry.library_date_added;
+                show.date_updated = entry.library_date_updated;
+            }
+
+            // the same ID twice in one export would break the unique index on show.mal_id
+            if(show.mal_id > 0 && (database->is_mal_id_owned(show.mal_id) || seen_mal_ids.insert(show.mal_id).second == false))
+            {
+                result.duplicates++;
+                continue;
+            }
+
+            MyAnimeListDetails details;
+            bool has_details = false;
+            if(entry.has_library_fields)
+            {
+                details.year = entry.library_year;
+                details.genres = entry.library_genres;
+                has_details = true;
+            }
+            else
+            {
+                has_details = client.get_cached_details(entry.series_animedb_id, details);
+            }
+
+            if(has_details == false && fetch_missing_genres)
+            {
+                try
+                {
+                    details = client.get_details(entry.series_animedb_id);
+                    has_details = true;
+                }
+                catch(CL_Exception &)
+                {
+                    // keep importing, the genres can be added later from the search page
+                }
+            }
+
+            // the export carries no release year, without the details it is 0 for unknown. The date the
+            // user started watching says nothing about when the show came out
+            show.year = details.year;
+
+            CL_String key = Database::make_show_key(show.title, (SHOW_TYPE)show.type, show.year, show.season);
+            if(show.title.empty() || show_keys.insert(key).second == false || 
+               database->show_exist(show.title, (SHOW_TYPE)show.type, show.year, show.season))
+            {
+                result.duplicates++;
+                continue;
+            }
+
+            if(has_details)
+                show.genres = resolve_genres(details.genres);
+            else
+                result.without_genres++;
+
+            batch.push_back(show);
+            result.imported++;
+
+            if(batch.size() >= BATCH_SIZE)
+                flush();
+        }
+        flush();
+
+        result.elapsed_ms = CL_System::get_time() - start_time;
+        return result;
+    }
+};
+
+
+// writes the library to a file on a worker thread with its own database connection, so the GUI keeps running
+class LibraryExporter
+{
+    CL_String filename;
+    ShowExportWriter::Format format;
+
+    CL_Thread thread;
+    bool running;
+    CL_InterlockedVariable finished;
+    ExportProgress progress;
+
+    CL_Mutex mutex;
+    CL_String error;
+    unsigned int start_time;
+    unsigned int elapsed_ms;
+
+    void worker_main()
+    {
+        try
+        {
+            Database database;
+            CL_File file(filename, CL_File::create_always, CL_File::access_write, CL_File::share_read, CL_File::flag_sequential_scan);
+            ShowExportWriter writer(file, format);
+            database.export_shows(writer, progress);
+        }
+        catch(CL_Exception &e)
+        {
+            CL_MutexSection lock(&mutex);
+            error = e.message;
+        }
+
+        elapsed_ms = CL_System::get_time() - start_time;
+        finished.set(1);
+    }
+
+public:
+    LibraryExporter() : running(false), start_time(0), elapsed_ms(0)
+    {
+    }
+
+    ~LibraryExporter()
+    {
+        cancel();
+        join();
+    }
+
+    void start(const CL_String &exportFilename)
+    {
+        join();
+
+        filename = exportFilename;
+        format = ShowExportWriter::get_format(filename);
+        error.clear();
+        progress.total.set(0);
+        progress.written.set(0);
+        progress.cancelled.set(0);
+        finished.set(0);
+        start_time = CL_System::get_time();
+
+        thread.start(this, &LibraryExporter::worker_main);
+        running = true;
+    }
+
+    void cancel()
+    {
+        progress.cancelled.set(1);
+    }
+
+    void join()
+    {
+        if(running)
+        {
+            thread.join();
+            running = false;
+        }
+    }
+
+    bool is_running() const { return running; }
+    bool is_finished() const { return finished.get() != 0; }
+    int get_total() const { return progress.total.get(); }
+    int get_written() const { return progress.written.get(); }
+
+    // only valid once is_finished returns true
+    unsigned int get_elapsed_ms() const { return elapsed_ms; }
+
+    CL_String get_error()
+    {
+        CL_MutexSection lock(&mutex);
+        return error;
+    }
+};
+
+
+// widths of list texts are measured through here so the list benchmark can count them, with long
+// titles measuring is much of what filling a list costs
+static unsigned int text_measurements = 0;
+
+static int get_text_width(CL_Font &font, CL_GraphicContext gc, const CL_StringRef &text)
+{
+    text_measurements++;
+    return font.get_text_size(gc, text).width;
+}
+
+class Page
+{
+
+    int id;
+
+public:
+    Page(int id) : id(id)
+    {
+
+    }
+    virtual ~Page(){}
+
+    int get_id() const
+    {
+        return id;
+    }
+    virtual void fill_page(const void *data)
+    {
+
+    }
+};
+
+
+class ListViewBenchmark;
+
+class TabManager
+{
+    // drives the pages directly
+    friend class ListViewBenchmark;
+
+    CL_Tab *tab;
+
+    // pages
+    std::auto_ptr<Page> addPage;
+    std::auto_ptr<Page> viewPage;
+    std::auto_ptr<Page> searchPage;
+    std::auto_ptr<Page> statsPage;
+    std::auto_ptr<Page> diagnosticsPage;
+
+public:
+    TabManager(CL_GUIComponent *parent, const CL_SharedPtr<Database> &database, const MyAnimeListConfig &malConfig,
+               const CL_SharedPtr<TaskScheduler> &tasks, bool diagnostics);
+    ~TabManager(){}
+
+    CL_Tab *get_tab() const;
+
+    void load_show_item(const ShowItem &si)
+    {
+        addPage->fill_page(&si);
+    }
+
+    void display_show_item(const ShowItem &si)
+    {
+        load_show_item(si);
+        get_tab()->show_page(addPage->get_id());
+    }
+};
+
+template<typename T1, typename T2>
+class UserItemPair : public std::pair<T1,T2>, public CL_ListViewItemUserData
+{
+public:
+    UserItemPair &operator =(const std::pair<T1,T2> &rhs)
+    {
+        std::pair<T1,T2>::operator =(rhs);
+        return *this;
+    }
+};
+
+typedef UserItemPair<int,ShowItem> ShowItemPair;
+
+// searches MyAnimeList for SearchPage
+class MALSearchTask : public CallbackTask
+{
+    CL_SharedPtr<HTTPRequestScheduler> scheduler;
+    MyAnimeListConfig config;
+    CL_String query;
+
+public:
+    std::map<int, ShowItem> shows;
+
+    MALSearchTask(const CL_SharedPtr<HTTPRequestScheduler> &scheduler, const MyAnimeListConfig &config, const CL_String &query)
+        : scheduler(scheduler), config(config), query(query)
+    {
+    }
+
+    void run(const CancellationToken &token)
+    {
+        MyAnimeListClient client(scheduler, config);
+        shows = client.search(query);
+    }
+};
+
+// downloads the genre names of a search result before it's opened in the add page
+class MALGenresTask : public CallbackTask
+{
+    CL_SharedPtr<HTTPRequestScheduler> scheduler;
+    MyAnimeListConfig config;
+
+public:
+    CL_SharedPtr<std::pair<int,ShowItem> > show;
+    std::vector<CL_String> genres;
+
+    MALGenresTask(const CL_SharedPtr<HTTPRequestScheduler> &scheduler, const MyAnimeListConfig &config, const CL_SharedPtr<std::pair<int,ShowItem> > &show)
+        : scheduler(scheduler), config(config), show(show)
+    {
+    }
+
+    void run(const CancellationToken &token)
+    {
+        MyAnimeListClient client(scheduler, config);
+        genres = client.get_genres(show->first);
+    }
+};
+
+// title search of the library for the add page popup, on a connection of its own like LibraryExporter
+class LibrarySearchTask : public CallbackTask
+{
+public:
+    SearchQuery query;
+    std::vector<ShowItem> shows;
+
+    LibrarySearchTask(const SearchQuery &query) : query(query)
+    {
+    }
+
+    void run(const CancellationToken &token)
+    {
+        Database database;
+        shows = database.find_shows(query.name, ALL_VIEWING_STATUS_MASK, query.start, query.limit);
+    }
+};
+
+// groups near duplicate titles of the whole library for the view page
+class DuplicateSearchTask : public CallbackTask
+{
+public:
+    std::vector<DuplicateCluster> clusters;
+    int show_count;
+    int compared_pairs;
+    unsigned int elapsed_ms;
+
+    DuplicateSearchTask() : show_count(0), compared_pairs(0), elapsed_ms(0)
+    {
+    }
+
+    void run(const CancellationToken &token)
+    {
+        unsigned int start_time = CL_System::get_time();
+
+        Database database;
+        std::vector<std::pair<int, CL_String> > keys = database.get_title_keys();
+        if(token.is_cancelled())
+            return;
+
+        DuplicateFinder finder;
+        for(std::vector<std::pair<int, CL_String> >::const_iterator it = keys.begin(); it != keys.end(); ++it)
+            finder.add(it->first, it->second);
+        clusters = finder.find();
+
+        show_count = (int)keys.size();
+        compared_pairs = finder.get_compared_pairs();
+        elapsed_ms = CL_System::get_time() - start_time;
+    }
+};
+
+class SearchPage : public Page
+{
+    friend class ListViewBenchmark;
+
+    CL_TabPage *page;
+    TabManager *tabMan;
+    CL_SharedPtr<Database> database;
+    CL_SharedPtr<HTTPRequestScheduler> scheduler;
+    MyAnimeListConfig malConfig;
+
+    CL_SharedPtr<TaskScheduler> tasks;
+    CL_SharedPtr<MALSearchTask> searchTask;
+    CancellationToken searchToken;
+    CL_SharedPtr<MALGenresTask> genresTask;
+    CancellationToken genresToken;
+
+    CL_ListView *result;
+    CL_LineEdit *search;
+    CL_PushButton *previous, *next, *edit;
+    CL_LineEdit *pagenumber;
+
+    int currentPage;
+
+    enum { LIMIT = 100 };
+
+    // the download runs in the background, a newer search replaces one that hasn't finished
+    void on_search_enter_pressed()
+    {
+        searchToken.cancel();
+        searchTask = CL_SharedPtr<MALSearchTask>(new MALSearchTask(scheduler, malConfig, search->get_text()));
+        searchTask->func_completed().set(this, &SearchPage::on_search_completed);
+        searchTask->func_failed().set(this, &SearchPage::on_task_failed);
+        searchToken = tasks->submit(searchTask, PRIORITY_HIGH);
+
+        result->get_header()->get_column("title").set_caption("Searching...");
+    }
+
+    void on_task_failed(const CL_String &error)
+    {
+        result->get_header()->get_column("title").set_caption("Title");
+        MessageDialog(page, "Error", cl_format("MyAnimeList couldn't be reached:\n%1", error)).exec();
+    }
+
+    void on_search_completed()
+    {
+        show_results(searchTask->shows);
+    }
+
+    // fills the first LIMIT rows with shows sorted by title and blanks the rest
+    void show_results(const std::map<int, ShowItem> &shows)
+    {
+        TraceSpan span("gui", "SearchPage::show_results");
+        MemoryScope memory(MEMORY_LIST_VIEW);
+
+        CL_ListViewItem docItem = result->get_document_item();
+
+        while(docItem.get_child_count() != LIMIT)
+        {
+            CL_ListViewItem item = result->create_item();
+            docItem.append_child(item);
+        }
+
+        CL_ListViewItem child = docItem.get_first_child();
+
+        CL_ListViewColumnHeader titleColumn = result->get_header()->get_column("title");
+        CL_ListViewColumnHeader ratingColumn = result->get_header()->get_column("rating");
+        CL_ListViewColumnHeader ownedColumn = result->get_header()->get_column("owned");
+        CL_ListViewColumnHeader commentColumn = result->get_header()->get_column("comment");
+
+        CL_String titleColumnId = titleColumn.get_column_id();
+        CL_String ratingColumnId = ratingColumn.get_column_id();
+        CL_String ownedColumnId = ownedColumn.get_column_id();
+        CL_String commentColumnId = commentColumn.get_column_id();
+
+        CL_String titleColumnName = cl_format("Title(%1)", shows.size());
+
+        CL_GUIThemePart listThemePart(result, "selection");
+        CL_Font font = listThemePart.get_font();
+        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
+                      listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+
+        int maxWidth = get_text_width(font, result->get_gc(), titleColumnName) + padding;
+
+        std::vector<std::pair<int,ShowItem> > showsVector;
+        for (std::map<int, ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
+        {            
+            showsVector.push_back(*it);
+            showsVector.back().second.sort_key = make_sort_key(it->second.title);
+        }
+
+        // same order as the library lists
+        struct SortFun
+        {
+            bool operator()(const std::pair<int,ShowItem> &show1, const std::pair<int,ShowItem> &show2)
+            {
+                return show1.second.sort_key < show2.second.sort_key;
+            }
+        };
+
+        std::sort(showsVector.begin(), showsVector.end(), SortFun());
+
+        for (std::vector<std::pair<int,ShowItem> >::const_iterator it = showsVector.begin(); it != showsVector.end(); ++it)
+        {  
+            int textWidth = get_text_width(font, result->get_gc(), it->second.title) + padding;
+            if(maxWidth < textWidth) maxWidth = textWidth;
+
+            ShowItemPair *showItemCopy = new ShowItemPair;
+            *showItemCopy = *it;
+
+            child.set_userdata(CL_SharedPtr<ShowItemPair>(showItemCopy));
+            child.set_column_text(titleColumnId, it->second.title);
+            child.set_column_text(ratingColumnId, CL_StringHelp::double_to_text(it->second.rating, 2));
+            child.set_column_text(ownedColumnId, database->is_mal_id_owned(it->first) ? "Yes" : "");
+            child.set_column_text(commentColumnId, clean(it->second.comment, CL_String("\r\n")));
+            child = child.get_next_sibling();
+        }
+
+        if(maxWidth > 0) titleColumn.set_width(maxWidth);
+
+        int ellipseWidth = get_text_width(font, result->get_gc(), "...  ") + padding;
+        commentColumn.set_width(result->get_width() - titleColumn.get_width()-ratingColumn.get_width()-ownedColumn.get_width()-ellipseWidth);
+
+        while(child.is_null() == false)
+        {
+            child.set_userdata(CL_SharedPtr<ShowItem>());
+            child.set_column_text(titleColumnId, "");
+            child.set_column_text(ratingColumnId, "");
+            child.set_column_text(ownedColumnId, "");
+            child.set_column_text(commentColumnId, "");
+            child = child.get_next_sibling();
+        }
+
+        titleColumn.set_caption(titleColumnName);
+        //update_current_page_number();
+
+    }
+
+    void on_edit_clicked()
+    {
+        if(result->get_selected_item().is_null() == false)
+        {
+            CL_SharedPtr<std::pair<int,ShowItem> > show = cl_dynamic_pointer_cast<std::pair<int,ShowItem> >(result->get_selected_item().get_userdata());
+            if(show)
+            {
+                // shows already in the library open the existing record instead of a new one
+                ShowItem owned = database->find_show_by_mal_id(show->first);
+                if(owned.id != -1)
+                {
+                    tabMan->display_show_item(owned);
+                    return;
+                }
+
+                if(show->second.genres.empty())
+                {
+                    genresToken.cancel();
+                    genresTask = CL_SharedPtr<MALGenresTask>(new MALGenresTask(scheduler, malConfig, show));
+                    genresTask->func_completed().set(this, &SearchPage::on_genres_completed);
+                    genresTask->func_failed().set(this, &SearchPage::on_task_failed);
+                    genresToken = tasks->submit(genresTask, PRIORITY_HIGH);
+                    return;
+                }
+                                
+                tabMan->display_show_item(show->second);
+            }   
+        }
+    }
+
+    void on_genres_completed()
+    {
+        CL_SharedPtr<std::pair<int,ShowItem> > show = genresTask->show;
+        const std::vector<CL_String> &genreStrsOrig = genresTask->genres;
+        std::vector<CL_String> genreStrs = database->get_missing_genres(genreStrsOrig);
+
+        if(genreStrs.empty() == false)
+        {
+            MessageDialog msg(page, "Question", 
+                              cl_format("The following genres will be added to the database:\n%1\nDo you wish to continue?", 
+                                        join(genreStrs.begin(), genreStrs.end(), CL_String(", "))),
+                              MessageDialog::ASK_YES_NO);
+            msg.exec();
+
+            if(msg.getResult() == MessageDialog::YES)
+            {
+                database->ensure_add_genres(genreStrs);
+            }
+            else
+            {
+                return;
+            }
+        }
+        show->second.genres = database->get_genres_by_name(genreStrsOrig);
+
+        tabMan->display_show_item(show->second);
+    }
+
+public:
+    SearchPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &database, const MyAnimeListConfig &malConfig,
+               const CL_SharedPtr<TaskScheduler> &tasks) 
+        : Page(page->get_id()), tabMan(tabMan), page(page), database(database), 
+        scheduler(new HTTPRequestScheduler(malConfig.requests_per_second)), malConfig(malConfig), tasks(tasks), currentPage(0),
+        pagenumber(CL_LineEdit::get_named_item(page, "pagenumber")),
+        result(CL_ListView::get_named_item(page, "result")),
+        search(CL_LineEdit::get_named_item(page, "search")),
+        previous(CL_PushButton::get_named_item(page, "previous")),
+        next(CL_PushButton::get_named_item(page, "next")),
+        edit(CL_PushButton::get_named_item(page, "edit"))
+    {
+        result->show_detail_icon(false);
+        result->show_detail_opener(false);
+
+        search->func_enter_pressed().set(this, &SearchPage::on_search_enter_pressed);
+
+        //previous->func_clicked().set(this, &SearchPage::on_previous_clicked);
+        //next->func_clicked().set(this, &SearchPage::on_next_clicked);
+        edit->func_clicked().set(this, &SearchPage::on_edit_clicked);
+
+        result->get_icon_list().clear();
+        result->set_multi_select(false);
+        result->set_select_whole_row(true);
+
+        pagenumber->set_alignment(CL_LineEdit::align_center);
+        pagenumber->set_read_only(true);
+
+        CL_ListViewColumnHeader column = result->get_header()->create_column("title", "Title");
+        result->get_header()->append(column);
+
+
+        CL_GUIThemePart listThemePart(result, "selection");
+        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
+            listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+
+        column = result->get_header()->create_column("rating", "Rating");
+        result->get_header()->append(column);
+        column.set_width(listThemePart.get_font().get_text_size(result->get_gc(), "Rating").width+padding);
+
+        column = result->get_header()->create_column("owned", "Owned");
+        result->get_header()->append(column);
+        column.set_width(listThemePart.get_font().get_text_size(result->get_gc(), "Owned").width+padding);
+
+        column = result->get_header()->create_column("comment", "Comment");
+        result->get_header()->append(column);
+    }
+
+    virtual ~SearchPage()
+    {
+
+    }
+};
+
+class AddPage : public Page
+{
+    CL_TabPage *page;
+    CL_SharedPtr<Database> database;
+
+    CL_PopupMenu genrePopMenu;
+    CL_PopupMenu statusPopMenu;
+    CL_PopupMenu pop; //generic popup menu, currently used for display search results
+
+    CL_SharedPtr<TaskScheduler> tasks;
+    CL_SharedPtr<LibrarySearchTask> searchTask;
+    CancellationToken searchToken;
+    CL_Point searchLocation; // where the popup of the running search opens
+
+    int malId; // MyAnimeList ID of the loaded show, 0 if unknown
+
+    // what the available genre list was built from
+    std::vector<CL_SharedPtr<GenreItem> > availableGenres;
+    int availableGenresGeneration;
+
+public:
+    AddPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &database, const CL_SharedPtr<TaskScheduler> &tasks) 
+        : Page(page->get_id()), page(page), database(database), tasks(tasks), malId(0), availableGenresGeneration(0)
+    {
+        CL_LineEdit::get_named_item(page, "title");
+        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
+        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+        CL_Label &ratingLabel = *CL_Label::get_named_item(page, "ratingLabel");
+        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
+        CL_PushButton &addButton = *CL_PushButton::get_named_item(page, "add");
+        CL_PushButton &clearButton = *CL_PushButton::get_named_item(page, "clear");
+        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
+        CL_PushButton &updateButton = *CL_PushButton::get_named_item(page, "update");
+        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
+        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+
+        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
+        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
+
+        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
+        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
+
+        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        CL_PushButton &addGenre = *CL_PushButton::get_named_item(page, "addGenre");
+        CL_PushButton &removeGenre = *CL_PushButton::get_named_item(page, "removeGenre");
+
+        genreSelection.show_detail_icon(false);
+        genreSelection.show_detail_opener(false);
+        genreAdded.show_detail_icon(false);
+        genreAdded.show_detail_opener(false);
+
+        for(int type = 0; type < TYPE_COUNT; type++)
+            genrePopMenu.insert_item(get_show_type_name((SHOW_TYPE)type));
+        mediatype.set_popup_menu(genrePopMenu);
+        mediatype.set_selected_item(0);
+        mediatype.set_editable(false);
+        mediatype.set_focus_policy(CL_GUIComponent::focus_refuse);
+                       
+        id.set_read_only(true);
+        date_added.set_read_only(true);
+        date_updated.set_read_only(true);
+
+        year.set_floating_point_mode(false);
+        // 0 is an unknown year, as imported shows without their details have
+        year.set_ranges(0,3000);
+        year.set_value(2010);
+        year.set_step_size(1);
+
+        episodes.set_floating_point_mode(false);
+        episodes.set_ranges(0, 0x7fffffff);
+        episodes.set_value(0);
+        episodes.set_step_size(1);
+
+        season.set_floating_point_mode(false);
+        season.set_ranges(0, 0x7fffffff);
+        season.set_value(0);
+        season.set_step_size(1);
+
+        ratingLabel.set_text("5/10");
+        rating.set_position(5);
+        rating.func_value_changed().set(this, &AddPage::on_rating_changed);
+
+        addButton.func_clicked().set(this, &AddPage::on_submit_clicked);
+        clearButton.func_clicked().set(this, &AddPage::on_clear_clicked);
+        searchButton.func_clicked().set(this, &AddPage::on_search_clicked);
+        updateButton.func_clicked().set(this, &AddPage::on_update_clicked);
+
+        addGenre.func_clicked().set(this, &AddPage::on_add_genre_clicked);
+        removeGenre.func_clicked().set(this, &AddPage::on_remove_genre_clicked);
+
+        refresh_available_genre_list();
+
+        CL_ListViewColumnHeader header = genreAdded.get_header()->create_column("genreAdded", "Selected Genre(0)");
+        header.set_width(genreAdded.get_width());
+        genreAdded.get_header()->append(header);
+
+        genreSelection.set_multi_select(false);
+        genreAdded.set_multi_select(false);
+
+        std::vector<StatusItem> statuses = this->database->get_all_status();
+
+        for(std::vector<StatusItem>::const_iterator it = statuses.begin(); it != statuses.end(); ++it)
+        {
+            statusPopMenu.insert_item(it->name, it->id);
+        }
+
+        status.set_popup_menu(statusPopMenu);
+        status.set_editable(false);
+        status.set_selected_item(0);
+        status.set_focus_policy(CL_GUIComponent::focus_refuse);
+    }
+
+
+    virtual ~AddPage() {}
+
+    virtual void fill_page(const void *data)
+    {
+        const ShowItem *si = static_cast<const ShowItem*>(data);
+        fill_page(*si);
+    }
+
+private:
+
+    void update_genre_added_header() const
+    {
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        genreAdded.get_header()->get_column("genreAdded").set_caption(cl_format("Selected Genre(%1)", genreAdded.get_document_item().get_child_count()));
+    }
+
+    std::vector<CL_SharedPtr<GenreItem> > refresh_available_genre_list() 
+    {
+        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
+
+        // nothing to do unless a genre was added since the list was built
+        int generation = this->database->get_genre_generation();
+        if(generation == availableGenresGeneration)
+            return availableGenres;
+
+        genreSelection.clear();
+
+        std::vector<GenreItem> genreItems = this->database->get_all_genres();
+
+        std::vector<CL_SharedPtr<GenreItem> > genreItemsPtr;
+
+        if(genreSelection.get_header()->get_column("genreSelection").is_null())
+        {
+            CL_ListViewColumnHeader header = genreSelection.get_header()->create_column("genreSelection", "Available Genre");
+            header.set_width(genreSelection.get_width());
+            genreSelection.get_header()->append(header);
+        }
+
+        CL_ListViewItem docItem = genreSelection.get_document_item();
+        for(std::vector<GenreItem>::const_iterator it = genreItems.begin(); it != genreItems.end(); ++it)
+        {
+            CL_ListViewItem item = genreSelection.create_item();
+            CL_SharedPtr<GenreItem> newGenreItem = CL_SharedPtr<GenreItem>(new GenreItem);
+            genreItemsPtr.push_back(newGenreItem);
+            *newGenreItem = *it;
+            item.set_userdata(newGenreItem);
+            item.set_column_text("genreSelection", it->name);
+            docItem.append_child(item);
+        }
+        genreSelection.get_header()->get_column("genreSelection").set_caption(cl_format("Available Genre(%1)", genreItems.size()));
+
+        availableGenres = genreItemsPtr;
+        availableGenresGeneration = generation;
+
+        return genreItemsPtr;
+    }
+
+    void on_add_genre_clicked()
+    {
+        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+
+        if(genreSelection.get_selected_item().is_null() == false)
+        {
+            CL_String genreText = genreSelection.get_selected_item().get_column("genreSelection").get_text();
+            CL_ListViewItem genreItem = genreAdded.find("genreAdded", genreText);
+            if(genreItem.is_null())
+            {
+                CL_ListViewItem newGenreItem = genreAdded.create_item();
+                newGenreItem.set_column_text("genreAdded", genreText);
+                newGenreItem.set_userdata(genreSelection.get_selected_item().get_userdata());
+                genreAdded.get_document_item().append_child(newGenreItem);
+
+                // sort the added genre items by re-adding the items
+                std::vector<CL_SharedPtr<GenreItem> > items;
+                CL_ListViewItem child = genreAdded.get_document_item().get_first_child();
+                while(child.is_null() == false)
+                {
+                    CL_SharedPtr<GenreItem> item = cl_dynamic_pointer_cast<GenreItem>(child.get_userdata());
+                    items.push_back(item);
+                    child = child.get_next_sibling();
+                }
+                genreAdded.clear();
+                
+                struct SortFun
+                {
+                    bool operator()(const CL_SharedPtr<GenreItem> &item1, const CL_SharedPtr<GenreItem> &item2)
+                    {
+                        return item1->name < item2->name;
+                    }
+                };
+
+                std::sort(items.begin(), items.end(), SortFun());
+
+                CL_ListViewItem genreAddedDocItem = genreAdded.get_document_item(); 
+                for (std::vector<CL_SharedPtr<GenreItem> >::iterator it = items.begin(); it != items.end(); ++it)
+                {
+                    CL_ListViewItem newItem = genreAdded.create_item();
+                    newItem.set_column_text("genreAdded", (*it)->name);
+                    newItem.set_userdata(*it);
+                    genreAddedDocItem.append_child(newItem);
+                }
+                update_genre_added_header();
+            }
+        }
+
+    }
+
+    void on_remove_genre_clicked()
+    {
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+
+        CL_ListViewItem selectedItem = genreAdded.get_selected_item();
+
+        if(selectedItem.is_null() == false)
+        {
+            selectedItem.remove();
+            
+            update_genre_added_header();
+        }
+    }
+
+    std::vector<GenreItem> get_selected_genres() const
+    {
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+
+        std::vector<GenreItem> genres;
+
+        CL_ListViewItem child = genreAdded.get_document_item().get_first_child();
+        while(child.is_null() == false)
+        {
+            CL_SharedPtr<GenreItem> item = cl_dynamic_pointer_cast<GenreItem>(child.get_userdata());
+            genres.push_back(*item);
+            child = child.get_next_sibling();
+        }
+
+        return genres;
+    }
+
+    void clear_genre() const
+    {
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        genreAdded.clear();
+        update_genre_added_header();
+    }
+    
+    void on_rating_changed()
+    {
+        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+        CL_Label &ratingLabel = *CL_Label::get_named_item(page, "ratingLabel");
+
+        ratingLabel.set_text(cl_format("%1/10", rating.get_position()));
+    }
+
+    SHOW_TYPE get_media_type() const
+    {
+        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
+
+        SHOW_TYPE type = TYPE_ANIME;
+        parse_show_type(mediatype.get_text(), type);
+        return type;
+    }
+
+    int get_status() const
+    {
+        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
+
+        return status.get_selected_item();
+    }
+
+    void set_media_type(SHOW_TYPE type) const
+    {
+        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
+
+        if(type >= 0 && type < TYPE_COUNT)
+            mediatype.set_text(get_show_type_name(type));
+        else
+            reset_media_type();
+    }
+
+    void reset_media_type() const
+    {
+        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
+        mediatype.set_selected_item(0);
+    }
+
+    void reset_status() const
+    {
+        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
+        status.set_selected_item(0);
+    }
+
+    void set_status(int statusCode)
+    {
+        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
+        CL_PopupMenuItem item = statusPopMenu.get_item(statusCode);
+
+        if(item.is_null() == false)
+            status.set_selected_item(statusCode);
+        else
+            status.set_selected_item(0);
+    }
+
+    void fill_page(const ShowItem &show)
+    {
+        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
+        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
+        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
+        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
+        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
+        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
+        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
+
+        malId = show.mal_id;
+
+        if(show.id != -1)
+        {
+            id.set_text(cl_format("%1", show.id));
+        }
+        else
+        {
+            id.set_text("");
+        }
+        id.request_repaint();
+
+        if(show.date_added.is_null() == false)
+        {
+            date_added.set_text(show.date_added.to_local().to_short_datetime_string());
+            
+        }
+        else
+        {
+            date_added.set_text("");
+        }
+        date_added.request_repaint();
+
+        if(show.date_updated.is_null() == false)
+        {
+            date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
+        }
+        else
+        {
+            date_updated.set_text("");
+        }
+        date_updated.request_repaint();
+
+        title.set_text(show.title);
+        year.set_value(show.year);
+        rating.set_position((int)show.rating);
+        if(rating.func_value_changed().is_null() == false)
+            rating.func_value_changed().invoke();
+        comment.set_text(show.comment);
+        episodes.set_value(show.episodes);
+        season.set_value(show.season);
+        set_status(show.status);
+        set_media_type((SHOW_TYPE)show.type);
+        clear_genre();
+
+        // update the available genre list since it may have been changed when a new anime was added
+        std::vector<CL_SharedPtr<GenreItem> > genreItems = refresh_available_genre_list();
+
+        for(std::vector<GenreItem>::const_iterator it2 = show.genres.begin(); it2 != show.genres.end(); ++it2)
+        {
+            for(std::vector<CL_SharedPtr<GenreItem> >::const_iterator it = genreItems.begin(); it != genreItems.end(); ++it)
+            {
+                if(it2->id == (*it)->id)
+                {
+                    CL_ListViewItem newItem = genreAdded.create_item();
+                    newItem.set_userdata(*it);
+                    newItem.set_column_text("genreAdded", (*it)->name);
+                    genreAdded.get_document_item().append_child(newItem);
+                }
+            }
+        }
+
+        update_genre_added_header();
+    }
+
+
+    void on_submit_clicked()
+    {
+        if(database)
+        {
+            CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
+            CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
+            CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
+            CL_Spin &year = *CL_Spin::get_named_item(page, "year");
+            CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+            CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
+            CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
+            CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+
+            CL_String trimmedTitle = clean(CL_String(trimmed(title.get_text())), CL_String("%_"));
+
+            if(trimmedTitle.empty())
+            {
+                MessageDialog(page, "Error", "The Title cannot be blank").exec();
+            }
+            else if(season.get_value() <= 0)
+            {
+                MessageDialog(page, "Error", "The Season number must be greater than 0").exec();
+            }
+            else if(get_selected_genres().empty())
+            {
+                MessageDialog(page, "Error", "You must select at least one genre").exec();
+            }
+            else
+            {
+                MessageDialog question(page, "Question", "Is everything correct?", MessageDialog::ASK_YES_NO);
+                question.exec();
+                question.set_visible(false);
+                if(question.getResult() == MessageDialog::YES)
+                {
+                    if(malId > 0 && database->is_mal_id_owned(malId))
+                    {
+                        MessageDialog(page, "Error", "This MyAnimeList show already exists in the database!\nClick Update to update it").exec();
+                    }
+                    else if(database->show_exist(trimmedTitle, get_media_type(), year.get_value(), season.get_value()))
+                    {
+                        MessageDialog(page, "Error", "This show already exists in the database!\nClick Update to update it").exec();
+                    }
+                    else
+                    {
+                        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+
+                        int showid = database->add_show(trimmedTitle, get_media_type(), get_selected_genres(), year.get_value(), 
+                                                        rating.get_position(), comment.get_text(), episodes.get_value(), season.get_value(), get_status(), malId);
+                        ShowItem show = database->find_show(showid);
+                        title.set_text(show.title);
+                        id.set_text(cl_format("%1", show.id));
+                        id.request_repaint();
+                        date_added.set_text(show.date_added.to_local().to_short_datetime_string());
+                        date_added.request_repaint();
+                        date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
+                        date_updated.request_repaint();
+                        MessageDialog(page, "Done", "It's added!").exec();
+                    }
+                }
+
+            }
+
+        }
+    }
+
+    void on_update_clicked()
+    {
+        if(database)
+        {
+            CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+            CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
+            CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
+            CL_Spin &year = *CL_Spin::get_named_item(page, "year");
+            CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+            CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
+            CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
+            CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+            
+            CL_String trimmedTitle = clean(CL_String(trimmed(title.get_text())), CL_String("%_"));
+
+            if(id.get_text().empty())
+            {
+                MessageDialog(page, "Error", "You haven't loaded a record yet!").exec();
+            }
+            else if(trimmedTitle.empty())
+            {
+                MessageDialog(page, "Error", "The Title cannot be blank").exec();
+            }
+            else if(season.get_value() <= 0)
+            {
+                MessageDialog(page, "Error", "The Season number must be greater than 0").exec();
+            }
+            else if(get_selected_genres().empty())
+            {
+                MessageDialog(page, "Error", "You must select at least one genre").exec();
+            }
+            else
+            {
+                MessageDialog question(page, "Question", "Is everything correct?", MessageDialog::ASK_YES_NO);
+                question.exec();
+                question.set_visible(false);
+                if(question.getResult() == MessageDialog::YES)
+                {                    
+                    if(database->show_exist(id.get_text_int()) == false)
+                    {
+                        MessageDialog(page, "Error", "This show doesn't exists in the database!\nClick Add to add it").exec();
+                    }
+                    else if(database->show_similar_to(id.get_text_int(), trimmedTitle, get_media_type(), year.get_value(), season.get_value()))
+                    {
+                        MessageDialog(page, "Error", "A similar show with the same title, type, year and season already exist\nTry changing the title").exec();
+                    }
+                    else
+                    {
+                        database->update_show(id.get_text_int(), trimmedTitle, get_media_type(), get_selected_genres(), year.get_value(), 
+                                              rating.get_position(), comment.get_text(), episodes.get_value(), season.get_value(), get_status(), malId);
+                        ShowItem show = database->find_show(id.get_text_int());
+                        title.set_text(show.title);
+                        id.set_text(cl_format("%1", show.id));
+                        id.request_repaint();
+                        date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
+                        date_updated.request_repaint();
+                        MessageDialog(page, "Done", "It's updated!").exec();
+                    }
+                }
+
+            }
+
+        }
+    }
+
+
+    void on_clear_clicked()
+    {
+        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
+        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
+        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
+        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
+        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
+        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
+        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
+        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+
+        id.set_text("");
+        id.request_repaint();
+        date_added.set_text("");
+        date_added.request_repaint();
+        date_updated.set_text("");
+        date_updated.request_repaint();
+        title.set_text("");
+        year.set_value(2010);
+
+        rating.set_position(5);
+        if(rating.func_value_changed().is_null() == false)
+            rating.func_value_changed().invoke();
+
+        comment.set_text("");
+        episodes.set_value(0);
+        season.set_value(0);
+
+        reset_status();
+        reset_media_type();
+        clear_genre();
+
+        malId = 0;
+    }
+
+    void on_result_menu_click(ShowItem show)
+    {
+        fill_page(show);
+    }
+
+    void on_next_menu_click(SearchQuery search)
+    {
+        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
+
+        CL_Rect geom = searchButton.get_geometry();
+        display_search_result(search.name, search.start, search.limit, CL_Point(geom.left, geom.top));
+    }
+
+    // the popup opens once the search has run in the background
+    void display_search_result(const CL_String &title, int start, int limit, const CL_Point &location)
+    {
+        SearchQuery query;
+        query.name = trimmed(title);
+        query.start = start;
+        query.limit = limit;
+
+        searchToken.cancel();
+        // the task reads on its own connection, which only sees committed edits
+        database->flush();
+        searchTask = CL_SharedPtr<LibrarySearchTask>(new LibrarySearchTask(query));
+        searchTask->func_completed().set(this, &AddPage::on_search_completed);
+        searchTask->func_failed().set(this, &AddPage::on_search_failed);
+        searchToken = tasks->submit(searchTask, PRIORITY_HIGH);
+        searchLocation = location;
+    }
+
+    void on_search_failed(const CL_String &error)
+    {
+        MessageDialog(page, "Error", cl_format("The search failed:\n%1", error)).exec();
+    }
+
+    void on_search_completed()
+    {
+        const std::vector<ShowItem> &shows = searchTask->shows;
+        CL_String trimmedTitle = searchTask->query.name;
+        int start = searchTask->query.start;
+        int limit = searchTask->query.limit;
+
+        pop.clear();
+        pop.insert_item("Cancel");
+        pop.insert_item("Clear").func_clicked().set(this, &AddPage::on_clear_clicked);
+        pop.insert_separator();
+        for (std::vector<ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
+        {
+            pop.insert_item(cl_format("%1 (%2) (season %3) (%4)", it->title, it->year, it->season, get_show_type_name((SHOW_TYPE)it->type)), it->id)
+                .func_clicked().set(this, &AddPage::on_result_menu_click, *it);
+        }
+
+        
+        if(shows.empty() == false)
+            pop.insert_separator();
+
+        SearchQuery search; 
+        search.name = trimmedTitle; 
+
+        if(start > 0)
+        {
+            search.start = cl_max(start-limit, 0); 
+            search.limit = limit;
+            pop.insert_item(cl_format("...Previous %1", limit)).func_clicked().set(this, &AddPage::on_next_menu_click, search);
+        }
+
+        if(shows.empty() == false)
+        {
+            search.start = start+limit; 
+            search.limit = limit;
+            pop.insert_item(cl_format("Next %1...", limit)).func_clicked().set(this, &AddPage::on_next_menu_click, search);
+        }
+
+        pop.start(page, page->component_to_screen_coords(searchLocation));
+    }
+
+    void on_search_clicked()
+    {
+        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
+        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
+
+        CL_Rect geom = searchButton.get_geometry();
+        display_search_result(title.get_text(), 0, 20, CL_Point(geom.left, geom.top));
+    }
+
+};
+
+// userdata of a library list item, the index of its row in ViewPage::shows. Items are reused for every page,
+// so it is set once when the item is created
+struct ShowRowIndex : CL_ListViewItemUserData
+{
+    ShowList::size_type index;
+
+    ShowRowIndex(ShowList::size_type index) : index(index) {}
+};
+
+class ViewPage : public Page
+{
+    friend class ListViewBenchmark;
+
+    ShowList shows;
+    CL_SharedPtr<Database> database;
+    TabManager *tabMan;
+    CL_TabPage *page;
+    MyAnimeListConfig malConfig;
+
+    CL_ListView *result;
+    CL_LineEdit *search;
+    CL_PushButton *previous, *next, *edit, *import, *duplicates, *merge, *similar;
+    CL_LineEdit *pagenumber;
+    CL_CheckBox *watching, *completed, *planning, *dropped;
+
+    enum { LIMIT=100 };
+    unsigned int currentPage;
+    ShowFilter filter;
+
+    // the list order is picked with the column headers, pageCursors has where each page up to the current one starts
+    ShowOrder order;
+    std::vector<ShowCursor> pageCursors;
+    // a page the database stopped filling at its scan limit, the next one starts where the scan stopped
+    bool pageCut;
+    ShowCursor resumeCursor;
+    CL_PopupMenu orderPopMenu;
+
+    int viewing_status_mask;
+
+    // while reviewing duplicates the list shows the members of duplicateClusters instead of the search result
+    bool showingDuplicates;
+    std::vector<DuplicateCluster> duplicateClusters;
+    std::vector<std::pair<int,int> > duplicateRows; // cluster index and show ID of every row
+    std::vector<int> shownClusters;                 // cluster index of every row in shows
+
+    // the duplicate search runs in the background, the button cancels it meanwhile
+    CL_SharedPtr<TaskScheduler> tasks;
+    CL_SharedPtr<DuplicateSearchTask> duplicateTask;
+    CancellationToken duplicateToken;
+    bool findingDuplicates;
+
+    // loaded on the first "Similar" click, then kept up to date through the database signals
+    Recommender recommender;
+    bool recommenderLoaded;
+    CL_SlotContainer slots;
+    CL_PopupMenu similarPopMenu;
+
+    void on_search_edit(CL_InputEvent &ev)
+    {
+        show_library();
+        refresh_list();
+    }
+
+    void refresh_list() 
+    {
+        TraceSpan span("gui", "ViewPage::refresh_list");
+        currentPage = 0;
+        pageCursors.assign(1, ShowCursor());
+
+        if(showingDuplicates)
+        {
+            find_shows();
+            populate_show_list();
+            return;
+        }
+
+        CL_ListViewItem docItem = result->get_document_item();
+        filter = ShowFilter::parse(search->get_text());
+        filter.status_mask = viewing_status_mask;
+        find_shows();
+        populate_show_list();
+    }
+    void update_current_page_number()
+    {
+        pagenumber->set_text(cl_format("%1", currentPage+1));
+    }
+
+    ShowList::size_type find_shows()
+    {
+        if(showingDuplicates)
+        {
+            shows.clear();
+            shownClusters.clear();
+            for(std::vector<std::pair<int,int> >::size_type i = currentPage*LIMIT; i < duplicateRows.size() && i < (currentPage+1)*LIMIT; i++)
+            {
+                shows.add(database->find_show(duplicateRows[i].second));
+                shownClusters.push_back(duplicateRows[i].first);
+            }
+            pageCut = false;
+            return shows.size();
+        }
+
+        pageCut = database->find_shows_after(filter, order, pageCursors[currentPage], LIMIT, shows, resumeCursor);
+
+        return shows.size();
+    }
+
+    void populate_show_list()
+    {        
+        TraceSpan span("gui", "ViewPage::populate_show_list");
+        MemoryScope memory(MEMORY_LIST_VIEW);
+        CL_ListViewItem docItem = result->get_document_item();
+
+        while(docItem.get_child_count() != LIMIT)
         {
             CL_ListViewItem item = result->create_item();
+            item.set_userdata(CL_SharedPtr<ShowRowIndex>(new ShowRowIndex(docItem.get_child_count())));
             docItem.append_child(item);
         }
 
@@ -943,152 +5352,563 @@ class SearchPage : public Page
         CL_String titleColumnId = titleColumn.get_column_id();
         CL_String ratingColumnId = ratingColumn.get_column_id();
         CL_String commentColumnId = commentColumn.get_column_id();
-
-        CL_String titleColumnName = cl_format("Title(%1)", shows.size());
+        
+        CL_String titleColumnName = cl_format(pageCut ? "Title(%1+)" : "Title(%1)", shows.size()) + get_order_marker(ORDER_TITLE);
+        CL_String commentColumnName = "Comment";
+        if(showingDuplicates)
+            titleColumnName = cl_format("Duplicate groups(%1)", duplicateClusters.size());
+        else if(order.column != ORDER_TITLE && order.column != ORDER_RATING)
+            commentColumnName = cl_format("Comment - %1", get_order_name(order));
 
         CL_GUIThemePart listThemePart(result, "selection");
         CL_Font font = listThemePart.get_font();
         int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
-                      listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+                        listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+        
+        int maxWidth = get_text_width(font, result->get_gc(), titleColumnName) + padding;
+        for (ShowList::size_type i = 0; i < shows.size(); i++)
+        {            
+            CL_String title = shows[i].title;
+            int textWidth = get_text_width(font, result->get_gc(), title) + padding;
+            if(maxWidth < textWidth) maxWidth = textWidth;
 
-        int maxWidth = font.get_text_size(result->get_gc(), titleColumnName).width + padding;
+            child.set_column_text(titleColumnId, title);
+            child.set_column_text(ratingColumnId, CL_StringHelp::double_to_text(shows[i].rating, 2));
+            child.set_column_text(commentColumnId, get_comment_text(i));
+            child = child.get_next_sibling();
+        }
+        if(maxWidth > 0) titleColumn.set_width(maxWidth);
 
-        std::vector<std::pair<int,ShowItem> > showsVector;
-        for (std::map<int, ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
-        {            
-            showsVector.push_back(*it);
+        int ellipseWidth = get_text_width(font, result->get_gc(), "...  ") + padding;
+        commentColumn.set_width(result->get_width() - titleColumn.get_width()-ratingColumn.get_width()-ellipseWidth);
+        
+        while(child.is_null() == false)
+        {
+            child.set_column_text(titleColumnId, "");
+            child.set_column_text(ratingColumnId, "");
+            child.set_column_text(commentColumnId, "");
+            child = child.get_next_sibling();
         }
 
-        struct SortFun
+        titleColumn.set_caption(titleColumnName);
+        ratingColumn.set_caption("Rating" + get_order_marker(ORDER_RATING));
+        commentColumn.set_caption(commentColumnName);
+        update_current_page_number();
+    }
+
+    // the show of the selected item, 0 for an empty or deleted row
+    const ShowRow *get_selected_show() const
+    {
+        CL_ListViewItem item = result->get_selected_item();
+        if(item.is_null())
+            return 0;
+
+        CL_SharedPtr<ShowRowIndex> row = cl_dynamic_pointer_cast<ShowRowIndex>(item.get_userdata());
+        if(!row || row->index >= shows.size() || shows[row->index].id <= 0)
+            return 0;
+        return &shows[row->index];
+    }
+
+    CL_String get_comment_text(ShowList::size_type index) const
+    {
+        CL_String commentText = clean(CL_String(shows[index].comment), CL_String("\r\n"));
+        if(showingDuplicates)
         {
-            bool operator()(const std::pair<int,ShowItem> &show1, const std::pair<int,ShowItem> &show2)
+            const DuplicateCluster &cluster = duplicateClusters[shownClusters[index]];
+            commentText = cl_format("#%1 %2%% similar  %3", shownClusters[index] + 1, (int)(cluster.similarity*100 + 0.5), commentText);
+        }
+        else if(order.column != ORDER_TITLE && order.column != ORDER_RATING)
+        {
+            commentText = cl_format("%1  %2", get_order_value(shows[index]), commentText);
+        }
+        return commentText;
+    }
+
+    // another process changed these shows: only their rows are reloaded, and they stay where they are
+    // even if they no longer match the filter or the order until the list is refreshed
+    void on_shows_changed(const std::vector<int> &showIds)
+    {
+        TraceSpan span("gui", "ViewPage::on_shows_changed");
+        MemoryScope memory(MEMORY_LIST_VIEW);
+        std::set<int> changed(showIds.begin(), showIds.end());
+
+        CL_String titleColumnId = result->get_header()->get_column("title").get_column_id();
+        CL_String ratingColumnId = result->get_header()->get_column("rating").get_column_id();
+        CL_String commentColumnId = result->get_header()->get_column("comment").get_column_id();
+
+        CL_ListViewItem child = result->get_document_item().get_first_child();
+        for(ShowList::size_type i = 0; i < shows.size() && child.is_null() == false; i++, child = child.get_next_sibling())
+        {
+            if(changed.count(shows[i].id) == 0)
+                continue;
+
+            ShowItem show = database->find_show(shows[i].id);
+            if(show.id == -1)
             {
-                return show1.second.title < show2.second.title;
+                // the row stays in the list so the ones after it keep their index, get_selected_show skips it
+                shows[i].id = -1;
+                child.set_column_text(titleColumnId, CL_String(shows[i].title) + " (deleted)");
+                child.set_column_text(ratingColumnId, "");
+                child.set_column_text(commentColumnId, "");
+                continue;
             }
-        };
 
-        std::sort(showsVector.begin(), showsVector.end(), SortFun());
+            shows.set(i, show);
+            child.set_column_text(titleColumnId, show.title);
+            child.set_column_text(ratingColumnId, CL_StringHelp::double_to_text(show.rating, 2));
+            child.set_column_text(commentColumnId, get_comment_text(i));
+        }
+        result->request_repaint();
 
-        for (std::vector<std::pair<int,ShowItem> >::const_iterator it = showsVector.begin(); it != showsVector.end(); ++it)
-        {  
-            int textWidth = font.get_text_size(result->get_gc(), it->second.title).width + padding;
-            if(maxWidth < textWidth) maxWidth = textWidth;
+        // the recommender is simply reloaded on the next "Similar" click
+        recommenderLoaded = false;
+    }
 
-            ShowItemPair *showItemCopy = new ShowItemPair;
-            *showItemCopy = *it;
+    // the current page is read again without the edits that were rolled back
+    void on_edits_lost()
+    {
+        recommenderLoaded = false;
+        find_shows();
+        populate_show_list();
+    }
 
-            child.set_userdata(CL_SharedPtr<ShowItemPair>(showItemCopy));
-            child.set_column_text(titleColumnId, it->second.title);
-            child.set_column_text(ratingColumnId, CL_StringHelp::double_to_text(it->second.rating, 2));
-            child.set_column_text(commentColumnId, clean(it->second.comment, CL_String("\r\n")));
-            child = child.get_next_sibling();
+    static CL_String get_order_name(const ShowOrder &order)
+    {
+        const char *names[ORDER_COUNT][2] =
+        {
+            { "title, A to Z", "title, Z to A" },
+            { "rating, lowest first", "rating, highest first" },
+            { "year, oldest first", "year, newest first" },
+            { "episodes, fewest first", "episodes, most first" },
+            { "date added, oldest first", "date added, newest first" },
+            { "date updated, oldest first", "date updated, newest first" },
+        };
+        return names[order.column][order.descending ? 1 : 0];
+    }
+
+    // shown after the caption of the column the list is sorted by
+    CL_String get_order_marker(SHOW_ORDER column) const
+    {
+        if(showingDuplicates || order.column != column)
+            return CL_String();
+        return order.descending ? " v" : " ^";
+    }
+
+    // the orders without a column of their own show their value in front of the comment
+    CL_String get_order_value(const ShowRow &show) const
+    {
+        switch(order.column)
+        {
+        case ORDER_YEAR:         return show.year > 0 ? CL_StringHelp::int_to_text(show.year) : CL_String();
+        case ORDER_EPISODES:     return cl_format("%1 ep", show.episodes);
+        case ORDER_DATE_ADDED:   return show.date_added.to_local().to_short_datetime_string();
+        case ORDER_DATE_UPDATED: return show.date_updated.to_local().to_short_datetime_string();
+        default:                 return CL_String();
         }
+    }
 
-        if(maxWidth > 0) titleColumn.set_width(maxWidth);
+    // a left click on Title or Rating sorts by that column and a second one reverses it, the other orders
+    // are in the menu that a click on Comment or a right click anywhere on the header opens
+    bool on_header_pressed(const CL_InputEvent &e)
+    {
+        if(showingDuplicates)
+            return false;
+
+        int titleRight = result->get_header()->get_column("title").get_width();
+        int ratingRight = titleRight + result->get_header()->get_column("rating").get_width();
+
+        if(e.id == CL_MOUSE_LEFT && e.mouse_pos.x < titleRight)
+            sort_by(ORDER_TITLE, false);
+        else if(e.id == CL_MOUSE_LEFT && e.mouse_pos.x < ratingRight)
+            sort_by(ORDER_RATING, true);
+        else if(e.id == CL_MOUSE_LEFT || e.id == CL_MOUSE_RIGHT)
+            show_order_menu(e.mouse_pos);
+        else
+            return false;
+        return true;
+    }
 
-        int ellipseWidth = font.get_text_size(result->get_gc(), "...  ").width + padding;
-        commentColumn.set_width(result->get_width() - titleColumn.get_width()-ratingColumn.get_width()-ellipseWidth);
+    // the first click on a column sorts in the direction most useful for it
+    void sort_by(SHOW_ORDER column, bool descendingFirst)
+    {
+        set_order(ShowOrder(column, order.column == column ? !order.descending : descendingFirst));
+    }
 
-        while(child.is_null() == false)
+    void set_order(ShowOrder newOrder)
+    {
+        order = newOrder;
+        refresh_list();
+    }
+
+    void show_order_menu(const CL_Point &pos)
+    {
+        orderPopMenu.clear();
+        for(int column = 0; column < ORDER_COUNT; column++)
         {
-            child.set_userdata(CL_SharedPtr<ShowItem>());
-            child.set_column_text(titleColumnId, "");
-            child.set_column_text(ratingColumnId, "");
-            child.set_column_text(commentColumnId, "");
-            child = child.get_next_sibling();
+            for(int descending = 0; descending < 2; descending++)
+            {
+                ShowOrder item((SHOW_ORDER)column, descending != 0);
+                CL_String name = get_order_name(item);
+                name[0] = toupper(name[0]);
+                orderPopMenu.insert_item(item == order ? "* " + name : name)
+                    .func_clicked().set(this, &ViewPage::set_order, item);
+            }
         }
+        orderPopMenu.start(page, result->get_header()->component_to_screen_coords(pos));
+    }
 
-        titleColumn.set_caption(titleColumnName);
-        //update_current_page_number();
+    void on_previous_clicked()
+    {
+        if(currentPage > 0) currentPage--; 
+        find_shows();
+        populate_show_list();
+    }
+
+    // a page cut short can be empty and still have shows after it
+    void on_next_clicked()
+    {
+        if(shows.empty() && pageCut == false)
+            return;
+
+        pageCursors.resize(currentPage+1);
+        pageCursors.push_back(pageCut ? resumeCursor : Database::make_cursor(order, shows.back()));
 
+        currentPage++;
+        if(find_shows() > 0 || pageCut)
+        {
+            populate_show_list();
+        }
+        else
+        {
+            currentPage--;
+            pageCursors.pop_back();
+            find_shows();
+        }
     }
 
     void on_edit_clicked()
     {
-        if(result->get_selected_item().is_null() == false)
+        const ShowRow *show = get_selected_show();
+        if(show)
         {
-            CL_SharedPtr<std::pair<int,ShowItem> > show = cl_dynamic_pointer_cast<std::pair<int,ShowItem> >(result->get_selected_item().get_userdata());
-            if(show)
-            {
-                if(show->second.genres.empty())
-                {
-                    MyAnimeListClient client;
+            // the list may have come from the snapshot, which doesn't hold every field
+            tabMan->display_show_item(database->find_show(show->id));
+        }
+    }
+
+    void on_import_clicked()
+    {
+        CL_OpenFileDialog dialog(page);
+        dialog.set_title("Import MyAnimeList list export");
+        dialog.add_filter("MyAnimeList export (*.xml)", "*.xml", true);
+        if(dialog.show() == false)
+            return;
+
+        MessageDialog question(page, "Question", "Download the genres of shows that aren't cached?\nThis is slow for large lists.", MessageDialog::ASK_YES_NO_CANCEL);
+        question.exec();
+        question.set_visible(false);
+        if(question.getResult() == MessageDialog::CANCEL)
+            return;
+
+        try
+        {
+            // the import runs on the GUI thread, shows whose genres can't be fetched right away go without
+            CL_SharedPtr<HTTPRequestScheduler> scheduler(new HTTPRequestScheduler(malConfig.requests_per_second));
+            scheduler->set_blocking(false);
+            MALListImporter importer(database, MyAnimeListClient(scheduler, malConfig));
+
+            CL_File file(dialog.get_filename(), CL_File::open_existing, CL_File::access_read);
+            MALImportResult imported = importer.import(file, question.getResult() == MessageDialog::YES);
+
+            refresh_list();
+            MessageDialog(page, "Done", cl_format("Imported %1 shows in %2 ms\n%3 duplicates skipped, %4 without genres", 
+                                                  imported.imported, imported.elapsed_ms, imported.duplicates, imported.without_genres)).exec();
+        }
+        catch(CL_Exception &e)
+        {
+            MessageDialog(page, "Error", cl_format("The import failed:\n%1", e.message)).exec();
+        }
+    }
+
+    void load_recommender()
+    {
+        unsigned int start_time = CL_System::get_time();
+
+        std::vector<ShowItem> shows = database->get_show_genres();
+        recommender.clear();
+        for(std::vector<ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
+            add_to_recommender(*it);
+
+        cl_log_event("recommend", "%1 shows loaded in %2 ms", shows.size(), CL_System::get_time() - start_time);
+        recommenderLoaded = true;
+    }
+
+    void add_to_recommender(const ShowItem &show)
+    {
+        std::vector<int> genres;
+        for(std::vector<GenreItem>::const_iterator it = show.genres.begin(); it != show.genres.end(); ++it)
+            genres.push_back(it->id);
+        recommender.set_show(show.id, genres, show.rating);
+    }
+
+    void on_show_saved(const ShowItem &show)
+    {
+        if(recommenderLoaded)
+            add_to_recommender(show);
+    }
+
+    void on_show_removed(int showid)
+    {
+        if(recommenderLoaded)
+            recommender.remove_show(showid);
+    }
+
+    void on_similar_clicked()
+    {
+        const ShowRow *show = get_selected_show();
+        if(!show)
+            return;
+
+        if(recommenderLoaded == false)
+            load_recommender();
+
+        unsigned int start_time = CL_System::get_time();
+        std::vector<Recommendation> recommendations = recommender.find_similar(show->id, 15);
+        cl_log_event("recommend", "%1 shows scored in %2 ms", recommender.get_show_count(), CL_System::get_time() - start_time);
+
+        if(recommendations.empty())
+        {
+            MessageDialog(page, "Done", cl_format("No shows similar to \"%1\" were found", show->title)).exec();
+            return;
+        }
+
+        similarPopMenu.clear();
+        similarPopMenu.insert_item("Cancel");
+        similarPopMenu.insert_separator();
+        for(std::vector<Recommendation>::const_iterator it = recommendations.begin(); it != recommendations.end(); ++it)
+        {
+            ShowItem recommended = database->find_show(it->id);
+            similarPopMenu.insert_item(cl_format("%1 (%2) (%3) %4%%", recommended.title, recommended.year, get_show_type_name((SHOW_TYPE)recommended.type), (int)(it->score*100 + 0.5)))
+                .func_clicked().set(this, &ViewPage::on_similar_menu_click, recommended);
+        }
+
+        CL_Rect geom = similar->get_geometry();
+        similarPopMenu.start(page, page->component_to_screen_coords(CL_Point(geom.left, geom.top)));
+    }
+
+    void on_similar_menu_click(ShowItem show)
+    {
+        tabMan->display_show_item(show);
+    }
+
+    void show_library()
+    {
+        duplicateToken.cancel();
+        findingDuplicates = false;
+        showingDuplicates = false;
+        duplicateClusters.clear();
+        duplicateRows.clear();
+        duplicates->set_text("Duplicates");
+        merge->set_enabled(false);
+    }
+
+    void build_duplicate_rows()
+    {
+        duplicateRows.clear();
+        for(std::vector<DuplicateCluster>::size_type i = 0; i < duplicateClusters.size(); i++)
+        {
+            for(std::vector<int>::const_iterator it = duplicateClusters[i].ids.begin(); it != duplicateClusters[i].ids.end(); ++it)
+                duplicateRows.push_back(std::make_pair((int)i, *it));
+        }
+    }
+
+    void on_duplicates_clicked()
+    {
+        if(showingDuplicates)
+        {
+            show_library();
+            refresh_list();
+            return;
+        }
+
+        if(findingDuplicates)
+        {
+            show_library();
+            return;
+        }
+
+        database->flush();
+        duplicateTask = CL_SharedPtr<DuplicateSearchTask>(new DuplicateSearchTask);
+        duplicateTask->func_completed().set(this, &ViewPage::on_duplicates_completed);
+        duplicateTask->func_failed().set(this, &ViewPage::on_duplicates_failed);
+        duplicateToken = tasks->submit(duplicateTask);
+
+        findingDuplicates = true;
+        duplicates->set_text("Cancel");
+    }
+
+    void on_duplicates_failed(const CL_String &error)
+    {
+        show_library();
+        MessageDialog(page, "Error", cl_format("The duplicate search failed:\n%1", error)).exec();
+    }
+
+    void on_duplicates_completed()
+    {
+        findingDuplicates = false;
+        duplicates->set_text("Duplicates");
+        duplicateClusters = duplicateTask->clusters;
+
+        cl_log_event("duplicates", "%1 groups among %2 shows, %3 pairs compared in %4 ms", 
+                     duplicateClusters.size(), duplicateTask->show_count, duplicateTask->compared_pairs, duplicateTask->elapsed_ms);
+
+        if(duplicateClusters.empty())
+        {
+            MessageDialog(page, "Done", "No similar titles were found").exec();
+            return;
+        }
+
+        showingDuplicates = true;
+        duplicates->set_text("Library");
+        merge->set_enabled(true);
+        build_duplicate_rows();
+        refresh_list();
+    }
+
+    // keeps the selected show and merges the rest of its group into it
+    void on_merge_clicked()
+    {
+        if(showingDuplicates == false)
+            return;
+
+        const ShowRow *show = get_selected_show();
+        if(!show)
+            return;
+
+        // the list may change while the question is open
+        int showId = show->id;
+        CL_String title = show->title;
+
+        std::vector<std::pair<int,int> >::const_iterator row = duplicateRows.begin();
+        while(row != duplicateRows.end() && row->second != showId)
+            ++row;
+        if(row == duplicateRows.end())
+            return;
+
+        int clusterIndex = row->first;
+        const DuplicateCluster &cluster = duplicateClusters[clusterIndex];
+
+        MessageDialog question(page, "Question", 
+                               cl_format("Merge the other %1 shows of group #%2 into \"%3\"?\nTheir genres are added to it and they are deleted.", 
+                                         cluster.ids.size() - 1, clusterIndex + 1, title),
+                               MessageDialog::ASK_YES_NO);
+        question.exec();
+        question.set_visible(false);
+        if(question.getResult() != MessageDialog::YES)
+            return;
+
+        try
+        {
+            database->merge_shows(showId, cluster.ids);
+        }
+        catch(CL_Exception &e)
+        {
+            MessageDialog(page, "Error", cl_format("The merge failed:\n%1", e.message)).exec();
+            return;
+        }
 
-                    std::vector<CL_String> genreStrs = client.get_genres(show->first);
-                    std::vector<GenreItem> genreItems = database->get_all_genres();
+        duplicateClusters.erase(duplicateClusters.begin() + clusterIndex);
+        build_duplicate_rows();
 
+        if(currentPage > 0 && currentPage*LIMIT >= duplicateRows.size())
+            currentPage--;
+        find_shows();
+        populate_show_list();
+    }
+
+    void on_viewing_status_checked(VIEWING_STATUS status)
+    {
+        viewing_status_mask |= (1 << status);
+        show_library();
+        refresh_list();
+    }
+
+    void on_viewing_status_unchecked(VIEWING_STATUS status)
+    {
+        viewing_status_mask &= ~(1 << status);
+        show_library();
+        refresh_list();
+    }
 
-                    struct CompareFun
-                    {
-                        bool operator()(const CL_String &i1, const GenreItem &i2)
-                        {
-                            return i1 < i2.name;
-                        }
-                        bool operator()(const GenreItem &i1, const CL_String &i2)
-                        {
-                            return i1.name < i2;
-                        }
-                        bool operator()(const GenreItem &i1, const GenreItem &i2)
-                        {
-                            return i1.name < i2.name;
-                        }
-                    };
-
-
-                    std::sort(genreStrs.begin(), genreStrs.end(), std::less<CL_String>());
-                    std::sort(genreItems.begin(), genreItems.end(), CompareFun());
-
-                    std::vector<CL_String> genreStrsOrig = genreStrs;
-
-                    std::vector<CL_String>::const_iterator genreStrsEnd = std::set_difference(genreStrs.begin(), genreStrs.end(), 
-                                                                                              genreItems.begin(), genreItems.end(), 
-                                                                                              genreStrs.begin(), CompareFun());
-                    std::vector<CL_String>::const_iterator genreStrsStart = genreStrs.begin();
-                    genreStrs.resize(std::distance(genreStrsStart, genreStrsEnd));
-
-                    if(genreStrs.empty() == false)
-                    {
-                        MessageDialog msg(page, "Question", 
-                                          cl_format("The following genres will be added to the database:\n%1\nDo you wish to continue?", 
-                                                    join(genreStrs.begin(), genreStrs.end(), CL_String(", "))),
-                                          MessageDialog::ASK_YES_NO);
-                        msg.exec();
-
-                        if(msg.getResult() == MessageDialog::YES)
-                        {
-                            database->ensure_add_genres(genreStrs);
-                        }
-                        else
-                        {
-                            return;
-                        }
-                    }
-                    show->second.genres = database->get_genres_by_name(genreStrsOrig);
-                }
-                                
-                tabMan->display_show_item(show->second);
-            }   
+    void on_visiblity_changed(bool visible)
+    {
+        if(visible)
+        {
+            refresh_list();
         }
     }
 
 public:
-    SearchPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &database) 
-        : Page(page->get_id()), tabMan(tabMan), page(page), database(database), currentPage(0),
-        pagenumber(CL_LineEdit::get_named_item(page, "pagenumber")),
-        result(CL_ListView::get_named_item(page, "result")),
-        search(CL_LineEdit::get_named_item(page, "search")),
-        previous(CL_PushButton::get_named_item(page, "previous")),
-        next(CL_PushButton::get_named_item(page, "next")),
-        edit(CL_PushButton::get_named_item(page, "edit"))
-    {
+    ViewPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &db, const MyAnimeListConfig &malConfig,
+             const CL_SharedPtr<TaskScheduler> &tasks)
+        : Page(page->get_id()), tabMan(tabMan), page(page), malConfig(malConfig), database(db), currentPage(0), pageCut(false), viewing_status_mask(0), showingDuplicates(false), 
+          tasks(tasks), findingDuplicates(false), recommenderLoaded(false),
+          pagenumber(CL_LineEdit::get_named_item(page, "pagenumber")),
+          result(CL_ListView::get_named_item(page, "result")),
+          search(CL_LineEdit::get_named_item(page, "search")),
+          previous(CL_PushButton::get_named_item(page, "previous")),
+          next(CL_PushButton::get_named_item(page, "next")),
+          edit(CL_PushButton::get_named_item(page, "edit")),
+          watching(CL_CheckBox::get_named_item(page, "watching")), 
+          completed(CL_CheckBox::get_named_item(page, "completed")), 
+          planning(CL_CheckBox::get_named_item(page, "planning")), 
+          dropped(CL_CheckBox::get_named_item(page, "dropped"))
+    {        
         result->show_detail_icon(false);
         result->show_detail_opener(false);
 
-        search->func_enter_pressed().set(this, &SearchPage::on_search_enter_pressed);
+        page->func_visibility_change().set(this, &ViewPage::on_visiblity_changed);
 
-        //previous->func_clicked().set(this, &SearchPage::on_previous_clicked);
-        //next->func_clicked().set(this, &SearchPage::on_next_clicked);
-        edit->func_clicked().set(this, &SearchPage::on_edit_clicked);
+        search->func_after_edit_changed().set(this, &ViewPage::on_search_edit);
+        previous->func_clicked().set(this, &ViewPage::on_previous_clicked);
+        next->func_clicked().set(this, &ViewPage::on_next_clicked);
+        edit->func_clicked().set(this, &ViewPage::on_edit_clicked);
+
+        import = new CL_PushButton(page);
+        import->set_text("Import");
+        import->set_geometry(CL_Rect(11, 546, 71, 566));
+        import->func_clicked().set(this, &ViewPage::on_import_clicked);
+
+        duplicates = new CL_PushButton(page);
+        duplicates->set_text("Duplicates");
+        duplicates->set_geometry(CL_Rect(75, 546, 145, 566));
+        duplicates->func_clicked().set(this, &ViewPage::on_duplicates_clicked);
+
+        merge = new CL_PushButton(page);
+        merge->set_text("Merge");
+        merge->set_geometry(CL_Rect(149, 546, 199, 566));
+        merge->set_enabled(false);
+        merge->func_clicked().set(this, &ViewPage::on_merge_clicked);
+
+        similar = new CL_PushButton(page);
+        similar->set_text("Similar");
+        similar->set_geometry(CL_Rect(203, 546, 263, 566));
+        similar->func_clicked().set(this, &ViewPage::on_similar_clicked);
+
+        slots.connect(database->sig_show_saved(), this, &ViewPage::on_show_saved);
+        slots.connect(database->sig_show_removed(), this, &ViewPage::on_show_removed);
+        slots.connect(database->sig_shows_changed(), this, &ViewPage::on_shows_changed);
+        slots.connect(database->sig_edits_lost(), this, &ViewPage::on_edits_lost);
+
+        watching->func_checked().set(this, &ViewPage::on_viewing_status_checked, WATCHING);
+        completed->func_checked().set(this, &ViewPage::on_viewing_status_checked, COMPLETED);
+        planning->func_checked().set(this, &ViewPage::on_viewing_status_checked, PLANNING);
+        dropped->func_checked().set(this, &ViewPage::on_viewing_status_checked, DROPPED);
+
+        watching->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, WATCHING);
+        completed->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, COMPLETED);
+        planning->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, PLANNING);
+        dropped->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, DROPPED);
 
         result->get_icon_list().clear();
         result->set_multi_select(false);
@@ -1107,887 +5927,1832 @@ public:
 
         column = result->get_header()->create_column("rating", "Rating");
         result->get_header()->append(column);
-        column.set_width(listThemePart.get_font().get_text_size(result->get_gc(), "Rating").width+padding);
+        column.set_width(listThemePart.get_font().get_text_size(result->get_gc(), "Rating v").width+padding);
 
         column = result->get_header()->create_column("comment", "Comment");
         result->get_header()->append(column);
-    }
-
-    virtual ~SearchPage()
-    {
+        result->get_header()->func_input_pressed().set(this, &ViewPage::on_header_pressed);
 
+        pageCursors.assign(1, ShowCursor());
+        find_shows();
+        populate_show_list();
     }
+    virtual ~ViewPage(){}
+
 };
 
-class AddPage : public Page
+// read only overview of the library, everything comes from the summary tables so it opens instantly
+class StatsPage : public Page
 {
     CL_TabPage *page;
     CL_SharedPtr<Database> database;
 
-    CL_PopupMenu genrePopMenu;
-    CL_PopupMenu statusPopMenu;
-    CL_PopupMenu pop; //generic popup menu, currently used for display search results
-
-public:
-    AddPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &database) : Page(page->get_id()), page(page), database(database)
-    {
-        CL_LineEdit::get_named_item(page, "title");
-        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
-        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-        CL_Label &ratingLabel = *CL_Label::get_named_item(page, "ratingLabel");
-        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
-        CL_PushButton &addButton = *CL_PushButton::get_named_item(page, "add");
-        CL_PushButton &clearButton = *CL_PushButton::get_named_item(page, "clear");
-        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
-        CL_PushButton &updateButton = *CL_PushButton::get_named_item(page, "update");
-        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
-        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
-
-        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
-        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
-
-        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
-        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
-        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
-
-        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
-        CL_PushButton &addGenre = *CL_PushButton::get_named_item(page, "addGenre");
-        CL_PushButton &removeGenre = *CL_PushButton::get_named_item(page, "removeGenre");
-
-        genreSelection.show_detail_icon(false);
-        genreSelection.show_detail_opener(false);
-        genreAdded.show_detail_icon(false);
-        genreAdded.show_detail_opener(false);
-
-        genrePopMenu.insert_item("Anime");
-        genrePopMenu.insert_item("Film");
-        genrePopMenu.insert_item("TV");
-        mediatype.set_popup_menu(genrePopMenu);
-        mediatype.set_selected_item(0);
-        mediatype.set_editable(false);
-        mediatype.set_focus_policy(CL_GUIComponent::focus_refuse);
-                       
-        id.set_read_only(true);
-        date_added.set_read_only(true);
-        date_updated.set_read_only(true);
+    CL_ListView *stats;
+    CL_Label *summary;
+    CL_PushButton *refresh, *check, *exportButton;
 
-        year.set_floating_point_mode(false);
-        year.set_ranges(1800,3000);
-        year.set_value(2010);
-        year.set_step_size(1);
+    LibraryExporter exporter;
+    CL_Timer exportTimer;
 
-        episodes.set_floating_point_mode(false);
-        episodes.set_ranges(0, 0x7fffffff);
-        episodes.set_value(0);
-        episodes.set_step_size(1);
+    void add_row(const CL_String &name, const CL_String &shows, const CL_String &episodes, const CL_String &share)
+    {
+        CL_ListViewItem item = stats->create_item();
+        item.set_column_text("name", name);
+        item.set_column_text("shows", shows);
+        item.set_column_text("episodes", episodes);
+        item.set_column_text("share", share);
+        stats->get_document_item().append_child(item);
+    }
 
-        season.set_floating_point_mode(false);
-        season.set_ranges(0, 0x7fffffff);
-        season.set_value(0);
-        season.set_step_size(1);
+    void add_section(const CL_String &title, const std::vector<StatsItem> &items, int total, bool showEpisodes)
+    {
+        if(stats->get_document_item().get_child_count() > 0)
+            add_row("", "", "", "");
+        add_row(title, "", "", "");
 
-        ratingLabel.set_text("5/10");
-        rating.set_position(5);
-        rating.func_value_changed().set(this, &AddPage::on_rating_changed);
+        for(std::vector<StatsItem>::const_iterator it = items.begin(); it != items.end(); ++it)
+        {
+            int percent = total > 0 ? (int)((it->shows * 100.0) / total + 0.5) : 0;
+            add_row("    " + it->name, CL_StringHelp::int_to_text(it->shows), 
+                    showEpisodes ? CL_StringHelp::int_to_text(it->episodes) : CL_String(), 
+                    cl_format("%1 %2%%", CL_String(percent / 2, '|'), percent));
+        }
+    }
 
-        addButton.func_clicked().set(this, &AddPage::on_submit_clicked);
-        clearButton.func_clicked().set(this, &AddPage::on_clear_clicked);
-        searchButton.func_clicked().set(this, &AddPage::on_search_clicked);
-        updateButton.func_clicked().set(this, &AddPage::on_update_clicked);
+    void refresh_stats()
+    {
+        TraceSpan span("gui", "StatsPage::refresh_stats");
+        unsigned int start_time = CL_System::get_time();
+        LibraryStats library = database->get_stats();
+
+        stats->clear();
+        add_section("Viewing status", library.by_status, library.shows, true);
+        add_section("Rating", library.by_rating, library.shows, false);
+        add_section("Year", library.by_year, library.shows, true);
+        add_section("Top genres", library.top_genres, library.shows, false);
+
+        summary->set_text(cl_format("%1 shows, %2 episodes (loaded in %3 ms)", library.shows, library.episodes, CL_System::get_time() - start_time));
+        summary->request_repaint();
+    }
 
-        addGenre.func_clicked().set(this, &AddPage::on_add_genre_clicked);
-        removeGenre.func_clicked().set(this, &AddPage::on_remove_genre_clicked);
+    void on_refresh_clicked()
+    {
+        refresh_stats();
+    }
 
-        refresh_available_genre_list();
+    void on_check_clicked()
+    {
+        unsigned int start_time = CL_System::get_time();
+        std::map<CL_String, int> differences = database->check_stats();
+        unsigned int elapsed = CL_System::get_time() - start_time;
 
-        CL_ListViewColumnHeader header = genreAdded.get_header()->create_column("genreAdded", "Selected Genre(0)");
-        header.set_width(genreAdded.get_width());
-        genreAdded.get_header()->append(header);
+        std::vector<CL_String> wrong;
+        for(std::map<CL_String, int>::const_iterator it = differences.begin(); it != differences.end(); ++it)
+        {
+            if(it->second > 0)
+                wrong.push_back(cl_format("%1: %2 rows", it->first, it->second));
+        }
 
-        genreSelection.set_multi_select(false);
-        genreAdded.set_multi_select(false);
+        if(wrong.empty())
+        {
+            MessageDialog(page, "Done", cl_format("The statistics match a full recompute (checked in %1 ms)", elapsed)).exec();
+            return;
+        }
 
-        std::vector<StatusItem> statuses = this->database->get_all_status();
+        cl_log_event("stats", "summary tables differ from a full recompute: %1", join(wrong.begin(), wrong.end(), CL_String(", ")));
 
-        for(std::vector<StatusItem>::const_iterator it = statuses.begin(); it != statuses.end(); ++it)
+        MessageDialog question(page, "Question", 
+                               cl_format("The statistics differ from a full recompute:\n%1\nRebuild them?", join(wrong.begin(), wrong.end(), CL_String("\n"))),
+                               MessageDialog::ASK_YES_NO);
+        question.exec();
+        question.set_visible(false);
+        if(question.getResult() == MessageDialog::YES)
         {
-            statusPopMenu.insert_item(it->name, it->id);
+            database->rebuild_stats();
+            refresh_stats();
         }
-
-        status.set_popup_menu(statusPopMenu);
-        status.set_editable(false);
-        status.set_selected_item(0);
-        status.set_focus_policy(CL_GUIComponent::focus_refuse);
     }
 
-
-    virtual ~AddPage() {}
-
-    virtual void fill_page(const void *data)
+    void on_export_clicked()
     {
-        const ShowItem *si = static_cast<const ShowItem*>(data);
-        fill_page(*si);
-    }
-
-private:
+        if(exporter.is_running())
+        {
+            exporter.cancel();
+            return;
+        }
 
-    void update_genre_added_header() const
-    {
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
-        genreAdded.get_header()->get_column("genreAdded").set_caption(cl_format("Selected Genre(%1)", genreAdded.get_document_item().get_child_count()));
+        CL_SaveFileDialog dialog(page);
+        dialog.set_title("Export library");
+        dialog.add_filter("Comma separated values (*.csv)", "*.csv", true);
+        dialog.add_filter("JSON (*.json)", "*.json");
+        dialog.add_filter("MyAnimeList list export (*.xml)", "*.xml");
+        if(dialog.show() == false)
+            return;
+
+        database->flush();
+        exporter.start(dialog.get_filename());
+        exportButton->set_text("Cancel");
+        exportTimer.start(100, true);
     }
 
-    std::vector<CL_SharedPtr<GenreItem> > refresh_available_genre_list() 
+    void on_export_timer()
     {
-        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
-
-        genreSelection.clear();
-
-        std::vector<GenreItem> genreItems = this->database->get_all_genres();
+        if(exporter.is_finished() == false)
+        {
+            int total = exporter.get_total();
+            int percent = total > 0 ? (int)(exporter.get_written() * 100.0 / total) : 0;
+            summary->set_text(cl_format("Exporting... %1 of %2 shows (%3%%)", exporter.get_written(), total, percent));
+            summary->request_repaint();
+            return;
+        }
 
-        std::vector<CL_SharedPtr<GenreItem> > genreItemsPtr;
+        exportTimer.stop();
+        exporter.join();
+        exportButton->set_text("Export");
+        refresh_stats();
 
-        if(genreSelection.get_header()->get_column("genreSelection").is_null())
+        CL_String error = exporter.get_error();
+        if(error.empty())
         {
-            CL_ListViewColumnHeader header = genreSelection.get_header()->create_column("genreSelection", "Available Genre");
-            header.set_width(genreSelection.get_width());
-            genreSelection.get_header()->append(header);
+            cl_log_event("export", "%1 shows exported in %2 ms", exporter.get_written(), exporter.get_elapsed_ms());
+            MessageDialog(page, "Done", cl_format("Exported %1 shows in %2 ms", exporter.get_written(), exporter.get_elapsed_ms())).exec();
         }
-
-        CL_ListViewItem docItem = genreSelection.get_document_item();
-        for(std::vector<GenreItem>::const_iterator it = genreItems.begin(); it != genreItems.end(); ++it)
+        else
         {
-            CL_ListViewItem item = genreSelection.create_item();
-            CL_SharedPtr<GenreItem> newGenreItem = CL_SharedPtr<GenreItem>(new GenreItem);
-            genreItemsPtr.push_back(newGenreItem);
-            *newGenreItem = *it;
-            item.set_userdata(newGenreItem);
-            item.set_column_text("genreSelection", it->name);
-            docItem.append_child(item);
+            MessageDialog(page, "Error", cl_format("The export failed:\n%1", error)).exec();
         }
-        genreSelection.get_header()->get_column("genreSelection").set_caption(cl_format("Available Genre(%1)", genreItems.size()));
+    }
 
-        return genreItemsPtr;
+    void on_visiblity_changed(bool visible)
+    {
+        if(visible)
+        {
+            refresh_stats();
+        }
     }
 
-    void on_add_genre_clicked()
+public:
+    StatsPage(CL_TabPage *page, const CL_SharedPtr<Database> &database)
+        : Page(page->get_id()), page(page), database(database),
+          stats(CL_ListView::get_named_item(page, "stats")),
+          summary(CL_Label::get_named_item(page, "summary")),
+          refresh(CL_PushButton::get_named_item(page, "refresh")),
+          check(CL_PushButton::get_named_item(page, "check")),
+          exportButton(CL_PushButton::get_named_item(page, "export"))
     {
-        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        stats->show_detail_icon(false);
+        stats->show_detail_opener(false);
+        stats->get_icon_list().clear();
+        stats->set_multi_select(false);
+        stats->set_select_whole_row(true);
+
+        page->func_visibility_change().set(this, &StatsPage::on_visiblity_changed);
+        refresh->func_clicked().set(this, &StatsPage::on_refresh_clicked);
+        check->func_clicked().set(this, &StatsPage::on_check_clicked);
+        exportButton->func_clicked().set(this, &StatsPage::on_export_clicked);
+        exportTimer.func_expired().set(this, &StatsPage::on_export_timer);
+
+        CL_GUIThemePart listThemePart(stats, "selection");
+        CL_Font font = listThemePart.get_font();
+        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
+            listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
 
-        if(genreSelection.get_selected_item().is_null() == false)
-        {
-            CL_String genreText = genreSelection.get_selected_item().get_column("genreSelection").get_text();
-            CL_ListViewItem genreItem = genreAdded.find("genreAdded", genreText);
-            if(genreItem.is_null())
-            {
-                CL_ListViewItem newGenreItem = genreAdded.create_item();
-                newGenreItem.set_column_text("genreAdded", genreText);
-                newGenreItem.set_userdata(genreSelection.get_selected_item().get_userdata());
-                genreAdded.get_document_item().append_child(newGenreItem);
+        CL_ListViewColumnHeader column = stats->get_header()->create_column("name", "Statistic");
+        stats->get_header()->append(column);
+        column.set_width(200);
 
-                // sort the added genre items by re-adding the items
-                std::vector<CL_SharedPtr<GenreItem> > items;
-                CL_ListViewItem child = genreAdded.get_document_item().get_first_child();
-                while(child.is_null() == false)
-                {
-                    CL_SharedPtr<GenreItem> item = cl_dynamic_pointer_cast<GenreItem>(child.get_userdata());
-                    items.push_back(item);
-                    child = child.get_next_sibling();
-                }
-                genreAdded.clear();
-                
-                struct SortFun
-                {
-                    bool operator()(const CL_SharedPtr<GenreItem> &item1, const CL_SharedPtr<GenreItem> &item2)
-                    {
-                        return item1->name < item2->name;
-                    }
-                };
+        column = stats->get_header()->create_column("shows", "Shows");
+        stats->get_header()->append(column);
+        column.set_width(font.get_text_size(stats->get_gc(), "0000000").width + padding);
 
-                std::sort(items.begin(), items.end(), SortFun());
+        column = stats->get_header()->create_column("episodes", "Episodes");
+        stats->get_header()->append(column);
+        column.set_width(font.get_text_size(stats->get_gc(), "Episodes").width + padding);
 
-                CL_ListViewItem genreAddedDocItem = genreAdded.get_document_item(); 
-                for (std::vector<CL_SharedPtr<GenreItem> >::iterator it = items.begin(); it != items.end(); ++it)
-                {
-                    CL_ListViewItem newItem = genreAdded.create_item();
-                    newItem.set_column_text("genreAdded", (*it)->name);
-                    newItem.set_userdata(*it);
-                    genreAddedDocItem.append_child(newItem);
-                }
-                update_genre_added_header();
-            }
-        }
+        column = stats->get_header()->create_column("share", "Share");
+        stats->get_header()->append(column);
+    }
+
+    virtual ~StatsPage() {}
+};
+
+// hidden page, shown with --diagnostics: how often each database statement ran, how long it took and
+// the runs that went over the slow query threshold
+class DiagnosticsPage : public Page
+{
+    CL_TabPage *page;
 
-    }
+    CL_ListView *statements;
+    CL_ListView *slow;
+    CL_ListView *memory;
+    CL_Label *summary;
+    CL_PushButton *refresh, *reset, *exportButton;
 
-    void on_remove_genre_clicked()
+    static CL_String format_ms(unsigned long long microseconds)
     {
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        return CL_StringHelp::double_to_text(microseconds / 1000.0, 2);
+    }
 
-        CL_ListViewItem selectedItem = genreAdded.get_selected_item();
+    static CL_String format_kb(long bytes)
+    {
+        return CL_StringHelp::int_to_text((int)((bytes + 1023) / 1024));
+    }
 
-        if(selectedItem.is_null() == false)
-        {
-            selectedItem.remove();
-            
-            update_genre_added_header();
-        }
+    void add_memory_row(const CL_String &name, const MemoryUsage &usage, bool counted)
+    {
+        CL_ListViewItem item = memory->create_item();
+        item.set_column_text("name", name);
+        item.set_column_text("current", format_kb(usage.current));
+        item.set_column_text("peak", format_kb(usage.peak));
+        item.set_column_text("allocations", counted ? CL_StringHelp::uint_to_text((unsigned int)usage.allocations) : CL_String());
+        memory->get_document_item().append_child(item);
     }
 
-    std::vector<GenreItem> get_selected_genres() const
+    void add_column(CL_ListView *list, const CL_String &id, const CL_String &caption, int width)
     {
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
+        CL_ListViewColumnHeader column = list->get_header()->create_column(id, caption);
+        list->get_header()->append(column);
+        if(width > 0)
+            column.set_width(width);
+    }
 
-        std::vector<GenreItem> genres;
+    void setup_list(CL_ListView *list)
+    {
+        list->show_detail_icon(false);
+        list->show_detail_opener(false);
+        list->get_icon_list().clear();
+        list->set_multi_select(false);
+        list->set_select_whole_row(true);
+    }
 
-        CL_ListViewItem child = genreAdded.get_document_item().get_first_child();
-        while(child.is_null() == false)
+    void refresh_lists()
+    {
+        StatementStats &stats = Database::get_statement_stats();
+        std::vector<StatementRecord> records = stats.get_statements();
+        std::vector<SlowStatement> slowRuns = stats.get_slow_statements();
+
+        unsigned int calls = 0;
+        unsigned long long total = 0;
+        statements->clear();
+        for(std::vector<StatementRecord>::const_iterator it = records.begin(); it != records.end(); ++it)
         {
-            CL_SharedPtr<GenreItem> item = cl_dynamic_pointer_cast<GenreItem>(child.get_userdata());
-            genres.push_back(*item);
-            child = child.get_next_sibling();
+            const LatencyHistogram &latency = it->latency;
+            calls += it->calls;
+            total += latency.get_total();
+
+            CL_ListViewItem item = statements->create_item();
+            item.set_column_text("total", format_ms(latency.get_total()));
+            item.set_column_text("calls", CL_StringHelp::uint_to_text(it->calls));
+            item.set_column_text("rows", CL_StringHelp::ull_to_text(it->rows));
+            item.set_column_text("p50", format_ms(latency.get_percentile(0.5)));
+            item.set_column_text("p99", format_ms(latency.get_percentile(0.99)));
+            item.set_column_text("max", format_ms(latency.get_max()));
+            item.set_column_text("statement", it->failures > 0 ? cl_format("(%1 failed) %2", it->failures, it->statement) : it->statement);
+            statements->get_document_item().append_child(item);
         }
 
-        return genres;
-    }
+        // newest first
+        slow->clear();
+        for(std::vector<SlowStatement>::const_reverse_iterator it = slowRuns.rbegin(); it != slowRuns.rend(); ++it)
+        {
+            CL_ListViewItem item = slow->create_item();
+            item.set_column_text("time", it->time);
+            item.set_column_text("duration", format_ms(it->duration));
+            item.set_column_text("rows", CL_StringHelp::int_to_text(it->rows));
+            item.set_column_text("statement", it->statement);
+            item.set_column_text("parameters", it->parameters);
+            item.set_column_text("plan", it->plan);
+            slow->get_document_item().append_child(item);
+        }
 
-    void clear_genre() const
-    {
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
-        genreAdded.clear();
-        update_genre_added_header();
-    }
-    
-    void on_rating_changed()
-    {
-        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-        CL_Label &ratingLabel = *CL_Label::get_named_item(page, "ratingLabel");
+        // without ENABLE_MEMORY_STATS nothing counts the heap, only sqlite's own numbers are real
+        memory->clear();
+        for(int i = 0; MemoryStats::is_enabled() && i < MEMORY_TAG_COUNT; i++)
+            add_memory_row(MemoryStats::get_tag_name((MEMORY_TAG)i), MemoryStats::get_usage((MEMORY_TAG)i), true);
+        add_memory_row("SQLite", MemoryStats::get_sqlite_usage(), false);
 
-        ratingLabel.set_text(cl_format("%1/10", rating.get_position()));
+        unsigned int threshold = stats.get_slow_threshold() / 1000;
+        summary->set_text(cl_format("%1 statements run %2 times in %3 ms, %4 slower than %5 ms (times in ms)", 
+                                    (int)records.size(), calls, format_ms(total), (int)slowRuns.size(), threshold));
+        summary->request_repaint();
     }
 
-    CL_String get_media_type() const
+    void on_refresh_clicked()
     {
-        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
-
-        return mediatype.get_text();
+        refresh_lists();
     }
 
-    int get_status() const
+    void on_reset_clicked()
     {
-        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
-
-        return status.get_selected_item();
+        Database::get_statement_stats().reset();
+        MemoryStats::reset_peaks();
+        refresh_lists();
     }
 
-    void set_media_type(const CL_String &type) const
+    void on_export_clicked()
     {
-        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
+        CL_SaveFileDialog dialog(page);
+        dialog.set_title("Export statement and memory statistics");
+        dialog.add_filter("Tab separated values (*.tsv)", "*.tsv", true);
+        if(dialog.show() == false)
+            return;
 
-        if(type == "Anime")
+        try
         {
-            mediatype.set_text(type);
+            CL_File file(dialog.get_filename(), CL_File::create_always, CL_File::access_write);
+            Database::get_statement_stats().write(file);
+            file.send("\n", 1);
+            MemoryStats::write(file);
         }
-        else if(type == "Film")
+        catch(CL_Exception &e)
         {
-            mediatype.set_text(type);
+            MessageDialog(page, "Error", cl_format("The statistics couldn't be written:\n%1", e.message)).exec();
         }
-        else if(type == "TV")
+    }
+
+    void on_visiblity_changed(bool visible)
+    {
+        if(visible)
         {
-            mediatype.set_text(type);
+            refresh_lists();
         }
-        else reset_media_type();
     }
 
-    void reset_media_type() const
+public:
+    DiagnosticsPage(CL_TabPage *page)
+        : Page(page->get_id()), page(page),
+          statements(CL_ListView::get_named_item(page, "statements")),
+          slow(CL_ListView::get_named_item(page, "slow")),
+          memory(CL_ListView::get_named_item(page, "memory")),
+          summary(CL_Label::get_named_item(page, "summary")),
+          refresh(CL_PushButton::get_named_item(page, "refresh")),
+          reset(CL_PushButton::get_named_item(page, "reset")),
+          exportButton(CL_PushButton::get_named_item(page, "export"))
     {
-        CL_ComboBox &mediatype = *CL_ComboBox::get_named_item(page, "mediatype");
-        mediatype.set_selected_item(0);
+        setup_list(statements);
+        setup_list(slow);
+        setup_list(memory);
+
+        page->func_visibility_change().set(this, &DiagnosticsPage::on_visiblity_changed);
+        refresh->func_clicked().set(this, &DiagnosticsPage::on_refresh_clicked);
+        reset->func_clicked().set(this, &DiagnosticsPage::on_reset_clicked);
+        exportButton->func_clicked().set(this, &DiagnosticsPage::on_export_clicked);
+
+        CL_GUIThemePart listThemePart(statements, "selection");
+        CL_Font font = listThemePart.get_font();
+        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
+            listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+        int number = font.get_text_size(statements->get_gc(), "0000000").width + padding;
+
+        add_column(statements, "total", "Total", number);
+        add_column(statements, "calls", "Calls", number);
+        add_column(statements, "rows", "Rows", number);
+        add_column(statements, "p50", "Median", number);
+        add_column(statements, "p99", "99%", number);
+        add_column(statements, "max", "Max", number);
+        add_column(statements, "statement", "Statement", 0);
+
+        add_column(slow, "time", "Time", font.get_text_size(slow->get_gc(), "0000-00-00 00:00:00").width + padding);
+        add_column(slow, "duration", "Duration", number);
+        add_column(slow, "rows", "Rows", number);
+        add_column(slow, "statement", "Statement", 250);
+        add_column(slow, "parameters", "Parameters", 120);
+        add_column(slow, "plan", "Plan", 0);
+
+        add_column(memory, "name", "Memory", 200);
+        add_column(memory, "current", "Current KB", number);
+        add_column(memory, "peak", "Peak KB", number);
+        add_column(memory, "allocations", "Allocations", 0);
     }
 
-    void reset_status() const
+    virtual ~DiagnosticsPage() {}
+};
+
+TabManager::TabManager(CL_GUIComponent *parent, const CL_SharedPtr<Database> &database, const MyAnimeListConfig &malConfig,
+                       const CL_SharedPtr<TaskScheduler> &tasks, bool diagnostics) 
+    : tab(new CL_Tab(parent))
+{
+    CL_GUILayoutCorners layout;
+
+    CL_TabPage *pageAdd = tab->add_page("Add Show", 0);
+    CL_TabPage *pageView = tab->add_page("View Records",1);
+    CL_TabPage *pageSearch = tab->add_page("Search MyAnimeList",2);
+    CL_TabPage *pageStats = tab->add_page("Statistics",3);
+    pageAdd->set_layout(layout);
+    pageView->set_layout(layout);
+    pageSearch->set_layout(layout);
+    pageStats->set_layout(layout);
+
+    // add start page
+    pageAdd->create_components("add.gui");
+    addPage.reset(new AddPage(pageAdd, this, database, tasks));
+    // add end page
+
+    // find/view records
+    pageView->create_components("view.gui");
+    viewPage.reset(new ViewPage(pageView, this, database, malConfig, tasks));
+
+    // myanimelist search page
+    pageSearch->create_components("view.gui");
+    searchPage.reset(new SearchPage(pageSearch, this, database, malConfig, tasks));
+
+    // library statistics
+    pageStats->create_components("stats.gui");
+    statsPage.reset(new StatsPage(pageStats, database));
+
+    // statement statistics, only when asked for
+    if(diagnostics)
     {
-        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
-        status.set_selected_item(0);
+        CL_TabPage *pageDiagnostics = tab->add_page("Diagnostics", 4);
+        pageDiagnostics->set_layout(layout);
+        pageDiagnostics->create_components("diagnostics.gui");
+        diagnosticsPage.reset(new DiagnosticsPage(pageDiagnostics));
     }
+}
 
-    void set_status(int statusCode)
-    {
-        CL_ComboBox &status = *CL_ComboBox::get_named_item(page, "status");
-        CL_PopupMenuItem item = statusPopMenu.get_item(statusCode);
+CL_Tab *TabManager::get_tab() const 
+{
+    return tab;
+}
 
-        if(item.is_null() == false)
-            status.set_selected_item(statusCode);
-        else
-            status.set_selected_item(0);
-    }
+// adds count made up shows to the library in batches, with the titles drawn from the given lengths,
+// up to four genres each and a date an hour apart. The titles are added to titles when it isn't null
+static void add_synthetic_shows(Database &database, SyntheticLibrary &synthetic, int count, int title_median, int title_max, std::vector<CL_String> *titles)
+{
+    enum { BATCH = 1000, ATTEMPTS = 100 };
 
-    void fill_page(const ShowItem &show)
-    {
-        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
-        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
-        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
-        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
-        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
-        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
-        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
-        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
-        CL_ListView &genreAdded = *CL_ListView::get_named_item(page, "genreAdded");
-        CL_ListView &genreSelection = *CL_ListView::get_named_item(page, "genreSelection");
+    std::vector<GenreItem> genres = database.get_all_genres();
+    const VIEWING_STATUS statuses[] = { WATCHING, COMPLETED, ONHOLD, DROPPED, PLANNING };
 
-        if(show.id != -1)
-        {
-            id.set_text(cl_format("%1", show.id));
-        }
-        else
+    // shows made up so far, the UNIQUE index on title_key, type, year and season would reject a repeat
+    std::set<CL_String> showKeys;
+
+    std::vector<ShowItem> batch;
+    for(int i = 0; i < count; i++)
+    {
+        ShowItem show;
+        show.title = synthetic.make_title(title_median, title_max);
+        show.comment = synthetic.make_comment();
+        show.type = (SHOW_TYPE)synthetic.next_int(TYPE_COUNT);
+        show.status = statuses[synthetic.next_int(5)];
+        show.year = 1960 + synthetic.next_int(66);
+        show.season = 1 + synthetic.next_int(4);
+        show.episodes = 1 + synthetic.next_int(52);
+        show.rating = synthetic.next_int(101) / 10.0;
+        // every other show came from MyAnimeList, so half the search results are owned
+        show.mal_id = i % 2 == 0 ? i + 1 : 0;
+        // an hour after the one before, like a library that grew over the years
+        show.date_added = CL_DateTime(2000 + i / 8064, 1 + i / 672 % 12, 1 + i / 24 % 28, i % 24, 0, 0);
+        show.date_updated = show.date_added;
+
+        // short titles come up more than once, draw another until the show is new
+        for(int attempt = 0; showKeys.insert(Database::make_show_key(show.title, (SHOW_TYPE)show.type, show.year, show.season)).second == false; attempt++)
         {
-            id.set_text("");
+            if(attempt == ATTEMPTS)
+                throw CL_Exception(cl_format("Unable to make up %1 different shows, allow longer titles", count));
+            show.title = synthetic.make_title(title_median, title_max);
         }
-        id.request_repaint();
 
-        if(show.date_added.is_null() == false)
+        int genreCount = genres.empty() ? 0 : synthetic.next_int(5);
+        std::set<int> picked;
+        while((int)show.genres.size() < genreCount)
         {
-            date_added.set_text(show.date_added.to_local().to_short_datetime_string());
-            
+            const GenreItem &genre = genres[synthetic.next_int((int)genres.size())];
+            if(picked.insert(genre.id).second)
+                show.genres.push_back(genre);
         }
-        else
+
+        if(titles)
+            titles->push_back(show.title);
+        batch.push_back(show);
+        if(batch.size() == BATCH)
         {
-            date_added.set_text("");
+            database.add_shows(batch);
+            batch.clear();
         }
-        date_added.request_repaint();
+    }
+    database.add_shows(batch);
+}
 
-        if(show.date_updated.is_null() == false)
+// what --bench-listview generates and runs
+struct ListViewBenchmarkSettings
+{
+    CL_String database_file;        // a copy of animerecord.s3db that is emptied and filled, overwritten every run
+    int shows;
+    int title_median;               // characters, half the titles are shorter
+    int title_max;                  // characters
+    unsigned int seed;
+    int iterations;                 // runs of every operation
+    bool snapshot;                  // read the lists from the snapshot as after a restart, instead of from sqlite
+    unsigned int allocation_budget; // per run of any operation instead of its own budget, 0 keeps the budgets
+    long peak_budget;               // bytes, the same
+    CL_String baseline;             // the text of an earlier report to compare with, empty for none
+    int baseline_tolerance;         // percent an operation may grow over the baseline
+
+    ListViewBenchmarkSettings() : database_file("benchmark.s3db"), shows(10000), title_median(20), title_max(200), seed(1), iterations(50),
+                                  snapshot(true), allocation_budget(0), peak_budget(0), baseline_tolerance(10) {}
+};
+
+// fills a library with made up shows, builds the pages on a window that is never shown and times what
+// the lists do on every click and keystroke: refresh, paging, typing a search, sorting and filling the
+// search results. Every run of an operation goes to the report with its allocations, the memory it
+// needed on top of what it started with and the text widths it measured
+class ListViewBenchmark
+{
+    ListViewBenchmarkSettings settings;
+    BenchmarkReport report;
+    SyntheticLibrary synthetic;
+    std::vector<CL_String> titles;  // of the generated shows, to type searches with
+
+    // ShowRow as it was before status and type were packed into bytes next to the other numbers: the dates
+    // between the ID and the rest, the type a string. Kept to measure what the packed layout gains
+    struct UnpackedShowRow
+    {
+        int id;
+        CL_DateTime date_added;
+        CL_DateTime date_updated;
+        const char *title;
+        const char *type;
+        const char *comment;
+        const char *sort_key;
+        const int *genres;
+        int genre_count;
+        int year;
+        int episodes;
+        int season;
+        int status;
+        int mal_id;
+        double rating;
+    };
+
+    // the run being measured
+    unsigned long long runStart;
+    MemoryUsage runUsage[MEMORY_TAG_COUNT];
+    unsigned int runMeasurements;
+    int scanMatches;    // summed up so the scans aren't optimized away
+
+    void generate_database()
+    {
+        unsigned int start_time = CL_System::get_time();
+        CL_String snapshotFile = settings.database_file + ".snapshot";
+
+        CL_FileHelp::copy_file("animerecord.s3db", settings.database_file, true);
+        try
         {
-            date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
+            CL_FileHelp::delete_file(snapshotFile);
         }
-        else
+        catch(CL_Exception &)
         {
-            date_updated.set_text("");
         }
-        date_updated.request_repaint();
-
-        title.set_text(show.title);
-        year.set_value(show.year);
-        rating.set_position((int)show.rating);
-        if(rating.func_value_changed().is_null() == false)
-            rating.func_value_changed().invoke();
-        comment.set_text(show.comment);
-        episodes.set_value(show.episodes);
-        season.set_value(show.season);
-        set_status(show.status);
-        set_media_type(show.type);
-        clear_genre();
 
-        // update the available genre list since it may have been changed when a new anime was added
-        std::vector<CL_SharedPtr<GenreItem> > genreItems = refresh_available_genre_list();
+        Database database(settings.database_file, snapshotFile);
+        database.remove_all_shows();
+        add_synthetic_shows(database, synthetic, settings.shows, settings.title_median, settings.title_max, &titles);
 
-        for(std::vector<GenreItem>::const_iterator it2 = show.genres.begin(); it2 != show.genres.end(); ++it2)
-        {
-            for(std::vector<CL_SharedPtr<GenreItem> >::const_iterator it = genreItems.begin(); it != genreItems.end(); ++it)
-            {
-                if(it2->id == (*it)->id)
-                {
-                    CL_ListViewItem newItem = genreAdded.create_item();
-                    newItem.set_userdata(*it);
-                    newItem.set_column_text("genreAdded", (*it)->name);
-                    genreAdded.get_document_item().append_child(newItem);
-                }
-            }
-        }
+        if(settings.snapshot)
+            database.save_snapshot();
 
-        update_genre_added_header();
+        cl_log_event("benchmark", "%1 shows generated in %2 ms", settings.shows, CL_System::get_time() - start_time);
     }
 
-
-    void on_submit_clicked()
+    void begin_run()
     {
-        if(database)
-        {
-            CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
-            CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
-            CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
-            CL_Spin &year = *CL_Spin::get_named_item(page, "year");
-            CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-            CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
-            CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
-            CL_Spin &season = *CL_Spin::get_named_item(page, "season");
-
-            CL_String trimmedTitle = clean(CL_String(trimmed(title.get_text())), CL_String("%_"));
+        MemoryStats::reset_peaks();
+        for(int i = 0; i < MEMORY_TAG_COUNT; i++)
+            runUsage[i] = MemoryStats::get_usage((MEMORY_TAG)i);
+        runMeasurements = text_measurements;
+        runStart = CL_System::get_microseconds();
+    }
 
-            if(trimmedTitle.empty())
-            {
-                MessageDialog(page, "Error", "The Title cannot be blank").exec();
-            }
-            else if(season.get_value() <= 0)
-            {
-                MessageDialog(page, "Error", "The Season number must be greater than 0").exec();
-            }
-            else if(get_selected_genres().empty())
-            {
-                MessageDialog(page, "Error", "You must select at least one genre").exec();
-            }
-            else
-            {
-                MessageDialog question(page, "Question", "Is everything correct?", MessageDialog::ASK_YES_NO);
-                question.exec();
-                question.set_visible(false);
-                if(question.getResult() == MessageDialog::YES)
-                {
-                    if(database->show_exist(trimmedTitle, get_media_type(), year.get_value(), season.get_value()))
-                    {
-                        MessageDialog(page, "Error", "This show already exists in the database!\nClick Update to update it").exec();
-                    }
-                    else
-                    {
-                        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
+    // the peaks of the tags are added up, which overstates the peak a little when they weren't at the same time
+    void end_run(const CL_String &operation)
+    {
+        unsigned int duration = (unsigned int)(CL_System::get_microseconds() - runStart);
 
-                        int showid = database->add_show(trimmedTitle, get_media_type(), get_selected_genres(), year.get_value(), 
-                                                        rating.get_position(), comment.get_text(), episodes.get_value(), season.get_value(), get_status());
-                        ShowItem show = database->find_show(showid);
-                        title.set_text(show.title);
-                        id.set_text(cl_format("%1", show.id));
-                        id.request_repaint();
-                        date_added.set_text(show.date_added.to_local().to_short_datetime_string());
-                        date_added.request_repaint();
-                        date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
-                        date_updated.request_repaint();
-                        MessageDialog(page, "Done", "It's added!").exec();
-                    }
-                }
+        unsigned long allocations = 0;
+        long peak = 0;
+        for(int i = 0; i < MEMORY_TAG_COUNT; i++)
+        {
+            MemoryUsage usage = MemoryStats::get_usage((MEMORY_TAG)i);
+            allocations += usage.allocations - runUsage[i].allocations;
+            peak += cl_max(usage.peak - runUsage[i].current, 0L);
+        }
 
-            }
+        report.record(operation, duration, (unsigned int)allocations, peak, text_measurements - runMeasurements);
+    }
 
-        }
+    // the criteria a filter on the list checks: a status mask, a year range, a minimum rating, the type and
+    // the season. Every row is read, like filtering a list that holds the whole library
+    static bool row_matches(int status, int year, double rating, bool type, int season)
+    {
+        return ((1 << status) & (WATCHING_MASK | COMPLETED_MASK)) != 0 && year >= 1990 && year <= 2010 &&
+               rating >= 5.0 && type && season <= 2;
     }
 
-    void on_update_clicked()
+    // the whole library in both layouts, the bytes per row and the time a filter takes over each
+    void run_row_scan(Database &database)
     {
-        if(database)
+        ShowList shows;
+        ShowCursor resume;
+        database.find_shows_after(ShowFilter(), ShowOrder(), ShowCursor(), settings.shows, shows, resume);
+
+        std::vector<UnpackedShowRow> unpacked(shows.size());
+        for(ShowList::size_type i = 0; i < shows.size(); i++)
         {
-            CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
-            CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
-            CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
-            CL_Spin &year = *CL_Spin::get_named_item(page, "year");
-            CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-            CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
-            CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
-            CL_Spin &season = *CL_Spin::get_named_item(page, "season");
-            
-            CL_String trimmedTitle = clean(CL_String(trimmed(title.get_text())), CL_String("%_"));
+            const ShowRow &show = shows[i];
+            UnpackedShowRow &row = unpacked[i];
+            row.id = show.id;
+            row.date_added = show.date_added;
+            row.date_updated = show.date_updated;
+            row.title = show.title;
+            row.type = get_show_type_name((SHOW_TYPE)show.type);
+            row.comment = show.comment;
+            row.sort_key = show.sort_key;
+            row.genres = show.genres;
+            row.genre_count = show.genre_count;
+            row.year = show.year;
+            row.episodes = show.episodes;
+            row.season = show.season;
+            row.status = show.status;
+            row.mal_id = show.mal_id;
+            row.rating = show.rating;
+        }
 
-            if(id.get_text().empty())
-            {
-                MessageDialog(page, "Error", "You haven't loaded a record yet!").exec();
-            }
-            else if(trimmedTitle.empty())
+        report.add_value("ShowRow bytes", (int)sizeof(ShowRow));
+        report.add_value("unpacked ShowRow bytes", (int)sizeof(UnpackedShowRow));
+        report.add_value("ShowItem bytes", (int)sizeof(ShowItem));
+
+        for(int i = 0; i < settings.iterations; i++)
+        {
+            begin_run();
+            for(ShowList::size_type j = 0; j < shows.size(); j++)
             {
-                MessageDialog(page, "Error", "The Title cannot be blank").exec();
+                const ShowRow &row = shows[j];
+                if(row_matches(row.status, row.year, row.rating, row.type == TYPE_TV, row.season))
+                    scanMatches++;
             }
-            else if(season.get_value() <= 0)
+            end_run("scan rows");
+
+            begin_run();
+            for(std::vector<UnpackedShowRow>::size_type j = 0; j < unpacked.size(); j++)
             {
-                MessageDialog(page, "Error", "The Season number must be greater than 0").exec();
+                const UnpackedShowRow &row = unpacked[j];
+                if(row_matches(row.status, row.year, row.rating, strcmp(row.type, "TV") == 0, row.season))
+                    scanMatches++;
             }
-            else if(get_selected_genres().empty())
+            end_run("scan unpacked rows");
+        }
+    }
+
+    void run_view_page(ViewPage &page)
+    {
+        for(int i = 0; i < settings.iterations; i++)
+        {
+            begin_run();
+            page.refresh_list();
+            end_run("refresh");
+        }
+
+        for(int i = 0; i < settings.iterations; i++)
+        {
+            begin_run();
+            page.result->paint();
+            end_run("paint");
+        }
+
+        // forward as far as there are pages, then back to the first
+        for(int i = 0; i < settings.iterations; i++)
+        {
+            unsigned int current = page.currentPage;
+            begin_run();
+            page.on_next_clicked();
+            end_run("next page");
+            if(page.currentPage == current)
+                break;
+        }
+        while(page.currentPage > 0)
+        {
+            begin_run();
+            page.on_previous_clicked();
+            end_run("previous page");
+        }
+
+        // up to the first 8 characters of a title, one keystroke at a time
+        for(int i = 0; i < settings.iterations && titles.empty() == false; i++)
+        {
+            const CL_String &title = titles[synthetic.next_int((int)titles.size())];
+            for(CL_String::size_type length = 1; length <= title.length() && length <= 8; length++)
             {
-                MessageDialog(page, "Error", "You must select at least one genre").exec();
+                page.search->set_text(title.substr(0, length));
+                CL_InputEvent event;
+                begin_run();
+                page.on_search_edit(event);
+                end_run("search keystroke");
             }
-            else
+        }
+        page.search->set_text("");
+        page.refresh_list();
+
+        for(int column = 0; column < ORDER_COUNT; column++)
+        {
+            for(int descending = 0; descending < 2; descending++)
             {
-                MessageDialog question(page, "Question", "Is everything correct?", MessageDialog::ASK_YES_NO);
-                question.exec();
-                question.set_visible(false);
-                if(question.getResult() == MessageDialog::YES)
-                {                    
-                    if(database->show_exist(id.get_text_int()) == false)
-                    {
-                        MessageDialog(page, "Error", "This show doesn't exists in the database!\nClick Add to add it").exec();
-                    }
-                    else if(database->show_similar_to(id.get_text_int(), trimmedTitle, get_media_type(), year.get_value(), season.get_value()))
-                    {
-                        MessageDialog(page, "Error", "A similar show with the same title, type, year and season already exist\nTry changing the title").exec();
-                    }
-                    else
-                    {
-                        database->update_show(id.get_text_int(), trimmedTitle, get_media_type(), get_selected_genres(), year.get_value(), 
-                                              rating.get_position(), comment.get_text(), episodes.get_value(), season.get_value(), get_status());
-                        ShowItem show = database->find_show(id.get_text_int());
-                        title.set_text(show.title);
-                        id.set_text(cl_format("%1", show.id));
-                        id.request_repaint();
-                        date_updated.set_text(show.date_updated.to_local().to_short_datetime_string());
-                        date_updated.request_repaint();
-                        MessageDialog(page, "Done", "It's updated!").exec();
-                    }
+                ShowOrder order((SHOW_ORDER)column, descending != 0);
+                CL_String operation = "sort by " + ViewPage::get_order_name(order);
+                for(int i = 0; i < settings.iterations; i++)
+                {
+                    begin_run();
+                    page.set_order(order);
+                    end_run(operation);
                 }
+            }
+        }
+        page.set_order(ShowOrder());
+    }
 
+    // results are made up from the generated titles, as the network would deliver them
+    void run_search_page(SearchPage &page)
+    {
+        for(int i = 0; i < settings.iterations && titles.empty() == false; i++)
+        {
+            std::map<int, ShowItem> results;
+            while((int)results.size() < SearchPage::LIMIT && (int)results.size() < settings.shows)
+            {
+                int index = synthetic.next_int((int)titles.size());
+                ShowItem &show = results[index + 1];
+                show.title = titles[index];
+                show.comment = synthetic.make_comment();
+                show.rating = synthetic.next_int(101) / 10.0;
             }
 
+            begin_run();
+            page.show_results(results);
+            end_run("search results");
         }
     }
 
+public:
+    ListViewBenchmark(const ListViewBenchmarkSettings &settings) : settings(settings), synthetic(settings.seed), scanMatches(0)
+    {
+        // every operation is held to its own budget wherever allocations are counted
+        if(MemoryStats::is_enabled())
+            report.use_listview_budgets();
+        report.set_allocation_budget(settings.allocation_budget);
+        report.set_peak_budget(settings.peak_budget);
+        if(settings.baseline.empty() == false)
+            report.set_baseline(settings.baseline, settings.baseline_tolerance);
+    }
 
-    void on_clear_clicked()
+    void run(CL_GUIManager &guiMan)
     {
-        CL_LineEdit &id = *CL_LineEdit::get_named_item(page, "id");
-        CL_LineEdit &date_added = *CL_LineEdit::get_named_item(page, "date_added");
-        CL_LineEdit &date_updated = *CL_LineEdit::get_named_item(page, "date_updated");
-        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
-        CL_Spin &year = *CL_Spin::get_named_item(page, "year");
-        CL_Slider &rating = *CL_Slider::get_named_item(page, "rating");
-        CL_TextEdit &comment = *CL_TextEdit::get_named_item(page, "comment");
-        CL_Spin &episodes = *CL_Spin::get_named_item(page, "episodes");
-        CL_Spin &season = *CL_Spin::get_named_item(page, "season");
+        generate_database();
 
-        id.set_text("");
-        id.request_repaint();
-        date_added.set_text("");
-        date_added.request_repaint();
-        date_updated.set_text("");
-        date_updated.request_repaint();
-        title.set_text("");
-        year.set_value(2010);
+        // opened again like on the next start, so the snapshot is used when there is one
+        CL_SharedPtr<Database> database(new Database(settings.database_file, settings.database_file + ".snapshot"));
+        CL_SharedPtr<TaskScheduler> tasks(new TaskScheduler);
 
-        rating.set_position(5);
-        if(rating.func_value_changed().is_null() == false)
-            rating.func_value_changed().invoke();
+        CL_DisplayWindowDescription desc;
+        desc.set_size(CL_Size(800, 600), true);
+        desc.set_title("Anime Record benchmark");
+        desc.set_visible(false);
 
-        comment.set_text("");
-        episodes.set_value(0);
-        season.set_value(0);
+        CL_Window win(&guiMan, desc);
+        CL_GUILayoutCorners layout;
+        win.set_layout(layout);
 
-        reset_status();
-        reset_media_type();
-        clear_genre();
+        begin_run();
+        std::auto_ptr<TabManager> tabMan(new TabManager(&win, database, MyAnimeListConfig(), tasks, false));
+        end_run("build pages");
+        tabMan->get_tab()->set_geometry(CL_Rect(0, 0, win.get_size()));
+
+        run_view_page(*static_cast<ViewPage *>(tabMan->viewPage.get()));
+        run_search_page(*static_cast<SearchPage *>(tabMan->searchPage.get()));
+        run_row_scan(*database);
+        cl_log_event("benchmark", "%1 rows matched the scans", scanMatches);
+
+        tasks->shutdown();
     }
 
-    void on_result_menu_click(ShowItem show)
+    const BenchmarkReport &get_report() const { return report; }
+};
+
+// what --bench-mal serves and runs
+struct MALBenchmarkSettings
+{
+    MockHTTPServerSettings server;  // its fixture directory is filled with generated documents, overwritten every run
+    int searches;                   // different search documents
+    int results;                    // entries per search document, each with its own details document
+    unsigned int seed;
+    int iterations;                 // runs of every operation
+    double requests_per_second;     // scheduler rate per host, high enough by default that only the server is measured
+
+    MALBenchmarkSettings() : searches(20), results(50), seed(1), iterations(50), requests_per_second(1000.0)
     {
-        fill_page(show);
+        server.fixture_directory = "benchmark-fixtures";
     }
+};
 
-    void on_next_menu_click(SearchQuery search)
+// serves made up MyAnimeList documents from the mock server and times searches and genre downloads end to
+// end: the request scheduler, the HTTP client with its decoding and the XML parsing. The server settings
+// add latency, bandwidth limits, chunks, gzip and errors, so the network path can be measured offline
+class MALBenchmark
+{
+    MALBenchmarkSettings settings;
+    BenchmarkReport report;
+    SyntheticLibrary synthetic;
+    std::vector<CL_String> queries;
+    std::vector<int> showids;
+
+    // bytes read by the runs of each operation, and what the scheduler counted over the whole benchmark
+    std::map<CL_String, unsigned long long> wireBytes;
+    std::map<CL_String, unsigned long long> contentBytes;
+    HTTPSchedulerCounters counters;
+
+    // the run being measured
+    unsigned long long runStart;
+    MemoryUsage runUsage[MEMORY_TAG_COUNT];
+    HTTPSchedulerCounters runCounters;
+
+    void generate_fixtures()
     {
-        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
+        static const char *genres[] = { "Action", "Adventure", "Comedy", "Drama", "Fantasy", "Mystery", "Romance", "Sci-Fi", "Slice of Life", "Sports" };
+        const int genreCount = sizeof(genres) / sizeof(genres[0]);
 
-        CL_Rect geom = searchButton.get_geometry();
-        display_search_result(search.name, search.start, search.limit, CL_Point(geom.left, geom.top));
+        HTTPFixtureStore fixtures(settings.server.fixture_directory);
+        int showid = 1;
+        for(int i = 0; i < settings.searches; i++)
+        {
+            CL_String query = cl_format("benchmark%1", i);
+            CL_String search = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<anime>\n";
+            for(int j = 0; j < settings.results; j++, showid++)
+            {
+                int year = 1960 + synthetic.next_int(66);
+                search += cl_format("<entry><id>%1</id><title>%2</title><episodes>%3</episodes>", showid, synthetic.make_title(20, 200), 1 + synthetic.next_int(52)) +
+                          cl_format("<score>%1</score><start_date>%2-04-01</start_date>", CL_StringHelp::double_to_text(synthetic.next_int(101) / 10.0, 2), year) +
+                          cl_format("<synopsis>%1</synopsis></entry>\n", synthetic.make_comment());
+
+                CL_String details = cl_format("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<anime><id>%1</id>", showid);
+                for(int k = 1 + synthetic.next_int(4); k > 0; k--)
+                    details += cl_format("<genre>%1</genre>", genres[synthetic.next_int(genreCount)]);
+                details += cl_format("<start_date>%1-04-01</start_date></anime>\n", year);
+
+                fixtures.save(MyAnimeListClient::get_details_path(showid), CL_DataBuffer(details.data(), details.length()));
+                showids.push_back(showid);
+            }
+            search += "</anime>\n";
+
+            fixtures.save(MyAnimeListClient::get_search_path(query), CL_DataBuffer(search.data(), search.length()));
+            queries.push_back(query);
+        }
     }
 
-    void display_search_result(const CL_String &title, int start, int limit, const CL_Point &location)
+    void begin_run(HTTPRequestScheduler &scheduler)
     {
-        CL_String trimmedTitle = trimmed(title);
-        std::vector<ShowItem> shows = database->find_shows(trimmedTitle, ALL_VIEWING_STATUS_MASK, start, limit);
+        MemoryStats::reset_peaks();
+        for(int i = 0; i < MEMORY_TAG_COUNT; i++)
+            runUsage[i] = MemoryStats::get_usage((MEMORY_TAG)i);
+        runCounters = scheduler.get_counters();
+        runStart = CL_System::get_microseconds();
+    }
 
-        pop.clear();
-        pop.insert_item("Cancel");
-        pop.insert_item("Clear").func_clicked().set(this, &AddPage::on_clear_clicked);
-        pop.insert_separator();
-        for (std::vector<ShowItem>::iterator it = shows.begin(); it != shows.end(); ++it)
+    void end_run(const CL_String &operation, HTTPRequestScheduler &scheduler)
+    {
+        unsigned int duration = (unsigned int)(CL_System::get_microseconds() - runStart);
+
+        unsigned long allocations = 0;
+        long peak = 0;
+        for(int i = 0; i < MEMORY_TAG_COUNT; i++)
         {
-            pop.insert_item(cl_format("%1 (%2) (season %3) (%4)", it->title, it->year, it->season, it->type), it->id)
-                .func_clicked().set(this, &AddPage::on_result_menu_click, *it);
+            MemoryUsage usage = MemoryStats::get_usage((MEMORY_TAG)i);
+            allocations += usage.allocations - runUsage[i].allocations;
+            peak += cl_max(usage.peak - runUsage[i].current, 0L);
         }
 
-        
-        if(shows.empty() == false)
-            pop.insert_separator();
+        HTTPSchedulerCounters current = scheduler.get_counters();
+        wireBytes[operation] += current.wire_bytes - runCounters.wire_bytes;
+        contentBytes[operation] += current.content_bytes - runCounters.content_bytes;
+        report.record(operation, duration, (unsigned int)allocations, peak, 0);
+    }
 
-        SearchQuery search; 
-        search.name = trimmedTitle; 
+public:
+    MALBenchmark(const MALBenchmarkSettings &settings) : settings(settings), synthetic(settings.seed)
+    {
+    }
 
-        if(start > 0)
+    // failed runs are logged and left out of the latencies, the scheduler's failed counter has them
+    void run()
+    {
+        generate_fixtures();
+
+        MockHTTPServer server(settings.server);
+        server.start();
+
+        MyAnimeListConfig config;
+        config.search_host = config.api_host = "127.0.0.1";
+        config.search_port = config.api_port = settings.server.port;
+        CL_SharedPtr<HTTPRequestScheduler> scheduler(new HTTPRequestScheduler(settings.requests_per_second, settings.requests_per_second, 4, settings.seed));
+        MyAnimeListClient client(scheduler, config);
+
+        for(int i = 0; i < settings.iterations && queries.empty() == false; i++)
         {
-            search.start = cl_max(start-limit, 0); 
-            search.limit = limit;
-            pop.insert_item(cl_format("...Previous %1", limit)).func_clicked().set(this, &AddPage::on_next_menu_click, search);
+            const CL_String &query = queries[synthetic.next_int((int)queries.size())];
+            std::map<int, ShowItem> shows;
+            try
+            {
+                begin_run(*scheduler);
+                shows = client.search(query);
+                end_run("search", *scheduler);
+            }
+            catch(CL_Exception &e)
+            {
+                cl_log_event("benchmark", "search for %1 failed: %2", query, e.message);
+            }
         }
 
-        if(shows.empty() == false)
+        for(int i = 0; i < settings.iterations && showids.empty() == false; i++)
         {
-            search.start = start+limit; 
-            search.limit = limit;
-            pop.insert_item(cl_format("Next %1...", limit)).func_clicked().set(this, &AddPage::on_next_menu_click, search);
+            int showid = showids[synthetic.next_int((int)showids.size())];
+            try
+            {
+                begin_run(*scheduler);
+                MyAnimeListDetails details = client.get_details(showid);
+                end_run("details", *scheduler);
+            }
+            catch(CL_Exception &e)
+            {
+                cl_log_event("benchmark", "details of %1 failed: %2", showid, e.message);
+            }
         }
 
-        pop.start(page, page->component_to_screen_coords(location));
+        counters = scheduler->get_counters();
+        server.stop();
     }
 
-    void on_search_clicked()
+    const BenchmarkReport &get_report() const { return report; }
+    const HTTPSchedulerCounters &get_counters() const { return counters; }
+
+    // the report followed by the bytes per run and the scheduler's counters, tab separated
+    CL_String to_text() const
     {
-        CL_LineEdit &title = *CL_LineEdit::get_named_item(page, "title");
-        CL_PushButton &searchButton = *CL_PushButton::get_named_item(page, "search");
+        CL_String text = report.to_text() + "\noperation\twire_bytes_per_run\tcontent_bytes_per_run\n";
+        const std::vector<BenchmarkOperation> &operations = report.get_operations();
+        for(std::vector<BenchmarkOperation>::const_iterator it = operations.begin(); it != operations.end(); ++it)
+        {
+            unsigned int runs = cl_max(it->latency.get_count(), 1u);
+            text += it->name + cl_format("\t%1\t%2\n", (unsigned int)(wireBytes.find(it->name)->second / runs), (unsigned int)(contentBytes.find(it->name)->second / runs));
+        }
 
-        CL_Rect geom = searchButton.get_geometry();
-        display_search_result(title.get_text(), 0, 20, CL_Point(geom.left, geom.top));
+        text += "\nrequests\tretried\tfailed\twire_bytes\tcontent_bytes\n";
+        text += cl_format("%1\t%2\t%3\t", counters.requests, counters.retried, counters.failed) +
+                cl_format("%1\t%2\n", CL_StringHelp::ull_to_text(counters.wire_bytes), CL_StringHelp::ull_to_text(counters.content_bytes));
+        return text;
     }
 
+    void write(CL_IODevice &file) const
+    {
+        CL_String text = to_text();
+        if(file.send(text.data(), text.length(), true) != (int)text.length())
+            throw CL_Exception("Unable to write the benchmark report");
+    }
 };
 
-class ViewPage : public Page
+// checks of the parts that need a server, threads or the message loop, run with --self-test. A check
+// throws a CL_Exception that says what went wrong
+class SelfTest
 {
-    std::vector<ShowItem> shows;
-    CL_SharedPtr<Database> database;
-    TabManager *tabMan;
-
-    CL_ListView *result;
-    CL_LineEdit *search;
-    CL_PushButton *previous, *next, *edit;
-    CL_LineEdit *pagenumber;
-    CL_CheckBox *watching, *completed, *planning, *dropped;
+    typedef void (*Check)();
 
-    enum { LIMIT=100 };
-    unsigned int currentPage;
-    CL_String query;
+    struct NamedCheck
+    {
+        const char *name;
+        Check check;
+    };
 
-    int viewing_status_mask;
+    // the mock servers listen here and on the ports after it
+    enum { PORT = 18320 };
 
-    void on_search_edit(CL_InputEvent &ev)
+    static void check(bool condition, const CL_String &what)
     {
-        refresh_list();
+        if(condition == false)
+            throw CL_Exception(what);
     }
 
-    void refresh_list() 
+    static CL_String get_port(int offset)
     {
-        currentPage = 0;
+        return CL_StringHelp::int_to_text(PORT + offset);
+    }
 
-        CL_ListViewItem docItem = result->get_document_item();
-        query = cl_format("%%%1%%", CL_StringHelp::text_to_lower(search->get_text()));
-        find_shows();
-        populate_show_list();
+    // xml-ish text that compresses like a real document
+    static CL_String make_document(int size)
+    {
+        CL_String document = "<?xml version=\"1.0\"?><anime>";
+        for(int i = 0; (int)document.length() < size; i++)
+            document += cl_format("<entry><id>%1</id><title>Show number %2</title><score>%3</score></entry>", i, i * 7919 % 10007, i % 10);
+        return document + "</anime>";
     }
-    void update_current_page_number()
+
+    // zlib wrapped, what servers send as Content-Encoding: deflate
+    static CL_String deflate_text(const CL_String &text)
     {
-        pagenumber->set_text(cl_format("%1", currentPage+1));
+        uLongf length = compressBound(text.length());
+        CL_String compressed(length, '\0');
+        if(compress2((Bytef *)&compressed[0], &length, (const Bytef *)text.data(), text.length(), Z_BEST_COMPRESSION) != Z_OK)
+            throw CL_Exception("Unable to compress the test document");
+        compressed.resize(length);
+        return compressed;
     }
 
-    std::vector<ShowItem>::size_type find_shows()
+    // a 200 KB document through the mock server with and without gzip and chunks, then responses that
+    // end early, which have to fail instead of coming back as a shorter document
+    static void check_http()
     {
-        shows = database->find_shows(query, viewing_status_mask, currentPage*LIMIT, LIMIT);
+        CL_String document = make_document(200 * 1024);
+        HTTPFixtureStore("selftest-fixtures").save("/selftest.xml", CL_DataBuffer(document.data(), document.length()));
 
-        return shows.size();
+        for(int i = 0; i < 4; i++)
+        {
+            MockHTTPServerSettings settings;
+            settings.fixture_directory = "selftest-fixtures";
+            settings.port = get_port(i);
+            settings.compress = (i & 1) != 0;
+            settings.chunk_size = (i & 2) != 0 ? 1000 : 0;
+            MockHTTPServer server(settings);
+            server.start();
+
+            HTTPClient client("127.0.0.1", settings.port);
+            CL_DataBuffer content = client.download("/selftest.xml", HTTPHeader());
+            const HTTPTransferStats &stats = client.get_last_stats();
+
+            CL_String mode = cl_format("gzip %1, chunks %2", (int)settings.compress, settings.chunk_size);
+            check(CL_String(content.get_data(), content.get_size()) == document, "the document came back changed with " + mode);
+            check(stats.status == 200 && (stats.content_encoding == "gzip") == settings.compress, "wrong status or encoding with " + mode);
+            check(settings.compress == false || stats.body_bytes * 4 < stats.content_bytes, "the gzip body isn't smaller with " + mode);
+        }
+
+        CL_String compressed = deflate_text(document);
+        CL_String cut[] =
+        {
+            cl_format("HTTP/1.1 200 OK\r\nContent-Length: %1\r\n\r\n", (int)document.length()) + document.substr(0, 5000),
+            CL_String("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1000\r\n") + document.substr(0, 4096) + "\r\n",
+            CL_String("HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\n\r\n") + compressed.substr(0, compressed.length() / 2),
+        };
+        const char *names[] = { "short Content-Length", "chunks without the last one", "deflate stream without its end" };
+
+        for(int i = 0; i < 3; i++)
+        {
+            HTTPResponseParser parser;
+            parser.feed(cut[i].data(), cut[i].length());
+            bool failed = false;
+            try
+            {
+                parser.finish();
+            }
+            catch(CL_Exception &)
+            {
+                failed = true;
+            }
+            check(failed, cl_format("a response with a %1 was accepted", names[i]));
+        }
     }
 
-    void populate_show_list()
-    {        
-        CL_ListViewItem docItem = result->get_document_item();
+    // a server that answers every request with 429 or 503 has to be tried exactly max_retries more times,
+    // one that fails a share of them until it answers, and a scheduler that doesn't block has to give up
+    // at once. The backoff is cut to ms so the check doesn't take the seconds a real one would
+    static void check_scheduler()
+    {
+        CL_String document = make_document(10 * 1024);
+        HTTPFixtureStore("selftest-fixtures").save("/scheduler.xml", CL_DataBuffer(document.data(), document.length()));
 
-        while(docItem.get_child_count() != LIMIT)
+        const int statuses[] = { 429, 503 };
+        for(int i = 0; i < 2; i++)
         {
-            CL_ListViewItem item = result->create_item();
-            docItem.append_child(item);
+            MockHTTPServerSettings settings;
+            settings.fixture_directory = "selftest-fixtures";
+            settings.port = get_port(4 + i);
+            settings.error_rate = 100;
+            settings.error_status = statuses[i];
+            MockHTTPServer server(settings);
+            server.start();
+
+            HTTPRequestScheduler scheduler(100.0, 100.0, 3);
+            scheduler.set_backoff(10, 40);
+            unsigned int start_time = CL_System::get_time();
+            bool failed = false;
+            try
+            {
+                scheduler.fetch(HTTPRequest("127.0.0.1", settings.port, "/scheduler.xml"));
+            }
+            catch(CL_Exception &e)
+            {
+                failed = e.message.find(CL_StringHelp::int_to_text(statuses[i])) != CL_String::npos;
+            }
+
+            HTTPSchedulerCounters counters = scheduler.get_counters();
+            check(failed, cl_format("a server that only answers %1 didn't fail the request with its status", statuses[i]));
+            check(counters.retried == 3 && counters.failed == 1, 
+                  cl_format("%1 answers: %2 retries and %3 failures instead of 3 and 1", statuses[i], counters.retried, counters.failed));
+            check(CL_System::get_time() - start_time < 2000, cl_format("%1 answers: the Retry-After of 1 s went past the 40 ms backoff limit", statuses[i]));
         }
 
-        CL_ListViewItem child = docItem.get_first_child();
+        // the mock draws its errors from the same sequence every time, so the retries are known in advance
+        MockHTTPServerSettings settings;
+        settings.fixture_directory = "selftest-fixtures";
+        settings.port = get_port(6);
+        settings.error_rate = 60;
+        settings.seed = 3;
+        int expected = 0;
+        for(unsigned int state = settings.seed; ; expected++)
+        {
+            state = state * 1103515245 + 12345;
+            if((int)(((state >> 16) & 0x7fff) % 100) >= settings.error_rate)
+                break;
+        }
 
-        CL_ListViewColumnHeader titleColumn = result->get_header()->get_column("title");
-        CL_ListViewColumnHeader ratingColumn = result->get_header()->get_column("rating");
-        CL_ListViewColumnHeader commentColumn = result->get_header()->get_column("comment");
+        {
+            MockHTTPServer server(settings);
+            server.start();
+
+            HTTPRequestScheduler scheduler(100.0, 100.0, expected + 1);
+            scheduler.set_backoff(10, 40);
+            CL_DataBuffer content = scheduler.fetch(HTTPRequest("127.0.0.1", settings.port, "/scheduler.xml"));
+            HTTPSchedulerCounters counters = scheduler.get_counters();
+            check(CL_String(content.get_data(), content.get_size()) == document, "the document came back changed after the retries");
+            check(counters.retried == expected && counters.failed == 0, cl_format("%1 retries instead of %2", counters.retried, expected));
+        }
 
-        CL_String titleColumnId = titleColumn.get_column_id();
-        CL_String ratingColumnId = ratingColumn.get_column_id();
-        CL_String commentColumnId = commentColumn.get_column_id();
-        
-        CL_String titleColumnName = cl_format("Title(%1)", shows.size());
+        // the GUI thread's import: one token, then the next request fails instead of waiting two seconds,
+        // and an error status isn't retried
+        settings.error_rate = 0;
+        settings.port = get_port(7);
+        MockHTTPServer server(settings);
+        server.start();
+
+        HTTPRequestScheduler scheduler(0.5, 1.0, 3);
+        scheduler.set_blocking(false);
+        scheduler.fetch(HTTPRequest("127.0.0.1", settings.port, "/scheduler.xml"));
+        unsigned int start_time = CL_System::get_time();
+        bool failed = false;
+        try
+        {
+            scheduler.fetch(HTTPRequest("127.0.0.1", settings.port, "/scheduler.xml"));
+        }
+        catch(CL_Exception &)
+        {
+            failed = true;
+        }
+        HTTPSchedulerCounters counters = scheduler.get_counters();
+        check(failed && counters.retried == 0, "a scheduler that doesn't block waited for the rate limit");
+        check(CL_System::get_time() - start_time < 500, "a scheduler that doesn't block took its time to fail");
+    }
 
-        CL_GUIThemePart listThemePart(result, "selection");
-        CL_Font font = listThemePart.get_font();
-        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
-                        listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
-        
-        int maxWidth = font.get_text_size(result->get_gc(), titleColumnName).width + padding;
-        for (std::vector<ShowItem>::const_iterator it = shows.begin(); it != shows.end(); ++it)
-        {            
-            int textWidth = font.get_text_size(result->get_gc(), it->title).width + padding;
-            if(maxWidth < textWidth) maxWidth = textWidth;
+    // counts its runs and how it ended. Some numbers throw a CL_Exception, a std::exception or an int
+    class StressTask : public BackgroundTask
+    {
+        int number;
+        CL_InterlockedVariable &runs;
+
+    public:
+        int completions;
+        int failures;
+
+        StressTask(int number, CL_InterlockedVariable &runs) : number(number), runs(runs), completions(0), failures(0) {}
+
+        static bool throws(int number) { return number % 10 == 3 || number % 10 == 6 || number % 10 == 9; }
+
+        void run(const CancellationToken &token)
+        {
+            runs.increment();
+            if(number % 10 == 3)
+                throw CL_Exception("thrown by a task");
+            if(number % 10 == 6)
+                throw std::runtime_error("thrown by a task");
+            if(number % 10 == 9)
+                throw number;
+        }
+
+        void completed() { completions++; }
+        void failed(const CL_String &error) { failures++; }
+    };
+
+    // 20000 tasks at every priority on four workers, every seventh cancelled before it is submitted.
+    // Each of the others has to run once and end in exactly one completed or failed, whatever it threw
+    static void check_tasks()
+    {
+        enum { TASKS = 20000 };
+        CL_InterlockedVariable runs;
+        runs.set(0);
+
+        TaskScheduler scheduler(4);
+        std::vector<CL_SharedPtr<StressTask> > tasks;
+        int expectedRuns = 0, expectedFailures = 0;
+        for(int i = 0; i < TASKS; i++)
+        {
+            tasks.push_back(CL_SharedPtr<StressTask>(new StressTask(i, runs)));
+            CancellationToken token;
+            if(i % 7 == 0)
+                token.cancel();
+            else
+            {
+                expectedRuns++;
+                if(StressTask::throws(i))
+                    expectedFailures++;
+            }
+            scheduler.submit(tasks.back(), token, (TaskPriority)(i % PRIORITY_COUNT));
+        }
 
-            ShowItem *showItemCopy = new ShowItem;
-            *showItemCopy = *it;
+        unsigned int start_time = CL_System::get_time();
+        while(scheduler.get_counters().dispatched < expectedRuns && CL_System::get_time() - start_time < 30000)
+        {
+            scheduler.dispatch_posted();
+            CL_System::sleep(1);
+        }
+        scheduler.shutdown();
 
-            child.set_userdata(CL_SharedPtr<ShowItem>(showItemCopy));
-            child.set_column_text(titleColumnId, it->title);
-            child.set_column_text(ratingColumnId, CL_StringHelp::double_to_text(it->rating, 2));
-            child.set_column_text(commentColumnId, clean(it->comment, CL_String("\r\n")));
-            child = child.get_next_sibling();
+        TaskSchedulerCounters counters = scheduler.get_counters();
+        check(counters.submitted == TASKS && counters.executed == expectedRuns && runs.get() == expectedRuns,
+              cl_format("%1 tasks ran instead of %2", counters.executed, expectedRuns));
+        check(counters.cancelled == TASKS - expectedRuns, cl_format("%1 tasks were cancelled instead of %2", counters.cancelled, TASKS - expectedRuns));
+        check(counters.failed == expectedFailures, cl_format("%1 tasks failed instead of %2", counters.failed, expectedFailures));
+        check(counters.dispatched == expectedRuns, cl_format("%1 completions instead of %2", counters.dispatched, expectedRuns));
+
+        for(int i = 0; i < TASKS; i++)
+        {
+            const StressTask &task = *tasks[i];
+            int completions = i % 7 == 0 ? 0 : 1;
+            int failures = i % 7 != 0 && StressTask::throws(i) ? 1 : 0;
+            check(task.completions + task.failures == completions && task.failures == failures,
+                  cl_format("task %1 completed %2 times and failed %3 times", i, task.completions, task.failures));
         }
-        if(maxWidth > 0) titleColumn.set_width(maxWidth);
+    }
+
+    // runs the keep alive objects for ms milliseconds, the message loop of a check
+    static void pump(unsigned int ms)
+    {
+        unsigned int start_time = CL_System::get_time();
+        while(CL_System::get_time() - start_time < ms)
+            CL_KeepAlive::process(10);
+    }
+
+    // the calling thread sleeps 500 ms inside a span with a 100 ms watchdog on it, which has to record
+    // that as one stall of about that length in that span, and nothing while the loop runs
+    static void check_watchdog()
+    {
+        Watchdog watchdog(100);
+        pump(300);
+        check(watchdog.get_stalls().empty(), "a stall was recorded while the loop was running");
 
-        int ellipseWidth = font.get_text_size(result->get_gc(), "...  ").width + padding;
-        commentColumn.set_width(result->get_width() - titleColumn.get_width()-ratingColumn.get_width()-ellipseWidth);
-        
-        while(child.is_null() == false)
         {
-            child.set_userdata(CL_SharedPtr<ShowItem>());
-            child.set_column_text(titleColumnId, "");
-            child.set_column_text(ratingColumnId, "");
-            child.set_column_text(commentColumnId, "");
-            child = child.get_next_sibling();
+            TraceSpan span("selftest", "sleep");
+            CL_System::sleep(500);
         }
+        pump(300);
+        watchdog.stop();
 
-        titleColumn.set_caption(titleColumnName);
-        update_current_page_number();
+        std::vector<StallEvent> stalls = watchdog.get_stalls();
+        check(stalls.size() == 1, cl_format("%1 stalls were recorded instead of 1", (int)stalls.size()));
+        check(stalls[0].activity.find("selftest/sleep") == 0, "the stall was recorded in \"" + stalls[0].activity + "\" instead of selftest/sleep");
+        check(stalls[0].duration >= 400 && stalls[0].duration < 1000, cl_format("the 500 ms stall was recorded as %1 ms", stalls[0].duration));
     }
 
-    void on_previous_clicked()
+    static CL_String export_xml(Database &database)
     {
-        if(currentPage > 0) currentPage--; 
-        find_shows();
-        populate_show_list();
+        CL_DataBuffer data;
+        CL_IODevice_Memory device(data);
+        ShowExportWriter writer(device, ShowExportWriter::FORMAT_XML);
+        ExportProgress progress;
+        database.export_shows(writer, progress);
+        return CL_String(device.get_data().get_data(), device.get_data().get_size());
     }
 
-    void on_next_clicked()
+    // shows with markup, line breaks, UTF-8, fractional ratings and dates in the past are exported as XML,
+    // imported into an empty library and exported again, which has to give the same file. CSV and JSON
+    // have no importer and aren't part of it
+    static void check_export()
     {
-        currentPage++;
-        if(find_shows() > 0)
+        CL_FileHelp::copy_file("animerecord.s3db", "selftest.s3db", true);
+        CL_SharedPtr<Database> database(new Database("selftest.s3db", "selftest.snapshot"));
+        database->remove_all_shows();
+
+        std::vector<CL_String> genreNames;
+        genreNames.push_back("Action");
+        genreNames.push_back("Slice of Life");
+        genreNames.push_back("Sci-Fi");
+        database->ensure_add_genres(genreNames);
+        std::vector<GenreItem> genres = database->get_genres_by_name(genreNames);
+
+        const char *titles[] = { "Plain", "Ah! My <Goddess> & \"friends\"", "Caf\xc3\xa9 \xe3\x81\x82\xe3\x81\x84", "Line\nbreak, comma" };
+        const VIEWING_STATUS statuses[] = { WATCHING, COMPLETED, ONHOLD, DROPPED, PLANNING };
+        std::vector<ShowItem> shows;
+        for(int i = 0; i < 20; i++)
         {
-            populate_show_list();
+            ShowItem show;
+            show.title = cl_format("%1 %2", titles[i % 4], i);
+            show.comment = i % 3 == 0 ? CL_String() : cl_format("comment %1\r\nwith \"quotes\" & <tags>", i);
+            show.type = (SHOW_TYPE)(i % TYPE_COUNT);
+            show.year = 1980 + i;
+            show.season = 1 + i % 3;
+            show.episodes = i * 3;
+            show.rating = i * 0.25;
+            show.status = statuses[i % 5];
+            show.mal_id = i % 2 == 0 ? 0 : 1000 + i;
+            show.date_added = CL_DateTime(2010, 1 + i % 12, 1 + i, 12, i, 30);
+            show.date_updated = CL_DateTime(2012, 2, 3, 4, 5, i);
+            show.genres.assign(genres.begin(), genres.begin() + i % (genres.size() + 1));
+            shows.push_back(show);
         }
-        else
+        database->add_shows(shows);
+
+        CL_String first = export_xml(*database);
+        check(first.find("<animerecord_date_added>2010-02-02 12:01:30</animerecord_date_added>") != CL_String::npos, "the export has no date_added");
+
+        database->remove_all_shows();
+        CL_DataBuffer data(first.data(), first.length());
+        CL_IODevice_Memory device(data);
+        MALListImporter importer(database, MyAnimeListClient());
+        MALImportResult imported = importer.import(device, false);
+        check(imported.imported == (int)shows.size(), cl_format("%1 of %2 shows were imported", imported.imported, (int)shows.size()));
+
+        CL_String second = export_xml(*database);
+        if(first != second)
         {
-            currentPage--;
+            CL_String::size_type pos = 0;
+            while(pos < first.length() && pos < second.length() && first[pos] == second[pos])
+                pos++;
+            throw CL_Exception(cl_format("the exports differ after %1 bytes, at \"%2\"", (int)pos, second.substr(pos, 60)));
         }
     }
 
-    void on_edit_clicked()
+    // the pages of a filter in one order, as many as there are up to pages. Every page has to come back
+    // within 10 ms, the fastest of three runs so a busy machine doesn't fail it. Returns false when it
+    // stopped at pages with shows still to come
+    static bool read_filter_pages(Database &database, const ShowFilter &filter, const ShowOrder &order, const CL_String &name,
+                                  int pages, std::vector<int> &ids)
     {
-        if(result->get_selected_item().is_null() == false)
+        enum { PAGE = 100, RUNS = 3, TARGET = 10000 };
+
+        ShowCursor after;
+        for(int page = 0; page < pages; page++)
         {
-            CL_SharedPtr<ShowItem> show = cl_dynamic_pointer_cast<ShowItem>(result->get_selected_item().get_userdata());
-            if(show)
+            ShowList shows;
+            ShowCursor resume;
+            bool cut = false;
+            unsigned long long fastest = ~0ULL;
+            for(int run = 0; run < RUNS; run++)
             {
-                tabMan->display_show_item(*show);
-            }   
+                unsigned long long start = CL_System::get_microseconds();
+                cut = database.find_shows_after(filter, order, after, PAGE, shows, resume);
+                fastest = cl_min(fastest, CL_System::get_microseconds() - start);
+            }
+            check(fastest < TARGET, cl_format("page %1 of %2 took %3 us", page + 1, name, (int)fastest));
+
+            for(ShowList::size_type i = 0; i < shows.size(); i++)
+                ids.push_back(shows[i].id);
+
+            if(cut)
+                after = resume;
+            else if(shows.size() == PAGE)
+                after = Database::make_cursor(order, shows.back());
+            else
+                return true;
         }
+        return false;
     }
 
-    void on_viewing_status_checked(VIEWING_STATUS status)
+    // filters that let in every show, a few hundred or none, on a library of 100000 shows read from sqlite
+    // in five orders. Each takes one of the ways find_shows_after reads: the order index, the year or rating
+    // index, show_genre or a scan that stops at its limit. The pages in title order have to hold the same
+    // shows as the snapshot gives, and no page of any order may repeat a show
+    static void check_filters()
     {
-        viewing_status_mask |= (1 << status);
-        refresh_list();
+        enum { SHOWS = 100000, RARE_SHOWS = 500, PAGES = 12 };
+
+        CL_FileHelp::copy_file("animerecord.s3db", "selftest.s3db", true);
+        try
+        {
+            CL_FileHelp::delete_file("selftest.snapshot");
+        }
+        catch(CL_Exception &)
+        {
+        }
+        Database database("selftest.s3db", "selftest.snapshot");
+        database.remove_all_shows();
+
+        SyntheticLibrary synthetic(1);
+        add_synthetic_shows(database, synthetic, SHOWS, 20, 200, 0);
+
+        // a genre too few shows have for a scan to fill a page
+        std::vector<CL_String> rareNames(1, "Self Test");
+        database.ensure_add_genres(rareNames);
+        std::vector<GenreItem> rare = database.get_genres_by_name(rareNames);
+        std::vector<ShowItem> rareShows;
+        for(int i = 0; i < RARE_SHOWS; i++)
+        {
+            ShowItem show;
+            show.title = cl_format("Self test %1", i);
+            show.year = 1960 + i % 66;
+            show.season = 1;
+            show.episodes = 12;
+            show.rating = (i % 101) / 10.0;
+            show.status = COMPLETED;
+            show.genres = rare;
+            rareShows.push_back(show);
+        }
+        database.add_shows(rareShows);
+
+        struct NamedFilter
+        {
+            const char *text;
+            int status_mask;
+        };
+        const NamedFilter filters[] =
+        {
+            { "", 0 },
+            { "", DROPPED_MASK },
+            { "year:1960 rating:9.55-", 0 },
+            { "rating:10", 0 },
+            { "genre:\"Self Test\" year:2000-", 0 },
+            { "genre:Action genre:Western genre:Sports", 0 },
+            { "type:TV season:4 year:1990-1999 rating:-1.05", 0 },
+            { "rating:3.25-3.45 type:Film", 0 },
+            { "qqqxz", 0 },
+        };
+        const ShowOrder orders[] =
+        {
+            ShowOrder(ORDER_TITLE), ShowOrder(ORDER_TITLE, true), ShowOrder(ORDER_RATING), ShowOrder(ORDER_YEAR, true), ShowOrder(ORDER_DATE_ADDED)
+        };
+        const int filterCount = sizeof(filters) / sizeof(filters[0]), orderCount = sizeof(orders) / sizeof(orders[0]);
+
+        // the filters and pages read in title order, ascending and descending, to compare with the snapshot
+        std::vector<ShowFilter> titleFilters;
+        std::vector<ShowOrder> titleOrders;
+        std::vector<CL_String> titleNames;
+        std::vector<std::vector<int> > titleIds;
+        std::vector<bool> titleEnded;
+        for(int i = 0; i < filterCount; i++)
+        {
+            ShowFilter filter = ShowFilter::parse(filters[i].text);
+            filter.status_mask = filters[i].status_mask;
+            for(int j = 0; j < orderCount; j++)
+            {
+                CL_String name = cl_format("\"%1\" with status mask %2 in order %3", filters[i].text, filters[i].status_mask, j);
+                std::vector<int> ids;
+                bool ended = read_filter_pages(database, filter, orders[j], name, PAGES, ids);
+                check(std::set<int>(ids.begin(), ids.end()).size() == ids.size(), "a show came up twice for " + name);
+                if(orders[j].column == ORDER_TITLE)
+                {
+                    titleFilters.push_back(filter);
+                    titleOrders.push_back(orders[j]);
+                    titleNames.push_back(name);
+                    titleIds.push_back(ids);
+                    titleEnded.push_back(ended);
+                }
+            }
+        }
+
+        // the snapshot fills every page, it reads as many as hold the shows from sqlite and one more
+        database.save_snapshot();
+        for(std::vector<ShowFilter>::size_type i = 0; i < titleFilters.size(); i++)
+        {
+            const std::vector<int> &ids = titleIds[i];
+            std::vector<int> expected;
+            read_filter_pages(database, titleFilters[i], titleOrders[i], titleNames[i] + " from the snapshot", (int)ids.size() / 100 + 2, expected);
+            bool same = expected.size() >= ids.size() && std::equal(ids.begin(), ids.end(), expected.begin()) &&
+                        (titleEnded[i] == false || expected.size() == ids.size());
+            check(same, cl_format("%1 gave %2 shows from sqlite and %3 from the snapshot, or not the same ones", titleNames[i], (int)ids.size(), (int)expected.size()));
+        }
     }
 
-    void on_viewing_status_unchecked(VIEWING_STATUS status)
+    static const NamedCheck *get_checks(int &count)
     {
-        viewing_status_mask &= ~(1 << status);
-        refresh_list();
+        static const NamedCheck checks[] =
+        {
+            { "http", &SelfTest::check_http },
+            { "export", &SelfTest::check_export },
+            { "filters", &SelfTest::check_filters },
+            { "scheduler", &SelfTest::check_scheduler },
+            { "tasks", &SelfTest::check_tasks },
+            { "watchdog", &SelfTest::check_watchdog },
+        };
+        count = sizeof(checks) / sizeof(checks[0]);
+        return checks;
     }
 
-    void on_visiblity_changed(bool visible)
+public:
+    // names separated by commas, "all" runs everything. Prints a line per check and returns how many failed
+    static int run(const CL_String &names)
     {
-        if(visible)
+        std::vector<CL_String> selected = CL_StringHelp::split_text(names, ",");
+        int count;
+        const NamedCheck *checks = get_checks(count);
+
+        int failed = 0;
+        for(int i = 0; i < count; i++)
         {
-            refresh_list();
+            if(names != "all" && std::find(selected.begin(), selected.end(), CL_String(checks[i].name)) == selected.end())
+                continue;
+
+            unsigned int start_time = CL_System::get_time();
+            try
+            {
+                checks[i].check();
+                CL_Console::write_line("ok      %1 (%2 ms)", checks[i].name, CL_System::get_time() - start_time);
+            }
+            catch(CL_Exception &e)
+            {
+                CL_Console::write_line("FAILED  %1: %2", checks[i].name, e.message);
+                failed++;
+            }
         }
+        return failed;
     }
+};
 
-public:
-    ViewPage(CL_TabPage *page, TabManager *tabMan, const CL_SharedPtr<Database> &db)
-        : Page(page->get_id()), tabMan(tabMan), database(db), currentPage(0), viewing_status_mask(0),
-          pagenumber(CL_LineEdit::get_named_item(page, "pagenumber")),
-          result(CL_ListView::get_named_item(page, "result")),
-          search(CL_LineEdit::get_named_item(page, "search")),
-          previous(CL_PushButton::get_named_item(page, "previous")),
-          next(CL_PushButton::get_named_item(page, "next")),
-          edit(CL_PushButton::get_named_item(page, "edit")),
-          watching(CL_CheckBox::get_named_item(page, "watching")), 
-          completed(CL_CheckBox::get_named_item(page, "completed")), 
-          planning(CL_CheckBox::get_named_item(page, "planning")), 
-          dropped(CL_CheckBox::get_named_item(page, "dropped"))
-    {        
-        result->show_detail_icon(false);
-        result->show_detail_opener(false);
+class App
+{
+    typedef const std::vector<CL_String>& Args;
 
-        page->func_visibility_change().set(this, &ViewPage::on_visiblity_changed);
+    std::auto_ptr<TabManager> tabMan;
 
-        search->func_after_edit_changed().set(this, &ViewPage::on_search_edit);
-        previous->func_clicked().set(this, &ViewPage::on_previous_clicked);
-        next->func_clicked().set(this, &ViewPage::on_next_clicked);
-        edit->func_clicked().set(this, &ViewPage::on_edit_clicked);
+    CL_SlotContainer slots;
+    bool close_clicked;
 
-        watching->func_checked().set(this, &ViewPage::on_viewing_status_checked, WATCHING);
-        completed->func_checked().set(this, &ViewPage::on_viewing_status_checked, COMPLETED);
-        planning->func_checked().set(this, &ViewPage::on_viewing_status_checked, PLANNING);
-        dropped->func_checked().set(this, &ViewPage::on_viewing_status_checked, DROPPED);
+    CL_SharedPtr<Database> database;
 
-        watching->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, WATCHING);
-        completed->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, COMPLETED);
-        planning->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, PLANNING);
-        dropped->func_unchecked().set(this, &ViewPage::on_viewing_status_unchecked, DROPPED);
+    // background work of the pages, completions run inside guiMan.exec
+    CL_SharedPtr<TaskScheduler> tasks;
 
-        result->get_icon_list().clear();
-        result->set_multi_select(false);
-        result->set_select_whole_row(true);
+    MyAnimeListConfig malConfig;
+    std::auto_ptr<MockHTTPServer> mockServer;
 
-        pagenumber->set_alignment(CL_LineEdit::align_center);
-        pagenumber->set_read_only(true);
+    CL_Timer writeTimer;
+    CL_Timer changeTimer;
 
-        CL_ListViewColumnHeader column = result->get_header()->create_column("title", "Title");
-        result->get_header()->append(column);
+    CL_String traceFile;
+    bool diagnostics;
 
+    // ms, statements that take this long are logged when --diagnostics is on, unless --slow-query says otherwise
+    enum { SLOW_QUERY_THRESHOLD = 200 };
 
-        CL_GUIThemePart listThemePart(result, "selection");
-        int padding = listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-right", "4")) + 
-            listThemePart.get_property_int(CL_GUIThemePartProperty("selection-margin-left", "3")) + 5;
+    std::auto_ptr<CL_FileLogger> fileLogger;
+    unsigned int watchdogThreshold;     // ms, 0 without a watchdog
 
-        column = result->get_header()->create_column("rating", "Rating");
-        result->get_header()->append(column);
-        column.set_width(listThemePart.get_font().get_text_size(result->get_gc(), "Rating").width+padding);
+private:
 
-        column = result->get_header()->create_column("comment", "Comment");
-        result->get_header()->append(column);
+    // options are given as --name=value
+    static std::map<CL_String, CL_String> parse_options(Args args)
+    {
+        std::map<CL_String, CL_String> options;
+        for(std::vector<CL_String>::size_type i = 1; i < args.size(); i++)
+        {
+            if(args[i].substr(0, 2) != "--")
+                continue;
 
-        find_shows();
-        populate_show_list();
+            CL_String::size_type equals = args[i].find('=');
+            if(equals == CL_String::npos)
+                options[args[i].substr(2)] = "1";
+            else
+                options[args[i].substr(2, equals-2)] = args[i].substr(equals+1);
+        }
+        return options;
     }
-    virtual ~ViewPage(){}
 
-};
+    static void split_endpoint(const CL_String &endpoint, CL_String &host, CL_String &port)
+    {
+        CL_String::size_type colon = endpoint.find(':');
+        host = endpoint.substr(0, colon);
+        port = colon == CL_String::npos ? CL_String("80") : endpoint.substr(colon+1);
+    }
 
-TabManager::TabManager(CL_GUIComponent *parent, const CL_SharedPtr<Database> &database) 
-    : tab(new CL_Tab(parent))
-{
-    CL_GUILayoutCorners layout;
+    // --mock-port, --mock-latency (ms), --mock-bandwidth (bytes/s), --mock-chunk (bytes), --mock-gzip (0/1),
+    // --mock-error-rate (%) and --mock-error-status tune the built-in server
+    static void parse_mock_options(std::map<CL_String, CL_String> &options, MockHTTPServerSettings &settings)
+    {
+        if(options.count("mock-port")) settings.port = options["mock-port"];
+        if(options.count("mock-latency")) settings.latency = CL_StringHelp::text_to_int(options["mock-latency"]);
+        if(options.count("mock-bandwidth")) settings.bandwidth = CL_StringHelp::text_to_int(options["mock-bandwidth"]);
+        if(options.count("mock-chunk")) settings.chunk_size = CL_StringHelp::text_to_int(options["mock-chunk"]);
+        if(options.count("mock-gzip")) settings.compress = CL_StringHelp::text_to_int(options["mock-gzip"]) != 0;
+        if(options.count("mock-error-rate")) settings.error_rate = CL_StringHelp::text_to_int(options["mock-error-rate"]);
+        if(options.count("mock-error-status")) settings.error_status = CL_StringHelp::text_to_int(options["mock-error-status"]);
+    }
 
-    CL_TabPage *pageAdd = tab->add_page("Add Show", 0);
-    CL_TabPage *pageView = tab->add_page("View Records",1);
-    CL_TabPage *pageSearch = tab->add_page("Search MyAnimeList",2);
-    pageAdd->set_layout(layout);
-    pageView->set_layout(layout);
-    pageSearch->set_layout(layout);
+    // --mal-search=host:port      search API endpoint
+    // --mal-api=host:port         genre API endpoint
+    // --mal-rate=n                requests per second and host
+    // --mal-record=dir            save every downloaded document as a fixture
+    // --mal-mock=dir              replay fixtures from dir with the built-in server, tuned with the --mock options
+    void setup_network(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
+
+        if(options.count("mal-search"))
+            split_endpoint(options["mal-search"], malConfig.search_host, malConfig.search_port);
+        if(options.count("mal-api"))
+            split_endpoint(options["mal-api"], malConfig.api_host, malConfig.api_port);
+        if(options.count("mal-rate"))
+            malConfig.requests_per_second = CL_StringHelp::text_to_double(options["mal-rate"]);
+        if(options.count("mal-record"))
+            malConfig.record_directory = options["mal-record"];
+
+        if(options.count("mal-mock"))
+        {
+            MockHTTPServerSettings settings;
+            settings.fixture_directory = options["mal-mock"];
+            parse_mock_options(options, settings);
 
-    // add start page
-    pageAdd->create_components("add.gui");
-    addPage.reset(new AddPage(pageAdd, this, database));
-    // add end page
+            mockServer.reset(new MockHTTPServer(settings));
+            mockServer->start();
 
-    // find/view records
-    pageView->create_components("view.gui");
-    viewPage.reset(new ViewPage(pageView, this, database));
+            malConfig.search_host = malConfig.api_host = "127.0.0.1";
+            malConfig.search_port = malConfig.api_port = settings.port;
+        }
+    }
 
-    // myanimelist search page
-    pageSearch->create_components("view.gui");
-    searchPage.reset(new SearchPage(pageSearch, this, database));
-}
+    // --write-delay=ms            queue show edits and commit them together every ms milliseconds
+    // --slow-query=ms             log statements that take at least ms milliseconds (off by default, 200 with
+    //                             --diagnostics, 0 turns it off)
+    // --diagnostics               add a tab with the statement statistics and the slow statement log
+    void setup_database(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
 
-CL_Tab *TabManager::get_tab() const 
-{
-    return tab;
-}
+        // the log keeps the parameters of every statement, so it isn't paid for unless someone reads it
+        diagnostics = options.count("diagnostics") > 0;
+        Database::set_slow_query_threshold(diagnostics ? SLOW_QUERY_THRESHOLD : 0);
+        if(options.count("slow-query"))
+            Database::set_slow_query_threshold(cl_max(CL_StringHelp::text_to_int(options["slow-query"]), 0));
 
-class App
-{
-    typedef const std::vector<CL_String>& Args;
+        database = CL_SharedPtr<Database>(new Database);
+        if(options.count("write-delay"))
+            database->set_write_delay(cl_max(CL_StringHelp::text_to_int(options["write-delay"]), 0));
+    }
 
-    std::auto_ptr<TabManager> tabMan;
+    // --trace=file.json           record where the time goes and write it as a Chrome trace on exit,
+    //                             --trace-events=n keeps the last n spans (65536 by default)
+    void setup_trace(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
+        if(options.count("trace") == 0)
+            return;
 
-    CL_SlotContainer slots;
-    bool close_clicked;
+        traceFile = options["trace"];
+        if(options.count("trace-events"))
+            Trace::enable(cl_max(CL_StringHelp::text_to_int(options["trace-events"]), 1));
+        else
+            Trace::enable();
+    }
 
-    CL_SharedPtr<Database> database;
+    // --log=file                  append everything logged, slow statements and stalls included, to file
+    // --watchdog=ms               log when the GUI thread doesn't get to its message loop for ms milliseconds,
+    //                             with the database, network or list operation it was stuck in
+    void setup_diagnostics(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
 
-private:
+        if(options.count("log"))
+        {
+            fileLogger.reset(new CL_FileLogger(options["log"]));
+            fileLogger->enable();
+        }
+        if(options.count("watchdog"))
+            watchdogThreshold = cl_max(CL_StringHelp::text_to_int(options["watchdog"]), 0);
+    }
+
+    // --bench-listview            instead of opening the window, fill a generated library and time the list operations
+    //                             of the view and search pages on a hidden one, print the results and exit. Tuned with
+    //                             --bench-file (benchmark.s3db), --bench-shows (10000), --bench-title-length (median
+    //                             characters, 20), --bench-title-max (200), --bench-seed, --bench-iterations (50) and
+    //                             --bench-snapshot (0/1). --bench-report=file writes the results to file as well.
+    //                             Allocations and peaks are only counted in builds with ENABLE_MEMORY_STATS, there a run of
+    //                             an operation that goes over its budget in BenchmarkReport.cpp fails the benchmark.
+    //                             --bench-max-allocations and --bench-max-peak-kb replace the budgets of every operation.
+    //                             --bench-baseline=file fails it as well when an operation needs more allocations per run or
+    //                             a higher peak than in the report in file, by over --bench-tolerance percent (10)
+    int run_benchmark(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
+
+        ListViewBenchmarkSettings settings;
+        if(options.count("bench-file")) settings.database_file = options["bench-file"];
+        if(options.count("bench-shows")) settings.shows = cl_max(CL_StringHelp::text_to_int(options["bench-shows"]), 0);
+        if(options.count("bench-title-length")) settings.title_median = cl_max(CL_StringHelp::text_to_int(options["bench-title-length"]), 1);
+        if(options.count("bench-title-max")) settings.title_max = cl_max(CL_StringHelp::text_to_int(options["bench-title-max"]), 1);
+        if(options.count("bench-seed")) settings.seed = CL_StringHelp::text_to_uint(options["bench-seed"]);
+        if(options.count("bench-iterations")) settings.iterations = cl_max(CL_StringHelp::text_to_int(options["bench-iterations"]), 1);
+        if(options.count("bench-snapshot")) settings.snapshot = CL_StringHelp::text_to_int(options["bench-snapshot"]) != 0;
+        if(options.count("bench-max-allocations")) settings.allocation_budget = cl_max(CL_StringHelp::text_to_int(options["bench-max-allocations"]), 0);
+        if(options.count("bench-max-peak-kb")) settings.peak_budget = cl_max(CL_StringHelp::text_to_int(options["bench-max-peak-kb"]), 0) * 1024L;
+        if(options.count("bench-baseline")) settings.baseline = CL_File::read_text(options["bench-baseline"]);
+        if(options.count("bench-tolerance")) settings.baseline_tolerance = cl_max(CL_StringHelp::text_to_int(options["bench-tolerance"]), 0);
+        if((settings.allocation_budget > 0 || settings.peak_budget > 0) && MemoryStats::is_enabled() == false)
+            throw CL_Exception("--bench-max-allocations and --bench-max-peak-kb need a build with ENABLE_MEMORY_STATS");
+        if(settings.baseline.empty() == false && MemoryStats::is_enabled() == false)
+            throw CL_Exception("--bench-baseline needs a build with ENABLE_MEMORY_STATS");
+
+        CL_GUIManager guiMan("theme");
+        ListViewBenchmark benchmark(settings);
+        benchmark.run(guiMan);
+        save_trace();
+
+        const BenchmarkReport &report = benchmark.get_report();
+        CL_Console::write(report.to_text());
+        if(options.count("bench-report"))
+        {
+            CL_File file(options["bench-report"], CL_File::create_always, CL_File::access_write);
+            report.write(file);
+        }
+
+        std::vector<CL_String> violations = report.get_violations();
+        for(std::vector<CL_String>::const_iterator it = violations.begin(); it != violations.end(); ++it)
+            cl_log_event("benchmark", "%1", *it);
+        return violations.empty() ? 0 : 1;
+    }
+
+    // --bench-mal                 instead of opening the window, serve generated MyAnimeList documents from the built-in
+    //                             server and time searches and genre downloads through the scheduler, print the latencies
+    //                             and bytes read and exit. The server is tuned with the --mock options, the benchmark with
+    //                             --bench-fixtures (benchmark-fixtures), --bench-searches (20), --bench-results (50 per
+    //                             search), --bench-seed, --bench-iterations (50), --mal-rate (1000) and --bench-report=file.
+    //                             The exit code is 1 when a request failed after its last retry
+    int run_mal_benchmark(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
+
+        MALBenchmarkSettings settings;
+        parse_mock_options(options, settings.server);
+        if(options.count("bench-fixtures")) settings.server.fixture_directory = options["bench-fixtures"];
+        if(options.count("bench-searches")) settings.searches = cl_max(CL_StringHelp::text_to_int(options["bench-searches"]), 1);
+        if(options.count("bench-results")) settings.results = cl_max(CL_StringHelp::text_to_int(options["bench-results"]), 1);
+        if(options.count("bench-seed")) settings.seed = CL_StringHelp::text_to_uint(options["bench-seed"]);
+        if(options.count("bench-iterations")) settings.iterations = cl_max(CL_StringHelp::text_to_int(options["bench-iterations"]), 1);
+        if(options.count("mal-rate")) settings.requests_per_second = cl_max(CL_StringHelp::text_to_double(options["mal-rate"]), 0.1);
+
+        MALBenchmark benchmark(settings);
+        benchmark.run();
+        save_trace();
+
+        CL_Console::write(benchmark.to_text());
+        if(options.count("bench-report"))
+        {
+            CL_File file(options["bench-report"], CL_File::create_always, CL_File::access_write);
+            benchmark.write(file);
+        }
+        return benchmark.get_counters().failed > 0 ? 1 : 0;
+    }
+
+    // --self-test=name,name      run the named checks (or "all") against local mock servers and exit, the exit
+    //                             code is the number that failed
+    int run_self_tests(Args args)
+    {
+        std::map<CL_String, CL_String> options = parse_options(args);
+        CL_String names = options["self-test"] == "1" ? CL_String("all") : options["self-test"];
+        return SelfTest::run(names);
+    }
+
+    void save_trace()
+    {
+        if(traceFile.empty())
+            return;
+
+        try
+        {
+            Trace::disable();
+            CL_File file(traceFile, CL_File::create_always, CL_File::access_write);
+            Trace::write_json(file);
+        }
+        catch(CL_Exception &e)
+        {
+            cl_log_event("trace", "unable to write %1: %2", traceFile, e.message);
+        }
+    }
+
+    void on_write_timer(CL_Window *win)
+    {
+        try
+        {
+            database->flush_if_due();
+        }
+        catch(CL_Exception &e)
+        {
+            // still queued when another process held the lock, the next tick tries again
+            cl_log_event("database", "unable to commit the queued edits: %1", e.message);
+            if(database->get_queued_writes() == 0)
+                MessageDialog(win, "Error", cl_format("The last changes couldn't be saved:\n%1", e.message)).exec();
+        }
+    }
+
+    // picks up what other instances of the program wrote to the same file
+    void on_change_timer()
+    {
+        try
+        {
+            database->check_external_changes();
+        }
+        catch(CL_Exception &e)
+        {
+            cl_log_event("database", "unable to check for changes: %1", e.message);
+        }
+    }
 
     CL_DisplayWindowDescription get_desc() const
     {
@@ -2016,16 +7781,27 @@ private:
   
     void setup_window(CL_Window &win)
     {        
-        tabMan.reset(new TabManager(&win, database));
+        tabMan.reset(new TabManager(&win, database, malConfig, tasks, diagnostics));
                 
         win.func_resized().set(this, &App::on_resize, &win);
     }
 
     int start(Args args)
     {
-        database = CL_SharedPtr<Database>(new Database);
+        setup_diagnostics(args);
+        setup_trace(args);
+        if(parse_options(args).count("bench-listview"))
+            return run_benchmark(args);
+        if(parse_options(args).count("bench-mal"))
+            return run_mal_benchmark(args);
+        if(parse_options(args).count("self-test"))
+            return run_self_tests(args);
+
+        setup_database(args);
+        setup_network(args);
 
         CL_GUIManager guiMan("theme");
+        tasks = CL_SharedPtr<TaskScheduler>(new TaskScheduler);
 
         CL_Window win(&guiMan, get_desc());
         CL_Rect client_area = win.get_client_area();
@@ -2036,13 +7812,49 @@ private:
         setup_window(win);
         win.set_visible();
 
-        return guiMan.exec();
+        // the timer runs at half the delay, so an edit is committed between one and one and a half delays later
+        if(database->get_write_delay() > 0)
+        {
+            writeTimer.func_expired().set(this, &App::on_write_timer, &win);
+            writeTimer.start(cl_max(database->get_write_delay() / 2, 1u), true);
+        }
+
+        changeTimer.func_expired().set(this, &App::on_change_timer);
+        changeTimer.start(1000, true);
+
+        // started last, building the pages isn't a stall
+        std::auto_ptr<Watchdog> watchdog;
+        if(watchdogThreshold > 0)
+            watchdog.reset(new Watchdog(watchdogThreshold));
+
+        int result = guiMan.exec();
+
+        // nothing dispatches completions after exec, so the workers are stopped before the pages go away
+        tasks->shutdown();
+        if(watchdog.get())
+            watchdog->stop();
+        writeTimer.stop();
+        changeTimer.stop();
+
+        try
+        {
+            database->save_snapshot();
+        }
+        catch(CL_Exception &e)
+        {
+            cl_log_event("snapshot", "unable to save the snapshot: %1", e.message);
+        }
+
+        save_trace();
+        return result;
     }
 
 public:
     App()
     {
         close_clicked = false;
+        diagnostics = false;
+        watchdogThreshold = 0;
     }
     static int main(Args args)
     {
@@ -2055,6 +7867,10 @@ public:
             // Initialize ClanLib base components
             CL_SetupCore setup_core;
 
+#ifdef ENABLE_CONSOLE
+            CL_ConsoleLogger logger;
+#endif
+
             // Initialize the ClanLib display component
             CL_SetupDisplay setup_display;
 
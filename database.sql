@@ -5,16 +5,20 @@ CREATE TABLE [genre] (
 
 CREATE TABLE [show] (
 [id] INTEGER  PRIMARY KEY AUTOINCREMENT NOT NULL,
-[date_added] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL,
-[date_updated] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL,
-[title] NVARCHAR(1000)  NOT NULL,
-[type] VARCHAR(50)  NOT NULL,
+[type] INTEGER DEFAULT '0' NOT NULL,
+[status] INTEGER DEFAULT '0' NOT NULL,
 [year] INTEGER DEFAULT '1900' NOT NULL,
 [season] INTEGER DEFAULT '1' NOT NULL,
 [episodes] INTEGER DEFAULT '0' NOT NULL,
 [rating] REAL DEFAULT '5' NOT NULL,
-[comment] NVARCHAR(5000)  NOT NULL,
-[status] INTEGER DEFAULT '0' NOT NULL
+[mal_id] INTEGER,
+[genre_mask] INTEGER DEFAULT '0' NOT NULL,
+[date_added] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL,
+[date_updated] TIMESTAMP DEFAULT CURRENT_TIMESTAMP NOT NULL,
+[sort_key] TEXT,
+[title_key] NVARCHAR(1000),
+[title] NVARCHAR(1000)  NOT NULL,
+[comment] NVARCHAR(5000)  NOT NULL
 );
 
 CREATE TABLE [show_genre] (
@@ -27,11 +31,134 @@ CREATE TABLE [status] (
 [name] VARCHAR(100)  UNIQUE NOT NULL
 );
 
+CREATE TABLE [stats_status] (
+[status] INTEGER  PRIMARY KEY NOT NULL,
+[shows] INTEGER DEFAULT '0' NOT NULL,
+[episodes] INTEGER DEFAULT '0' NOT NULL
+);
+
+CREATE TABLE [stats_rating] (
+[rating] INTEGER  PRIMARY KEY NOT NULL,
+[shows] INTEGER DEFAULT '0' NOT NULL
+);
+
+CREATE TABLE [stats_year] (
+[year] INTEGER  PRIMARY KEY NOT NULL,
+[shows] INTEGER DEFAULT '0' NOT NULL,
+[episodes] INTEGER DEFAULT '0' NOT NULL
+);
+
+CREATE TABLE [stats_genre] (
+[genre_id] INTEGER  PRIMARY KEY NOT NULL,
+[shows] INTEGER DEFAULT '0' NOT NULL
+);
+
+CREATE TABLE [library_version] (
+[version] INTEGER NOT NULL
+);
+
+INSERT INTO [library_version] ([version]) VALUES (0);
+
+CREATE TABLE [show_change] (
+[show_id] INTEGER  PRIMARY KEY NOT NULL,
+[change] INTEGER NOT NULL
+);
+
+CREATE INDEX [show_change_index] ON [show_change](
+[change]  ASC
+);
+
 CREATE INDEX [show_genre_index] ON [show_genre](
 [show_id]  ASC,
 [genre_id]  ASC
 );
 
+CREATE INDEX [show_genre_genre_index] ON [show_genre](
+[genre_id]  ASC,
+[show_id]  ASC
+);
+
+CREATE UNIQUE INDEX [show_mal_id_index] ON [show](
+[mal_id]  ASC
+);
+
+CREATE UNIQUE INDEX [show_title_key_index] ON [show](
+[title_key]  ASC,
+[type]  ASC,
+[year]  ASC,
+[season]  ASC
+);
+
+CREATE INDEX [show_filter_index] ON [show](
+[sort_key]  ASC,
+[id]  ASC,
+[status]  ASC,
+[year]  ASC,
+[rating]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
+CREATE INDEX [show_rating_index] ON [show](
+[rating]  ASC,
+[id]  ASC,
+[status]  ASC,
+[year]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
+CREATE INDEX [show_year_index] ON [show](
+[year]  ASC,
+[id]  ASC,
+[status]  ASC,
+[rating]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
+CREATE INDEX [show_episodes_index] ON [show](
+[episodes]  ASC,
+[id]  ASC,
+[status]  ASC,
+[year]  ASC,
+[rating]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
+CREATE INDEX [show_date_added_index] ON [show](
+[date_added]  ASC,
+[id]  ASC,
+[status]  ASC,
+[year]  ASC,
+[rating]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
+CREATE INDEX [show_date_updated_index] ON [show](
+[date_updated]  ASC,
+[id]  ASC,
+[status]  ASC,
+[year]  ASC,
+[rating]  ASC,
+[type]  ASC,
+[season]  ASC,
+[genre_mask]  ASC,
+[title_key]  ASC
+);
+
 CREATE TRIGGER [ON_TBL_SHOW_DELETE_ITEM] 
 AFTER DELETE ON [show] 
 FOR EACH ROW 
@@ -39,6 +166,10 @@ BEGIN
 
 delete from show_genre where show_id = old.id;
 
+update stats_status set shows = shows - 1, episodes = episodes - old.episodes where status = old.status;
+update stats_rating set shows = shows - 1 where rating = cast(old.rating as integer);
+update stats_year set shows = shows - 1, episodes = episodes - old.episodes where year = old.year;
+
 END;
 
 CREATE TRIGGER [ON_TBL_SHOW_UPDATE] 
@@ -50,4 +181,168 @@ update show
 set date_updated = datetime('now')
 where id = new.id;
 
+update stats_status set shows = shows - 1, episodes = episodes - old.episodes
+where status = old.status and (old.status <> new.status or old.episodes <> new.episodes);
+insert or ignore into stats_status (status) values (new.status);
+update stats_status set shows = shows + 1, episodes = episodes + new.episodes
+where status = new.status and (old.status <> new.status or old.episodes <> new.episodes);
+
+update stats_rating set shows = shows - 1
+where rating = cast(old.rating as integer) and cast(old.rating as integer) <> cast(new.rating as integer);
+insert or ignore into stats_rating (rating) values (cast(new.rating as integer));
+update stats_rating set shows = shows + 1
+where rating = cast(new.rating as integer) and cast(old.rating as integer) <> cast(new.rating as integer);
+
+update stats_year set shows = shows - 1, episodes = episodes - old.episodes
+where year = old.year and (old.year <> new.year or old.episodes <> new.episodes);
+insert or ignore into stats_year (year) values (new.year);
+update stats_year set shows = shows + 1, episodes = episodes + new.episodes
+where year = new.year and (old.year <> new.year or old.episodes <> new.episodes);
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_INSERT] 
+AFTER INSERT ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+insert or ignore into stats_status (status) values (new.status);
+update stats_status set shows = shows + 1, episodes = episodes + new.episodes where status = new.status;
+insert or ignore into stats_rating (rating) values (cast(new.rating as integer));
+update stats_rating set shows = shows + 1 where rating = cast(new.rating as integer);
+insert or ignore into stats_year (year) values (new.year);
+update stats_year set shows = shows + 1, episodes = episodes + new.episodes where year = new.year;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_INSERT] 
+AFTER INSERT ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+insert or ignore into stats_genre (genre_id) values (new.genre_id);
+update stats_genre set shows = shows + 1 where genre_id = new.genre_id;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_DELETE] 
+AFTER DELETE ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+update stats_genre set shows = shows - 1 where genre_id = old.genre_id;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_VERSION_INSERT] 
+AFTER INSERT ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+update library_version set version = version + 1;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_VERSION_UPDATE] 
+AFTER UPDATE ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+update library_version set version = version + 1;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_VERSION_DELETE] 
+AFTER DELETE ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+update library_version set version = version + 1;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_VERSION_INSERT] 
+AFTER INSERT ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+update library_version set version = version + 1;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_VERSION_DELETE] 
+AFTER DELETE ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+update library_version set version = version + 1;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_CHANGE_INSERT] 
+AFTER INSERT ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+insert or replace into show_change (show_id, change) values (new.id, (select ifnull(max(change), 0) + 1 from show_change));
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_CHANGE_UPDATE] 
+AFTER UPDATE ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+insert or replace into show_change (show_id, change) values (new.id, (select ifnull(max(change), 0) + 1 from show_change));
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_CHANGE_DELETE] 
+AFTER DELETE ON [show] 
+FOR EACH ROW 
+BEGIN 
+
+insert or replace into show_change (show_id, change) values (old.id, (select ifnull(max(change), 0) + 1 from show_change));
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_MASK_INSERT] 
+AFTER INSERT ON [show_genre] 
+FOR EACH ROW WHEN new.genre_id >= 0 AND new.genre_id < 63 
+BEGIN 
+
+update show set genre_mask = genre_mask | (1 << new.genre_id)
+where id = new.show_id and genre_mask & (1 << new.genre_id) = 0;
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_MASK_DELETE] 
+AFTER DELETE ON [show_genre] 
+FOR EACH ROW WHEN old.genre_id >= 0 AND old.genre_id < 63 
+BEGIN 
+
+update show set genre_mask = genre_mask & ~(1 << old.genre_id)
+where id = old.show_id and genre_mask & (1 << old.genre_id) <> 0
+and not exists (select 1 from show_genre where show_id = old.show_id and genre_id = old.genre_id);
+
 END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_CHANGE_INSERT] 
+AFTER INSERT ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+insert or replace into show_change (show_id, change) values (new.show_id, (select ifnull(max(change), 0) + 1 from show_change));
+
+END;
+
+CREATE TRIGGER [ON_TBL_SHOW_GENRE_CHANGE_DELETE] 
+AFTER DELETE ON [show_genre] 
+FOR EACH ROW 
+BEGIN 
+
+insert or replace into show_change (show_id, change) values (old.show_id, (select ifnull(max(change), 0) + 1 from show_change));
+
+END;
+
+PRAGMA user_version = 12;